@@ -12,24 +12,96 @@ const UI1 cMaxElementsInNode = 32;
 
 const double cNumBinsDouble = static_cast<double>(cNumBins);
 
+///<summary>The nodes with more items are split by the binned SAH in the hybrid mode of the sweep SAH splitter</summary>
+const UI1 cMaxElementsForSweepSplit = 4096;
+
 ////////////////////
 //struct_tree_kd.h//
 ////////////////////
 const UI1 cMaxDepthTree = 32;
+///<summary>Size of the stack of the traversal of the KD Tree, at most one node per level waits in it</summary>
+const UI1 cTraversalStackSize = cMaxDepthTree + 1;
+///<summary>The number of the points which traverse the KD Tree together in the batched queries</summary>
+const UI1 cPacketSize = 4;
+///<summary>The number of the packets which are taken by the thread at once in the batched queries</summary>
+const I1 cPacketsPerChunk = 64;
+///<summary>The number of the unused triangles of the leaf which are passed to the vectorized kernel at once</summary>
+const UI1 cTrianglesBlockSize = 32;
 const UI1 cNumElementsForParalell = 1024;
+///<summary>The nodes with this number of the items are split and partitioned by all threads</summary>
+const UI1 cNumElementsForParallelSplit = 1 << 14;
 
 const UI1 cStringBufferSize = 512;
-const UI1 cHyperVectorBufferSize = 1024;
+///<summary>The size of the part of the text of the mesh which is parsed by one thread</summary>
+const UI1 cMeshChunkSize = 1 << 18;
+///<summary>The size of the buffer on the stack of the number which is parsed by strtod if it isn't parsed exactly by the fast path, the longer numbers are copied into the heap</summary>
+const UI1 cNumberBufferSize = 64;
+///<summary>The maximal number of the values of the list of the PLY file, the list of more values is the wrong file</summary>
+const UI1 cPlyMaxListSize = static_cast<UI1>(1) << 32;
+///<summary>The size of the slab of the arena of the built nodes, it's the size of the huge page</summary>
+const UI1 cArenaSlabSize = 1 << 21;
+
+///<summary>Value of SFlatKDTreeNode::m_dimSplit for the leafs</summary>
+const UI4 cFlatNodeLeaf = 3;
+///<summary>Value of SFlatKDTreeNode::m_dimSplit for the links to the subtrees while the KD Tree is building and to the rebuilt subtrees of the edited KD Tree</summary>
+const UI4 cFlatNodeLink = 4;
+
+///<summary>The SAH cost of the edited leaf relative to its cost after the last rebuild, the leafs above it are rebuilt by default</summary>
+const double cMaxCostLeafRebuild = 2.;
+///<summary>The SAH cost of the refitted KD Tree relative to its cost after the last build, the KD Tree above it is rebuilt by default</summary>
+const double cMaxCostRefitRebuild = 2.;
+
+///<summary>The signature, the version and the alignment of the arrays of the file of the KD Tree</summary>
+const char cKDTreeFileMagic[8] = { 'K', 'D', '3', 'D', 'T', 'R', 'E', 'E' };
+const UI4 cKDTreeFileVersion = 2;
+const UI1 cKDTreeFileAlignment = 64;
+
+///<summary>The size of the cache line, the array of the flattened nodes starts at the cache line</summary>
+const UI1 cCacheLineSize = 64;
+
+///<summary>The maximal number of the centers of the items of the leaf of the Morton build</summary>
+const UI1 cMortonLeafSize = 4;
+///<summary>The levels of the KD Tree which are split by the splitter in the Morton build with the splitter on the top</summary>
+const UI1 cMortonSplitterDepth = 8;
+///<summary>The bits of the digit of the radix sort of the Morton codes</summary>
+const UI1 cRadixSortBits = 8;
+const UI1 cRadixSortBuckets = 1 << cRadixSortBits;
+
+///<summary>The limits of the in place build per item, the buffers of the build are reserved by them once</summary>
+///<remarks>The items on the both sides of the split planes are duplicated, so the sizes aren't bounded by the items : the node is split only if the nodes and the id items of its children fit into its share of the limits</remarks>
+///<remarks>The SAH trees of the test meshes take 8.8-10.2 nodes and 13.1-14.8 id items per item, the regular sphere of 1800 triangles with the degenerate triangles at the poles takes 26.5 nodes and 36.0 id items per item</remarks>
+const UI1 cInPlaceNodesFactor = 24;
+const UI1 cInPlaceIDItemsFactor = 32;
 
 //////////////////
 //math constants//
 //////////////////
 const double cEps = 1e-8;
 const double cEps2 = 1e-14;
+///<summary>The maximal coordinate of the point in the Morton code(21 bits per axis)</summary>
+const UI8 cMortonMaxCoord = (1 << 21) - 1;
+///<summary>The maximal number of the planes of the convex volume which clip the triangle</summary>
+const UI1 cMaxClipPlanes = 6;
+///<summary>The maximal number of the vertices of the triangle clipped by the planes of the bounding box, every plane adds one vertex at most : 3 + 6</summary>
+const UI1 cMaxVxClippedTriangle = 9;
 
 ///////////////////////////////
 //test find nearest constants//
 ///////////////////////////////
 const UI1 cNumRandomPoints = 10000;
+///<summary>The number of the queries of the tests which compare the results of the KD Tree with the brute force</summary>
+const UI1 cNumTestQueries = 1000;
+///<summary>The number of the nearest items of the tests of the k nearest items query</summary>
+const UI1 cNumTestNearestItems = 16;
+///<summary>The number of the random triangles of the test of the vectorized kernel, the kernel gets them by the blocks of the different sizes</summary>
+const UI1 cNumTestTriangles = 4096;
+///<summary>The number of the squares along the edge of the face of the cube of the test of the signed distance</summary>
+const UI1 cNumTestCubeSquares = 16;
+///<summary>The number of the items which are removed, moved and inserted by each step of the test of the edits of the KD Tree</summary>
+const UI1 cNumTestEditItems = 256;
+///<summary>The number of the frames of the test of the refit of the part of the mesh</summary>
+const UI1 cNumTestRefitFrames = 8;
+///<summary>The part of the size of the mesh along x whose vertices are moved by the test of the refit of the part of the mesh</summary>
+const double cTestRefitMovedPart = 0.1;
 const double cMinBoundary = -1000.;
 const double cMaxBoundary = 1000.;
@@ -10,10 +10,17 @@
 #define USE_BRUTEFORCE_CMP_1
 
 ///ON/OFF building nodes of KD Tree on linear memory location(cache friendly code)
+///(the nodes are in the arenas only if USE_INPLACE_BUILD is OFF, the in place build writes the flattened nodes itself)
 #define USE_STACK_NODES
 
-///ON/OFF stack traversal KD Tree nodes
-#define USE_STACK_TRAVERSAL_TREE_1
+///ON/OFF building KD Tree in place over the preallocated buffers of the id items(without the nodes and the vectors per node)
+#define USE_INPLACE_BUILD
+
+///ON/OFF calculating the distances from the point to the triangles of the leafs by the vectorized kernels
+#define USE_SIMD_DIST_TRIANGLES
+
+///ON/OFF mapping the saved KD Tree of the test from the file <test>.kdt instead of building it, the file is saved after the building if it's absent
+#define USE_SAVED_TREES_1
 
 ///Some from math.h
 #define DBL_MAX          1.7976931348623158e+308
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include <time.h>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <string>
 
 #include "struct_kd_tree.h"
 
@@ -30,10 +33,10 @@ void readAllTestsNames(const char* const pFileName, std::vector<char*>& aPFileNa
 }
 
 template<typename T>
-double bruteForceFindNearest(const std::vector<T>& aTr, const D3& point)
+double bruteForceFindNearest(const T* aTr, const UI1 nTr, const D3& point)
 {
 	double minDist2 = DBL_MAX;
-	for (UI1 i = 0, size = aTr.size(); i < size; ++i)
+	for (UI1 i = 0; i < nTr; ++i)
 	{
 		const double dist2 = aTr[i].calcDist2(point);
 		if (dist2 < minDist2)
@@ -97,32 +100,320 @@ char* cntStr(const char* const str_1, const char* const str_2)
 	return static_cast<char*>(result);
 }
 
+template<typename TItem>
+bool readTestMesh(const char* const pFileName, std::vector<D3>& aVx, std::vector<TItem>& aItems)
+{
+	try
+	{
+		CFileReaderMesh testFile(pFileName, aVx, aItems);
+	}
+	catch (CExceptionCanNotOpenFile& err)
+	{
+		printf("Can't open file : %s ...\n Err : %d", pFileName, err.getError());
+		return false;
+	}
+	catch (CExceptionWrongFileFormat& err)
+	{
+		printf("Wrong file : %s ...\n Err : %s\n", pFileName, err.getMessage());
+		return false;
+	}
+
+	return !aItems.empty();
+}
+
+double randomTest(const double minValue, const double maxValue)
+{
+	return minValue + (maxValue - minValue) * static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
+}
+
+template<typename TItem>
+SBBox calcBBoxTestItems(const TItem* const pItems, const UI1 nItems)
+{
+	SBBox bBox = pItems[0].calcBBoxItem();
+	for (UI1 i = 1; i < nItems; ++i)
+	{
+		const SBBox bBoxItem = pItems[i].calcBBoxItem();
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			bBox.m_minBB[dim] = std::min(bBox.m_minBB[dim], bBoxItem.m_minBB[dim]);
+			bBox.m_maxBB[dim] = std::max(bBox.m_maxBB[dim], bBoxItem.m_maxBB[dim]);
+		}
+	}
+
+	return bBox;
+}
+
+///The points are in the bounding box of the items grown by its quarter on every side, so some of them are out of the mesh
+template<typename TItem>
+void generateTestPoints(const TItem* const pItems, const UI1 nItems, const UI1 nPoints, std::vector<D3>& aPoints)
+{
+	const SBBox bBox = calcBBoxTestItems(pItems, nItems);
+	const D3 grow((bBox.m_maxBB - bBox.m_minBB) * 0.25);
+	aPoints.resize(nPoints);
+	for (UI1 i = 0; i < nPoints; ++i)
+	{
+		for (UI1 dim = 0; dim < 3; ++dim)
+			aPoints[i][dim] = randomTest(bBox.m_minBB[dim] - grow[dim], bBox.m_maxBB[dim] + grow[dim]);
+	}
+}
+
+///<summary>Tests the queries of the KD Tree on every test mesh, the KD Tree is built by the SAH splitter over the triangles of the mesh</summary>
+///<remarks>In : testTree - The functor which is called with the KD Tree and the random points of generateTestPoints, it checks the queries and prints their errors</remarks>
+template<typename TTestTree>
+void testQueriesTree(std::vector<char*>& aPFileNames, TTestTree testTree)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangle> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+		const C3DKDTree<CItemTriangle> tree(std::move(aItems), spltterNode, true);
+
+		std::vector<D3> aPoints;
+		generateTestPoints(tree.getItems(), tree.getNumItems(), cNumTestQueries, aPoints);
+		testTree(tree, aPoints);
+	}
+}
+
+///<summary>Appends the raw bytes of the value to the binary data of the test mesh, the bytes are reversed if bSwap</summary>
+template<typename TValue>
+void appendTestBytes(std::string& data, const TValue value, const bool bSwap = false)
+{
+	char aBytes[sizeof(TValue)];
+	memcpy(aBytes, &value, sizeof(TValue));
+	if (bSwap)
+		std::reverse(aBytes, aBytes + sizeof(TValue));
+	data.append(aBytes, sizeof(TValue));
+}
+
+///<summary>Writes the data into the file of the test mesh and reads it as the indexed mesh</summary>
+///<remarks>In : aVxExpected - The expected vertices</remarks>
+///<remarks>In : aIDVxExpected - The expected ids of the vertices of the triangles, if it's empty, then the reader must throw CExceptionWrongFileFormat</remarks>
+///<returns>The number of the errors : 1 if the mesh differs from the expected mesh or the reader throws the unexpected exception</returns>
+UI1 checkReadMesh(const char* const pNameMesh, const std::string& data, const std::vector<D3>& aVxExpected, const std::vector<UI4>& aIDVxExpected)
+{
+	try
+	{
+		{
+			CFileWriter file(pNameMesh);
+			file.writeBytes(data.data(), data.size());
+		}
+
+		std::vector<D3> aVx;
+		std::vector<CItemTriangleIndexed> aTr;
+		CFileReaderMesh fileMesh(pNameMesh, aVx, aTr);
+		remove(pNameMesh);
+
+		if (aIDVxExpected.empty() || aVx.size() != aVxExpected.size() || 3 * aTr.size() != aIDVxExpected.size())
+			return 1;
+
+		for (UI1 i = 0, nVx = aVx.size(); i < nVx; ++i)
+		{
+			if (aVx[i][0] != aVxExpected[i][0] || aVx[i][1] != aVxExpected[i][1] || aVx[i][2] != aVxExpected[i][2])
+				return 1;
+		}
+
+		for (UI1 i = 0, nIDVx = aIDVxExpected.size(); i < nIDVx; ++i)
+		{
+			if (&aTr[i / 3][i % 3] != &aVx[aIDVxExpected[i]])
+				return 1;
+		}
+	}
+	catch (CExceptionWrongFileFormat&)
+	{
+		remove(pNameMesh);
+		return aIDVxExpected.empty() ? 0 : 1;
+	}
+	catch (CExceptionCanNotOpenFile& err)
+	{
+		printf("Can't open file : %s ...\n Err : %d", pNameMesh, err.getError());
+		return 1;
+	}
+
+	return 0;
+}
+
+///<summary>Reads the small meshes of the OFF, the binary PLY and the binary STL files, and the broken files which must throw CExceptionWrongFileFormat</summary>
+void testReadMesh()
+{
+	const char* const pNameMesh = "tests/mesh.tmp";
+	const std::vector<D3> aVxTetra = { D3(0., 0., 0.), D3(1., 0., 0.), D3(0., 1., 0.), D3(0., 0., 1.) };
+	const std::vector<UI4> aIDVxNone;
+	const std::string vxTetra = "0 0 0\n1 0 0\n0 1 0\n0 0 1\n";
+	UI1 nErrors = 0;
+
+	///The values after the face to the end of its line are its colour, even if they look like the face
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 2 0\n" + vxTetra + "3 0 1 2\n3 0 1 3\n", aVxTetra, { 0, 1, 2, 0, 1, 3 });
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 2 0\n" + vxTetra + "3 0 1 2 3 0 0 0\n3 0 1 3\n", aVxTetra, { 0, 1, 2, 0, 1, 3 });
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 2 0\n" + vxTetra + "3 0 1 2 3 1 1 1\n3 0 1 3\n", aVxTetra, { 0, 1, 2, 0, 1, 3 });
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 2 0\n" + vxTetra + "3 0 1 2 0.5 0.5 0.5 1.0\n3 0 1 3 255 0 0\n", aVxTetra, { 0, 1, 2, 0, 1, 3 });
+
+	///Several vertices on the line, the face split into the lines, the fan of the quad, the comments and the file without the keyword
+	nErrors += checkReadMesh(pNameMesh, "# tetra\nOFF\n# counts\n4 2 0\n0 0 0 1 0 0\n0 1\n0 0 0 1 # last\n3 0 1 2\n4 0\n1 2 3\n", aVxTetra, { 0, 1, 2, 0, 1, 2, 0, 2, 3 });
+	nErrors += checkReadMesh(pNameMesh, "4 1 0\n" + vxTetra + "3 1 2 3\n", aVxTetra, { 1, 2, 3 });
+
+	///The colours of the vertices are skipped by the prefix of the keyword
+	nErrors += checkReadMesh(pNameMesh, "COFF\n4 1 0\n0 0 0 255 0 0 255\n1 0 0 0 255 0 255\n0 1 0 0 0 255 255\n0 0 1 1 1 1 1\n3 0 1 3\n", aVxTetra, { 0, 1, 3 });
+
+	///The missing face, the face after the last face, the wrong id of the vertex, the missing vertex and the wrong keyword
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 3 0\n" + vxTetra + "3 0 1 2\n3 0 1 3\n", aVxTetra, aIDVxNone);
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 1 0\n" + vxTetra + "3 0 1 2\n3 0 1 3\n", aVxTetra, aIDVxNone);
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 1 0\n" + vxTetra + "3 0 1 4\n", aVxTetra, aIDVxNone);
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 1 0\n0 0 0\n1 0 0\n0 1 0\n3 0 1 2\n", aVxTetra, aIDVxNone);
+	nErrors += checkReadMesh(pNameMesh, "MESH\n4 1 0\n" + vxTetra + "3 0 1 2\n", aVxTetra, aIDVxNone);
+
+	///The binary PLY of the float vertices with the colour and of the quad in the little endian order, and of the double vertices in the big endian order
+	const UI4 one = 1;
+	const bool bLittleEndian = *reinterpret_cast<const unsigned char*>(&one) == 1;
+	for (UI1 iOrder = 0; iOrder < 2; ++iOrder)
+	{
+		const bool bSwap = (iOrder == 0) != bLittleEndian;
+		std::string data = iOrder == 0 ?
+			"ply\nformat binary_little_endian 1.0\ncomment tetra\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+			"element face 2\nproperty list uchar int vertex_indices\nend_header\n" :
+			"ply\nformat binary_big_endian 1.0\nelement vertex 4\nproperty double x\nproperty double y\nproperty double z\n"
+			"element face 2\nproperty list uchar uint vertex_indices\nend_header\n";
+		for (UI1 iVx = 0; iVx < aVxTetra.size(); ++iVx)
+		{
+			for (UI1 dim = 0; dim < 3; ++dim)
+			{
+				if (iOrder == 0)
+					appendTestBytes(data, static_cast<float>(aVxTetra[iVx][dim]), bSwap);
+				else
+					appendTestBytes(data, aVxTetra[iVx][dim], bSwap);
+			}
+			if (iOrder == 0)
+				appendTestBytes(data, static_cast<unsigned char>(255));
+		}
+
+		///The quad 0 1 2 3 and the triangle 1 2 3
+		const UI4 aIDFaces[7] = { 0, 1, 2, 3, 1, 2, 3 };
+		for (UI1 iFace = 0, iID = 0; iFace < 2; ++iFace)
+		{
+			const unsigned char nFaceVx = iFace == 0 ? 4 : 3;
+			appendTestBytes(data, nFaceVx);
+			for (UI1 i = 0; i < nFaceVx; ++i)
+				appendTestBytes(data, aIDFaces[iID++], bSwap);
+		}
+
+		nErrors += checkReadMesh(pNameMesh, data, aVxTetra, { 0, 1, 2, 0, 2, 3, 1, 2, 3 });
+		nErrors += checkReadMesh(pNameMesh, data.substr(0, data.size() - 2), aVxTetra, aIDVxNone);
+	}
+	nErrors += checkReadMesh(pNameMesh, "ply\nformat ascii 1.0\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\nend_header\n" + vxTetra, aVxTetra, aIDVxNone);
+
+	///The binary PLY of the wrong count of the list, of the ids of the vertices which aren't the integers in the range and of the vertex with the list
+	{
+		const std::string format = bLittleEndian ? "ply\nformat binary_little_endian 1.0\n" : "ply\nformat binary_big_endian 1.0\n";
+		const std::string header = format + "element vertex 4\nproperty float x\nproperty float y\nproperty float z\n";
+		std::string vx;
+		for (UI1 iVx = 0; iVx < aVxTetra.size(); ++iVx)
+		{
+			for (UI1 dim = 0; dim < 3; ++dim)
+				appendTestBytes(vx, static_cast<float>(aVxTetra[iVx][dim]));
+		}
+
+		std::string data = header + "element face 1\nproperty list char int vertex_indices\nend_header\n" + vx;
+		appendTestBytes(data, static_cast<signed char>(-1));
+		nErrors += checkReadMesh(pNameMesh, data, aVxTetra, aIDVxNone);
+
+		const float aIDWrong[3] = { 1.5f, -1.f, 1e30f };
+		for (UI1 iWrong = 0; iWrong < 3; ++iWrong)
+		{
+			data = header + "element face 1\nproperty list uchar float vertex_indices\nend_header\n" + vx;
+			appendTestBytes(data, static_cast<unsigned char>(3));
+			appendTestBytes(data, 0.f);
+			appendTestBytes(data, 2.f);
+			appendTestBytes(data, aIDWrong[iWrong]);
+			nErrors += checkReadMesh(pNameMesh, data, aVxTetra, aIDVxNone);
+		}
+
+		data = header + "property list uchar int extra\nend_header\n";
+		for (UI1 iVx = 0; iVx < aVxTetra.size(); ++iVx)
+		{
+			data.append(vx, 12 * iVx, 12);
+			appendTestBytes(data, static_cast<unsigned char>(0));
+		}
+		nErrors += checkReadMesh(pNameMesh, data, aVxTetra, aIDVxNone);
+	}
+
+	///The numbers longer than the buffer of strtod are parsed too
+	const std::string zeros(2 * cNumberBufferSize, '0');
+	nErrors += checkReadMesh(pNameMesh, "OFF\n4 1 0\n0 0 0\n1." + zeros + " 0 0\n0 " + zeros + "1 0\n0 0 1\n3 0 1 2\n", aVxTetra, { 0, 1, 2 });
+
+	///The binary STL of two triangles, the vertices aren't welded, and the truncated STL
+	{
+		std::string data(80, ' ');
+		data.replace(0, 10, "binary stl");
+		appendTestBytes(data, static_cast<UI4>(2));
+		const UI4 aIDTr[6] = { 0, 1, 2, 0, 1, 3 };
+		std::vector<D3> aVxSTL;
+		for (UI1 iTr = 0; iTr < 2; ++iTr)
+		{
+			for (UI1 dim = 0; dim < 3; ++dim)
+				appendTestBytes(data, 0.f);
+			for (UI1 iVx = 0; iVx < 3; ++iVx)
+			{
+				const D3& vx = aVxTetra[aIDTr[3 * iTr + iVx]];
+				aVxSTL.push_back(vx);
+				for (UI1 dim = 0; dim < 3; ++dim)
+					appendTestBytes(data, static_cast<float>(vx[dim]));
+			}
+			appendTestBytes(data, static_cast<unsigned short>(0));
+		}
+
+		nErrors += checkReadMesh(pNameMesh, data, aVxSTL, { 0, 1, 2, 3, 4, 5 });
+		nErrors += checkReadMesh(pNameMesh, data.substr(0, data.size() - 10), aVxSTL, aIDVxNone);
+	}
+
+	printf("Mesh reader errors : %zu\n", nErrors);
+}
+
 void testBuildTree(std::vector<char*>& aPFileNames)
 {
 	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
 	{
 		printf("%s :\n", aPFileNames[i]);
 		std::vector<D3> aVx;
-		std::vector<CItemTriangle> aTr;
+		std::vector<CItemTriangle> aItems;
 
 		try
 		{
-			CFileReaderOFF testFile(aPFileNames[i], aVx, aTr);
+			CFileReaderMesh testFile(aPFileNames[i], aVx, aItems);
 		}
 		catch (CExceptionCanNotOpenFile& err)
 		{
 			printf("Can't open file : %s ...\n Err : %d", aPFileNames[i], err.getError());
 			continue;
 		}
+		catch (CExceptionWrongFileFormat& err)
+		{
+			printf("Wrong file : %s ...\n Err : %s\n", aPFileNames[i], err.getMessage());
+			continue;
+		}
+
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
 
-		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode;
+#ifdef USE_INPLACE_BUILD
+		const C3DKDTree<CItemTriangle> treeSerial(aItems, spltterNode, false);
+#endif
 
 		clock_t startTime = clock();
-		C3DKDTree<CItemTriangle> tree(aTr, spltterNode, true);
+		C3DKDTree<CItemTriangle> tree(std::move(aItems), spltterNode, true);
 		clock_t endTime = clock();
 
 		printf("Time : %lf sec.\n", (static_cast<double>(endTime) - static_cast<double>(startTime)) / static_cast<double>(CLOCKS_PER_SEC));
 
+#ifdef USE_INPLACE_BUILD
+		///The buffers of the in place build are reserved by the limits of the build, so they never grow
+		const UI1 nErrors = (treeSerial.getNumBuildGrowths() != 0) + (tree.getNumBuildGrowths() != 0);
+		printf("Growths of the buffers of the build : serial %zu, parallel %zu, errors : %zu\n", treeSerial.getNumBuildGrowths(), tree.getNumBuildGrowths(), nErrors);
+#endif
+
 #ifdef DUMP_TREE_LOG
 		{
 			char* pNameLog = cntStr(aPFileNames[i], ".log");
@@ -145,40 +436,128 @@ void testBuildTree(std::vector<char*>& aPFileNames)
 	}
 }
 
+void testSweepSplitter(std::vector<char*>& aPFileNames)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangle> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		std::vector<D3> aPoints;
+		generateTestPoints(aItems.data(), aItems.size(), cNumTestQueries, aPoints);
+
+		///The sweep over all nodes, the sweep with the perfect splits over all nodes and the hybrid mode with the perfect splits
+		const char* const aPNamesSplitters[3] = { "Sweep SAH", "Sweep SAH with the perfect splits", "Hybrid SAH" };
+		const bool aPerfectSplits[3] = { false, true, true };
+		const UI1 aMaxItemsSweep[3] = { SIZE_MAX, SIZE_MAX, cMaxElementsForSweepSplit };
+		for (UI1 iSplitter = 0; iSplitter < 3; ++iSplitter)
+		{
+			C3DKDTreeNodeSplitterSAHSweep<CItemTriangle> spltterNode(aPerfectSplits[iSplitter], aMaxItemsSweep[iSplitter], true);
+
+			clock_t startTime = clock();
+			C3DKDTree<CItemTriangle> tree(aItems, spltterNode, true);
+			clock_t endTime = clock();
+
+			SKDTreeQueryScratch scratch;
+			UI1 nErrors = 0;
+			for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+			{
+				C3DKDTreeNearestItemINFO nearestItemINFO;
+				tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+				const double minDist = bruteForceFindNearest(aItems.data(), aItems.size(), aPoints[i_1]);
+				if (cEps < fabs(nearestItemINFO.m_minDist - minDist) ||
+					cEps < fabs(aItems[nearestItemINFO.m_idItem].calcDist2(aPoints[i_1]) - nearestItemINFO.m_minDist2))
+					++nErrors;
+			}
+
+			printf("%s : leafs : %zu, time : %lf sec., errors : %zu\n", aPNamesSplitters[iSplitter], tree.getNumLeafs(),
+				(static_cast<double>(endTime) - static_cast<double>(startTime)) / static_cast<double>(CLOCKS_PER_SEC), nErrors);
+		}
+	}
+}
+
 void testFindNearestItem(std::vector<char*>& aPFileNames)
 {
 	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
 	{
 		printf("%s :\n", aPFileNames[i]);
 		std::vector<D3> aVx;
-		std::vector<CItemTriangle> aTr;
+		std::vector<CItemTriangle> aItems;
 
 		try
 		{
-			CFileReaderOFF testFile(aPFileNames[i], aVx, aTr);
+			CFileReaderMesh testFile(aPFileNames[i], aVx, aItems);
 		}
 		catch (CExceptionCanNotOpenFile& err)
 		{
 			printf("Can't open file : %s ...\n Err : %d", aPFileNames[i], err.getError());
-			free(static_cast<void*>(aPFileNames[i]));
 			continue;
 		}
+		catch (CExceptionWrongFileFormat& err)
+		{
+			printf("Wrong file : %s ...\n Err : %s\n", aPFileNames[i], err.getMessage());
+			continue;
+		}
+
+#ifdef USE_SAVED_TREES
+		std::unique_ptr<C3DKDTree<CItemTriangle>> pTree;
+		char* pNameTree = cntStr(aPFileNames[i], ".kdt");
+		if (pNameTree == nullptr)
+			continue;
+
+		try
+		{
+			pTree.reset(new C3DKDTree<CItemTriangle>(pNameTree));
+		}
+		catch (CExceptionCanNotOpenFile&)
+		{
+		}
+		catch (CExceptionWrongFileFormat& err)
+		{
+			printf("Wrong file : %s ...\n Err : %s\n", pNameTree, err.getMessage());
+		}
+
+		if (!pTree)
+		{
+			C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+			pTree.reset(new C3DKDTree<CItemTriangle>(std::move(aItems), spltterNode, true));
+			try
+			{
+				pTree->save(pNameTree);
+			}
+			catch (CExceptionCanNotOpenFile& err)
+			{
+				printf("Can't open file : %s ...\n Err : %d", pNameTree, err.getError());
+			}
+			catch (CExceptionMemoryError& err)
+			{
+				printf("Memory error : %s", err.getMessage());
+			}
+		}
 
-		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode;
-		C3DKDTree<CItemTriangle> tree(aTr, spltterNode, true);
+		free(static_cast<void*>(pNameTree));
+		const C3DKDTree<CItemTriangle>& tree = *pTree;
+#else
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+		C3DKDTree<CItemTriangle> tree(std::move(aItems), spltterNode, true);
+#endif
 
-		const I1 nThreads = omp_get_max_threads();
-		std::vector<std::vector<D3>> aRandomPoints(nThreads + 1);
+		std::vector<D3> aPoints;
 
 #ifndef USE_RANDOM_POINTS
 #if 1
-		readPointsFromFile("tests/aVx.vx", aRandomPoints[0]);
+		readPointsFromFile("tests/aVx.vx", aPoints);
 #else
 		{
-			aRandomPoints[0].resize(aTr.size());
-			for (size_t i = 0, size = aRandomPoints[0].size(); i < size; ++i)
+			aPoints.resize(tree.getNumItems());
+			for (size_t i = 0, size = aPoints.size(); i < size; ++i)
 			{
-				aRandomPoints[0][i] = (aTr[i][0] + aTr[i][1] + aTr[i][2]) / 3.;
+				const CItemTriangle& item = tree.getItems()[i];
+				aPoints[i] = (D3(item[0]) + D3(item[1]) + D3(item[2])) / 3.;
 			}
 		}
 #endif
@@ -186,45 +565,1071 @@ void testFindNearestItem(std::vector<char*>& aPFileNames)
 
 #ifdef USE_RANDOM_POINTS
 		srand((unsigned I1)time(0));
+		aPoints.resize(cNumRandomPoints);
 		for (I1 i_1 = 0; i_1 < cNumRandomPoints; ++i_1)
 		{
-			aRandompoints[0][i_1][0] = random(minBoundary, maxBoundary);
-			aRandompoints[0][i_1][1] = random(minBoundary, maxBoundary);
-			aRandompoints[0][i_1][2] = random(minBoundary, maxBoundary);
+			aPoints[i_1][0] = random(minBoundary, maxBoundary);
+			aPoints[i_1][1] = random(minBoundary, maxBoundary);
+			aPoints[i_1][2] = random(minBoundary, maxBoundary);
 		}
 
-		writePointsToFile("tests/aVx.vx", aRandomPoints[0]);
+		writePointsToFile("tests/aVx.vx", aPoints);
+#endif
+
+		std::vector<C3DKDTreeNearestItemINFO> aNearestItemsINFO;
+
+		clock_t startTime = clock();
+		tree.findNearestItems(aPoints, aNearestItemsINFO);
+		clock_t endTime = clock();
+
+#ifdef USE_BRUTEFORCE_CMP
+		for (UI1 i_1 = 0, size = aPoints.size(); i_1 < size; ++i_1)
+		{
+			const double minDist = bruteForceFindNearest(tree.getItems(), tree.getNumItems(), aPoints[i_1]);
+			if (cEps2 < fabs(aNearestItemsINFO[i_1].m_minDist - minDist))
+				throw;
+		}
 #endif
 
-		const UI1 nPointsInThread = aRandomPoints[0].size() / nThreads;
-		for (I1 i = 1; i < nThreads; ++i)
+		printf("Time : %lf sec.\n", (static_cast<double>(endTime) - static_cast<double>(startTime)) / static_cast<double>(CLOCKS_PER_SEC));
+	}
+}
+
+void testFindNearestItems(std::vector<char*>& aPFileNames)
+{
+	testQueriesTree(aPFileNames, [](const C3DKDTree<CItemTriangle>& tree, const std::vector<D3>& aPoints)
+	{
+		///The packets of the batch query must find the same distances as the single queries
+		std::vector<C3DKDTreeNearestItemINFO> aNearestItemsINFO;
+		tree.findNearestItems(aPoints, aNearestItemsINFO);
+
+		SKDTreeQueryScratch scratch;
+		UI1 nErrors = 0;
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
 		{
-			aRandomPoints[i].resize(nPointsInThread);
-			::memcpy(aRandomPoints[i].begin()._Ptr, aRandomPoints[0].begin()._Ptr + (i - 1) * nPointsInThread, nPointsInThread * sizeof(D3));
+			C3DKDTreeNearestItemINFO nearestItemINFO;
+			tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+			if (cEps < fabs(aNearestItemsINFO[i_1].m_minDist - nearestItemINFO.m_minDist) ||
+				cEps < fabs(tree.getItems()[aNearestItemsINFO[i_1].m_idItem].calcDist2(aPoints[i_1]) - aNearestItemsINFO[i_1].m_minDist2))
+				++nErrors;
 		}
 
-		aRandomPoints[nThreads].resize(aRandomPoints[0].size() - nPointsInThread * (nThreads - 1));
-		::memcpy(aRandomPoints[nThreads].begin()._Ptr, aRandomPoints[0].begin()._Ptr + (nThreads - 1) * nPointsInThread, (aRandomPoints[0].size() - nPointsInThread * (nThreads - 1)) * sizeof(D3));
+		printf("Batch nearest items errors : %zu\n", nErrors);
+	});
+}
 
-		clock_t startTime = clock();
+void testFindKNearestItems(std::vector<char*>& aPFileNames)
+{
+	testQueriesTree(aPFileNames, [](const C3DKDTree<CItemTriangle>& tree, const std::vector<D3>& aPoints)
+	{
+		const UI1 nItems = tree.getNumItems();
+		const UI1 k = std::min(cNumTestNearestItems, nItems);
+		std::vector<double> aDist2(nItems);
+		std::vector<C3DKDTreeNearestItemINFO> aNearestItemsINFO;
+		SKDTreeQueryScratch scratch;
+		UI1 nErrors = 0;
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+		{
+			for (UI1 i_2 = 0; i_2 < nItems; ++i_2)
+				aDist2[i_2] = tree.getItems()[i_2].calcDist2(aPoints[i_1]);
+			std::nth_element(aDist2.begin(), aDist2.begin() + (k - 1), aDist2.end());
+			std::sort(aDist2.begin(), aDist2.begin() + k);
+
+			///The odd points are limited by the distance between the nearest items, so the query returns less than k items
+			const double maxDist = i_1 % 2 == 0 ? DBL_MAX : sqrt(aDist2[k / 2]) + cEps;
+			tree.findKNearestItems(aNearestItemsINFO, aPoints[i_1], k, maxDist, scratch);
+
+			UI1 nExpected = k;
+			if (maxDist != DBL_MAX)
+			{
+				nExpected = 0;
+				while (nExpected < k && aDist2[nExpected] <= maxDist * maxDist)
+					++nExpected;
+			}
+
+			bool bError = aNearestItemsINFO.size() != nExpected;
+			for (UI1 i_2 = 0, nFound = std::min(aNearestItemsINFO.size(), nExpected); i_2 < nFound && !bError; ++i_2)
+			{
+				const C3DKDTreeNearestItemINFO& nearestItemINFO = aNearestItemsINFO[i_2];
+				const double dist = aDist2[i_2] < cEps2 ? 0. : sqrt(aDist2[i_2]);
+				bError = cEps < fabs(dist - nearestItemINFO.m_minDist) ||
+					cEps < fabs(tree.getItems()[nearestItemINFO.m_idItem].calcDist2(aPoints[i_1]) - nearestItemINFO.m_minDist2);
+			}
+
+			if (bError)
+				++nErrors;
+		}
+
+		printf("K nearest items errors : %zu\n", nErrors);
+	});
+}
+
+void testFindItemsInRadius(std::vector<char*>& aPFileNames)
+{
+	testQueriesTree(aPFileNames, [](const C3DKDTree<CItemTriangle>& tree, const std::vector<D3>& aPoints)
+	{
+		const UI1 nItems = tree.getNumItems();
+		std::vector<UI1> aIDItemsFound;
+		SKDTreeQueryScratch scratch;
+		UI1 nErrors = 0;
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+		{
+			const D3& point = aPoints[i_1];
+
+			///The radius is greater than the distance to the nearest item, so the ball contains some items
+			C3DKDTreeNearestItemINFO nearestItemINFO;
+			tree.findNearestItem(nearestItemINFO, point, scratch);
+			const double radius = 1.25 * nearestItemINFO.m_minDist + cEps;
+
+			aIDItemsFound.clear();
+			bool bError = false;
+			tree.findItemsInRadius(point, radius, [&](const UI1 idItem, const double dist2)
+			{
+				aIDItemsFound.push_back(idItem);
+				if (cEps < fabs(tree.getItems()[idItem].calcDist2(point) - dist2))
+					bError = true;
+			}, scratch);
+
+			///Every item is reported once and the items on the sphere of the radius may be reported or not
+			std::sort(aIDItemsFound.begin(), aIDItemsFound.end());
+			if (std::adjacent_find(aIDItemsFound.begin(), aIDItemsFound.end()) != aIDItemsFound.end())
+				bError = true;
+
+			for (UI1 i_2 = 0; i_2 < nItems && !bError; ++i_2)
+			{
+				const double dist = sqrt(tree.getItems()[i_2].calcDist2(point));
+				const bool bFound = std::binary_search(aIDItemsFound.begin(), aIDItemsFound.end(), i_2);
+				if (bFound != (dist <= radius) && cEps < fabs(dist - radius))
+					bError = true;
+			}
+
+			if (bError)
+				++nErrors;
+		}
+
+		printf("Items in radius errors : %zu\n", nErrors);
+	});
+}
+
+void testFindHits(std::vector<char*>& aPFileNames)
+{
+	testQueriesTree(aPFileNames, [](const C3DKDTree<CItemTriangle>& tree, const std::vector<D3>& aOrigins)
+	{
+		const UI1 nItems = tree.getNumItems();
+		const SBBox bBox = calcBBoxTestItems(tree.getItems(), nItems);
+		const D3 sizeBBox(bBox.m_maxBB - bBox.m_minBB);
+
+		SKDTreeQueryScratch scratch;
+		UI1 nErrors = 0;
+		UI1 nHits = 0;
+		for (UI1 i_1 = 0, nRays = aOrigins.size(); i_1 < nRays; ++i_1)
+		{
+			D3 origin = aOrigins[i_1];
+			D3 dir(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+			switch (i_1 % 4)
+			{
+			case 0:
+				///The ray to the center of the random item, it starts in or out of the bounding box of the KD Tree
+				dir = tree.getItems()[rand() % nItems].calcBBoxItem().calcMid() - origin;
+				break;
+			case 1:
+				///The ray starts inside of the bounding box of the KD Tree
+				for (UI1 dim = 0; dim < 3; ++dim)
+					origin[dim] = randomTest(bBox.m_minBB[dim], bBox.m_maxBB[dim]);
+				break;
+			case 2:
+				///The ray starts out of the bounding box of the KD Tree and goes away from it, so it misses the root
+				for (UI1 dim = 0; dim < 3; ++dim)
+				{
+					origin[dim] = bBox.m_maxBB[dim] + 0.1 * sizeBBox[dim] + cEps;
+					dir[dim] = fabs(dir[dim]);
+				}
+				break;
+			default:
+				break;
+			}
+
+			///The even rays are infinite, the odd rays are the segments of the random length
+			const double tMax = i_1 % 2 == 0 ? DBL_MAX : randomTest(0., 2.);
+
+			bool bHitBrute = false;
+			double tBrute = tMax;
+			for (UI1 i_2 = 0; i_2 < nItems; ++i_2)
+			{
+				double t = 0.;
+				if (tree.getItems()[i_2].calcIntersectRay(origin, dir, tBrute, t) && (!bHitBrute || t < tBrute))
+				{
+					bHitBrute = true;
+					tBrute = t;
+				}
+			}
+
+			C3DKDTreeRayHitINFO hitINFO;
+			const bool bHit = tree.findFirstHit(hitINFO, origin, dir, tMax, scratch);
+			const bool bAnyHit = tree.findAnyHit(origin, dir, tMax, scratch);
+
+			bool bError = bHit != bHitBrute || bAnyHit != bHitBrute;
+			if (bHit && !bError)
+			{
+				double t = 0.;
+				bError = cEps < fabs(hitINFO.m_t - tBrute) ||
+					!tree.getItems()[hitINFO.m_idItem].calcIntersectRay(origin, dir, tMax, t) || cEps < fabs(t - hitINFO.m_t);
+			}
+
+			if (bHitBrute)
+				++nHits;
+			if (bError)
+				++nErrors;
+		}
+
+		printf("Hits : %zu of %zu, hits errors : %zu\n", nHits, aOrigins.size(), nErrors);
+	});
+}
+
+///The random orthonormal axes, the third axis is the random direction
+void generateTestAxes(D3(&aAxis)[3])
+{
+	D3 dir;
+	do
+	{
+		dir = D3(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+	} while (dir.norm2() < 0.01);
+
+	aAxis[2] = dir / dir.norm();
+	const D3 other = fabs(aAxis[2][0]) < 0.9 ? D3(1., 0., 0.) : D3(0., 1., 0.);
+	aAxis[0] = other % aAxis[2];
+	aAxis[0] = aAxis[0] / aAxis[0].norm();
+	aAxis[1] = aAxis[2] % aAxis[0];
+}
+
+///<returns>The number of the errors of the found items of the overlap query : the items found twice, the found items which don't overlap the volume and the missed items</returns>
+template<typename TVolume>
+UI1 checkItemsOverlap(const C3DKDTree<CItemTriangle>& tree, const TVolume& volume, const std::vector<UI1>& aIDItemsFound, UI1& nFound)
+{
+	std::vector<UI1> aIDItemsSorted(aIDItemsFound);
+	std::sort(aIDItemsSorted.begin(), aIDItemsSorted.end());
+	UI1 nErrors = std::adjacent_find(aIDItemsSorted.begin(), aIDItemsSorted.end()) != aIDItemsSorted.end() ? 1 : 0;
+
+	UI1 nExpected = 0;
+	for (UI1 i = 0, nItems = tree.getNumItems(); i < nItems; ++i)
+	{
+		if (!tree.getItems()[i].isOverlap(volume))
+			continue;
+
+		++nExpected;
+		if (!std::binary_search(aIDItemsSorted.begin(), aIDItemsSorted.end(), i))
+			++nErrors;
+	}
+
+	if (nExpected != aIDItemsSorted.size())
+		++nErrors;
+
+	nFound += aIDItemsFound.size();
+	return nErrors;
+}
+
+void testFindItemsOverlap(std::vector<char*>& aPFileNames)
+{
+	testQueriesTree(aPFileNames, [](const C3DKDTree<CItemTriangle>& tree, const std::vector<D3>& aPoints)
+	{
+		const SBBox bBoxTree = calcBBoxTestItems(tree.getItems(), tree.getNumItems());
+		const double sizeTree = (bBoxTree.m_maxBB - bBoxTree.m_minBB).norm();
+
+		std::vector<UI1> aIDItemsFound;
+		const auto addItem = [&aIDItemsFound](const UI1 idItem)
+		{
+			aIDItemsFound.push_back(idItem);
+		};
+
+		SKDTreeQueryScratch scratch;
+		UI1 aErrors[3] = { 0, 0, 0 };
+		UI1 aFound[3] = { 0, 0, 0 };
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+		{
+			const D3& point = aPoints[i_1];
+			const D3 halfSize(randomTest(0.01, 0.1) * sizeTree, randomTest(0.01, 0.1) * sizeTree, randomTest(0.01, 0.1) * sizeTree);
+			aIDItemsFound.clear();
+
+			///The axis aligned box, the oriented box and the frustum take turns
+			const UI1 iVolume = i_1 % 3;
+			if (iVolume == 0)
+			{
+				SBBox bBox;
+				bBox.m_minBB = point - halfSize;
+				bBox.m_maxBB = point + halfSize;
+				tree.findItemsInBBox(bBox, addItem, scratch);
+				aErrors[iVolume] += checkItemsOverlap(tree, SVolumeBBox(bBox), aIDItemsFound, aFound[iVolume]);
+			}
+			else if (iVolume == 1)
+			{
+				D3 aAxis[3];
+				generateTestAxes(aAxis);
+				const SVolumeOrientedBBox volume(point, aAxis, halfSize);
+				tree.findItemsOverlap(volume, addItem, scratch);
+				aErrors[iVolume] += checkItemsOverlap(tree, volume, aIDItemsFound, aFound[iVolume]);
+			}
+			else
+			{
+				///The frustum of the view from the point along the third axis, its sides are the planes through the point
+				D3 aAxis[3];
+				generateTestAxes(aAxis);
+				const double nearDist = 0.01 * sizeTree;
+				const double farDist = randomTest(0.1, 0.5) * sizeTree;
+				const double tanAngle = randomTest(0.1, 0.6);
+
+				D3 aNormal[6];
+				aNormal[0] = -1. * aAxis[2];
+				aNormal[1] = aAxis[2];
+				aNormal[2] = aAxis[0] - tanAngle * aAxis[2];
+				aNormal[3] = -1. * aAxis[0] - tanAngle * aAxis[2];
+				aNormal[4] = aAxis[1] - tanAngle * aAxis[2];
+				aNormal[5] = -1. * aAxis[1] - tanAngle * aAxis[2];
+
+				double aOffset[6];
+				aOffset[0] = -(aAxis[2] * point + nearDist);
+				aOffset[1] = aAxis[2] * point + farDist;
+				for (UI1 iPlane = 2; iPlane < 6; ++iPlane)
+					aOffset[iPlane] = aNormal[iPlane] * point;
 
-#pragma omp parallel for schedule(static)
-		for (I1 i = 1; i <= nThreads; ++i)
+				const SVolumeFrustum volume(aNormal, aOffset);
+				tree.findItemsOverlap(volume, addItem, scratch);
+				aErrors[iVolume] += checkItemsOverlap(tree, volume, aIDItemsFound, aFound[iVolume]);
+			}
+		}
+
+		printf("Overlap bounding box errors : %zu, found items : %zu\n", aErrors[0], aFound[0]);
+		printf("Overlap oriented bounding box errors : %zu, found items : %zu\n", aErrors[1], aFound[1]);
+		printf("Overlap frustum errors : %zu, found items : %zu\n", aErrors[2], aFound[2]);
+	});
+}
+
+void testDistTrianglesSIMD()
+{
+	printf("SIMD level : %d\n", static_cast<int>(math::getSIMDLevel()));
+
+	srand(1);
+	std::vector<D3> aVx(3 * cNumTestTriangles);
+	for (UI1 i = 0; i < cNumTestTriangles; ++i)
+	{
+		D3* pVx = &aVx[3 * i];
+		for (UI1 j = 0; j < 3; ++j)
+			pVx[j] = D3(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+
+		///Every fourth triangle is degenerate : the point, the segment with the equal vertices, the segment of the collinear vertices or the needle
+		if (i % 4 == 0)
+		{
+			switch (i / 4 % 4)
+			{
+			case 0:
+				pVx[1] = pVx[0];
+				pVx[2] = pVx[0];
+				break;
+			case 1:
+				pVx[2] = pVx[i / 16 % 2];
+				break;
+			case 2:
+				pVx[2] = pVx[0] + (pVx[1] - pVx[0]) * randomTest(-1., 2.);
+				break;
+			default:
+				pVx[2] = pVx[0] + (pVx[1] - pVx[0]) * 0.5 + D3(cEps, -cEps, cEps);
+				break;
+			}
+		}
+	}
+
+	std::vector<STrianglePrecomputed> aTriangles(cNumTestTriangles);
+	std::vector<UI4> aIDTriangles(cNumTestTriangles);
+	for (UI1 i = 0; i < cNumTestTriangles; ++i)
+	{
+		aTriangles[i].setTriangle(aVx[3 * i], aVx[3 * i + 1], aVx[3 * i + 2]);
+		aIDTriangles[i] = static_cast<UI4>(cNumTestTriangles - 1 - i);
+	}
+
+	///The blocks of 1..9 triangles cover the full registers and the tails of the kernels
+	UI1 nErrors = 0;
+	UI1 nBlocks = 0;
+	for (UI1 begin = 0, nBlock = 1; begin < cNumTestTriangles; begin += nBlock, nBlock = nBlock % 9 + 1, ++nBlocks)
+	{
+		const UI1 n = std::min(nBlock, cNumTestTriangles - begin);
+		const D3 point(randomTest(-2., 2.), randomTest(-2., 2.), randomTest(-2., 2.));
+
+		double minDist2 = DBL_MAX;
+		for (UI1 i = 0; i < n; ++i)
+		{
+			const UI4 idTriangle = aIDTriangles[begin + i];
+			minDist2 = std::min(minDist2, math::distToTriangle2(aVx[3 * idTriangle], aVx[3 * idTriangle + 1], aVx[3 * idTriangle + 2], point));
+		}
+
+		UI1 iMin = n;
+		const double minDist2SIMD = math::calcMinDist2Triangles(aTriangles.data(), aIDTriangles.data() + begin, n, point, iMin);
+
+		bool bError = iMin >= n || cEps < fabs(sqrt(minDist2SIMD) - sqrt(minDist2));
+		if (!bError)
+		{
+			const UI4 idTriangle = aIDTriangles[begin + iMin];
+			bError = cEps < fabs(sqrt(math::distToTriangle2(aVx[3 * idTriangle], aVx[3 * idTriangle + 1], aVx[3 * idTriangle + 2], point)) - sqrt(minDist2));
+		}
+
+		if (bError)
+			++nErrors;
+	}
+
+	printf("SIMD distances errors : %zu of %zu\n", nErrors, nBlocks);
+}
+
+///<summary>Tests the distance to the triangles which are near the threshold of the degenerate triangle of math::distToTriangle2 at the different scales</summary>
+///<remarks>The distance differs from the distance to the nearest edge by the height of the triangle at most, the thin triangle is its longest edge,
+///the distance is scaled with the triangle and the vectorized kernel gives the same distance</remarks>
+void testDistTriangleSlivers()
+{
+	srand(2);
+	const double aWidth[5] = { 0., 1e-9, cEps, 1e-5, 1. };
+	///The scales are the powers of 2, so the scaled triangles are exact
+	const double aScale[4] = { ldexp(1., -16), ldexp(1., -8), 1., ldexp(1., 8) };
+	UI1 nErrors = 0;
+	UI1 nTests = 0;
+	for (UI1 iTest = 0; iTest < 1000; ++iTest)
+	{
+		const D3 A(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+		D3 B(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+		while ((B - A).norm() < 0.25)
+			B = D3(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+		const D3 point(randomTest(-2., 2.), randomTest(-2., 2.), randomTest(-2., 2.));
+		const D3 AB = B - A;
+		const D3 side = math::normalizeVector(AB % D3(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.)));
+		const double width = aWidth[iTest % 5];
+		const D3 C = A + AB * randomTest(-0.5, 1.5) + side * (width * AB.norm());
+		const double height = width * AB.norm();
+
+		const double dist = sqrt(math::distToTriangle2(A, B, C, point));
+		const double distEdges = std::min(math::distToSeg(A, B, point), std::min(math::distToSeg(B, C, point), math::distToSeg(A, C, point)));
+		bool bError = fabs(dist - distEdges) > height + cEps || (width == 1. && dist > distEdges + cEps);
+
+		for (UI1 iScale = 0; iScale < 4; ++iScale)
+		{
+			const double scale = aScale[iScale];
+			const D3 vxA = A * scale, vxB = B * scale, vxC = C * scale, pointScaled = point * scale;
+			const double distScaled = sqrt(math::distToTriangle2(vxA, vxB, vxC, pointScaled));
+			bError = bError || fabs(distScaled - dist * scale) > 1e-12 * dist * scale;
+
+			STrianglePrecomputed triangle;
+			triangle.setTriangle(vxA, vxB, vxC);
+			const UI4 idTriangle = 0;
+			UI1 iMin = 1;
+			const double distSIMD = sqrt(math::calcMinDist2Triangles(&triangle, &idTriangle, 1, pointScaled, iMin));
+			bError = bError || iMin != 0 || fabs(distSIMD - distScaled) > cEps * scale;
+		}
+
+		++nTests;
+		if (bError)
+			++nErrors;
+	}
+
+	printf("Sliver distances errors : %zu of %zu\n", nErrors, nTests);
+}
+
+void testFindNearestFeature(std::vector<char*>& aPFileNames)
+{
+	testQueriesTree(aPFileNames, [](const C3DKDTree<CItemTriangle>& tree, const std::vector<D3>& aPoints)
+	{
+		SKDTreeQueryScratch scratch;
+		UI1 nErrors = 0;
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+		{
+			const D3& point = aPoints[i_1];
+			C3DKDTreeNearestFeatureINFO nearestFeatureINFO;
+			tree.findNearestItem(nearestFeatureINFO, point, scratch);
+
+			///The closest point and the feature must be the ones of the found triangle
+			D3 closestPoint;
+			eTriangleFeature feature = eTriangleFeatureFace;
+			tree.getItems()[nearestFeatureINFO.m_idItem].calcDist2Feature(point, closestPoint, feature);
+
+			const double minDist = bruteForceFindNearest(tree.getItems(), tree.getNumItems(), point);
+			if (cEps < fabs(nearestFeatureINFO.m_minDist - minDist) || cEps < fabs((point - nearestFeatureINFO.m_closestPoint).norm() - minDist) ||
+				cEps < (closestPoint - nearestFeatureINFO.m_closestPoint).norm() || feature != nearestFeatureINFO.m_feature)
+				++nErrors;
+		}
+
+		printf("Nearest feature errors : %zu\n", nErrors);
+	});
+}
+
+///The cube [-1, 1]^3 of n x n squares on every face, the triangles are oriented outward and share the bitwise equal vertices
+void generateTestCube(const UI1 n, std::vector<CItemTriangle>& aItems)
+{
+	aItems.clear();
+	for (UI1 dim = 0; dim < 3; ++dim)
+	{
+		const UI1 dimU = (dim + 1) % 3;
+		const UI1 dimV = (dim + 2) % 3;
+		for (I1 side = -1; side <= 1; side += 2)
+		{
+			for (UI1 i = 0; i < n; ++i)
+			{
+				for (UI1 j = 0; j < n; ++j)
+				{
+					///The corners of the square in the order of the outward normal of the face +dim
+					const UI1 aU[4] = { i, i + 1, i + 1, i };
+					const UI1 aV[4] = { j, j, j + 1, j + 1 };
+					D3 aCorners[4];
+					for (UI1 k = 0; k < 4; ++k)
+					{
+						aCorners[k][dim] = static_cast<double>(side);
+						aCorners[k][dimU] = -1. + 2. * static_cast<double>(aU[k]) / static_cast<double>(n);
+						aCorners[k][dimV] = -1. + 2. * static_cast<double>(aV[k]) / static_cast<double>(n);
+					}
+
+					if (side > 0)
+					{
+						aItems.push_back(CItemTriangle(aCorners[0], aCorners[1], aCorners[2]));
+						aItems.push_back(CItemTriangle(aCorners[0], aCorners[2], aCorners[3]));
+					}
+					else
+					{
+						aItems.push_back(CItemTriangle(aCorners[0], aCorners[2], aCorners[1]));
+						aItems.push_back(CItemTriangle(aCorners[0], aCorners[3], aCorners[2]));
+					}
+				}
+			}
+		}
+	}
+}
+
+void testFindSignedDist()
+{
+	std::vector<CItemTriangle> aItems;
+	generateTestCube(cNumTestCubeSquares, aItems);
+
+	C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+	C3DKDTree<CItemTriangle> tree(std::move(aItems), spltterNode, true);
+	CMeshPseudoNormals normals(tree.getItems(), tree.getNumItems());
+
+	srand(1);
+	SKDTreeQueryScratch scratch;
+	UI1 nErrors = 0;
+	for (UI1 i = 0; i < cNumTestQueries; ++i)
+	{
+		///The odd points are near the edges and the corners of the cube, so their closest features are the edges and the vertices
+		D3 point(randomTest(-1.5, 1.5), randomTest(-1.5, 1.5), randomTest(-1.5, 1.5));
+		if (i % 2 == 1)
+		{
+			for (UI1 dim = 0; dim < 2; ++dim)
+				point[(i / 2 + dim) % 3] = (rand() % 2 == 0 ? -1. : 1.) + randomTest(-0.1, 0.1);
+		}
+
+		///The exact signed distance to the cube
+		double distOut2 = 0.;
+		double distIn = -DBL_MAX;
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			const double dist = fabs(point[dim]) - 1.;
+			distOut2 += dist > 0. ? dist * dist : 0.;
+			distIn = std::max(distIn, dist);
+		}
+		const double signedDist = sqrt(distOut2) + std::min(distIn, 0.);
+
+		C3DKDTreeNearestFeatureINFO nearestFeatureINFO;
+		if (cEps < fabs(tree.findSignedDist(nearestFeatureINFO, point, normals, scratch) - signedDist))
+			++nErrors;
+	}
+
+	printf("Signed distances errors : %zu\n", nErrors);
+}
+
+CItemTriangle moveTestItem(const CItemTriangle& item, const D3& shift)
+{
+	return CItemTriangle(item[0] + shift, item[1] + shift, item[2] + shift);
+}
+
+///<summary>Compares the nearest items of the edited KD Tree with the brute force over the not removed items</summary>
+UI1 checkEditedTree(const C3DKDTree<CItemTriangle>& tree, const std::vector<CItemTriangle>& aItems, const std::vector<bool>& aRemovedItems, const std::vector<D3>& aPoints)
+{
+	SKDTreeQueryScratch scratch;
+	UI1 nErrors = tree.validate() ? 0 : 1;
+	for (UI1 i = 0, nItems = aItems.size(); i < nItems; ++i)
+	{
+		if (tree.isItemRemoved(i) != aRemovedItems[i])
+			++nErrors;
+	}
+
+	for (UI1 i = 0, nPoints = aPoints.size(); i < nPoints; ++i)
+	{
+		double minDist2 = DBL_MAX;
+		for (UI1 i_1 = 0, nItems = aItems.size(); i_1 < nItems; ++i_1)
+		{
+			if (!aRemovedItems[i_1])
+				minDist2 = std::min(minDist2, aItems[i_1].calcDist2(aPoints[i]));
+		}
+		const double minDist = minDist2 < cEps2 ? 0. : sqrt(minDist2);
+
+		C3DKDTreeNearestItemINFO nearestItemINFO;
+		tree.findNearestItem(nearestItemINFO, aPoints[i], scratch);
+		if (nearestItemINFO.m_idItem >= aItems.size() || aRemovedItems[nearestItemINFO.m_idItem] || cEps < fabs(minDist - nearestItemINFO.m_minDist))
+			++nErrors;
+	}
+
+	return nErrors;
+}
+
+///<returns>True if the mapping of the file of the KD Tree throws CExceptionWrongFileFormat</returns>
+bool isWrongTreeFile(const char* const pNameTree)
+{
+	try
+	{
+		C3DKDTree<CItemTriangle> tree(pNameTree);
+	}
+	catch (CExceptionWrongFileFormat&)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+///<returns>True if the KD Tree mapped from the file is valid</returns>
+bool isValidTreeFile(const char* const pNameTree)
+{
+	C3DKDTree<CItemTriangle> tree(pNameTree);
+	return tree.validate();
+}
+
+///<summary>Writes the first size bytes of the file of the KD Tree into the other file, the first byte is flipped if bBadMagic</summary>
+void writeTestTreeFile(const char* const pNameTree, const std::vector<char>& aData, const UI1 size, const bool bBadMagic)
+{
+	CFileWriter file(pNameTree);
+	if (bBadMagic)
+	{
+		const char first = static_cast<char>(~aData[0]);
+		file.writeBytes(&first, 1);
+		file.writeBytes(aData.data() + 1, size - 1);
+	}
+	else
+		file.writeBytes(aData.data(), size);
+}
+
+void testSavedTree(std::vector<char*>& aPFileNames)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangle> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+		C3DKDTree<CItemTriangle> tree(std::move(aItems), spltterNode, true);
+
+		char* pNameTree = cntStr(aPFileNames[i], ".tmp.kdt");
+		char* pNameWrongTree = cntStr(aPFileNames[i], ".wrong.kdt");
+		if (pNameTree == nullptr || pNameWrongTree == nullptr)
+		{
+			free(static_cast<void*>(pNameTree));
+			free(static_cast<void*>(pNameWrongTree));
+			continue;
+		}
+
+		std::vector<D3> aPoints;
+		generateTestPoints(tree.getItems(), tree.getNumItems(), cNumTestQueries, aPoints);
+
+		UI1 nErrors = 0;
+		std::vector<char> aData;
+		try
+		{
+			tree.save(pNameTree);
+
+			///The mapped KD Tree has the same arrays, so its queries find the same items at the same distances
+			{
+				C3DKDTree<CItemTriangle> treeMapped(pNameTree);
+				if (!tree.validate() || !treeMapped.validate() ||
+					treeMapped.getNumItems() != tree.getNumItems() || treeMapped.getNumNodes() != tree.getNumNodes() || treeMapped.getNumLeafs() != tree.getNumLeafs() ||
+					memcmp(treeMapped.getItems(), tree.getItems(), tree.getNumItems() * sizeof(CItemTriangle)) != 0)
+					++nErrors;
+
+				SKDTreeQueryScratch scratch;
+				for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+				{
+					C3DKDTreeNearestItemINFO nearestItemINFO;
+					C3DKDTreeNearestItemINFO nearestItemINFOMapped;
+					tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+					treeMapped.findNearestItem(nearestItemINFOMapped, aPoints[i_1], scratch);
+
+					const D3 dir = tree.getItems()[rand() % tree.getNumItems()].calcBBoxItem().calcMid() - aPoints[i_1];
+					C3DKDTreeRayHitINFO hitINFO;
+					C3DKDTreeRayHitINFO hitINFOMapped;
+					const bool bHit = tree.findFirstHit(hitINFO, aPoints[i_1], dir, DBL_MAX, scratch);
+					const bool bHitMapped = treeMapped.findFirstHit(hitINFOMapped, aPoints[i_1], dir, DBL_MAX, scratch);
+
+					if (nearestItemINFO.m_idItem != nearestItemINFOMapped.m_idItem || nearestItemINFO.m_minDist != nearestItemINFOMapped.m_minDist ||
+						bHit != bHitMapped || (bHit && (hitINFO.m_idItem != hitINFOMapped.m_idItem || hitINFO.m_t != hitINFOMapped.m_t)))
+						++nErrors;
+				}
+			}
+
+			{
+				CFileMapping fileMapping;
+				fileMapping.map(pNameTree);
+				aData.assign(fileMapping.getData(), fileMapping.getData() + fileMapping.getSize());
+			}
+
+			///The file with the wrong signature, the file cut in the half of the arrays and the file of the header only aren't mapped
+			writeTestTreeFile(pNameWrongTree, aData, aData.size(), true);
+			if (!isWrongTreeFile(pNameWrongTree))
+				++nErrors;
+
+			writeTestTreeFile(pNameWrongTree, aData, aData.size() / 2, false);
+			if (!isWrongTreeFile(pNameWrongTree))
+				++nErrors;
+
+			writeTestTreeFile(pNameWrongTree, aData, sizeof(SKDTreeFileHeader), false);
+			if (!isWrongTreeFile(pNameWrongTree))
+				++nErrors;
+
+			writeTestTreeFile(pNameWrongTree, aData, sizeof(SKDTreeFileHeader) - 1, false);
+			if (!isWrongTreeFile(pNameWrongTree))
+				++nErrors;
+
+			///The counts of the crafted header wrap the sizes of the arrays to the few bytes, so the arrays seem to be in the file
+			const UI1 aOffsetNums[4] = { offsetof(SKDTreeFileHeader, m_numItems), offsetof(SKDTreeFileHeader, m_numNodes), offsetof(SKDTreeFileHeader, m_numIDItems),
+				offsetof(SKDTreeFileHeader, m_numTrianglesPrecomputed) };
+			const UI8 aSizeElements[4] = { sizeof(CItemTriangle), sizeof(SFlatKDTreeNode), sizeof(UI4), sizeof(STrianglePrecomputed) };
+			for (UI1 iNum = 0; iNum < 4; ++iNum)
+			{
+				std::vector<char> aDataWrong(aData);
+				const UI8 numWrong = static_cast<UI8>(-1) / aSizeElements[iNum] + 1;
+				memcpy(aDataWrong.data() + aOffsetNums[iNum], &numWrong, sizeof(numWrong));
+				writeTestTreeFile(pNameWrongTree, aDataWrong, aDataWrong.size(), false);
+				if (!isWrongTreeFile(pNameWrongTree))
+					++nErrors;
+			}
+
+			///The file of the right child of the root out of the nodes and the file of the id item out of the items are mapped, but they aren't valid
+			SKDTreeFileHeader header;
+			memcpy(&header, aData.data(), sizeof(header));
+			const UI4 idWrong = static_cast<UI4>(-1);
+			const UI1 aOffsetWrong[2] = { header.m_offsetNodes + offsetof(SFlatKDTreeNode, m_idRightNode), header.m_offsetIDItems };
+			for (UI1 iWrong = 0; iWrong < 2; ++iWrong)
+			{
+				std::vector<char> aDataWrong(aData);
+				memcpy(aDataWrong.data() + aOffsetWrong[iWrong], &idWrong, sizeof(idWrong));
+				writeTestTreeFile(pNameWrongTree, aDataWrong, aDataWrong.size(), false);
+				if (isWrongTreeFile(pNameWrongTree) || isValidTreeFile(pNameWrongTree))
+					++nErrors;
+			}
+		}
+		catch (CExceptionCanNotOpenFile& err)
+		{
+			printf("Can't open file : %s ...\n Err : %d", pNameTree, err.getError());
+			++nErrors;
+		}
+		catch (CExceptionWrongFileFormat& err)
+		{
+			printf("Wrong file : %s ...\n Err : %s\n", pNameTree, err.getMessage());
+			++nErrors;
+		}
+		catch (CExceptionMemoryError& err)
+		{
+			printf("Memory error : %s", err.getMessage());
+			++nErrors;
+		}
+
+		remove(pNameTree);
+		remove(pNameWrongTree);
+		free(static_cast<void*>(pNameTree));
+		free(static_cast<void*>(pNameWrongTree));
+
+		printf("Saved tree errors : %zu\n", nErrors);
+	}
+}
+
+void testEditTree(std::vector<char*>& aPFileNames)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangle> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+		C3DKDTree<CItemTriangle> tree(aItems, spltterNode, true);
+
+		std::vector<D3> aPoints;
+		generateTestPoints(aItems.data(), aItems.size(), cNumTestQueries, aPoints);
+
+		const SBBox bBox = calcBBoxTestItems(aItems.data(), aItems.size());
+		const D3 sizeBBox(bBox.m_maxBB - bBox.m_minBB);
+		const UI1 nEdits = std::min(cNumTestEditItems, aItems.size() / 4);
+		std::vector<bool> aRemovedItems(aItems.size(), false);
+
+		///The removed items, the moved items(some of them are removed before) and the inserted items, the moved and the inserted items can be out of the bounding box of the KD Tree
+		for (UI1 i_1 = 0; i_1 < nEdits; ++i_1)
+		{
+			const UI1 idItem = rand() % aItems.size();
+			tree.removeItem(idItem);
+			aRemovedItems[idItem] = true;
+		}
+
+		for (UI1 i_1 = 0; i_1 < nEdits; ++i_1)
+		{
+			const UI1 idItem = rand() % aItems.size();
+			const D3 shift(randomTest(-0.5, 0.5) * sizeBBox[0], randomTest(-0.5, 0.5) * sizeBBox[1], randomTest(-0.5, 0.5) * sizeBBox[2]);
+			aItems[idItem] = moveTestItem(aItems[idItem], shift);
+			aRemovedItems[idItem] = false;
+			tree.updateItem(idItem, aItems[idItem]);
+		}
+
+		///The inserted items are crowded near one item, so its leafs degrade
+		const CItemTriangle itemCrowd = aItems[rand() % aItems.size()];
+		UI1 nErrors = 0;
+		for (UI1 i_1 = 0; i_1 < nEdits; ++i_1)
+		{
+			const D3 shift(randomTest(-0.01, 0.01) * sizeBBox[0], randomTest(-0.01, 0.01) * sizeBBox[1], randomTest(-0.01, 0.01) * sizeBBox[2]);
+			aItems.push_back(moveTestItem(itemCrowd, shift));
+			aRemovedItems.push_back(false);
+			if (tree.insertItem(aItems.back()) != aItems.size() - 1)
+				++nErrors;
+		}
+		nErrors += checkEditedTree(tree, aItems, aRemovedItems, aPoints);
+
+		///No leaf is past the infinite threshold, so they all wait for the next call
+		if (tree.rebuildDegradedLeafs(spltterNode, DBL_MAX) != 0)
+			++nErrors;
+
+		const UI1 nRebuiltLeafs = tree.rebuildDegradedLeafs(spltterNode);
+		nErrors += checkEditedTree(tree, aItems, aRemovedItems, aPoints);
+
+		///The inserted items are moved after the rebuild, so they are removed from the leafs of the rebuilt subtrees
+		for (UI1 i_1 = aItems.size() - nEdits, nItems = aItems.size(); i_1 < nItems; i_1 += 2)
+		{
+			const D3 shift(randomTest(-0.5, 0.5) * sizeBBox[0], randomTest(-0.5, 0.5) * sizeBBox[1], randomTest(-0.5, 0.5) * sizeBBox[2]);
+			aItems[i_1] = moveTestItem(aItems[i_1], shift);
+			tree.updateItem(i_1, aItems[i_1]);
+		}
+		nErrors += checkEditedTree(tree, aItems, aRemovedItems, aPoints);
+
+		printf("Edit errors : %zu, rebuilt leafs : %zu\n", nErrors, nRebuiltLeafs);
+	}
+}
+
+void testRefitTree(std::vector<char*>& aPFileNames)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangle> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+		C3DKDTree<CItemTriangle> tree(aItems, spltterNode, true);
+
+		///The refit with the other number of the vertices fails and keeps the KD Tree
+		UI1 nErrors = 0;
+		double costRelative = 0.;
+		std::vector<D3> aVertices(3 * aItems.size() - 1);
+		if (tree.refit(aVertices, spltterNode, costRelative) || tree.getNumItems() != aItems.size())
+			++nErrors;
+
+		///The vertices are moved by the smooth deformation, so the shared vertices of the triangles stay shared
+		const SBBox bBox = calcBBoxTestItems(aItems.data(), aItems.size());
+		const D3 sizeBBox(bBox.m_maxBB - bBox.m_minBB);
+		std::vector<D3> aPoints;
+		aVertices.resize(3 * aItems.size());
+		for (UI1 iFrame = 1; iFrame <= 2; ++iFrame)
 		{
-			for (UI1 i_1 = 0, size = aRandomPoints[i].size(); i_1 < size; ++i_1)
+			for (UI1 i_1 = 0, nItems = aItems.size(); i_1 < nItems; ++i_1)
+			{
+				D3* const aMoved = &aVertices[3 * i_1];
+				for (UI1 k = 0; k < 3; ++k)
+				{
+					const D3 vx(aItems[i_1][k]);
+					for (UI1 dim = 0; dim < 3; ++dim)
+						aMoved[k][dim] = vx[dim] + 0.02 * sizeBBox[dim] * sin(static_cast<double>(iFrame) + 3. * (vx[(dim + 1) % 3] - bBox.m_minBB[(dim + 1) % 3]) / (sizeBBox[(dim + 1) % 3] + cEps));
+				}
+				aItems[i_1] = CItemTriangle(aMoved[0], aMoved[1], aMoved[2]);
+			}
+
+			if (!tree.refit(aVertices, spltterNode, costRelative) || !(costRelative > 0.) || memcmp(tree.getItems(), aItems.data(), aItems.size() * sizeof(CItemTriangle)) != 0)
+				++nErrors;
+
+			///The KD Tree above the bound is rebuilt, the refit without the moves distributes the items by their clipped parts, so its cost doesn't exceed the cost of the build
+			if (costRelative > cMaxCostRefitRebuild && !(tree.refit(spltterNode, DBL_MAX) <= 1.))
+				++nErrors;
+
+			generateTestPoints(aItems.data(), aItems.size(), cNumTestQueries, aPoints);
+			SKDTreeQueryScratch scratch;
+			for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
 			{
 				C3DKDTreeNearestItemINFO nearestItemINFO;
-				tree.findNearestItem(nearestItemINFO, aRandomPoints[i][i_1], i - 1);
-#ifdef USE_BRUTEFORCE_CMP
-				const double minDist = bruteForceFindNearest(aTr, aRandomPoints[i][i_1]);
-				if (cEps2 < fabs(nearestItemINFO.m_minDist - minDist))
-					throw;
-#endif
+				tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+				if (cEps < fabs(bruteForceFindNearest(aItems.data(), aItems.size(), aPoints[i_1]) - nearestItemINFO.m_minDist))
+					++nErrors;
 			}
 		}
-		clock_t endTime = clock();
 
-		printf("Time : %lf sec.\n", (static_cast<double>(endTime) - static_cast<double>(startTime)) / static_cast<double>(CLOCKS_PER_SEC));
+		///The small moves of the part of the mesh are refitted in place, so the refit of the frame is much cheaper than the build
+		const std::vector<D3> aVerticesStill(aVertices);
+		const double xMoved = bBox.m_maxBB[0] - cTestRefitMovedPart * sizeBBox[0];
+		clock_t refitTime = 0;
+		for (UI1 iFrame = 1; iFrame <= cNumTestRefitFrames; ++iFrame)
+		{
+			for (UI1 i_1 = 0, nItems = aItems.size(); i_1 < nItems; ++i_1)
+			{
+				D3* const aMoved = &aVertices[3 * i_1];
+				for (UI1 k = 0; k < 3; ++k)
+				{
+					const D3& vx = aVerticesStill[3 * i_1 + k];
+					if (vx[0] <= xMoved)
+						continue;
+
+					for (UI1 dim = 0; dim < 3; ++dim)
+						aMoved[k][dim] = vx[dim] + 0.002 * sizeBBox[dim] * sin(static_cast<double>(iFrame) + 3. * (vx[(dim + 1) % 3] - bBox.m_minBB[(dim + 1) % 3]) / (sizeBBox[(dim + 1) % 3] + cEps));
+				}
+				aItems[i_1] = CItemTriangle(aMoved[0], aMoved[1], aMoved[2]);
+			}
+
+			const clock_t startTime = clock();
+			if (!tree.refit(aVertices, spltterNode, costRelative) || !(costRelative > 0.))
+				++nErrors;
+			refitTime += clock() - startTime;
+		}
+
+		generateTestPoints(aItems.data(), aItems.size(), cNumTestQueries, aPoints);
+		SKDTreeQueryScratch scratch;
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+		{
+			C3DKDTreeNearestItemINFO nearestItemINFO;
+			tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+			if (cEps < fabs(bruteForceFindNearest(aItems.data(), aItems.size(), aPoints[i_1]) - nearestItemINFO.m_minDist))
+				++nErrors;
+		}
+
+		const clock_t startTime = clock();
+		C3DKDTree<CItemTriangle> treeBuilt(aItems, spltterNode, true);
+		const double buildTime = static_cast<double>(clock() - startTime) / static_cast<double>(CLOCKS_PER_SEC);
+		const double refitFrameTime = static_cast<double>(refitTime) / static_cast<double>(CLOCKS_PER_SEC) / static_cast<double>(cNumTestRefitFrames);
+		printf("Refit of the part time : %lf sec., build time : %lf sec., build / refit : %lf\n", refitFrameTime, buildTime, refitFrameTime > 0. ? buildTime / refitFrameTime : 0.);
+
+		///The leafs rebuilt after the refit don't hide the degradation of the refitted nodes, so the relative cost stays near its value before the edits
+		const double costRefitted = tree.refit(spltterNode, DBL_MAX);
+		const CItemTriangle itemCrowd = aItems[rand() % aItems.size()];
+		for (UI1 i_1 = 0, nEdits = std::min(cNumTestEditItems, aItems.size() / 4); i_1 < nEdits; ++i_1)
+		{
+			const D3 shift(randomTest(-0.01, 0.01) * sizeBBox[0], randomTest(-0.01, 0.01) * sizeBBox[1], randomTest(-0.01, 0.01) * sizeBBox[2]);
+			aItems.push_back(moveTestItem(itemCrowd, shift));
+			tree.insertItem(aItems.back());
+		}
+		const UI1 nRebuiltLeafs = tree.rebuildDegradedLeafs(spltterNode);
+		const double costEdited = tree.refit(spltterNode, DBL_MAX);
+		if (nRebuiltLeafs != 0 && !(fabs(costEdited - costRefitted) < 0.1 * costRefitted))
+			++nErrors;
+
+		printf("Refit errors : %zu, relative SAH cost : %f\n", nErrors, costRelative);
+	}
+}
+
+void testMortonTree(std::vector<char*>& aPFileNames)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangle> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		C3DKDTreeNodeSplitterSAH<CItemTriangle> spltterNode(true);
+		C3DKDTree<CItemTriangle> tree(aItems, spltterNode, true);
+
+		std::vector<D3> aPoints;
+		generateTestPoints(aItems.data(), aItems.size(), cNumTestQueries, aPoints);
+		const UI1 k = std::min(cNumTestNearestItems, aItems.size());
+
+		///The KD Trees of the Morton builds differ from the KD Tree of the splitter, but their queries find the same distances, the ties can find the other items
+		const eKDTreeBuild aBuilds[2] = { eKDTreeBuildMorton, eKDTreeBuildMortonSplitterTop };
+		for (UI1 iBuild = 0; iBuild < 2; ++iBuild)
+		{
+			C3DKDTree<CItemTriangle> treeMorton(aItems, spltterNode, true, aBuilds[iBuild]);
+
+			SKDTreeQueryScratch scratch;
+			std::vector<C3DKDTreeNearestItemINFO> aNearestItemsINFO;
+			std::vector<C3DKDTreeNearestItemINFO> aNearestItemsINFOMorton;
+			UI1 nErrors = 0;
+			for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+			{
+				C3DKDTreeNearestItemINFO nearestItemINFO;
+				C3DKDTreeNearestItemINFO nearestItemINFOMorton;
+				tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+				treeMorton.findNearestItem(nearestItemINFOMorton, aPoints[i_1], scratch);
+				bool bError = cEps < fabs(nearestItemINFO.m_minDist - nearestItemINFOMorton.m_minDist);
+
+				tree.findKNearestItems(aNearestItemsINFO, aPoints[i_1], k, DBL_MAX, scratch);
+				treeMorton.findKNearestItems(aNearestItemsINFOMorton, aPoints[i_1], k, DBL_MAX, scratch);
+				bError = bError || aNearestItemsINFO.size() != aNearestItemsINFOMorton.size();
+				for (UI1 i_2 = 0, nFound = std::min(aNearestItemsINFO.size(), aNearestItemsINFOMorton.size()); i_2 < nFound; ++i_2)
+					bError = bError || cEps < fabs(aNearestItemsINFO[i_2].m_minDist - aNearestItemsINFOMorton[i_2].m_minDist);
+
+				///The ray goes from the point to the center of the random item or to the random direction
+				D3 dir(randomTest(-1., 1.), randomTest(-1., 1.), randomTest(-1., 1.));
+				if (i_1 % 2 == 0)
+					dir = aItems[rand() % aItems.size()].calcBBoxItem().calcMid() - aPoints[i_1];
+
+				C3DKDTreeRayHitINFO hitINFO;
+				C3DKDTreeRayHitINFO hitINFOMorton;
+				const bool bHit = tree.findFirstHit(hitINFO, aPoints[i_1], dir, DBL_MAX, scratch);
+				const bool bHitMorton = treeMorton.findFirstHit(hitINFOMorton, aPoints[i_1], dir, DBL_MAX, scratch);
+				bError = bError || bHit != bHitMorton || (bHit && cEps < fabs(hitINFO.m_t - hitINFOMorton.m_t)) ||
+					bHit != treeMorton.findAnyHit(aPoints[i_1], dir, DBL_MAX, scratch);
+
+				if (bError)
+					++nErrors;
+			}
+
+			printf("%s build errors : %zu\n", aBuilds[iBuild] == eKDTreeBuildMorton ? "Morton" : "Morton with the splitter on the top", nErrors);
+		}
+	}
+}
+
+void testIndexedTree(std::vector<char*>& aPFileNames)
+{
+	srand(1);
+	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
+	{
+		printf("%s :\n", aPFileNames[i]);
+		std::vector<D3> aVx;
+		std::vector<CItemTriangleIndexed> aItems;
+		if (!readTestMesh(aPFileNames[i], aVx, aItems))
+			continue;
+
+		///The items are moved into the KD Tree, so it keeps the array of the reader and the triangles keep pointing into aVx
+		const CItemTriangleIndexed* const pItems = aItems.data();
+		C3DKDTreeNodeSplitterSAH<CItemTriangleIndexed> spltterNode(true);
+		C3DKDTree<CItemTriangleIndexed> tree(std::move(aItems), spltterNode, true);
+		UI1 nErrors = tree.getItems() == pItems && aItems.empty() ? 0 : 1;
+
+		std::vector<D3> aPoints;
+		generateTestPoints(tree.getItems(), tree.getNumItems(), cNumTestQueries, aPoints);
+
+		SKDTreeQueryScratch scratch;
+		for (UI1 i_1 = 0, nPoints = aPoints.size(); i_1 < nPoints; ++i_1)
+		{
+			C3DKDTreeNearestItemINFO nearestItemINFO;
+			tree.findNearestItem(nearestItemINFO, aPoints[i_1], scratch);
+			const double minDist = bruteForceFindNearest(tree.getItems(), tree.getNumItems(), aPoints[i_1]);
+			if (cEps < fabs(nearestItemINFO.m_minDist - minDist) ||
+				cEps < fabs(tree.getItems()[nearestItemINFO.m_idItem].calcDist2(aPoints[i_1]) - nearestItemINFO.m_minDist2))
+				++nErrors;
+		}
+
+		printf("Indexed triangles errors : %zu\n", nErrors);
 	}
 }
 
@@ -232,8 +1637,24 @@ int main()
 {
 	std::vector<char*> aPFileNames;
 	readAllTestsNames("tests/All.test", aPFileNames);
+	testReadMesh();
 	testBuildTree(aPFileNames);
-	//testFindNearestItem(aPFileNames);
+	testSweepSplitter(aPFileNames);
+	testFindNearestItem(aPFileNames);
+	testFindNearestItems(aPFileNames);
+	testFindKNearestItems(aPFileNames);
+	testFindItemsInRadius(aPFileNames);
+	testFindHits(aPFileNames);
+	testFindItemsOverlap(aPFileNames);
+	testDistTrianglesSIMD();
+	testDistTriangleSlivers();
+	testFindNearestFeature(aPFileNames);
+	testFindSignedDist();
+	testSavedTree(aPFileNames);
+	testEditTree(aPFileNames);
+	testRefitTree(aPFileNames);
+	testMortonTree(aPFileNames);
+	testIndexedTree(aPFileNames);
 	for (UI1 i = 0, size = aPFileNames.size(); i < size; ++i)
 		free(static_cast<void*>(aPFileNames[i]));
 }
\ No newline at end of file
@@ -0,0 +1,447 @@
+#include "const.h"
+#include "math_simd.h"
+#include "math_util.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define USE_SIMD_X86
+#endif
+
+#ifdef USE_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+///The intrinsics of MSVC don't need the instruction set of the function
+#define SIMD_TARGET_AVX
+#define SIMD_TARGET_SSE2
+#else
+#define SIMD_TARGET_AVX __attribute__((target("avx")))
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+#endif
+
+///<summary>Precomputes the triangle</summary>
+///<remarks>In : A - 1st point of the triangle</remarks>
+///<remarks>In : B - 2nd point of the triangle</remarks>
+///<remarks>In : C - 3rd point of the triangle</remarks>
+void STrianglePrecomputed::setTriangle(const D3& A, const D3& B, const D3& C)
+{
+	D3 vxA = A;
+	D3 E0 = B - A;
+	D3 E1 = C - A;
+
+	double a = E0 * E0;
+	double b = E0 * E1;
+	double c = E1 * E1;
+	const double det = a * c - b * b;
+
+	///The degenerate triangle is the longest of its edges as in math::distToTriangle2, both edges from A are the segment and the edge BC is its end point
+	const bool bDegenerate = det <= cEps2 * a * c;
+	if (bDegenerate)
+	{
+		const double e2 = (C - B).norm2();
+		vxA = (a >= c && a >= e2) || c >= e2 ? A : B;
+		E0 = (a >= c && a >= e2 ? B : C) - vxA;
+		E1 = E0;
+		a = b = c = E0 * E0;
+	}
+
+	for (UI1 dim = 0; dim < 3; ++dim)
+	{
+		m_aField[eTriangleFieldAX + dim] = vxA[dim];
+		m_aField[eTriangleFieldE0X + dim] = E0[dim];
+		m_aField[eTriangleFieldE1X + dim] = E1[dim];
+	}
+
+	m_aField[eTriangleFieldA] = a;
+	m_aField[eTriangleFieldB] = b;
+	m_aField[eTriangleFieldC] = c;
+
+	const double e2 = (E1 - E0).norm2();
+	m_aField[eTriangleFieldInvDet] = bDegenerate ? 0. : 1. / det;
+	m_aField[eTriangleFieldInvA] = a > 0. ? 1. / a : 0.;
+	m_aField[eTriangleFieldInvC] = c > 0. ? 1. / c : 0.;
+	m_aField[eTriangleFieldInvE2] = e2 > 0. ? 1. / e2 : 0.;
+}
+
+namespace math
+{
+	///<summary>The kernel of the minimal square of the distance from the point to the triangles</summary>
+	typedef double(*TMinDist2Triangles)(const STrianglePrecomputed* aTriangles, const UI4* pIDTriangles, const UI1 nTriangles, const D3& point, UI1& iMin);
+
+	///<summary>Calculates the minimal square of the distance from the point to the triangles one by one</summary>
+	///<remarks>The nearest point is the projection of the point into the triangle or the nearest point of one of the edges</remarks>
+	///<remarks>In : aTriangles - The precomputed triangles</remarks>
+	///<remarks>In : pIDTriangles - Ids of the triangles for which we are calculating the distance</remarks>
+	///<remarks>In : nTriangles - The number of the ids</remarks>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : iMin - Position of the id of the nearest triangle, it's not changed if there are no ids</remarks>
+	///<returns>The minimal square of the distance, DBL_MAX if there are no ids</returns>
+	static double calcMinDist2TrianglesScalar(const STrianglePrecomputed* aTriangles, const UI4* pIDTriangles, const UI1 nTriangles, const D3& point, UI1& iMin)
+	{
+		double minDist2 = DBL_MAX;
+		for (UI1 i = 0; i < nTriangles; ++i)
+		{
+			const double* const aField = aTriangles[pIDTriangles[i]].m_aField;
+
+			///PA = P - A
+			const double pax = point[0] - aField[eTriangleFieldAX];
+			const double pay = point[1] - aField[eTriangleFieldAY];
+			const double paz = point[2] - aField[eTriangleFieldAZ];
+			const double e0x = aField[eTriangleFieldE0X];
+			const double e0y = aField[eTriangleFieldE0Y];
+			const double e0z = aField[eTriangleFieldE0Z];
+			const double e1x = aField[eTriangleFieldE1X];
+			const double e1y = aField[eTriangleFieldE1Y];
+			const double e1z = aField[eTriangleFieldE1Z];
+
+			const double d0 = e0x * pax + e0y * pay + e0z * paz;
+			const double d1 = e1x * pax + e1y * pay + e1z * paz;
+
+			///The projection into the plane of the triangle
+			const double invDet = aField[eTriangleFieldInvDet];
+			const double s = (aField[eTriangleFieldC] * d0 - aField[eTriangleFieldB] * d1) * invDet;
+			const double t = (aField[eTriangleFieldA] * d1 - aField[eTriangleFieldB] * d0) * invDet;
+
+			double dist2;
+			if (invDet > 0. && s >= 0. && t >= 0. && s + t <= 1.)
+			{
+				const double x = s * e0x + t * e1x - pax;
+				const double y = s * e0y + t * e1y - pay;
+				const double z = s * e0z + t * e1z - paz;
+				dist2 = x * x + y * y + z * z;
+			}
+			else
+			{
+				///Edge AB
+				double u = max2(0., min2(1., d0 * aField[eTriangleFieldInvA]));
+				double x = u * e0x - pax;
+				double y = u * e0y - pay;
+				double z = u * e0z - paz;
+				dist2 = x * x + y * y + z * z;
+
+				///Edge AC
+				u = max2(0., min2(1., d1 * aField[eTriangleFieldInvC]));
+				x = u * e1x - pax;
+				y = u * e1y - pay;
+				z = u * e1z - paz;
+				dist2 = min2(dist2, x * x + y * y + z * z);
+
+				///Edge BC : E2 = E1 - E0, PB = PA - E0
+				const double e2x = e1x - e0x;
+				const double e2y = e1y - e0y;
+				const double e2z = e1z - e0z;
+				const double pbx = pax - e0x;
+				const double pby = pay - e0y;
+				const double pbz = paz - e0z;
+				u = max2(0., min2(1., (e2x * pbx + e2y * pby + e2z * pbz) * aField[eTriangleFieldInvE2]));
+				x = u * e2x - pbx;
+				y = u * e2y - pby;
+				z = u * e2z - pbz;
+				dist2 = min2(dist2, x * x + y * y + z * z);
+			}
+
+			if (dist2 < minDist2)
+			{
+				minDist2 = dist2;
+				iMin = i;
+			}
+		}
+
+		return minDist2;
+	}
+
+#ifdef USE_SIMD_X86
+	///<summary>Loads the field of 2 triangles into the lanes of the register</summary>
+	SIMD_TARGET_SSE2 static inline __m128d loadField(const double* const(&apField)[2], const eTriangleField field)
+	{
+		return _mm_set_pd(apField[1][field], apField[0][field]);
+	}
+
+	///<summary>Calculates the square of the distance from the point to the point u * E of the edge</summary>
+	///<remarks>In : u - Parameter of the point of the edge</remarks>
+	///<remarks>In : ex, ey, ez - The edge</remarks>
+	///<remarks>In : px, py, pz - The point from the start of the edge</remarks>
+	SIMD_TARGET_SSE2 static inline __m128d calcDist2Edge(const __m128d u, const __m128d ex, const __m128d ey, const __m128d ez,
+		const __m128d px, const __m128d py, const __m128d pz)
+	{
+		const __m128d x = _mm_sub_pd(_mm_mul_pd(u, ex), px);
+		const __m128d y = _mm_sub_pd(_mm_mul_pd(u, ey), py);
+		const __m128d z = _mm_sub_pd(_mm_mul_pd(u, ez), pz);
+		return _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z));
+	}
+
+	///<summary>Calculates the minimal square of the distance from the point to the triangles by 2 triangles at once(SSE2)</summary>
+	///<remarks>The regions are selected by the masks without the branches, the free lanes of the last step repeat the last triangle</remarks>
+	///<remarks>In : aTriangles - The precomputed triangles</remarks>
+	///<remarks>In : pIDTriangles - Ids of the triangles for which we are calculating the distance</remarks>
+	///<remarks>In : nTriangles - The number of the ids</remarks>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : iMin - Position of the id of the nearest triangle, it's not changed if there are no ids</remarks>
+	///<returns>The minimal square of the distance, DBL_MAX if there are no ids</returns>
+	SIMD_TARGET_SSE2 static double calcMinDist2TrianglesSSE2(const STrianglePrecomputed* aTriangles, const UI4* pIDTriangles, const UI1 nTriangles, const D3& point, UI1& iMin)
+	{
+		const __m128d px = _mm_set1_pd(point[0]);
+		const __m128d py = _mm_set1_pd(point[1]);
+		const __m128d pz = _mm_set1_pd(point[2]);
+		const __m128d zero = _mm_setzero_pd();
+		const __m128d one = _mm_set1_pd(1.);
+
+		double minDist2 = DBL_MAX;
+		for (UI1 i = 0; i < nTriangles; i += 2)
+		{
+			const double* const apField[2] =
+			{
+				aTriangles[pIDTriangles[i]].m_aField,
+				aTriangles[pIDTriangles[min2(i + 1, nTriangles - 1)]].m_aField
+			};
+
+			const __m128d e0x = loadField(apField, eTriangleFieldE0X);
+			const __m128d e0y = loadField(apField, eTriangleFieldE0Y);
+			const __m128d e0z = loadField(apField, eTriangleFieldE0Z);
+			const __m128d e1x = loadField(apField, eTriangleFieldE1X);
+			const __m128d e1y = loadField(apField, eTriangleFieldE1Y);
+			const __m128d e1z = loadField(apField, eTriangleFieldE1Z);
+
+			const __m128d pax = _mm_sub_pd(px, loadField(apField, eTriangleFieldAX));
+			const __m128d pay = _mm_sub_pd(py, loadField(apField, eTriangleFieldAY));
+			const __m128d paz = _mm_sub_pd(pz, loadField(apField, eTriangleFieldAZ));
+
+			const __m128d d0 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e0x, pax), _mm_mul_pd(e0y, pay)), _mm_mul_pd(e0z, paz));
+			const __m128d d1 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e1x, pax), _mm_mul_pd(e1y, pay)), _mm_mul_pd(e1z, paz));
+
+			///The projection into the plane of the triangle
+			const __m128d a = loadField(apField, eTriangleFieldA);
+			const __m128d b = loadField(apField, eTriangleFieldB);
+			const __m128d c = loadField(apField, eTriangleFieldC);
+			const __m128d invDet = loadField(apField, eTriangleFieldInvDet);
+			const __m128d s = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(c, d0), _mm_mul_pd(b, d1)), invDet);
+			const __m128d t = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(a, d1), _mm_mul_pd(b, d0)), invDet);
+			const __m128d maskInside = _mm_and_pd(_mm_and_pd(_mm_cmpgt_pd(invDet, zero), _mm_cmple_pd(_mm_add_pd(s, t), one)),
+				_mm_and_pd(_mm_cmpge_pd(s, zero), _mm_cmpge_pd(t, zero)));
+
+			const __m128d x = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(s, e0x), _mm_mul_pd(t, e1x)), pax);
+			const __m128d y = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(s, e0y), _mm_mul_pd(t, e1y)), pay);
+			const __m128d z = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(s, e0z), _mm_mul_pd(t, e1z)), paz);
+			const __m128d dist2Plane = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z));
+
+			///Edge AB
+			__m128d u = _mm_max_pd(zero, _mm_min_pd(one, _mm_mul_pd(d0, loadField(apField, eTriangleFieldInvA))));
+			__m128d dist2Edges = calcDist2Edge(u, e0x, e0y, e0z, pax, pay, paz);
+
+			///Edge AC
+			u = _mm_max_pd(zero, _mm_min_pd(one, _mm_mul_pd(d1, loadField(apField, eTriangleFieldInvC))));
+			dist2Edges = _mm_min_pd(dist2Edges, calcDist2Edge(u, e1x, e1y, e1z, pax, pay, paz));
+
+			///Edge BC : E2 = E1 - E0, PB = PA - E0
+			const __m128d e2x = _mm_sub_pd(e1x, e0x);
+			const __m128d e2y = _mm_sub_pd(e1y, e0y);
+			const __m128d e2z = _mm_sub_pd(e1z, e0z);
+			const __m128d pbx = _mm_sub_pd(pax, e0x);
+			const __m128d pby = _mm_sub_pd(pay, e0y);
+			const __m128d pbz = _mm_sub_pd(paz, e0z);
+			const __m128d d2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e2x, pbx), _mm_mul_pd(e2y, pby)), _mm_mul_pd(e2z, pbz));
+			u = _mm_max_pd(zero, _mm_min_pd(one, _mm_mul_pd(d2, loadField(apField, eTriangleFieldInvE2))));
+			dist2Edges = _mm_min_pd(dist2Edges, calcDist2Edge(u, e2x, e2y, e2z, pbx, pby, pbz));
+
+			const __m128d dist2 = _mm_or_pd(_mm_and_pd(maskInside, dist2Plane), _mm_andnot_pd(maskInside, dist2Edges));
+
+			double aDist2[2];
+			_mm_storeu_pd(aDist2, dist2);
+			for (UI1 j = 0; j < 2 && i + j < nTriangles; ++j)
+			{
+				if (aDist2[j] < minDist2)
+				{
+					minDist2 = aDist2[j];
+					iMin = i + j;
+				}
+			}
+		}
+
+		return minDist2;
+	}
+
+	///<summary>Loads the field of 4 triangles into the lanes of the register</summary>
+	SIMD_TARGET_AVX static inline __m256d loadField(const double* const(&apField)[4], const eTriangleField field)
+	{
+		return _mm256_set_pd(apField[3][field], apField[2][field], apField[1][field], apField[0][field]);
+	}
+
+	///<summary>Calculates the square of the distance from the point to the point u * E of the edge</summary>
+	///<remarks>In : u - Parameter of the point of the edge</remarks>
+	///<remarks>In : ex, ey, ez - The edge</remarks>
+	///<remarks>In : px, py, pz - The point from the start of the edge</remarks>
+	SIMD_TARGET_AVX static inline __m256d calcDist2Edge(const __m256d u, const __m256d ex, const __m256d ey, const __m256d ez,
+		const __m256d px, const __m256d py, const __m256d pz)
+	{
+		const __m256d x = _mm256_sub_pd(_mm256_mul_pd(u, ex), px);
+		const __m256d y = _mm256_sub_pd(_mm256_mul_pd(u, ey), py);
+		const __m256d z = _mm256_sub_pd(_mm256_mul_pd(u, ez), pz);
+		return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+	}
+
+	///<summary>Calculates the minimal square of the distance from the point to the triangles by 4 triangles at once(AVX)</summary>
+	///<remarks>The regions are selected by the masks without the branches, the free lanes of the last step repeat the last triangle</remarks>
+	///<remarks>In : aTriangles - The precomputed triangles</remarks>
+	///<remarks>In : pIDTriangles - Ids of the triangles for which we are calculating the distance</remarks>
+	///<remarks>In : nTriangles - The number of the ids</remarks>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : iMin - Position of the id of the nearest triangle, it's not changed if there are no ids</remarks>
+	///<returns>The minimal square of the distance, DBL_MAX if there are no ids</returns>
+	SIMD_TARGET_AVX static double calcMinDist2TrianglesAVX(const STrianglePrecomputed* aTriangles, const UI4* pIDTriangles, const UI1 nTriangles, const D3& point, UI1& iMin)
+	{
+		const __m256d px = _mm256_set1_pd(point[0]);
+		const __m256d py = _mm256_set1_pd(point[1]);
+		const __m256d pz = _mm256_set1_pd(point[2]);
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d one = _mm256_set1_pd(1.);
+
+		double minDist2 = DBL_MAX;
+		for (UI1 i = 0; i < nTriangles; i += 4)
+		{
+			const double* const apField[4] =
+			{
+				aTriangles[pIDTriangles[i]].m_aField,
+				aTriangles[pIDTriangles[min2(i + 1, nTriangles - 1)]].m_aField,
+				aTriangles[pIDTriangles[min2(i + 2, nTriangles - 1)]].m_aField,
+				aTriangles[pIDTriangles[min2(i + 3, nTriangles - 1)]].m_aField
+			};
+
+			const __m256d e0x = loadField(apField, eTriangleFieldE0X);
+			const __m256d e0y = loadField(apField, eTriangleFieldE0Y);
+			const __m256d e0z = loadField(apField, eTriangleFieldE0Z);
+			const __m256d e1x = loadField(apField, eTriangleFieldE1X);
+			const __m256d e1y = loadField(apField, eTriangleFieldE1Y);
+			const __m256d e1z = loadField(apField, eTriangleFieldE1Z);
+
+			const __m256d pax = _mm256_sub_pd(px, loadField(apField, eTriangleFieldAX));
+			const __m256d pay = _mm256_sub_pd(py, loadField(apField, eTriangleFieldAY));
+			const __m256d paz = _mm256_sub_pd(pz, loadField(apField, eTriangleFieldAZ));
+
+			const __m256d d0 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e0x, pax), _mm256_mul_pd(e0y, pay)), _mm256_mul_pd(e0z, paz));
+			const __m256d d1 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, pax), _mm256_mul_pd(e1y, pay)), _mm256_mul_pd(e1z, paz));
+
+			///The projection into the plane of the triangle
+			const __m256d a = loadField(apField, eTriangleFieldA);
+			const __m256d b = loadField(apField, eTriangleFieldB);
+			const __m256d c = loadField(apField, eTriangleFieldC);
+			const __m256d invDet = loadField(apField, eTriangleFieldInvDet);
+			const __m256d s = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(c, d0), _mm256_mul_pd(b, d1)), invDet);
+			const __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(a, d1), _mm256_mul_pd(b, d0)), invDet);
+			const __m256d maskInside = _mm256_and_pd(
+				_mm256_and_pd(_mm256_cmp_pd(invDet, zero, _CMP_GT_OQ), _mm256_cmp_pd(_mm256_add_pd(s, t), one, _CMP_LE_OQ)),
+				_mm256_and_pd(_mm256_cmp_pd(s, zero, _CMP_GE_OQ), _mm256_cmp_pd(t, zero, _CMP_GE_OQ)));
+
+			const __m256d x = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(s, e0x), _mm256_mul_pd(t, e1x)), pax);
+			const __m256d y = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(s, e0y), _mm256_mul_pd(t, e1y)), pay);
+			const __m256d z = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(s, e0z), _mm256_mul_pd(t, e1z)), paz);
+			const __m256d dist2Plane = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+
+			///Edge AB
+			__m256d u = _mm256_max_pd(zero, _mm256_min_pd(one, _mm256_mul_pd(d0, loadField(apField, eTriangleFieldInvA))));
+			__m256d dist2Edges = calcDist2Edge(u, e0x, e0y, e0z, pax, pay, paz);
+
+			///Edge AC
+			u = _mm256_max_pd(zero, _mm256_min_pd(one, _mm256_mul_pd(d1, loadField(apField, eTriangleFieldInvC))));
+			dist2Edges = _mm256_min_pd(dist2Edges, calcDist2Edge(u, e1x, e1y, e1z, pax, pay, paz));
+
+			///Edge BC : E2 = E1 - E0, PB = PA - E0
+			const __m256d e2x = _mm256_sub_pd(e1x, e0x);
+			const __m256d e2y = _mm256_sub_pd(e1y, e0y);
+			const __m256d e2z = _mm256_sub_pd(e1z, e0z);
+			const __m256d pbx = _mm256_sub_pd(pax, e0x);
+			const __m256d pby = _mm256_sub_pd(pay, e0y);
+			const __m256d pbz = _mm256_sub_pd(paz, e0z);
+			const __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, pbx), _mm256_mul_pd(e2y, pby)), _mm256_mul_pd(e2z, pbz));
+			u = _mm256_max_pd(zero, _mm256_min_pd(one, _mm256_mul_pd(d2, loadField(apField, eTriangleFieldInvE2))));
+			dist2Edges = _mm256_min_pd(dist2Edges, calcDist2Edge(u, e2x, e2y, e2z, pbx, pby, pbz));
+
+			const __m256d dist2 = _mm256_blendv_pd(dist2Edges, dist2Plane, maskInside);
+
+			double aDist2[4];
+			_mm256_storeu_pd(aDist2, dist2);
+			for (UI1 j = 0; j < 4 && i + j < nTriangles; ++j)
+			{
+				if (aDist2[j] < minDist2)
+				{
+					minDist2 = aDist2[j];
+					iMin = i + j;
+				}
+			}
+		}
+
+		return minDist2;
+	}
+
+	///<summary>Checks that the processor and the OS support AVX</summary>
+	///<returns>True if AVX is supported, otherwise false</returns>
+	static bool isSupportedAVX()
+	{
+#ifdef _MSC_VER
+		int aInfo[4];
+		__cpuid(aInfo, 1);
+
+		///The OS saves the AVX registers(OSXSAVE and XCR0)
+		const bool bOSXSAVE = (aInfo[2] & (1 << 27)) != 0;
+		const bool bAVX = (aInfo[2] & (1 << 28)) != 0;
+		return bOSXSAVE && bAVX && (_xgetbv(0) & 6) == 6;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx") != 0;
+#endif
+	}
+#endif
+
+	///<summary>Chooses the instruction set of the kernels by the processor</summary>
+	///<returns>The instruction set of the kernels</returns>
+	static eSIMDLevel selectSIMDLevel()
+	{
+#ifdef USE_SIMD_X86
+		if (isSupportedAVX())
+			return eSIMDLevelAVX;
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		return eSIMDLevelSSE2;
+#endif
+#endif
+		return eSIMDLevelScalar;
+	}
+
+	///<summary>Gets the instruction set of the kernels, it's chosen by the processor once</summary>
+	///<returns>The instruction set of the kernels</returns>
+	eSIMDLevel getSIMDLevel()
+	{
+		static const eSIMDLevel simdLevel = selectSIMDLevel();
+		return simdLevel;
+	}
+
+	///<summary>Gets the kernel for the instruction set</summary>
+	///<remarks>In : simdLevel - The instruction set of the kernel</remarks>
+	///<returns>The kernel</returns>
+	static TMinDist2Triangles getKernelMinDist2Triangles(const eSIMDLevel simdLevel)
+	{
+		switch (simdLevel)
+		{
+#ifdef USE_SIMD_X86
+		case eSIMDLevelAVX:
+			return calcMinDist2TrianglesAVX;
+		case eSIMDLevelSSE2:
+			return calcMinDist2TrianglesSSE2;
+#endif
+		default:
+			return calcMinDist2TrianglesScalar;
+		}
+	}
+
+	///<summary>Calculates the minimal square of the distance from the point to the triangles</summary>
+	///<remarks>In : aTriangles - The precomputed triangles</remarks>
+	///<remarks>In : pIDTriangles - Ids of the triangles for which we are calculating the distance</remarks>
+	///<remarks>In : nTriangles - The number of the ids</remarks>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : iMin - Position of the id of the nearest triangle, it's not changed if there are no ids</remarks>
+	///<returns>The minimal square of the distance, DBL_MAX if there are no ids</returns>
+	double calcMinDist2Triangles(const STrianglePrecomputed* aTriangles, const UI4* pIDTriangles, const UI1 nTriangles, const D3& point, UI1& iMin)
+	{
+		static const TMinDist2Triangles pKernel = getKernelMinDist2Triangles(getSIMDLevel());
+		return pKernel(aTriangles, pIDTriangles, nTriangles, point, iMin);
+	}
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include "struct_basic_types.h"
+
+///<summary>The fields of the precomputed triangle</summary>
+enum eTriangleField
+{
+	///<summary>The first vertex A</summary>
+	eTriangleFieldAX,
+	eTriangleFieldAY,
+	eTriangleFieldAZ,
+	///<summary>The edge E0 = B - A</summary>
+	eTriangleFieldE0X,
+	eTriangleFieldE0Y,
+	eTriangleFieldE0Z,
+	///<summary>The edge E1 = C - A</summary>
+	eTriangleFieldE1X,
+	eTriangleFieldE1Y,
+	eTriangleFieldE1Z,
+	///<summary>a = E0 * E0, b = E0 * E1, c = E1 * E1</summary>
+	eTriangleFieldA,
+	eTriangleFieldB,
+	eTriangleFieldC,
+	///<summary>1 / (a * c - b * b), it's 0 for the degenerate triangle which is stored as the segment</summary>
+	eTriangleFieldInvDet,
+	///<summary>The inverse squares of the lengths of the edges AB, AC and BC, they are 0 for the points</summary>
+	eTriangleFieldInvA,
+	eTriangleFieldInvC,
+	eTriangleFieldInvE2,
+
+	eTriangleFieldCount
+};
+
+///<summary>The triangle with the precomputed data of the distance from the point</summary>
+///<remarks>The vectorized kernels load the same field of the several triangles into the lanes of the register</remarks>
+///<remarks>The triangle is stored once per item, not per leaf : the triangle is in 13-15 leafs of the SAH KD Tree, so the blocks of the leafs would take 10 times more memory than the gathers save</remarks>
+struct STrianglePrecomputed
+{
+	///<summary>Precomputes the triangle</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	void setTriangle(const D3& A, const D3& B, const D3& C);
+
+	double m_aField[eTriangleFieldCount];
+};
+
+namespace math
+{
+	///<summary>The instruction sets of the vectorized kernels</summary>
+	enum eSIMDLevel
+	{
+		eSIMDLevelScalar,
+		eSIMDLevelSSE2,
+		eSIMDLevelAVX
+	};
+
+	///<summary>Gets the instruction set of the kernels, it's chosen by the processor once</summary>
+	///<returns>The instruction set of the kernels</returns>
+	eSIMDLevel getSIMDLevel();
+
+	///<summary>Calculates the minimal square of the distance from the point to the triangles</summary>
+	///<remarks>In : aTriangles - The precomputed triangles</remarks>
+	///<remarks>In : pIDTriangles - Ids of the triangles for which we are calculating the distance</remarks>
+	///<remarks>In : nTriangles - The number of the ids</remarks>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : iMin - Position of the id of the nearest triangle, it's not changed if there are no ids</remarks>
+	///<returns>The minimal square of the distance, DBL_MAX if there are no ids</returns>
+	double calcMinDist2Triangles(const STrianglePrecomputed* aTriangles, const UI4* pIDTriangles, const UI1 nTriangles, const D3& point, UI1& iMin);
+};
@@ -1,47 +1,89 @@
 #include "const.h"
 #include "math_util.h"
 
+#include <omp.h>
+
 namespace math
 {
-	///<summary>Calculates square of the distance from the point to the triangle</summary>
+	///<summary>Calculates square of the distance from the point to the segment and the parameter of the closest point</summary>
+	///<remarks>In : a - Start point of the segment</remarks>
+	///<remarks>In : b - End point of the segment</remarks>
+	///<remarks>In : point - The point for which we are looking for the distance to the segment</remarks>
+	///<remarks>Out : u - The parameter of the closest point a + (b - a) * u</remarks>
+	///<returns>Square of the distance between the point and the segment</returns>
+	static inline double distToSeg2(const D3& a, const D3& b, const D3& point, double& u)
+	{
+		const D3 ab = b - a;
+		const double segLen2 = ab.norm2();
+		if (segLen2 < cEps2)
+		{
+			u = 0.;
+			return (point - a).norm2();
+		}
+
+		u = max2(0., min2(1., ((point - a)* ab) / segLen2));
+		const D3 projPt = a + u * ab;
+
+		return (projPt - point).norm2();
+	}
+
+	///<summary>Calculates square of the distance from the point to the triangle and the closest point A + E0 * s + E1 * t</summary>
 	///<remarks>In : A - 1st point of the triangle</remarks>
 	///<remarks>In : B - 2nd point of the triangle</remarks>
 	///<remarks>In : C - 3rd point of the triangle</remarks>
 	///<remarks>In : P - The point for which we are looking for distance to the segment</remarks>
+	///<remarks>Out : s, t - The barycentric coordinates of the closest point by the edges E0 = B - A and E1 = C - A</remarks>
+	///<remarks>Out : bFace - True if the closest point is inside the triangle, otherwise it's on the edge or the vertex given by s and t</remarks>
 	///<returns>Square of the distance between the point and the triangle</returns>
-	double distToTriangle2(const D3& A, const D3& B, const D3& C, const D3& P)
+	static inline double distToTriangle2(const D3& A, const D3& B, const D3& C, const D3& P, double& s, double& t, bool& bFace)
 	{
 		const D3 E0 = B - A;
 		const D3 E1 = C - A;
 
 		const D3 D = A - P;
 		const double a = E0 * E0;
-
-		if (a < cEps2)
-			return math::distToSeg2(B, C, P);
-
 		const double b = E0 * E1;
 		const double c = E1 * E1;
-
-		if (c < cEps2)
-			return math::distToSeg2(B, C, P);
-
-		const double d = E0 * D;
-		const double e = E1 * D;
-		const double f = D * D;
-
 		const double det = a * c - b * b;
 
-		if (det < cEps2)
+		///det = a * c * sin^2 of the angle at A and it's rounded by about 1e-16 * a * c, so the triangle is the segment if the sine is below cEps.
+		///Such triangle is thinner than cEps of its edges. The relative test doesn't depend on the scale of the triangle,
+		///the absolute test det < cEps2 made every triangle with the edges below 1e-3.5 the segment.
+		///The collinear vertices and the points(a = 0 or c = 0) are the longest edge, it contains the third vertex
+		bFace = false;
+		if (det <= cEps2 * a * c)
 		{
-			if ((B - C).norm2() < cEps2)
-				return math::distToSeg2(A, C, P);
+			double u = 0.;
+			const double e2 = (C - B).norm2();
+			if (a >= c && a >= e2)
+			{
+				const double sqrDistance = distToSeg2(A, B, P, u);
+				s = u;
+				t = 0.;
+				return sqrDistance;
+			}
+			else if (c >= e2)
+			{
+				const double sqrDistance = distToSeg2(A, C, P, u);
+				s = 0.;
+				t = u;
+				return sqrDistance;
+			}
 			else
-				return math::distToSeg2(B, C, P);
+			{
+				const double sqrDistance = distToSeg2(B, C, P, u);
+				s = 1. - u;
+				t = u;
+				return sqrDistance;
+			}
 		}
 
-		double s = b * e - c * d;
-		double t = b * d - a * e;
+		const double d = E0 * D;
+		const double e = E1 * D;
+		const double f = D * D;
+
+		s = b * e - c * d;
+		t = b * d - a * e;
 
 		double sqrDistance = 0.;
 
@@ -137,6 +179,7 @@ namespace math
 				}
 				else
 				{
+					bFace = true;
 					s = s / det;
 					t = t / det;
 					sqrDistance = s * (a * s + b * t + 2. * d) + t * (b * s + c * t + 2. * e) + f;
@@ -270,6 +313,49 @@ namespace math
 		return sqrDistance;
 	}
 
+	///<summary>Calculates square of the distance from the point to the triangle</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : P - The point for which we are looking for distance to the segment</remarks>
+	///<returns>Square of the distance between the point and the triangle</returns>
+	double distToTriangle2(const D3& A, const D3& B, const D3& C, const D3& P)
+	{
+		double s = 0.;
+		double t = 0.;
+		bool bFace = false;
+		return distToTriangle2(A, B, C, P, s, t, bFace);
+	}
+
+	///<summary>Calculates square of the distance from the point to the triangle, its closest point and the feature which contains it</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : P - The point for which we are looking for distance to the segment</remarks>
+	///<remarks>Out : closestPoint - The closest point of the triangle</remarks>
+	///<remarks>Out : feature - The face, the edge or the vertex of the triangle which contains the closest point</remarks>
+	///<returns>Square of the distance between the point and the triangle</returns>
+	double distToTriangle2(const D3& A, const D3& B, const D3& C, const D3& P, D3& closestPoint, eTriangleFeature& feature)
+	{
+		double s = 0.;
+		double t = 0.;
+		bool bFace = false;
+		const double sqrDistance = distToTriangle2(A, B, C, P, s, t, bFace);
+
+		///The closest point is on the edges and the vertices when s and t are clamped to exactly 0 or 1
+		if (bFace)
+			feature = eTriangleFeatureFace;
+		else if (s == 0.)
+			feature = t == 0. ? eTriangleFeatureVertexA : (t == 1. ? eTriangleFeatureVertexC : eTriangleFeatureEdgeCA);
+		else if (t == 0.)
+			feature = s == 1. ? eTriangleFeatureVertexB : eTriangleFeatureEdgeAB;
+		else
+			feature = eTriangleFeatureEdgeBC;
+
+		closestPoint = A + (B - A) * s + (C - A) * t;
+		return sqrDistance;
+	}
+
 	///<summary>Calculates distance from the point to the triangle</summary>
 	///<remarks>In : A - 1st point of the triangle</remarks>
 	///<remarks>In : B - 2nd point of the triangle</remarks>
@@ -280,4 +366,332 @@ namespace math
 	{
 		return sqrt(distToTriangle2(A, B, C, P));
 	}
-};
\ No newline at end of file
+
+	///<summary>Clips the convex polygon by the plane of the axis</summary>
+	///<remarks>In : aIn - Vertices of the polygon</remarks>
+	///<remarks>In : nIn - The number of the vertices of the polygon</remarks>
+	///<remarks>Out : aOut - Vertices of the clipped polygon</remarks>
+	///<remarks>In : dim - Axis of the plane</remarks>
+	///<remarks>In : pos - Position of the plane</remarks>
+	///<remarks>In : bKeepLess - True if we keep the part where the coordinate is less than pos, otherwise the greater part</remarks>
+	///<returns>The number of the vertices of the clipped polygon</returns>
+	static UI1 clipPolygon(const D3* aIn, const UI1 nIn, D3* aOut, const UI1 dim, const double& pos, const bool bKeepLess)
+	{
+		UI1 nOut = 0;
+		for (UI1 i = 0; i < nIn; ++i)
+		{
+			const D3& a = aIn[i];
+			const D3& b = aIn[(i + 1) % nIn];
+
+			const double distA = bKeepLess ? pos - a[dim] : a[dim] - pos;
+			const double distB = bKeepLess ? pos - b[dim] : b[dim] - pos;
+
+			if (distA >= 0.)
+				aOut[nOut++] = a;
+
+			if ((distA >= 0.) != (distB >= 0.))
+			{
+				D3 intersection = a + (b - a) * (distA / (distA - distB));
+				intersection[dim] = pos;
+				aOut[nOut++] = intersection;
+			}
+		}
+		return nOut;
+	}
+
+	///<summary>Calculates the bounding box of the part of the triangle in the bounding box</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : bBox - The bounding box which clips the triangle</remarks>
+	///<remarks>Out : bBoxClipped - The bounding box of the clipped triangle</remarks>
+	///<returns>False if the triangle is out of the bounding box, otherwise true</returns>
+	bool clipTriangleBBox(const D3& A, const D3& B, const D3& C, const SBBox& bBox, SBBox& bBoxClipped)
+	{
+		///Every plane adds one vertex at most : 3 + 6
+		D3 aPolygon[2][9];
+		aPolygon[0][0] = A;
+		aPolygon[0][1] = B;
+		aPolygon[0][2] = C;
+
+		UI1 nVx = 3;
+		UI1 iIn = 0;
+		for (UI1 dim = 0; dim < 3 && nVx != 0; ++dim)
+		{
+			nVx = clipPolygon(aPolygon[iIn], nVx, aPolygon[1 - iIn], dim, bBox.m_minBB[dim] - cEps, false);
+			iIn = 1 - iIn;
+			if (nVx == 0)
+				break;
+
+			nVx = clipPolygon(aPolygon[iIn], nVx, aPolygon[1 - iIn], dim, bBox.m_maxBB[dim] + cEps, true);
+			iIn = 1 - iIn;
+		}
+
+		if (nVx == 0)
+			return false;
+
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			double minDim = DBL_MAX;
+			double maxDim = -DBL_MAX;
+			for (UI1 i = 0; i < nVx; ++i)
+			{
+				minDim = min2(minDim, aPolygon[iIn][i][dim]);
+				maxDim = max2(maxDim, aPolygon[iIn][i][dim]);
+			}
+
+			bBoxClipped.m_minBB[dim] = minDim;
+			bBoxClipped.m_maxBB[dim] = maxDim;
+		}
+
+		return true;
+	}
+
+	///<summary>Splits the triangle clipped by the planes of the axes into the parts on the both sides of the plane of the axis, the parts are extended by cEps over the plane as by clipTriangleBBox</summary>
+	///<remarks>The part of the clipped triangle is the clipped triangle too, so it has cMaxVxClippedTriangle vertices at most, only the degenerate part can get one more vertex</remarks>
+	///<remarks>In : aVx - Vertices of the clipped triangle</remarks>
+	///<remarks>In : nVx - The number of the vertices of the clipped triangle</remarks>
+	///<remarks>In : dim - Axis of the plane</remarks>
+	///<remarks>In : pos - Position of the plane</remarks>
+	///<remarks>Out : aVxLess - Vertices of the part where the coordinate isn't greater than pos + cEps</remarks>
+	///<remarks>Out : nVxLess - The number of the vertices of the part, 0 if it's empty</remarks>
+	///<remarks>Out : aVxGreater - Vertices of the part where the coordinate isn't less than pos - cEps</remarks>
+	///<remarks>Out : nVxGreater - The number of the vertices of the part, 0 if it's empty</remarks>
+	void splitClippedTriangle(const D3* aVx, const UI1 nVx, const UI1 dim, const double pos, D3* aVxLess, UI1& nVxLess, D3* aVxGreater, UI1& nVxGreater)
+	{
+		nVxLess = clipPolygon(aVx, nVx, aVxLess, dim, pos + cEps, true);
+		nVxGreater = clipPolygon(aVx, nVx, aVxGreater, dim, pos - cEps, false);
+	}
+
+	///<summary>Intersects the ray with the triangle by the Moller-Trumbore test, the edges of the triangle are extended by cEps in the barycentric coordinates</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+	///<remarks>Out : t - The parameter of the hit point</remarks>
+	///<returns>True if the ray hits the triangle at 0 <= t <= tMax, otherwise false</returns>
+	bool intersectRayTriangle(const D3& A, const D3& B, const D3& C, const D3& origin, const D3& dir, const double tMax, double& t)
+	{
+		const D3 E0 = B - A;
+		const D3 E1 = C - A;
+
+		///The ray is parallel to the plane of the triangle or the triangle is degenerate
+		const D3 P = dir % E1;
+		const double det = E0 * P;
+		if (det == 0.)
+			return false;
+
+		const double invDet = 1. / det;
+		const D3 D = origin - A;
+		const double u = (D * P) * invDet;
+		if (u < -cEps || u > 1. + cEps)
+			return false;
+
+		const D3 Q = D % E0;
+		const double v = (dir * Q) * invDet;
+		if (v < -cEps || u + v > 1. + cEps)
+			return false;
+
+		const double tHit = (E1 * Q) * invDet;
+		if (tHit < 0. || tHit > tMax)
+			return false;
+
+		t = tHit;
+		return true;
+	}
+
+	///<summary>Clips the ray by the bounding box, the bounding box is extended by cEps</summary>
+	///<remarks>In : bBox - The bounding box</remarks>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In/Out : tNear - The minimal parameter of the ray in the bounding box</remarks>
+	///<remarks>In/Out : tFar - The maximal parameter of the ray in the bounding box</remarks>
+	///<returns>False if the ray misses the bounding box, otherwise true</returns>
+	bool clipRayBBox(const SBBox& bBox, const D3& origin, const D3& dir, double& tNear, double& tFar)
+	{
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			const double minDim = bBox.m_minBB[dim] - cEps;
+			const double maxDim = bBox.m_maxBB[dim] + cEps;
+			if (dir[dim] == 0.)
+			{
+				if (origin[dim] < minDim || origin[dim] > maxDim)
+					return false;
+
+				continue;
+			}
+
+			const double invDir = 1. / dir[dim];
+			const double t0 = (minDim - origin[dim]) * invDir;
+			const double t1 = (maxDim - origin[dim]) * invDir;
+			tNear = max2(tNear, min2(t0, t1));
+			tFar = min2(tFar, max2(t0, t1));
+			if (tNear > tFar)
+				return false;
+		}
+
+		return true;
+	}
+
+	///<summary>Checks that the triangle overlaps the bounding box by the separating axis test, the touching triangle overlaps</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : bBox - The bounding box</remarks>
+	///<returns>True if the triangle overlaps the bounding box, otherwise false</returns>
+	bool isOverlapTriangleBBox(const D3& A, const D3& B, const D3& C, const SBBox& bBox)
+	{
+		///The triangle is moved into the center of the bounding box
+		const D3 center = bBox.calcMid();
+		const D3 halfSize = (bBox.m_maxBB - bBox.m_minBB) * 0.5;
+		const D3 aVx[3] = { A - center, B - center, C - center };
+
+		///The axes of the bounding box
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			if (min2(min2(aVx[0][dim], aVx[1][dim]), aVx[2][dim]) > halfSize[dim] ||
+				max2(max2(aVx[0][dim], aVx[1][dim]), aVx[2][dim]) < -halfSize[dim])
+				return false;
+		}
+
+		const D3 aEdges[3] = { aVx[1] - aVx[0], aVx[2] - aVx[1], aVx[0] - aVx[2] };
+
+		///The normal of the triangle
+		const D3 normal = aEdges[0] % aEdges[1];
+		const double radiusNormal = halfSize[0] * fabs(normal[0]) + halfSize[1] * fabs(normal[1]) + halfSize[2] * fabs(normal[2]);
+		if (fabs(normal * aVx[0]) > radiusNormal)
+			return false;
+
+		///The cross products of the edges of the triangle and the axes of the bounding box
+		for (UI1 iEdge = 0; iEdge < 3; ++iEdge)
+		{
+			for (UI1 dim = 0; dim < 3; ++dim)
+			{
+				D3 axisBBox(0., 0., 0.);
+				axisBBox[dim] = 1.;
+				const D3 axis = axisBBox % aEdges[iEdge];
+
+				const double p0 = axis * aVx[0];
+				const double p1 = axis * aVx[1];
+				const double p2 = axis * aVx[2];
+				const double radius = halfSize[0] * fabs(axis[0]) + halfSize[1] * fabs(axis[1]) + halfSize[2] * fabs(axis[2]);
+				if (min2(min2(p0, p1), p2) > radius || max2(max2(p0, p1), p2) < -radius)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	///<summary>Clips the convex polygon by the plane</summary>
+	///<remarks>In : aIn - Vertices of the polygon</remarks>
+	///<remarks>In : nIn - The number of the vertices of the polygon</remarks>
+	///<remarks>Out : aOut - Vertices of the clipped polygon</remarks>
+	///<remarks>In : normal - The outer normal of the plane, we keep the part where normal * x <= offset</remarks>
+	///<remarks>In : offset - The offset of the plane</remarks>
+	///<returns>The number of the vertices of the clipped polygon</returns>
+	static UI1 clipPolygonPlane(const D3* aIn, const UI1 nIn, D3* aOut, const D3& normal, const double offset)
+	{
+		UI1 nOut = 0;
+		for (UI1 i = 0; i < nIn; ++i)
+		{
+			const D3& a = aIn[i];
+			const D3& b = aIn[(i + 1) % nIn];
+
+			const double distA = offset - normal * a;
+			const double distB = offset - normal * b;
+
+			if (distA >= 0.)
+				aOut[nOut++] = a;
+
+			if ((distA >= 0.) != (distB >= 0.))
+				aOut[nOut++] = a + (b - a) * (distA / (distA - distB));
+		}
+		return nOut;
+	}
+
+	///<summary>Checks that the triangle overlaps the convex volume of the planes by the clipping of the triangle</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : aNormal - The outer normals of the planes, the volume is n * x <= offset for all planes</remarks>
+	///<remarks>In : aOffset - The offsets of the planes</remarks>
+	///<remarks>In : nPlanes - The number of the planes, at most cMaxClipPlanes</remarks>
+	///<returns>True if the triangle overlaps the volume, otherwise false</returns>
+	bool isOverlapTrianglePlanes(const D3& A, const D3& B, const D3& C, const D3* aNormal, const double* aOffset, const UI1 nPlanes)
+	{
+		///Each plane adds one vertex to the clipped triangle at most
+		D3 aPolygon[2][3 + cMaxClipPlanes];
+		aPolygon[0][0] = A;
+		aPolygon[0][1] = B;
+		aPolygon[0][2] = C;
+		UI1 nVx = 3;
+		UI1 iIn = 0;
+
+		for (UI1 iPlane = 0; iPlane < nPlanes; ++iPlane)
+		{
+			nVx = clipPolygonPlane(aPolygon[iIn], nVx, aPolygon[1 - iIn], aNormal[iPlane], aOffset[iPlane]);
+			iIn = 1 - iIn;
+			if (nVx == 0)
+				return false;
+		}
+
+		return true;
+	}
+
+	///<summary>Sorts the Morton codes with their ids by the radix sort, the equal codes keep the order of their ids</summary>
+	///<remarks>In/Out : aCodes - The pairs of the Morton code and the id</remarks>
+	///<remarks>In : bUseMultithread - The digits are counted and scattered by the threads over their ranges of the pairs</remarks>
+	void sortMortonCodes(std::vector<std::pair<UI8, UI4>>& aCodes, const bool bUseMultithread)
+	{
+		const I1 nCodes = static_cast<I1>(aCodes.size());
+		const I1 nThreads = bUseMultithread && nCodes >= static_cast<I1>(cNumElementsForParalell) ? omp_get_max_threads() : 1;
+
+		///The digits above the highest bit of the codes are zero, so they aren't sorted
+		UI8 bitsCodes = 0;
+		for (I1 i = 0; i < nCodes; ++i)
+			bitsCodes |= aCodes[i].first;
+
+		std::vector<std::pair<UI8, UI4>> aSorted(nCodes);
+		std::vector<UI1> aCounts(nThreads * cRadixSortBuckets);
+		for (UI1 shift = 0; shift < 64 && (bitsCodes >> shift) != 0; shift += cRadixSortBits)
+		{
+#pragma omp parallel num_threads(static_cast<int>(nThreads))
+			{
+				const I1 nTeam = omp_get_num_threads();
+				const I1 iThread = omp_get_thread_num();
+				const I1 begin = nCodes * iThread / nTeam;
+				const I1 end = nCodes * (iThread + 1) / nTeam;
+				UI1* pCounts = &aCounts[iThread * cRadixSortBuckets];
+
+				for (UI1 iBucket = 0; iBucket < cRadixSortBuckets; ++iBucket)
+					pCounts[iBucket] = 0;
+				for (I1 i = begin; i < end; ++i)
+					++pCounts[(aCodes[i].first >> shift) & (cRadixSortBuckets - 1)];
+
+#pragma omp barrier
+				///The counts become the positions of the buckets of the threads, the bucket of the thread follows the same bucket of the previous threads
+#pragma omp single
+				{
+					UI1 position = 0;
+					for (UI1 iBucket = 0; iBucket < cRadixSortBuckets; ++iBucket)
+					{
+						for (I1 iTeam = 0; iTeam < nTeam; ++iTeam)
+						{
+							const UI1 count = aCounts[iTeam * cRadixSortBuckets + iBucket];
+							aCounts[iTeam * cRadixSortBuckets + iBucket] = position;
+							position += count;
+						}
+					}
+				}
+
+				for (I1 i = begin; i < end; ++i)
+					aSorted[pCounts[(aCodes[i].first >> shift) & (cRadixSortBuckets - 1)]++] = aCodes[i];
+			}
+
+			aCodes.swap(aSorted);
+		}
+	}
+};
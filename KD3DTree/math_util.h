@@ -2,6 +2,20 @@
 #include "const.h"
 #include "struct_basic_types.h"
 
+#include <utility>
+
+///<summary>The features of the triangle ABC which can contain the closest point to the point</summary>
+enum eTriangleFeature
+{
+	eTriangleFeatureFace,
+	eTriangleFeatureVertexA,
+	eTriangleFeatureVertexB,
+	eTriangleFeatureVertexC,
+	eTriangleFeatureEdgeAB,
+	eTriangleFeatureEdgeBC,
+	eTriangleFeatureEdgeCA
+};
+
 namespace math
 {
 	///<returns>Random double-precission number in [min; max]</returns>
@@ -46,29 +60,102 @@ namespace math
 
 	///<summary>Calculates bounding box of the array of items</summary>
 	///<remarks>In : aItems - Array of the items, for which we are calculating the bounding box</remarks>
+	///<remarks>Out : aBBoxItems - Bounding boxes of every item</remarks>
 	///<returns>Bounding box of of the items into the array</returns>
 	template<typename T>
-	SBBox calcBBoxItems(const std::vector<T>& aItems)
+	SBBox calcBBoxItems(const std::vector<T>& aItems, std::vector<SBBox>& aBBoxItems)
 	{
 		SBBox bBoxItems;
+		bBoxItems.m_minBB = D3(DBL_MAX, DBL_MAX, DBL_MAX);
+		bBoxItems.m_maxBB = D3(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+
+		///The bounding box of the item is calculated on the fly, so it's calculated once and kept for the splitters
+		aBBoxItems.resize(aItems.size());
+		for (UI1 i = 0, nItems = aItems.size(); i < nItems; ++i)
+		{
+			const SBBox& bBoxItem = aBBoxItems[i] = aItems[i].calcBBoxItem();
+			for (UI1 dim = 0; dim < 3; ++dim)
+			{
+				if (bBoxItem.m_minBB[dim] < bBoxItems.m_minBB[dim])
+					bBoxItems.m_minBB[dim] = bBoxItem.m_minBB[dim];
+				if (bBoxItem.m_maxBB[dim] > bBoxItems.m_maxBB[dim])
+					bBoxItems.m_maxBB[dim] = bBoxItem.m_maxBB[dim];
+			}
+		}
+		return bBoxItems;
+	}
+
+	///<summary>Calculates the bounding box of the points</summary>
+	///<remarks>In : pPoints - Array of the points</remarks>
+	///<remarks>In : nPoints - The number of the points</remarks>
+	///<returns>Bounding box of the points</returns>
+	inline SBBox calcBBoxPoints(const D3* pPoints, const UI1 nPoints)
+	{
+		SBBox bBoxPoints;
 		for (UI1 dim = 0; dim < 3; ++dim)
 		{
 			double minDim = DBL_MAX;
 			double maxDim = -DBL_MAX;
-			for (UI1 i = 0, nItems = aItems.size(); i < nItems; ++i)
+			for (UI1 i = 0; i < nPoints; ++i)
 			{
-				const SBBox& bBoxItem = aItems[i].getBBoxItem();
-				if (bBoxItem.m_minBB[dim] < minDim)
-					minDim = bBoxItem.m_minBB[dim];
-				if (bBoxItem.m_maxBB[dim] > maxDim)
-					maxDim = bBoxItem.m_maxBB[dim];
+				minDim = min2(minDim, pPoints[i][dim]);
+				maxDim = max2(maxDim, pPoints[i][dim]);
 			}
-			bBoxItems.m_minBB[dim] = minDim;
-			bBoxItems.m_maxBB[dim] = maxDim;
+			bBoxPoints.m_minBB[dim] = minDim;
+			bBoxPoints.m_maxBB[dim] = maxDim;
 		}
-		return bBoxItems;
+		return bBoxPoints;
+	}
+
+	///<summary>Spreads the low 21 bits of the value, so there are two zero bits between them</summary>
+	///<remarks>In : x - The value</remarks>
+	///<returns>The spread bits of the value</returns>
+	inline UI8 spreadBitsMorton(UI8 x)
+	{
+		x &= cMortonMaxCoord;
+		x = (x | x << 32) & 0x1f00000000ffffULL;
+		x = (x | x << 16) & 0x1f0000ff0000ffULL;
+		x = (x | x << 8) & 0x100f00f00f00f00fULL;
+		x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+		x = (x | x << 2) & 0x1249249249249249ULL;
+		return x;
+	}
+
+	///<summary>Compacts every third bit of the value into the low 21 bits, it's the inverse of spreadBitsMorton</summary>
+	///<remarks>In : x - The spread bits</remarks>
+	///<returns>The compacted value</returns>
+	inline UI8 compactBitsMorton(UI8 x)
+	{
+		x &= 0x1249249249249249ULL;
+		x = (x | x >> 2) & 0x10c30c30c30c30c3ULL;
+		x = (x | x >> 4) & 0x100f00f00f00f00fULL;
+		x = (x | x >> 8) & 0x1f0000ff0000ffULL;
+		x = (x | x >> 16) & 0x1f00000000ffffULL;
+		x = (x | x >> 32) & cMortonMaxCoord;
+		return x;
+	}
+
+	///<summary>Calculates the Morton code of the point, the near points have the near codes mostly</summary>
+	///<remarks>In : point - The point</remarks>
+	///<remarks>In : bBox - The bounding box which is quantized by the code</remarks>
+	///<returns>The Morton code of the point(21 bits per axis)</returns>
+	inline UI8 calcMortonCode(const D3& point, const SBBox& bBox)
+	{
+		UI8 code = 0;
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			const double len = bBox.m_maxBB[dim] - bBox.m_minBB[dim];
+			const double t = len < cEps ? 0. : max2(0., min2(1., (point[dim] - bBox.m_minBB[dim]) / len));
+			code |= spreadBitsMorton(static_cast<UI8>(t * static_cast<double>(cMortonMaxCoord))) << dim;
+		}
+		return code;
 	}
 
+	///<summary>Sorts the Morton codes with their ids by the radix sort, the equal codes keep the order of their ids</summary>
+	///<remarks>In/Out : aCodes - The pairs of the Morton code and the id</remarks>
+	///<remarks>In : bUseMultithread - The digits are counted and scattered by the threads over their ranges of the pairs</remarks>
+	void sortMortonCodes(std::vector<std::pair<UI8, UI4>>& aCodes, const bool bUseMultithread);
+
 	///<summary>Calculates square of the distance from the point to the segment</summary>
 	///<remarks>In : a - Start point of the segment</remarks>
 	///<remarks>In : b - End point of the segment</remarks>
@@ -177,6 +264,16 @@ namespace math
 	///<returns>Square of the distance between the point and the triangle</returns>
 	double distToTriangle2(const D3& A, const D3& B, const D3& C, const D3& P);
 
+	///<summary>Calculates square of the distance from the point to the triangle, its closest point and the feature which contains it</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : P - The point for which we are looking for distance to the segment</remarks>
+	///<remarks>Out : closestPoint - The closest point of the triangle</remarks>
+	///<remarks>Out : feature - The face, the edge or the vertex of the triangle which contains the closest point</remarks>
+	///<returns>Square of the distance between the point and the triangle</returns>
+	double distToTriangle2(const D3& A, const D3& B, const D3& C, const D3& P, D3& closestPoint, eTriangleFeature& feature);
+
 	///<summary>Calculates distance from the point to the triangle</summary>
 	///<remarks>In : A - 1st point of the triangle</remarks>
 	///<remarks>In : B - 2nd point of the triangle</remarks>
@@ -184,4 +281,80 @@ namespace math
 	///<remarks>In : P - The point for which we are looking for distance to the segment</remarks>
 	///<returns>Distance between the point and the triangle</returns>
 	double distToTriangle(const D3& A, const D3& B, const D3& C, const D3& P);
+
+	///<summary>Calculates the bounding box of the part of the triangle in the bounding box</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : bBox - The bounding box which clips the triangle</remarks>
+	///<remarks>Out : bBoxClipped - The bounding box of the clipped triangle</remarks>
+	///<returns>False if the triangle is out of the bounding box, otherwise true</returns>
+	bool clipTriangleBBox(const D3& A, const D3& B, const D3& C, const SBBox& bBox, SBBox& bBoxClipped);
+
+	///<summary>Splits the triangle clipped by the planes of the axes into the parts on the both sides of the plane of the axis, the parts are extended by cEps over the plane as by clipTriangleBBox</summary>
+	///<remarks>The part of the clipped triangle is the clipped triangle too, so it has cMaxVxClippedTriangle vertices at most, only the degenerate part can get one more vertex</remarks>
+	///<remarks>In : aVx - Vertices of the clipped triangle</remarks>
+	///<remarks>In : nVx - The number of the vertices of the clipped triangle</remarks>
+	///<remarks>In : dim - Axis of the plane</remarks>
+	///<remarks>In : pos - Position of the plane</remarks>
+	///<remarks>Out : aVxLess - Vertices of the part where the coordinate isn't greater than pos + cEps</remarks>
+	///<remarks>Out : nVxLess - The number of the vertices of the part, 0 if it's empty</remarks>
+	///<remarks>Out : aVxGreater - Vertices of the part where the coordinate isn't less than pos - cEps</remarks>
+	///<remarks>Out : nVxGreater - The number of the vertices of the part, 0 if it's empty</remarks>
+	void splitClippedTriangle(const D3* aVx, const UI1 nVx, const UI1 dim, const double pos, D3* aVxLess, UI1& nVxLess, D3* aVxGreater, UI1& nVxGreater);
+
+	///<summary>Intersects the ray with the triangle by the Moller-Trumbore test, the edges of the triangle are extended by cEps in the barycentric coordinates</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+	///<remarks>Out : t - The parameter of the hit point</remarks>
+	///<returns>True if the ray hits the triangle at 0 <= t <= tMax, otherwise false</returns>
+	bool intersectRayTriangle(const D3& A, const D3& B, const D3& C, const D3& origin, const D3& dir, const double tMax, double& t);
+
+	///<summary>Clips the ray by the bounding box, the bounding box is extended by cEps</summary>
+	///<remarks>In : bBox - The bounding box</remarks>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In/Out : tNear - The minimal parameter of the ray in the bounding box</remarks>
+	///<remarks>In/Out : tFar - The maximal parameter of the ray in the bounding box</remarks>
+	///<returns>False if the ray misses the bounding box, otherwise true</returns>
+	bool clipRayBBox(const SBBox& bBox, const D3& origin, const D3& dir, double& tNear, double& tFar);
+
+	///<summary>Calculates the half of the surface area of the bounding box, it's the weight of the node in the SAH</summary>
+	///<returns>The half of the surface area of the bounding box</returns>
+	inline double calcHalfAreaBBox(const SBBox& bBox)
+	{
+		const D3 len = bBox.m_maxBB - bBox.m_minBB;
+		return len[0] * len[1] + len[0] * len[2] + len[1] * len[2];
+	}
+
+	///<summary>Checks that the bounding boxes overlap, the touching bounding boxes overlap</summary>
+	///<returns>True if the bounding boxes overlap, otherwise false</returns>
+	inline bool isOverlapBBoxes(const SBBox& bBoxA, const SBBox& bBoxB)
+	{
+		return (bBoxA.m_minBB[0] <= bBoxB.m_maxBB[0] && bBoxB.m_minBB[0] <= bBoxA.m_maxBB[0] &&
+			bBoxA.m_minBB[1] <= bBoxB.m_maxBB[1] && bBoxB.m_minBB[1] <= bBoxA.m_maxBB[1] &&
+			bBoxA.m_minBB[2] <= bBoxB.m_maxBB[2] && bBoxB.m_minBB[2] <= bBoxA.m_maxBB[2]);
+	}
+
+	///<summary>Checks that the triangle overlaps the bounding box by the separating axis test, the touching triangle overlaps</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : bBox - The bounding box</remarks>
+	///<returns>True if the triangle overlaps the bounding box, otherwise false</returns>
+	bool isOverlapTriangleBBox(const D3& A, const D3& B, const D3& C, const SBBox& bBox);
+
+	///<summary>Checks that the triangle overlaps the convex volume of the planes by the clipping of the triangle</summary>
+	///<remarks>In : A - 1st point of the triangle</remarks>
+	///<remarks>In : B - 2nd point of the triangle</remarks>
+	///<remarks>In : C - 3rd point of the triangle</remarks>
+	///<remarks>In : aNormal - The outer normals of the planes, the volume is n * x <= offset for all planes</remarks>
+	///<remarks>In : aOffset - The offsets of the planes</remarks>
+	///<remarks>In : nPlanes - The number of the planes, at most cMaxClipPlanes</remarks>
+	///<returns>True if the triangle overlaps the volume, otherwise false</returns>
+	bool isOverlapTrianglePlanes(const D3& A, const D3& B, const D3& C, const D3* aNormal, const double* aOffset, const UI1 nPlanes);
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "struct_arena.h"
+#include "struct_file.h"
+
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+void CMonotonicArena::addSlab(const UI1 size)
+{
+	///The slabs are the multiples of cArenaSlabSize, so the big slabs can be backed by the huge pages too
+	const UI1 sizeSlab = size <= cArenaSlabSize ? cArenaSlabSize : (size + cArenaSlabSize - 1) / cArenaSlabSize * cArenaSlabSize;
+	m_aSlabs.reserve(m_aSlabs.size() + 1);
+
+#ifdef _WIN32
+	///The large pages of Windows need the privilege of the user, so the slab is committed by the regular pages
+	char* pData = static_cast<char*>(VirtualAlloc(nullptr, sizeSlab, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+	if (pData == nullptr)
+		throw CExceptionMemoryError("Can't allocate memory ...");
+#else
+	void* pMapping = mmap(nullptr, sizeSlab, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pMapping == MAP_FAILED)
+		throw CExceptionMemoryError("Can't allocate memory ...");
+#ifdef MADV_HUGEPAGE
+	madvise(pMapping, sizeSlab, MADV_HUGEPAGE);
+#endif
+	char* pData = static_cast<char*>(pMapping);
+#endif
+
+	SSlab slab;
+	slab.m_pData = pData;
+	slab.m_size = sizeSlab;
+	m_aSlabs.push_back(slab);
+
+	m_pCurrent = pData;
+	m_pEnd = pData + sizeSlab;
+}
+
+void CMonotonicArena::clear()
+{
+	for (UI1 i = 0, nSlabs = m_aSlabs.size(); i < nSlabs; ++i)
+	{
+#ifdef _WIN32
+		VirtualFree(m_aSlabs[i].m_pData, 0, MEM_RELEASE);
+#else
+		munmap(m_aSlabs[i].m_pData, m_aSlabs[i].m_size);
+#endif
+	}
+
+	m_aSlabs.clear();
+	m_pCurrent = nullptr;
+	m_pEnd = nullptr;
+	m_sizeUsed = 0;
+}
+
+UI1 CMonotonicArena::getSizeReserved() const
+{
+	UI1 size = 0;
+	for (UI1 i = 0, nSlabs = m_aSlabs.size(); i < nSlabs; ++i)
+		size += m_aSlabs[i].m_size;
+	return size;
+}
+
+void* allocateCacheLine(const UI1 size)
+{
+#ifdef _WIN32
+	void* pData = _aligned_malloc(size, cCacheLineSize);
+#else
+	void* pData = nullptr;
+	if (posix_memalign(&pData, cCacheLineSize, size) != 0)
+		pData = nullptr;
+#endif
+	if (pData == nullptr)
+		throw std::bad_alloc();
+
+	return pData;
+}
+
+void freeCacheLine(void* const pData)
+{
+#ifdef _WIN32
+	_aligned_free(pData);
+#else
+	free(pData);
+#endif
+}
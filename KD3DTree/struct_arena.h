@@ -0,0 +1,172 @@
+#pragma once
+#include "const.h"
+#include "struct_basic_types.h"
+
+#include <new>
+#include <type_traits>
+#include <vector>
+
+///<summary>The monotonic arena of the memory, it's allocated by the big slabs and all memory is released at once</summary>
+///<remarks>The objects of the arena aren't destroyed, so only the trivially destructible objects are created in it</remarks>
+///<remarks>The arena isn't shared by the threads, every thread allocates from its own arena</remarks>
+class CMonotonicArena
+{
+	CMonotonicArena(const CMonotonicArena& arena);
+	CMonotonicArena& operator=(const CMonotonicArena& arena);
+public:
+	CMonotonicArena() : m_pCurrent(nullptr), m_pEnd(nullptr), m_sizeUsed(0)
+	{
+
+	}
+
+	CMonotonicArena(CMonotonicArena&& arena) : m_aSlabs(std::move(arena.m_aSlabs)), m_pCurrent(arena.m_pCurrent), m_pEnd(arena.m_pEnd), m_sizeUsed(arena.m_sizeUsed)
+	{
+		arena.m_pCurrent = nullptr;
+		arena.m_pEnd = nullptr;
+		arena.m_sizeUsed = 0;
+	}
+
+	~CMonotonicArena()
+	{
+		clear();
+	}
+
+	///<summary>Allocates the memory from the current slab, the new slab is allocated if the current slab hasn't enough memory</summary>
+	///<remarks>The exception CExceptionMemoryError is thrown if the slab can't be allocated</remarks>
+	///<remarks>In : size - The size of the memory in bytes</remarks>
+	///<remarks>In : alignment - The alignment of the memory, it's the power of 2 which is not more than the size of the page</remarks>
+	///<returns>The pointer to the memory</returns>
+	void* allocate(const UI1 size, const UI1 alignment)
+	{
+		char* pData = alignPointer(m_pCurrent, alignment);
+		if (pData == nullptr || pData + size > m_pEnd)
+		{
+			addSlab(size);
+			pData = m_pCurrent;
+		}
+
+		m_pCurrent = pData + size;
+		m_sizeUsed += size;
+		return pData;
+	}
+
+	///<summary>Allocates the not initialized array</summary>
+	///<remarks>In : n - The number of the elements of the array</remarks>
+	///<returns>The pointer to the first element of the array</returns>
+	template<typename U>
+	U* allocateArray(const UI1 n)
+	{
+		static_assert(std::is_trivially_destructible<U>::value, "The elements of the arena aren't destroyed");
+		return static_cast<U*>(allocate(n * sizeof(U), alignof(U)));
+	}
+
+	///<summary>Creates the object by the default constructor</summary>
+	///<returns>The pointer to the object</returns>
+	template<typename U>
+	U* create()
+	{
+		static_assert(std::is_trivially_destructible<U>::value, "The objects of the arena aren't destroyed");
+		return new (allocate(sizeof(U), alignof(U))) U();
+	}
+
+	///<summary>Makes the current slab big enough, so the next allocations of the size don't allocate the slabs</summary>
+	///<remarks>In : size - The size of the memory in bytes</remarks>
+	void reserve(const UI1 size)
+	{
+		if (m_pCurrent == nullptr || m_pCurrent + size > m_pEnd)
+			addSlab(size);
+	}
+
+	///<summary>Releases all slabs, the pointers to the objects of the arena become invalid</summary>
+	void clear();
+
+	///<returns>The number of the allocated bytes without the padding</returns>
+	UI1 getSizeUsed() const
+	{
+		return m_sizeUsed;
+	}
+
+	///<returns>The number of the bytes of all slabs</returns>
+	UI1 getSizeReserved() const;
+
+	///<returns>The number of the slabs, the arena allocated the memory after its reserve if it has more than one slab</returns>
+	UI1 getNumSlabs() const
+	{
+		return m_aSlabs.size();
+	}
+
+private:
+	///<summary>Aligns the pointer up</summary>
+	///<returns>The aligned pointer, nullptr for nullptr</returns>
+	static char* alignPointer(char* const p, const UI1 alignment)
+	{
+		return reinterpret_cast<char*>((reinterpret_cast<UI1>(p) + alignment - 1) & ~(alignment - 1));
+	}
+
+	///<summary>Allocates the new slab and makes it current, the rest of the previous slab isn't used</summary>
+	///<remarks>In : size - The size of the memory which must fit into the slab, the slab is bigger than cArenaSlabSize for the big memory</remarks>
+	void addSlab(const UI1 size);
+
+	struct SSlab
+	{
+		char* m_pData;
+		UI1 m_size;
+	};
+
+	///<summary>The slabs of the arena, the last slab is current</summary>
+	std::vector<SSlab> m_aSlabs;
+	///<summary>The first free byte and the end of the current slab</summary>
+	char* m_pCurrent;
+	char* m_pEnd;
+	UI1 m_sizeUsed;
+};
+
+///<summary>Allocates the memory which starts at the cache line</summary>
+///<remarks>The exception std::bad_alloc is thrown if the memory can't be allocated</remarks>
+///<remarks>In : size - The size of the memory in bytes</remarks>
+///<returns>The pointer to the memory</returns>
+void* allocateCacheLine(const UI1 size);
+
+///<summary>Releases the memory allocated by allocateCacheLine</summary>
+void freeCacheLine(void* const pData);
+
+///<summary>The allocator of the arrays which start at the cache line, so the layout of the array by the cache lines doesn't depend on its address</summary>
+template<typename U>
+class CCacheLineAllocator
+{
+public:
+	typedef U value_type;
+
+	CCacheLineAllocator()
+	{
+
+	}
+
+	template<typename V>
+	CCacheLineAllocator(const CCacheLineAllocator<V>&)
+	{
+
+	}
+
+	U* allocate(const UI1 n)
+	{
+		return static_cast<U*>(allocateCacheLine(n * sizeof(U)));
+	}
+
+	void deallocate(U* const pData, const UI1)
+	{
+		freeCacheLine(pData);
+	}
+};
+
+template<typename U, typename V>
+bool operator==(const CCacheLineAllocator<U>&, const CCacheLineAllocator<V>&)
+{
+	return true;
+}
+
+template<typename U, typename V>
+bool operator!=(const CCacheLineAllocator<U>&, const CCacheLineAllocator<V>&)
+{
+	return false;
+}
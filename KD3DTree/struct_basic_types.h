@@ -6,6 +6,8 @@
 
 typedef ptrdiff_t	I1;
 typedef size_t		UI1;
+typedef unsigned int	UI4;
+typedef unsigned long long	UI8;
 
 class D3
 {
@@ -1,91 +1,65 @@
 #include "struct_file.h"
 
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <omp.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 char* CFileReader::getFileLine() const
 {
-	UI1 bufSize = cStringBufferSize, i = 0;
-	const UI1 bufDelta = cStringBufferSize;
-	char* pStr = (char*)malloc(sizeof(char) * bufSize);
+	UI1 bufSize = cStringBufferSize, len = 0;
+	char* pStr = static_cast<char*>(malloc(sizeof(char) * bufSize));
 
 	if (pStr == nullptr)
 		throw CExceptionMemoryError("Can't allocate memory ...");
 
-	while (static_cast<I1>(pStr[i] = fgetc(m_pFile)) != EOF)
+	///The line is read by the blocks, the buffer grows until the block ends by the end of the line
+	while (fgets(pStr + len, static_cast<int>(bufSize - len), m_pFile) != nullptr)
 	{
-		if (static_cast<I1>(pStr[i]) == 13)
-		{
-			if (++i >= bufSize)
-			{
-				bufSize += bufDelta;
-				void* ptr = realloc(pStr, sizeof(char) * bufSize);
-				if (ptr == nullptr)
-				{
-					free(static_cast<void*>(pStr));
-					throw CExceptionMemoryError("Can't reallocate memory ...");
-				}
-				pStr = static_cast<char*>(ptr);
-			}
-			if (static_cast<I1>(pStr[i] = fgetc(m_pFile)) != EOF && static_cast<I1>(pStr[i]) != 10)
-			{
-				if (++i >= bufSize)
-				{
-					bufSize += bufDelta;
-					void* ptr = realloc(pStr, sizeof(char) * bufSize);
-					if (ptr == nullptr)
-					{
-						free(static_cast<void*>(pStr));
-						throw CExceptionMemoryError("Can't reallocate memory ...");
-					}
-					pStr = static_cast<char*>(ptr);
-				}
-			}
-			else
-				break;
-		}
-		else
+		len += strlen(pStr + len);
+		if (len != 0 && pStr[len - 1] == '\n')
+			break;
+
+		if (len + 1 >= bufSize)
 		{
-			if (++i >= bufSize)
+			bufSize += cStringBufferSize;
+			void* ptr = realloc(pStr, sizeof(char) * bufSize);
+			if (ptr == nullptr)
 			{
-				bufSize += bufDelta;
-				void* ptr = realloc(pStr, sizeof(char) * bufSize);
-				if (ptr == nullptr)
-				{
-					free(static_cast<void*>(pStr));
-					throw CExceptionMemoryError("Can't reallocate memory ...");
-				}
-				pStr = static_cast<char*>(ptr);
+				free(static_cast<void*>(pStr));
+				throw CExceptionMemoryError("Can't reallocate memory ...");
 			}
+			pStr = static_cast<char*>(ptr);
 		}
 	}
 
-	if (static_cast<I1>(pStr[i]) != EOF)
+	while (len != 0 && (pStr[len - 1] == '\n' || pStr[len - 1] == '\r'))
+		--len;
+
+	if (len == 0)
 	{
-		pStr[--i] = '\0';
-		void* ptr = realloc(pStr, sizeof(char) * (i + 1));
-		if (ptr == nullptr)
-		{
-			free(static_cast<void*>(pStr));
-			throw CExceptionMemoryError("Can't reallocate memory ...");
-		}
-		return static_cast<char*>(ptr);
+		free(static_cast<void*>(pStr));
+		return nullptr;
 	}
 
-	pStr[i] = '\0';
-	void* ptr = realloc(pStr, sizeof(char) * (i + 1));
+	pStr[len] = '\0';
+	void* ptr = realloc(pStr, sizeof(char) * (len + 1));
 	if (ptr == nullptr)
 	{
 		free(static_cast<void*>(pStr));
 		throw CExceptionMemoryError("Can't reallocate memory ...");
 	}
-
-	pStr = static_cast<char*>(ptr);
-	if (strlen(pStr) == 0)
-		free(pStr);
-	else
-		return pStr;
-
-	return nullptr;
+	return static_cast<char*>(ptr);
 }
 
 void CFileWriterDXF::writeTriangle(const CItemTriangle& tr) const
@@ -151,4 +125,935 @@ void CFileWriterDXF::writeBBoxRight(const SBBox& bBox) const
 
 	writeLine(C, C1);
 	writeLine(D, D1);
-}
\ No newline at end of file
+}
+
+void CFileMapping::map(const char* const pFileName)
+{
+	unmap();
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		throw CExceptionCanNotOpenFile(static_cast<errno_t>(GetLastError()));
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(hFile);
+		throw CExceptionWrongFileFormat("The file is empty ...");
+	}
+
+	HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* pData = hMapping != nullptr ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (pData == nullptr)
+	{
+		const errno_t error = static_cast<errno_t>(GetLastError());
+		if (hMapping != nullptr)
+			CloseHandle(hMapping);
+		CloseHandle(hFile);
+		throw CExceptionCanNotOpenFile(error);
+	}
+
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_size = static_cast<UI1>(size.QuadPart);
+#else
+	const int file = open(pFileName, O_RDONLY);
+	if (file == -1)
+		throw CExceptionCanNotOpenFile(errno);
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(file);
+		throw CExceptionWrongFileFormat("The file is empty ...");
+	}
+
+	///The mapping keeps the file, so the descriptor is closed at once
+	void* pData = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, file, 0);
+	const errno_t error = errno;
+	close(file);
+	if (pData == MAP_FAILED)
+		throw CExceptionCanNotOpenFile(error);
+
+	m_size = static_cast<UI1>(fileStat.st_size);
+#endif
+	m_pData = static_cast<const char*>(pData);
+}
+
+void CFileMapping::unmap()
+{
+	if (m_pData == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_pData);
+	CloseHandle(static_cast<HANDLE>(m_hMapping));
+	CloseHandle(static_cast<HANDLE>(m_hFile));
+	m_hMapping = nullptr;
+	m_hFile = nullptr;
+#else
+	munmap(const_cast<char*>(m_pData), m_size);
+#endif
+	m_pData = nullptr;
+	m_size = 0;
+}
+
+///<summary>The exact powers of 10 for the fast path of the parsing of the numbers</summary>
+static const double s_aPow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static inline bool isSpace(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+static inline bool isDigit(const char c)
+{
+	return static_cast<unsigned char>(c - '0') < 10;
+}
+
+///<summary>Skips the spaces and the tabs of the current line</summary>
+static inline void skipBlanks(const char*& p, const char* const pEnd)
+{
+	while (p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r'))
+		++p;
+}
+
+///<summary>Skips the spaces, the ends of the lines and the comments from # to the end of the line</summary>
+static inline void skipSpacesComments(const char*& p, const char* const pEnd)
+{
+	while (p < pEnd)
+	{
+		if (*p == '#')
+		{
+			while (p < pEnd && *p != '\n')
+				++p;
+		}
+		else if (isSpace(*p))
+			++p;
+		else
+			break;
+	}
+}
+
+///<summary>Moves to the start of the next line</summary>
+static inline void skipLine(const char*& p, const char* const pEnd)
+{
+	while (p < pEnd && *p++ != '\n')
+	{
+	}
+}
+
+///<summary>Parses the unsigned integer</summary>
+///<returns>False if there is no number at p</returns>
+static inline bool parseUI1(const char*& p, const char* const pEnd, UI1& val)
+{
+	if (p == pEnd || !isDigit(*p))
+		return false;
+
+	val = 0;
+	while (p < pEnd && isDigit(*p))
+		val = val * 10 + static_cast<UI1>(*p++ - '0');
+	return true;
+}
+
+///<summary>Parses the real number</summary>
+///<remarks>The numbers of at most 15 significant digits and of the small exponents are exact products or quotients of two doubles,
+///the other numbers are parsed by strtod, so the result is always rounded to the nearest</remarks>
+///<returns>False if there is no number at p</returns>
+static bool parseDbl(const char*& p, const char* const pEnd, double& val)
+{
+	const char* const pStart = p;
+	bool bNegative = false;
+	if (p < pEnd && (*p == '-' || *p == '+'))
+		bNegative = *p++ == '-';
+
+	UI8 mantissa = 0;
+	I1 nDigits = 0;
+	I1 nSignificant = 0;
+	I1 exp10 = 0;
+	for (; p < pEnd && isDigit(*p); ++p, ++nDigits)
+	{
+		if (nSignificant < 19)
+		{
+			mantissa = mantissa * 10 + static_cast<UI8>(*p - '0');
+			nSignificant += mantissa != 0;
+		}
+		else
+			++exp10;
+	}
+
+	if (p < pEnd && *p == '.')
+	{
+		for (++p; p < pEnd && isDigit(*p); ++p, ++nDigits)
+		{
+			if (nSignificant < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<UI8>(*p - '0');
+				nSignificant += mantissa != 0;
+				--exp10;
+			}
+		}
+	}
+
+	if (nDigits == 0)
+	{
+		p = pStart;
+		return false;
+	}
+
+	if (p < pEnd && (*p == 'e' || *p == 'E'))
+	{
+		const char* pExp = p + 1;
+		bool bNegativeExp = false;
+		if (pExp < pEnd && (*pExp == '-' || *pExp == '+'))
+			bNegativeExp = *pExp++ == '-';
+
+		UI1 exp = 0;
+		if (parseUI1(pExp, pEnd, exp))
+		{
+			exp10 += bNegativeExp ? -static_cast<I1>(exp) : static_cast<I1>(exp);
+			p = pExp;
+		}
+	}
+
+	if (nSignificant <= 15 && -22 <= exp10 && exp10 <= 22)
+	{
+		val = static_cast<double>(mantissa);
+		val = exp10 < 0 ? val / s_aPow10[-exp10] : val * s_aPow10[exp10];
+		if (bNegative)
+			val = -val;
+		return true;
+	}
+
+	///The mapped text isn't ended by zero, so the number is copied for strtod, the rare long numbers are copied into the heap
+	const UI1 len = static_cast<UI1>(p - pStart);
+	if (len >= cNumberBufferSize)
+	{
+		const std::string number(pStart, len);
+		val = strtod(number.c_str(), nullptr);
+		return true;
+	}
+
+	char aBuffer[cNumberBufferSize];
+	memcpy(aBuffer, pStart, len);
+	aBuffer[len] = '\0';
+	val = strtod(aBuffer, nullptr);
+	return true;
+}
+
+///<summary>The state of the record of the OFF file which isn't finished at the end of the chunk, the records continue on the next lines</summary>
+struct SOffRecordState
+{
+	///<summary>The number of the values of the record which are read, 0 at the start of the record</summary>
+	UI1 m_numValues;
+	///<summary>The number of the vertices of the face, it's read as the first value of the face</summary>
+	UI1 m_numFaceVx;
+	///<summary>The first and the last ids of the vertices of the face, they start the next triangle of its fan</summary>
+	UI4 m_aIDVx[2];
+
+	bool isSame(const SOffRecordState& state) const
+	{
+		return m_numValues == state.m_numValues && m_numFaceVx == state.m_numFaceVx && m_aIDVx[0] == state.m_aIDVx[0] && m_aIDVx[1] == state.m_aIDVx[1];
+	}
+};
+
+///<summary>The part of the text of the OFF file which is parsed by one thread, it starts at the line</summary>
+///<remarks>The chunk is counted from the state of the end of the previous chunk, the state is guessed as the start of the record and is fixed if the guess is wrong</remarks>
+struct SOffChunk
+{
+	const char* m_pBegin;
+	const char* m_pEnd;
+	SOffRecordState m_stateBegin;
+	SOffRecordState m_stateEnd;
+	///<summary>Index of the record which is read at the start of the chunk among all records of the section</summary>
+	UI1 m_idFirstRecord;
+	///<summary>Index of the first triangle of the chunk</summary>
+	UI1 m_idFirstTr;
+	///<summary>The number of the records which are finished in the chunk</summary>
+	UI1 m_numRecords;
+	UI1 m_numTr;
+	///<summary>The end of the section of the records, it's set by the chunk where the last record of the section is finished</summary>
+	const char* m_pStop;
+	bool m_bError;
+};
+
+///<summary>Splits the text into the chunks at the starts of the lines</summary>
+static void splitOffChunks(const char* const pBegin, const char* const pEnd, std::vector<SOffChunk>& aChunks)
+{
+	aChunks.clear();
+	for (const char* p = pBegin; p < pEnd;)
+	{
+		SOffChunk chunk;
+		chunk.m_pBegin = p;
+		p = static_cast<UI1>(pEnd - p) > cMeshChunkSize ? p + cMeshChunkSize : pEnd;
+		skipLine(p, pEnd);
+		chunk.m_pEnd = p;
+		::memset(&chunk.m_stateBegin, 0, sizeof(chunk.m_stateBegin));
+		chunk.m_stateEnd = chunk.m_stateBegin;
+		chunk.m_idFirstRecord = chunk.m_idFirstTr = chunk.m_numRecords = chunk.m_numTr = 0;
+		chunk.m_pStop = nullptr;
+		chunk.m_bError = false;
+		aChunks.push_back(chunk);
+	}
+}
+
+static inline bool isTokenEnd(const char* const p, const char* const pEnd)
+{
+	return p == pEnd || isSpace(*p) || *p == '#';
+}
+
+static inline void skipToken(const char*& p, const char* const pEnd)
+{
+	while (p < pEnd && !isSpace(*p) && *p != '#')
+		++p;
+}
+
+///<summary>Counts or parses the vertices of the chunk of the OFF file, the values of the vertex are read across the lines</summary>
+///<remarks>In/Out : chunk - The chunk, its records are counted from m_stateBegin, m_pStop is set if the last vertex is finished in it</remarks>
+///<remarks>In : bExtraValues - The vertices have the extra values after x y z(the normals, the colours, the texture coordinates), they are skipped to the end of the line</remarks>
+///<remarks>In : maxVx - The number of the vertices of the section from the start of the chunk</remarks>
+///<remarks>Out : pVx - The vertices from the first record of the chunk, if it's nullptr, then the values are counted without the parsing</remarks>
+static void parseOffVertices(SOffChunk& chunk, const bool bExtraValues, const UI1 maxVx, D3* const pVx)
+{
+	UI1 numValues = chunk.m_stateBegin.m_numValues;
+	UI1 nVx = 0;
+	const char* p = chunk.m_pBegin;
+	const char* const pEnd = chunk.m_pEnd;
+	for (;;)
+	{
+		skipSpacesComments(p, pEnd);
+		if (numValues == 0 && nVx >= maxVx)
+		{
+			chunk.m_pStop = p;
+			break;
+		}
+		if (p == pEnd)
+			break;
+
+		if (pVx == nullptr)
+			skipToken(p, pEnd);
+		else if (!parseDbl(p, pEnd, pVx[nVx][numValues]) || !isTokenEnd(p, pEnd))
+		{
+			chunk.m_bError = true;
+			break;
+		}
+
+		if (++numValues == 3)
+		{
+			numValues = 0;
+			++nVx;
+			if (bExtraValues)
+				skipLine(p, pEnd);
+		}
+	}
+
+	chunk.m_numRecords = nVx;
+	chunk.m_stateEnd = chunk.m_stateBegin;
+	chunk.m_stateEnd.m_numValues = numValues;
+}
+
+///<summary>Counts or parses the faces of the chunk of the OFF file into the fans of the triangles, the values of the face are read across the lines</summary>
+///<remarks>The values after the face to the end of its line are its colour, so the face continues on the next line only if its line ends inside of it</remarks>
+///<remarks>In/Out : chunk - The chunk, its records and its triangles are counted from m_stateBegin, the counting stops at the error, m_pStop is set if the last face is finished in it</remarks>
+///<remarks>In : nVx - The number of the vertices</remarks>
+///<remarks>In : maxFaces - The number of the faces of the section from the start of the chunk</remarks>
+///<remarks>Out : pIDVx - Ids of the vertices of the triangles from the first triangle of the chunk, if it's nullptr, then the triangles are counted only</remarks>
+static void parseOffFaces(SOffChunk& chunk, const UI1 nVx, const UI1 maxFaces, UI4* pIDVx)
+{
+	SOffRecordState state = chunk.m_stateBegin;
+	UI1 nFaces = 0;
+	UI1 nTr = 0;
+	const char* p = chunk.m_pBegin;
+	const char* const pEnd = chunk.m_pEnd;
+	for (;;)
+	{
+		skipSpacesComments(p, pEnd);
+		if (state.m_numValues == 0 && nFaces >= maxFaces)
+		{
+			chunk.m_pStop = p;
+			break;
+		}
+		if (p == pEnd)
+			break;
+
+		UI1 val = 0;
+		if (!parseUI1(p, pEnd, val) || !isTokenEnd(p, pEnd) || (state.m_numValues == 0 ? val < 3 : val >= nVx))
+		{
+			chunk.m_bError = true;
+			break;
+		}
+
+		if (state.m_numValues == 0)
+			state.m_numFaceVx = val;
+		else if (state.m_numValues <= 2)
+			state.m_aIDVx[state.m_numValues - 1] = static_cast<UI4>(val);
+		else
+		{
+			if (pIDVx != nullptr)
+			{
+				*pIDVx++ = state.m_aIDVx[0];
+				*pIDVx++ = state.m_aIDVx[1];
+				*pIDVx++ = static_cast<UI4>(val);
+			}
+			state.m_aIDVx[1] = static_cast<UI4>(val);
+			++nTr;
+		}
+
+		if (++state.m_numValues > state.m_numFaceVx)
+		{
+			state.m_numValues = 0;
+			++nFaces;
+			skipLine(p, pEnd);
+		}
+	}
+
+	chunk.m_numRecords = nFaces;
+	chunk.m_numTr = nTr;
+	chunk.m_stateEnd = state;
+}
+
+///<summary>Sets the starts of the chunks of the section by the states of the ends of the previous chunks and the indices of their first records</summary>
+///<remarks>The chunks are counted in parallel from the start of the record, the chunk is counted again if the previous chunk ends inside of the record</remarks>
+///<remarks>In/Out : aChunks - The counted chunks of the section, they are cut after the chunk where the section ends</remarks>
+///<remarks>In : nRecords - The number of the records of the section</remarks>
+///<remarks>In : countChunk - Counts the records of the chunk from its m_stateBegin</remarks>
+///<returns>False if the section has less records than nRecords or has the wrong record</returns>
+template<typename TCount>
+static bool linkOffChunks(std::vector<SOffChunk>& aChunks, const UI1 nRecords, TCount countChunk)
+{
+	UI1 idRecord = 0;
+	for (UI1 iChunk = 0, nChunks = aChunks.size(); iChunk < nChunks; ++iChunk)
+	{
+		SOffChunk& chunk = aChunks[iChunk];
+		if (iChunk > 0 && !chunk.m_stateBegin.isSame(aChunks[iChunk - 1].m_stateEnd))
+		{
+			chunk.m_stateBegin = aChunks[iChunk - 1].m_stateEnd;
+			chunk.m_bError = false;
+			countChunk(chunk, nRecords - idRecord);
+		}
+
+		chunk.m_idFirstRecord = idRecord;
+		idRecord += chunk.m_numRecords;
+		if (idRecord >= nRecords)
+		{
+			aChunks.resize(iChunk + 1);
+			return true;
+		}
+
+		if (chunk.m_bError)
+			return false;
+	}
+
+	return false;
+}
+
+void CFileReaderMesh::read(const char* const pFileName, std::vector<D3>& aVx, std::vector<UI4>& aIDVx)
+{
+	CFileMapping fileMapping;
+	fileMapping.map(pFileName);
+
+	const char* const pData = fileMapping.getData();
+	const UI1 size = fileMapping.getSize();
+	const char* const pEnd = pData + size;
+
+	aVx.clear();
+	aIDVx.clear();
+
+	if (size >= 4 && memcmp(pData, "ply", 3) == 0 && isSpace(pData[3]))
+	{
+		readPLY(pData, pEnd, aVx, aIDVx);
+		return;
+	}
+
+	///The binary STL has the header of 80 bytes, the number of the triangles and 50 bytes per triangle
+	if (size >= 84)
+	{
+		UI4 nTr;
+		memcpy(&nTr, pData + 80, sizeof(nTr));
+		if (size == 84 + 50 * static_cast<UI1>(nTr))
+		{
+			readSTL(pData, pEnd, aVx, aIDVx);
+			return;
+		}
+	}
+
+	if (size >= 6 && memcmp(pData, "solid", 5) == 0 && isSpace(pData[5]))
+		throw CExceptionWrongFileFormat("The text STL file isn't supported ...");
+
+	readOFF(pData, pEnd, aVx, aIDVx);
+}
+
+void CFileReaderMesh::readOFF(const char* pData, const char* const pEnd, std::vector<D3>& aVx, std::vector<UI4>& aIDVx)
+{
+	///The keyword is optional, its prefixes of the colors, the normals and the texture coordinates are allowed, they are skipped as the extra values of the vertices
+	bool bExtraValues = false;
+	skipSpacesComments(pData, pEnd);
+	if (pData < pEnd && !isDigit(*pData))
+	{
+		const char* pWord = pData;
+		while (pData < pEnd && !isSpace(*pData) && *pData != '#')
+			++pData;
+
+		const UI1 lenWord = static_cast<UI1>(pData - pWord);
+		if (lenWord < 3 || memcmp(pData - 3, "OFF", 3) != 0 || strspn(pWord, "STCN") < lenWord - 3)
+			throw CExceptionWrongFileFormat("The file isn't the OFF file ...");
+
+		bExtraValues = lenWord > 3;
+		skipSpacesComments(pData, pEnd);
+	}
+
+	UI1 nVx = 0;
+	UI1 nFaces = 0;
+	UI1 nEd = 0;
+	if (!parseUI1(pData, pEnd, nVx))
+		throw CExceptionWrongFileFormat("The header of the OFF file is wrong ...");
+	skipSpacesComments(pData, pEnd);
+	if (!parseUI1(pData, pEnd, nFaces))
+		throw CExceptionWrongFileFormat("The header of the OFF file is wrong ...");
+	skipBlanks(pData, pEnd);
+	parseUI1(pData, pEnd, nEd);
+	skipLine(pData, pEnd);
+
+	if (nVx == 0 || nFaces == 0)
+		return;
+	if (nVx > static_cast<UI1>(static_cast<UI4>(-1)))
+		throw CExceptionWrongFileFormat("The OFF file has too many vertices ...");
+
+	///The text is split at the lines into the chunks which are parsed by the threads, the records are read across the lines
+	std::vector<SOffChunk> aChunks;
+	splitOffChunks(pData, pEnd, aChunks);
+	I1 nChunks = static_cast<I1>(aChunks.size());
+
+	///Counts the vertices per chunk, so each vertex gets its global index
+#pragma omp parallel for schedule(dynamic) if (nChunks > 1)
+	for (I1 iChunk = 0; iChunk < nChunks; ++iChunk)
+		parseOffVertices(aChunks[iChunk], bExtraValues, static_cast<UI1>(-1), nullptr);
+
+	if (!linkOffChunks(aChunks, nVx, [bExtraValues](SOffChunk& chunk, const UI1 maxVx) { parseOffVertices(chunk, bExtraValues, maxVx, nullptr); }))
+		throw CExceptionWrongFileFormat("The OFF file is truncated ...");
+
+	///Parses the vertices, the chunk of the last vertex finds the start of the faces
+	aVx.resize(nVx);
+	nChunks = static_cast<I1>(aChunks.size());
+#pragma omp parallel for schedule(dynamic) if (nChunks > 1)
+	for (I1 iChunk = 0; iChunk < nChunks; ++iChunk)
+	{
+		SOffChunk& chunk = aChunks[iChunk];
+		parseOffVertices(chunk, bExtraValues, nVx - chunk.m_idFirstRecord, aVx.data() + chunk.m_idFirstRecord);
+	}
+
+	for (I1 iChunk = 0; iChunk < nChunks; ++iChunk)
+	{
+		if (aChunks[iChunk].m_bError)
+			throw CExceptionWrongFileFormat("The vertex of the OFF file is wrong ...");
+	}
+
+	///Counts the faces and the triangles of their fans per chunk
+	splitOffChunks(aChunks.back().m_pStop, pEnd, aChunks);
+	nChunks = static_cast<I1>(aChunks.size());
+#pragma omp parallel for schedule(dynamic) if (nChunks > 1)
+	for (I1 iChunk = 0; iChunk < nChunks; ++iChunk)
+		parseOffFaces(aChunks[iChunk], nVx, static_cast<UI1>(-1), nullptr);
+
+	if (!linkOffChunks(aChunks, nFaces, [nVx](SOffChunk& chunk, const UI1 maxFaces) { parseOffFaces(chunk, nVx, maxFaces, nullptr); }))
+		throw CExceptionWrongFileFormat("The face of the OFF file is wrong or the file is truncated ...");
+
+	///The chunk of the last face is counted again without the records after it
+	SOffChunk& chunkLast = aChunks.back();
+	chunkLast.m_bError = false;
+	parseOffFaces(chunkLast, nVx, nFaces - chunkLast.m_idFirstRecord, nullptr);
+
+	///The records after the last face mean that the header has the wrong number of the faces or the faces are misread
+	const char* pRest = chunkLast.m_pStop;
+	skipSpacesComments(pRest, pEnd);
+	if (pRest != pEnd)
+		throw CExceptionWrongFileFormat("The OFF file has the data after the last face ...");
+
+	UI1 nTr = 0;
+	nChunks = static_cast<I1>(aChunks.size());
+	for (I1 iChunk = 0; iChunk < nChunks; ++iChunk)
+	{
+		aChunks[iChunk].m_idFirstTr = nTr;
+		nTr += aChunks[iChunk].m_numTr;
+	}
+
+	///Parses the faces into the fans of the triangles at the offsets of the chunks
+	aIDVx.resize(3 * nTr);
+#pragma omp parallel for schedule(dynamic) if (nChunks > 1)
+	for (I1 iChunk = 0; iChunk < nChunks; ++iChunk)
+	{
+		SOffChunk& chunk = aChunks[iChunk];
+		parseOffFaces(chunk, nVx, nFaces - chunk.m_idFirstRecord, aIDVx.data() + 3 * chunk.m_idFirstTr);
+	}
+}
+
+///<summary>The scalar types of the properties of the PLY file</summary>
+enum ePlyType
+{
+	ePlyTypeNone,
+	ePlyTypeI8,
+	ePlyTypeUI8,
+	ePlyTypeI16,
+	ePlyTypeUI16,
+	ePlyTypeI32,
+	ePlyTypeUI32,
+	ePlyTypeF32,
+	ePlyTypeF64
+};
+
+///<summary>The property of the element of the PLY file, the list property has the type of its count</summary>
+struct SPlyProperty
+{
+	ePlyType m_type;
+	ePlyType m_typeCount;
+	///<summary>0, 1, 2 for the coordinates x, y, z of the vertex, -1 for the other properties</summary>
+	I1 m_idCoord;
+	bool m_bIndices;
+};
+
+struct SPlyElement
+{
+	std::vector<SPlyProperty> m_aProperties;
+	UI1 m_count;
+	bool m_bVertex;
+	bool m_bFace;
+};
+
+static ePlyType parsePlyType(const char* const pWord, const UI1 len)
+{
+	static const char* const aNames[] = { "char", "uchar", "short", "ushort", "int", "uint", "float", "double",
+		"int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64" };
+	for (UI1 i = 0; i < 16; ++i)
+	{
+		if (strlen(aNames[i]) == len && memcmp(aNames[i], pWord, len) == 0)
+			return static_cast<ePlyType>(i % 8 + 1);
+	}
+	return ePlyTypeNone;
+}
+
+static inline UI1 getPlyTypeSize(const ePlyType type)
+{
+	static const UI1 aSizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	return aSizes[type];
+}
+
+///<summary>Reads the scalar of the binary PLY file</summary>
+///<remarks>In/Out : p - The position of the scalar, it moves past it</remarks>
+///<remarks>In : bSwap - The byte order of the file differs from the byte order of the machine</remarks>
+static double readPlyScalar(const char*& p, const ePlyType type, const bool bSwap)
+{
+	const UI1 size = getPlyTypeSize(type);
+	unsigned char aBytes[8];
+	for (UI1 i = 0; i < size; ++i)
+		aBytes[i] = static_cast<unsigned char>(p[bSwap ? size - 1 - i : i]);
+	p += size;
+
+	switch (type)
+	{
+	case ePlyTypeI8: { signed char v; memcpy(&v, aBytes, 1); return v; }
+	case ePlyTypeUI8: return aBytes[0];
+	case ePlyTypeI16: { short v; memcpy(&v, aBytes, 2); return v; }
+	case ePlyTypeUI16: { unsigned short v; memcpy(&v, aBytes, 2); return v; }
+	case ePlyTypeI32: { int v; memcpy(&v, aBytes, 4); return v; }
+	case ePlyTypeUI32: { UI4 v; memcpy(&v, aBytes, 4); return v; }
+	case ePlyTypeF32: { float v; memcpy(&v, aBytes, 4); return v; }
+	case ePlyTypeF64: { double v; memcpy(&v, aBytes, 8); return v; }
+	default: return 0.;
+	}
+}
+
+///<summary>Reads the number of the values of the list or the id of the vertex of the binary PLY file</summary>
+///<remarks>The exception CExceptionWrongFileFormat is thrown if the value isn't the integer in [0, maxValue)</remarks>
+///<remarks>In/Out : p - The position of the scalar, it moves past it</remarks>
+///<remarks>In : bSwap - The byte order of the file differs from the byte order of the machine</remarks>
+static UI1 readPlyIndex(const char*& p, const ePlyType type, const bool bSwap, const UI1 maxValue)
+{
+	const double val = readPlyScalar(p, type, bSwap);
+	if (!(0. <= val && val < static_cast<double>(maxValue)) || val != std::floor(val))
+		throw CExceptionWrongFileFormat("The list or the index of the PLY file is wrong ...");
+
+	return static_cast<UI1>(val);
+}
+
+///<summary>Gets the word of the line of the header</summary>
+static inline bool getPlyWord(const char*& p, const char* const pEnd, const char*& pWord, UI1& len)
+{
+	skipBlanks(p, pEnd);
+	pWord = p;
+	while (p < pEnd && !isSpace(*p))
+		++p;
+	len = static_cast<UI1>(p - pWord);
+	return len != 0;
+}
+
+static inline bool isPlyWord(const char* const pWord, const UI1 len, const char* const pName)
+{
+	return strlen(pName) == len && memcmp(pWord, pName, len) == 0;
+}
+
+void CFileReaderMesh::readPLY(const char* pData, const char* const pEnd, std::vector<D3>& aVx, std::vector<UI4>& aIDVx)
+{
+	bool bSwap = false;
+	bool bFormat = false;
+	std::vector<SPlyElement> aElements;
+
+	///The header is the text to the line end_header, the binary data follows it
+	const UI4 one = 1;
+	const bool bLittleEndian = *reinterpret_cast<const unsigned char*>(&one) == 1;
+	for (skipLine(pData, pEnd);;)
+	{
+		if (pData == pEnd)
+			throw CExceptionWrongFileFormat("The header of the PLY file isn't ended ...");
+
+		const char* pWord;
+		UI1 len;
+		if (!getPlyWord(pData, pEnd, pWord, len))
+		{
+			skipLine(pData, pEnd);
+			continue;
+		}
+
+		if (isPlyWord(pWord, len, "end_header"))
+		{
+			skipLine(pData, pEnd);
+			break;
+		}
+
+		if (isPlyWord(pWord, len, "format"))
+		{
+			getPlyWord(pData, pEnd, pWord, len);
+			if (isPlyWord(pWord, len, "binary_little_endian"))
+				bSwap = !bLittleEndian;
+			else if (isPlyWord(pWord, len, "binary_big_endian"))
+				bSwap = bLittleEndian;
+			else
+				throw CExceptionWrongFileFormat("Only the binary PLY files are supported ...");
+			bFormat = true;
+		}
+		else if (isPlyWord(pWord, len, "element"))
+		{
+			SPlyElement element;
+			getPlyWord(pData, pEnd, pWord, len);
+			element.m_bVertex = isPlyWord(pWord, len, "vertex");
+			element.m_bFace = isPlyWord(pWord, len, "face");
+			skipBlanks(pData, pEnd);
+			if (!parseUI1(pData, pEnd, element.m_count))
+				throw CExceptionWrongFileFormat("The element of the PLY file is wrong ...");
+			aElements.push_back(element);
+		}
+		else if (isPlyWord(pWord, len, "property"))
+		{
+			if (aElements.empty())
+				throw CExceptionWrongFileFormat("The property of the PLY file is out of the element ...");
+
+			SPlyProperty property;
+			property.m_typeCount = ePlyTypeNone;
+			getPlyWord(pData, pEnd, pWord, len);
+			if (isPlyWord(pWord, len, "list"))
+			{
+				getPlyWord(pData, pEnd, pWord, len);
+				property.m_typeCount = parsePlyType(pWord, len);
+				getPlyWord(pData, pEnd, pWord, len);
+				if (property.m_typeCount == ePlyTypeNone || property.m_typeCount == ePlyTypeF32 || property.m_typeCount == ePlyTypeF64)
+					throw CExceptionWrongFileFormat("The type of the list of the PLY file is wrong ...");
+			}
+
+			property.m_type = parsePlyType(pWord, len);
+			if (property.m_type == ePlyTypeNone)
+				throw CExceptionWrongFileFormat("The type of the property of the PLY file is wrong ...");
+
+			getPlyWord(pData, pEnd, pWord, len);
+			property.m_idCoord = -1;
+			if (len == 1 && 'x' <= *pWord && *pWord <= 'z' && property.m_typeCount == ePlyTypeNone)
+				property.m_idCoord = *pWord - 'x';
+			property.m_bIndices = property.m_typeCount != ePlyTypeNone &&
+				(isPlyWord(pWord, len, "vertex_indices") || isPlyWord(pWord, len, "vertex_index"));
+			aElements.back().m_aProperties.push_back(property);
+		}
+
+		skipLine(pData, pEnd);
+	}
+
+	if (!bFormat)
+		throw CExceptionWrongFileFormat("The format of the PLY file is absent ...");
+
+	for (UI1 iElement = 0; iElement < aElements.size(); ++iElement)
+	{
+		const SPlyElement& element = aElements[iElement];
+		const std::vector<SPlyProperty>& aProperties = element.m_aProperties;
+
+		///The elements without the lists have the fixed size, so they are read in parallel or are skipped at once
+		bool bFixed = true;
+		UI1 sizeFixed = 0;
+		for (UI1 i = 0; i < aProperties.size(); ++i)
+		{
+			bFixed = bFixed && aProperties[i].m_typeCount == ePlyTypeNone;
+			sizeFixed += getPlyTypeSize(aProperties[i].m_type);
+		}
+
+		if (element.m_bVertex)
+		{
+			///The lists of the vertices aren't read, so the vertex must have its coordinates only in the scalars
+			UI1 maskCoords = 0;
+			for (UI1 i = 0; i < aProperties.size(); ++i)
+			{
+				if (aProperties[i].m_idCoord >= 0)
+					maskCoords |= static_cast<UI1>(1) << aProperties[i].m_idCoord;
+			}
+			if (!bFixed || maskCoords != 7)
+				throw CExceptionWrongFileFormat("The vertex of the PLY file has the list or hasn't the coordinates ...");
+			if (element.m_count > static_cast<UI1>(static_cast<UI4>(-1)))
+				throw CExceptionWrongFileFormat("The PLY file has too many vertices ...");
+			aVx.assign(element.m_count, D3(0., 0., 0.));
+		}
+
+		if (bFixed)
+		{
+			if (static_cast<UI1>(pEnd - pData) / (sizeFixed != 0 ? sizeFixed : 1) < element.m_count)
+				throw CExceptionWrongFileFormat("The PLY file is truncated ...");
+
+			if (element.m_bVertex)
+			{
+				const I1 nVx = static_cast<I1>(element.m_count);
+#pragma omp parallel for if (nVx > static_cast<I1>(cNumElementsForParalell))
+				for (I1 iVx = 0; iVx < nVx; ++iVx)
+				{
+					const char* p = pData + iVx * sizeFixed;
+					for (UI1 i = 0; i < aProperties.size(); ++i)
+					{
+						const double val = readPlyScalar(p, aProperties[i].m_type, bSwap);
+						if (aProperties[i].m_idCoord >= 0)
+							aVx[iVx][aProperties[i].m_idCoord] = val;
+					}
+				}
+			}
+
+			pData += element.m_count * sizeFixed;
+			continue;
+		}
+
+		///The elements with the lists are read twice, the first pass finds the number of the triangles of the fans of the faces
+		const char* const pElement = pData;
+		UI1 nTr = 0;
+		for (UI1 iItem = 0; iItem < element.m_count; ++iItem)
+		{
+			for (UI1 i = 0; i < aProperties.size(); ++i)
+			{
+				const SPlyProperty& property = aProperties[i];
+				UI1 nValues = 1;
+				if (property.m_typeCount != ePlyTypeNone)
+				{
+					if (static_cast<UI1>(pEnd - pData) < getPlyTypeSize(property.m_typeCount))
+						throw CExceptionWrongFileFormat("The PLY file is truncated ...");
+					nValues = readPlyIndex(pData, property.m_typeCount, bSwap, cPlyMaxListSize);
+				}
+
+				if (static_cast<UI1>(pEnd - pData) / getPlyTypeSize(property.m_type) < nValues)
+					throw CExceptionWrongFileFormat("The PLY file is truncated ...");
+				pData += nValues * getPlyTypeSize(property.m_type);
+
+				if (element.m_bFace && property.m_bIndices && nValues >= 3)
+					nTr += nValues - 2;
+			}
+		}
+
+		if (!element.m_bFace)
+			continue;
+
+		aIDVx.resize(3 * nTr);
+		UI4* pIDVx = aIDVx.data();
+		for (const char* p = pElement; p < pData;)
+		{
+			for (UI1 i = 0; i < aProperties.size(); ++i)
+			{
+				const SPlyProperty& property = aProperties[i];
+				const UI1 nValues = property.m_typeCount != ePlyTypeNone ? readPlyIndex(p, property.m_typeCount, bSwap, cPlyMaxListSize) : 1;
+				if (!property.m_bIndices)
+				{
+					p += nValues * getPlyTypeSize(property.m_type);
+					continue;
+				}
+
+				UI1 aID[3] = { 0, 0, 0 };
+				for (UI1 iVx = 0; iVx < nValues; ++iVx)
+				{
+					const UI1 id = readPlyIndex(p, property.m_type, bSwap, aVx.size());
+					if (iVx < 2)
+					{
+						aID[iVx] = id;
+						continue;
+					}
+
+					aID[2] = id;
+					*pIDVx++ = static_cast<UI4>(aID[0]);
+					*pIDVx++ = static_cast<UI4>(aID[1]);
+					*pIDVx++ = static_cast<UI4>(aID[2]);
+					aID[1] = aID[2];
+				}
+			}
+		}
+	}
+}
+
+void CFileReaderMesh::readSTL(const char* pData, const char* const pEnd, std::vector<D3>& aVx, std::vector<UI4>& aIDVx)
+{
+	if (pEnd - pData < 84)
+		throw CExceptionWrongFileFormat("The STL file is truncated ...");
+
+	UI4 nTr;
+	memcpy(&nTr, pData + 80, sizeof(nTr));
+	pData += 84;
+
+	///The triangles past the end of the file aren't read
+	if (static_cast<UI1>(pEnd - pData) / 50 < nTr)
+		throw CExceptionWrongFileFormat("The STL file is truncated ...");
+
+	if (static_cast<UI1>(3) * nTr > static_cast<UI1>(static_cast<UI4>(-1)))
+		throw CExceptionWrongFileFormat("The STL file has too many triangles ...");
+
+	///The triangle has the normal, 3 vertices of the floats and 2 bytes of the attributes, the normal is skipped
+	const I1 nTrs = static_cast<I1>(nTr);
+	aVx.resize(3 * nTr);
+	aIDVx.resize(3 * nTr);
+#pragma omp parallel for if (nTrs > static_cast<I1>(cNumElementsForParalell))
+	for (I1 iTr = 0; iTr < nTrs; ++iTr)
+	{
+		float aCoords[9];
+		memcpy(aCoords, pData + 50 * iTr + 12, sizeof(aCoords));
+		for (UI1 iVx = 0; iVx < 3; ++iVx)
+		{
+			aVx[3 * iTr + iVx] = D3(aCoords[3 * iVx], aCoords[3 * iVx + 1], aCoords[3 * iVx + 2]);
+			aIDVx[3 * iTr + iVx] = static_cast<UI4>(3 * iTr + iVx);
+		}
+	}
+}
+
+CFileReaderMesh::CFileReaderMesh(const char* const pFileName, std::vector<D3>& aVx, std::vector<CItemTriangle>& aTr)
+{
+	std::vector<UI4> aIDVx;
+	read(pFileName, aVx, aIDVx);
+
+	const I1 nTr = static_cast<I1>(aIDVx.size() / 3);
+	aTr.resize(nTr);
+#pragma omp parallel for if (nTr > static_cast<I1>(cNumElementsForParalell))
+	for (I1 i = 0; i < nTr; ++i)
+	{
+		aTr[i].setTriangle(aVx[aIDVx[3 * i]], aVx[aIDVx[3 * i + 1]], aVx[aIDVx[3 * i + 2]]);
+	}
+}
+
+CFileReaderMesh::CFileReaderMesh(const char* const pFileName, std::vector<D3>& aVx, std::vector<CItemTriangleIndexed>& aTr)
+{
+	std::vector<UI4> aIDVx;
+	read(pFileName, aVx, aIDVx);
+
+	const I1 nTr = static_cast<I1>(aIDVx.size() / 3);
+	aTr.resize(nTr);
+#pragma omp parallel for if (nTr > static_cast<I1>(cNumElementsForParalell))
+	for (I1 i = 0; i < nTr; ++i)
+	{
+		aTr[i].setTriangle(aVx.data(), aIDVx[3 * i], aIDVx[3 * i + 1], aIDVx[3 * i + 2]);
+	}
+}
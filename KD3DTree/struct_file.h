@@ -36,6 +36,21 @@ public:
 	}
 };
 
+class CExceptionWrongFileFormat
+{
+	const char* const m_pMessage;
+public:
+	explicit CExceptionWrongFileFormat(const char* const pMessage) : m_pMessage(pMessage)
+	{
+
+	}
+
+	const char* getMessage() const
+	{
+		return m_pMessage;
+	}
+};
+
 class CFile
 {
 	CFile(const CFile& file);
@@ -90,6 +105,13 @@ public:
 	{
 		fprintf_s(m_pFile, "%zu\n", val);
 	}
+
+	///<summary>Writes the raw bytes into the binary file</summary>
+	void writeBytes(const void* pData, const UI1 size)
+	{
+		if (size != 0 && fwrite(pData, 1, size, m_pFile) != size)
+			throw CExceptionMemoryError("Can't write file ...");
+	}
 };
 
 class CFileReader : public CFile
@@ -121,6 +143,45 @@ public:
 	}
 };
 
+///<summary>The read-only mapping of the file into the memory, the processes which map one file share its physical pages</summary>
+class CFileMapping
+{
+	CFileMapping(const CFileMapping& fileMapping);
+	CFileMapping& operator=(const CFileMapping& fileMapping);
+public:
+	CFileMapping() : m_pData(nullptr), m_size(0), m_hFile(nullptr), m_hMapping(nullptr)
+	{
+
+	}
+
+	~CFileMapping()
+	{
+		unmap();
+	}
+
+	///<summary>Maps the whole file, the previous mapping is released</summary>
+	void map(const char* const pFileName);
+
+	///<summary>Releases the mapping</summary>
+	void unmap();
+
+	const char* getData() const
+	{
+		return m_pData;
+	}
+
+	UI1 getSize() const
+	{
+		return m_size;
+	}
+
+private:
+	const char* m_pData;
+	UI1 m_size;
+	///<summary>The handles of the file and of the mapping on Windows</summary>
+	void* m_hFile;
+	void* m_hMapping;
+};
 
 class CFileWriterDXF : public CFileWriter
 {
@@ -141,37 +202,39 @@ public:
 	}
 };
 
-class CFileReaderOFF : public CFileReader
+///<summary>Reads the triangle mesh from the OFF file, the binary PLY file or the binary STL file</summary>
+///<remarks>The file is mapped and parsed in place, the text of the large OFF files is parsed by the parts in parallel</remarks>
+///<remarks>The records of the OFF file are read across the lines, so a line can have several vertices and a record can be split into the lines</remarks>
+///<remarks>The rest of the line of the face of the OFF file is its colour, the data after the last face is the error</remarks>
+///<remarks>The polygons are split into the fans of the triangles, the vertices of the STL file aren't welded</remarks>
+///<remarks>The exceptions CExceptionCanNotOpenFile and CExceptionWrongFileFormat are thrown if the mesh can't be read</remarks>
+class CFileReaderMesh
 {
+	CFileReaderMesh(const CFileReaderMesh& reader);
+	CFileReaderMesh& operator=(const CFileReaderMesh& reader);
 public:
-	CFileReaderOFF(const char* const pFileName, std::vector<D3>& aVx, std::vector<CItemTriangle>& aTr) : CFileReader(pFileName)
-	{
-		UI1 nVx = 0;
-		UI1 nTr = 0;
-		UI1 nEd = 0;
-
-		fscanf_s(m_pFile, "%zu%zu%zu", &nVx, &nTr, &nEd);
-		if (nVx == 0 || nTr == 0)
-			return;
-
-		aVx.resize(nVx);
-		for (UI1 i = 0; i < nVx; ++i)
-		{
-			double x, y, z;
-			fscanf_s(m_pFile, "%lf%lf%lf", &x, &y, &z);
-			aVx[i][0] = x;
-			aVx[i][1] = y;
-			aVx[i][2] = z;
-		}
-
-		aTr.resize(nTr);
-		for (UI1 i = 0; i < nTr; ++i)
-		{
-			UI1 a, b, c, d;
-			fscanf_s(m_pFile, "%zu%zu%zu%zu", &a, &b, &c, &d);
-			aTr[i].setTriangle(aVx[b], aVx[c], aVx[d]);
-		}
-	}
+	///<summary>Reads the mesh, the vertices are copied into the triangles</summary>
+	///<remarks>In : pFileName - The name of the file of the mesh</remarks>
+	///<remarks>Out : aVx - The vertices of the mesh</remarks>
+	///<remarks>Out : aTr - The triangles of the mesh</remarks>
+	CFileReaderMesh(const char* const pFileName, std::vector<D3>& aVx, std::vector<CItemTriangle>& aTr);
+
+	///<summary>Reads the indexed mesh, the triangles keep the ids of their vertices in aVx</summary>
+	///<remarks>aVx must not be changed while the triangles are used</remarks>
+	///<remarks>In : pFileName - The name of the file of the mesh</remarks>
+	///<remarks>Out : aVx - The vertices of the mesh</remarks>
+	///<remarks>Out : aTr - The triangles of the mesh</remarks>
+	CFileReaderMesh(const char* const pFileName, std::vector<D3>& aVx, std::vector<CItemTriangleIndexed>& aTr);
+
+private:
+	///<summary>Reads the vertices and the ids of the vertices of the triangles, the format is detected by the content of the file</summary>
+	///<remarks>Out : aVx - The vertices of the mesh</remarks>
+	///<remarks>Out : aIDVx - Ids of the vertices, 3 per triangle</remarks>
+	static void read(const char* const pFileName, std::vector<D3>& aVx, std::vector<UI4>& aIDVx);
+
+	static void readOFF(const char* pData, const char* const pEnd, std::vector<D3>& aVx, std::vector<UI4>& aIDVx);
+	static void readPLY(const char* pData, const char* const pEnd, std::vector<D3>& aVx, std::vector<UI4>& aIDVx);
+	static void readSTL(const char* pData, const char* const pEnd, std::vector<D3>& aVx, std::vector<UI4>& aIDVx);
 };
 
 class CFileWriterLOG : public CFileWriter
@@ -2,85 +2,266 @@
 #include "math_util.h"
 #include "struct_basic_types.h"
 
-enum eType
-{
-	eTypeTriangle
-};
+#include <type_traits>
+
+///The item of the KD Tree is resolved statically by the templates of the KD Tree and of the splitters, it has no virtual functions.
+///It must have the functions:
+///	double calcDist(const D3& point) const - Distance from the point to the item
+///	double calcDist2(const D3& point) const - Square of the distance from the point to the item
+///	SBBox calcBBoxItem() const - Bounding box of the item
+///	bool calcBBoxClipped(const SBBox& bBox, SBBox& bBoxClipped) const - Bounding box of the part of the item in the bounding box
+///	bool calcIntersectRay(const D3& origin, const D3& dir, const double tMax, double& t) const - Parameter of the hit point of the ray in [0, tMax]
+///	template<typename TVolume> bool isOverlap(const TVolume& volume) const - The exact test of the overlap with the volume of struct_volume.h
+///The queries of the closest feature and of the signed distance need the triangles with the vertices item[0], item[1], item[2] and the function:
+///	double calcDist2Feature(const D3& point, D3& closestPoint, eTriangleFeature& feature) const - Square of the distance, the closest point and its feature
 
-class CItem
+///<summary>The triangle packed into its vertices only, the bounding box is calculated on the fly</summary>
+class CItemTriangle
 {
-	const eType m_typeItem;
 public:
-	explicit CItem(const eType typeItem) : m_typeItem(typeItem)
+	CItemTriangle()
 	{
 
 	}
 
-	virtual ~CItem()
+	CItemTriangle(const D3& a, const D3& b, const D3& c) : m_aVx{ a, b, c }
 	{
 
 	}
 
-	///<returns>Type of the item (see enum)</returns>
-	eType getTypeItem() const
+	void setTriangle(const D3& a, const D3& b, const D3& c)
+	{
+		m_aVx[0] = a;
+		m_aVx[1] = b;
+		m_aVx[2] = c;
+	}
+
+	///<returns>Bounding box of the triangle</returns>
+	SBBox calcBBoxItem() const
 	{
-		return m_typeItem;
+		SBBox bBoxItem;
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			const double a = m_aVx[0][dim];
+			const double b = m_aVx[1][dim];
+			const double c = m_aVx[2][dim];
+			const double minAB = a < b ? a : b;
+			const double maxAB = a < b ? b : a;
+			bBoxItem.m_minBB[dim] = minAB < c ? minAB : c;
+			bBoxItem.m_maxBB[dim] = maxAB < c ? c : maxAB;
+		}
+		return bBoxItem;
 	}
 
 	///<returns>Distance from the point to the triangle</returns>
-	virtual const double calcDist(const D3& point) const = 0;
+	double calcDist(const D3& point) const
+	{
+		return math::distToTriangle(m_aVx[0], m_aVx[1], m_aVx[2], point);
+	}
+
+	///<returns>Square of the distance from the point to the triangle</returns>
+	double calcDist2(const D3& point) const
+	{
+		return math::distToTriangle2(m_aVx[0], m_aVx[1], m_aVx[2], point);
+	}
+
+	///<summary>Calculates square of the distance from the point to the triangle, its closest point and the feature which contains it</summary>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : closestPoint - The closest point of the triangle</remarks>
+	///<remarks>Out : feature - The face, the edge or the vertex of the triangle which contains the closest point</remarks>
 	///<returns>Square of the distance from the point to the triangle</returns>
-	virtual const double calcDist2(const D3& point) const = 0;
-	///<returns>Reference to the bounding box of the item</returns>
-	virtual const SBBox& getBBoxItem() const = 0;
+	double calcDist2Feature(const D3& point, D3& closestPoint, eTriangleFeature& feature) const
+	{
+		return math::distToTriangle2(m_aVx[0], m_aVx[1], m_aVx[2], point, closestPoint, feature);
+	}
+
+	///<summary>Calculates the bounding box of the part of the triangle in the bounding box</summary>
+	///<returns>False if the triangle is out of the bounding box, otherwise true</returns>
+	bool calcBBoxClipped(const SBBox& bBox, SBBox& bBoxClipped) const
+	{
+		return math::clipTriangleBBox(m_aVx[0], m_aVx[1], m_aVx[2], bBox, bBoxClipped);
+	}
+
+	///<summary>Intersects the ray with the triangle</summary>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+	///<remarks>Out : t - The parameter of the hit point</remarks>
+	///<returns>True if the ray hits the triangle at 0 <= t <= tMax, otherwise false</returns>
+	bool calcIntersectRay(const D3& origin, const D3& dir, const double tMax, double& t) const
+	{
+		return math::intersectRayTriangle(m_aVx[0], m_aVx[1], m_aVx[2], origin, dir, tMax, t);
+	}
+
+	///<summary>Checks that the triangle overlaps the volume</summary>
+	///<remarks>In : volume - The volume of the overlap query</remarks>
+	///<returns>True if the triangle overlaps the volume, otherwise false</returns>
+	template<typename TVolume>
+	bool isOverlap(const TVolume& volume) const
+	{
+		return volume.isOverlapTriangle(m_aVx[0], m_aVx[1], m_aVx[2]);
+	}
+
+	const D3& operator[](const UI1 dim) const
+	{
+		return m_aVx[dim];
+	}
+private:
+	///<summary>Vertices of the triangle</summary>
+	D3 m_aVx[3];
 };
 
-class CItemTriangle : public CItem
+static_assert(sizeof(CItemTriangle) == 9 * sizeof(double), "CItemTriangle must be packed into its vertices");
+
+///<summary>The triangle of the indexed mesh, it keeps the ids of its vertices in the shared array of the vertices</summary>
+///<remarks>The array of the vertices must outlive the triangle and must not be reallocated</remarks>
+///<remarks>The vertices aren't copied, the triangle keeps only the pointer to the array and 3 ids, so it isn't precomputed for the vectorized kernels</remarks>
+class CItemTriangleIndexed
 {
 public:
-	CItemTriangle() : CItem(eTypeTriangle)
+	CItemTriangleIndexed() : m_aVx(nullptr), m_aIDVx{ 0, 0, 0 }
 	{
 
 	}
 
-	CItemTriangle(const D3& a, const D3& b, const D3& c) : CItem(eTypeTriangle), m_aVx{ a, b, c }
+	CItemTriangleIndexed(const D3* aVx, const UI4 idA, const UI4 idB, const UI4 idC) : m_aVx(aVx), m_aIDVx{ idA, idB, idC }
 	{
-		calcBBoxItem();
+
 	}
 
-	void setTriangle(const D3& a, const D3& b, const D3& c)
+	///<remarks>In : aVx - The shared array of the vertices</remarks>
+	///<remarks>In : idA, idB, idC - Ids of the vertices of the triangle in aVx</remarks>
+	void setTriangle(const D3* aVx, const UI4 idA, const UI4 idB, const UI4 idC)
 	{
-		m_aVx[0] = a;
-		m_aVx[1] = b;
-		m_aVx[2] = c;
+		m_aVx = aVx;
+		m_aIDVx[0] = idA;
+		m_aIDVx[1] = idB;
+		m_aIDVx[2] = idC;
+	}
 
-		calcBBoxItem();
+	///<returns>Bounding box of the triangle</returns>
+	SBBox calcBBoxItem() const
+	{
+		SBBox bBoxItem;
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			const double a = m_aVx[m_aIDVx[0]][dim];
+			const double b = m_aVx[m_aIDVx[1]][dim];
+			const double c = m_aVx[m_aIDVx[2]][dim];
+			const double minAB = a < b ? a : b;
+			const double maxAB = a < b ? b : a;
+			bBoxItem.m_minBB[dim] = minAB < c ? minAB : c;
+			bBoxItem.m_maxBB[dim] = maxAB < c ? c : maxAB;
+		}
+		return bBoxItem;
 	}
 
-	virtual const SBBox& getBBoxItem() const
+	///<returns>Distance from the point to the triangle</returns>
+	double calcDist(const D3& point) const
 	{
-		return m_bBoxItem;
+		return math::distToTriangle((*this)[0], (*this)[1], (*this)[2], point);
 	}
 
-	virtual const double calcDist(const D3& point) const
+	///<returns>Square of the distance from the point to the triangle</returns>
+	double calcDist2(const D3& point) const
 	{
-		return math::distToTriangle(m_aVx[0], m_aVx[1], m_aVx[2], point);
+		return math::distToTriangle2((*this)[0], (*this)[1], (*this)[2], point);
 	}
 
-	virtual const double calcDist2(const D3& point) const
+	///<summary>Calculates square of the distance from the point to the triangle, its closest point and the feature which contains it</summary>
+	///<remarks>In : point - The point for which we are calculating the distance</remarks>
+	///<remarks>Out : closestPoint - The closest point of the triangle</remarks>
+	///<remarks>Out : feature - The face, the edge or the vertex of the triangle which contains the closest point</remarks>
+	///<returns>Square of the distance from the point to the triangle</returns>
+	double calcDist2Feature(const D3& point, D3& closestPoint, eTriangleFeature& feature) const
 	{
-		return math::distToTriangle2(m_aVx[0], m_aVx[1], m_aVx[2], point);
+		return math::distToTriangle2((*this)[0], (*this)[1], (*this)[2], point, closestPoint, feature);
+	}
+
+	///<summary>Calculates the bounding box of the part of the triangle in the bounding box</summary>
+	///<returns>False if the triangle is out of the bounding box, otherwise true</returns>
+	bool calcBBoxClipped(const SBBox& bBox, SBBox& bBoxClipped) const
+	{
+		return math::clipTriangleBBox((*this)[0], (*this)[1], (*this)[2], bBox, bBoxClipped);
+	}
+
+	///<summary>Intersects the ray with the triangle</summary>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+	///<remarks>Out : t - The parameter of the hit point</remarks>
+	///<returns>True if the ray hits the triangle at 0 <= t <= tMax, otherwise false</returns>
+	bool calcIntersectRay(const D3& origin, const D3& dir, const double tMax, double& t) const
+	{
+		return math::intersectRayTriangle((*this)[0], (*this)[1], (*this)[2], origin, dir, tMax, t);
+	}
+
+	///<summary>Checks that the triangle overlaps the volume</summary>
+	///<remarks>In : volume - The volume of the overlap query</remarks>
+	///<returns>True if the triangle overlaps the volume, otherwise false</returns>
+	template<typename TVolume>
+	bool isOverlap(const TVolume& volume) const
+	{
+		return volume.isOverlapTriangle((*this)[0], (*this)[1], (*this)[2]);
 	}
 
 	const D3& operator[](const UI1 dim) const
 	{
-		return m_aVx[dim];
+		return m_aVx[m_aIDVx[dim]];
 	}
 private:
-	void calcBBoxItem();	
+	///<summary>The shared array of the vertices</summary>
+	const D3* m_aVx;
+	///<summary>Ids of the vertices of the triangle in m_aVx</summary>
+	UI4 m_aIDVx[3];
+};
 
-	///<summary>Bounding box of the triangle</summary>
-	SBBox m_bBoxItem;
-	///<summary>Vertices of the triangle</summary>
-	D3 m_aVx[3];
-};
\ No newline at end of file
+///<summary>Checks that the items can be saved into the file of the KD Tree and mapped from it, they must have no pointers</summary>
+template<typename T>
+struct SItemSerializable
+{
+	static const bool value = std::is_trivially_copyable<T>::value;
+};
+
+///<summary>The triangles of the indexed mesh keep the pointer to the array of the vertices</summary>
+template<>
+struct SItemSerializable<CItemTriangleIndexed>
+{
+	static const bool value = false;
+};
+
+///<summary>Gets the vertices of the item if it's the triangle</summary>
+///<returns>False if the item isn't the triangle</returns>
+template<typename T>
+inline bool getTriangleVertices(const T&, D3&, D3&, D3&)
+{
+	return false;
+}
+
+///<summary>Gets the vertices of the triangle</summary>
+///<returns>True</returns>
+template<>
+inline bool getTriangleVertices<CItemTriangle>(const CItemTriangle& item, D3& A, D3& B, D3& C)
+{
+	A = item[0];
+	B = item[1];
+	C = item[2];
+	return true;
+}
+
+///<summary>Sets the vertices of the item if it's the triangle</summary>
+///<returns>False if the item isn't the triangle, then it isn't changed</returns>
+template<typename T>
+inline bool setTriangleVertices(T&, const D3&, const D3&, const D3&)
+{
+	return false;
+}
+
+///<summary>Sets the vertices of the triangle</summary>
+///<returns>True</returns>
+template<>
+inline bool setTriangleVertices<CItemTriangle>(CItemTriangle& item, const D3& A, const D3& B, const D3& C)
+{
+	item.setTriangle(A, B, C);
+	return true;
+}
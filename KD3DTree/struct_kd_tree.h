@@ -1,52 +1,339 @@
 #pragma once
 #include "math_util.h"
+#include "math_simd.h"
 
 #include "struct_file.h"
 #include "struct_basic_types.h"
+#include "struct_mesh_normals.h"
+#include "struct_volume.h"
 #include "struct_tree_kd_node.h"
 #include "struct_node_splitter.h"
+#include "struct_arena.h"
 #include "defines.h"
 
-#include <list>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <omp.h>
 
-#ifdef USE_STACK_NODES
-template <typename T>
-class CHyperVector
-{
-	///<summary>The elements of the 'Hyper Vector'</summary>
-	std::list<std::vector<T>> m_aArr;
-	///<summary>The maximum size of the element into the 'Hyper Vector'</summary>
-	const UI1 m_maxSize;
-	///<summary>Pointer to the first free element into the 'Hyper Vector'</summary>
-	UI1 m_counter;
+#ifdef USE_INPLACE_BUILD
+///<summary>The part of the nodes and of the id items of the in place build which is reserved for the subtree</summary>
+///<remarks>The nodes and the id items of the leafs are appended from the starts of the parts, the id items of the node which is building are at the end of its slice</remarks>
+///<remarks>The subtree never leaves its slice, so the threads build their subtrees in the shared buffers without the locks</remarks>
+struct SKDTreeBuildSlice
+{
+	SKDTreeBuildSlice() : m_idNode(0), m_endNodes(0), m_idIDItem(0), m_endIDItems(0), m_numNodes(0), m_numIDItems(0)
+	{
+
+	}
+
+	SKDTreeBuildSlice(const UI1 idNode, const UI1 endNodes, const UI1 idIDItem, const UI1 endIDItems) :
+		m_idNode(idNode), m_endNodes(endNodes), m_idIDItem(idIDItem), m_endIDItems(endIDItems), m_numNodes(0), m_numIDItems(0)
+	{
+
+	}
+
+	///<summary>Shares the free nodes and id items of the slice between the children of its node</summary>
+	///<remarks>The node is taken from the slice already, 2 nodes and the id items of the children are free at least, so every child gets one node and the place for its id items</remarks>
+	///<remarks>The left child which can't spawn the subtrees takes all free nodes and id items, the right child takes the rest of the slice after it, so the subtree is limited by its slice only
+	///otherwise the spawned subtree takes its whole slice, so the free nodes and id items are shared by the numbers of the items of the children</remarks>
+	///<remarks>Out : sliceLeft - The slice of the left child at the start of the free part</remarks>
+	///<remarks>Out : sliceRight - The slice of the right child at the end of the free part, so the id items of the right child are at its end already</remarks>
+	///<remarks>In : nItemsLeft - The number of the id items of the left child</remarks>
+	///<remarks>In : nItemsRight - The number of the id items of the right child</remarks>
+	///<remarks>In : bShareByItems - The free nodes and id items are shared by the numbers of the items</remarks>
+	void share(SKDTreeBuildSlice& sliceLeft, SKDTreeBuildSlice& sliceRight, const UI1 nItemsLeft, const UI1 nItemsRight, const bool bShareByItems) const
+	{
+		const UI1 nItems = nItemsLeft + nItemsRight;
+		const UI1 nFreeNodes = m_endNodes - m_idNode - 2;
+		const UI1 nFreeIDItems = m_endIDItems - m_idIDItem - nItems;
+		const UI1 nNodesLeft = 1 + (!bShareByItems ? nFreeNodes : nItems > 0 ? nFreeNodes * nItemsLeft / nItems : nFreeNodes / 2);
+		const UI1 nIDItemsLeft = nItemsLeft + (!bShareByItems ? nFreeIDItems : nItems > 0 ? nFreeIDItems * nItemsLeft / nItems : 0);
+
+		sliceLeft = SKDTreeBuildSlice(m_idNode, m_idNode + nNodesLeft, m_idIDItem, m_idIDItem + nIDItemsLeft);
+		sliceRight = SKDTreeBuildSlice(m_idNode + nNodesLeft, m_endNodes, m_idIDItem + nIDItemsLeft, m_endIDItems);
+	}
+
+	///<summary>Moves the start of the slice after the subtree of the child which is built at its start</summary>
+	///<remarks>In : sliceChild - The slice of the child after its build</remarks>
+	void moveAfter(const SKDTreeBuildSlice& sliceChild)
+	{
+		m_idNode = sliceChild.m_idNode;
+		m_idIDItem = sliceChild.m_idIDItem;
+		m_numNodes += sliceChild.m_numNodes;
+		m_numIDItems += sliceChild.m_numIDItems;
+	}
+
+	///<summary>Id of the next node of the subtree and the end of its nodes</summary>
+	UI1 m_idNode;
+	UI1 m_endNodes;
+	///<summary>Position of the next id item of the leafs of the subtree and the end of its id items</summary>
+	UI1 m_idIDItem;
+	UI1 m_endIDItems;
+	///<summary>The numbers of the nodes and of the id items of the leafs built in the slice, the spawned subtrees are counted by their tasks</summary>
+	UI1 m_numNodes;
+	UI1 m_numIDItems;
+};
+
+///<summary>The buffers for building of the KD Tree in place, every subtree is built in its slice of them</summary>
+///<remarks>The node is split only if its children fit into its slice, so the build takes cInPlaceNodesFactor nodes and cInPlaceIDItemsFactor id items per item at most
+///and the buffers are reserved once by these limits, the pages which the build doesn't touch aren't used</remarks>
+struct SKDTreeBuildBuffers
+{
+	SKDTreeBuildBuffers() : m_pNodes(nullptr), m_pIDItems(nullptr), m_numGrowths(0)
+	{
+
+	}
+
+	///<summary>Reserves the nodes and the id items for the build of the items</summary>
+	///<remarks>In : nItems - The number of the items</remarks>
+	///<returns>The slice of all nodes and id items</returns>
+	SKDTreeBuildSlice reserve(const UI1 nItems)
+	{
+		const UI1 nNodes = cInPlaceNodesFactor * math::max2(nItems, static_cast<UI1>(1));
+		const UI1 nIDItems = cInPlaceIDItemsFactor * nItems;
+		m_arena.reserve(nNodes * sizeof(SFlatKDTreeNode) + nIDItems * sizeof(UI4));
+		m_pNodes = m_arena.allocateArray<SFlatKDTreeNode>(nNodes);
+		m_pIDItems = m_arena.allocateArray<UI4>(nIDItems);
+
+		return SKDTreeBuildSlice(0, nNodes, 0, nIDItems);
+	}
+
+	///<summary>Takes the next node of the slice</summary>
+	///<returns>The node, it's the leaf without the items</returns>
+	SFlatKDTreeNode& takeNode(SKDTreeBuildSlice& slice)
+	{
+		++slice.m_numNodes;
+		return *new (m_pNodes + slice.m_idNode++) SFlatKDTreeNode();
+	}
+
+	///<summary>Makes the leaf of the id items of the node, they are moved from the end of the slice to its start</summary>
+	///<remarks>In/Out : slice - The slice of the node</remarks>
+	///<remarks>In/Out : node - The node taken from the slice</remarks>
+	///<remarks>In : pIDItems - The id items of the node</remarks>
+	///<remarks>In : nIDItems - The number of the id items of the node</remarks>
+	void setLeaf(SKDTreeBuildSlice& slice, SFlatKDTreeNode& node, const UI4* const pIDItems, const UI1 nIDItems)
+	{
+		node.setLeaf(static_cast<UI4>(slice.m_idIDItem), static_cast<UI4>(nIDItems));
+		::memmove(m_pIDItems + slice.m_idIDItem, pIDItems, nIDItems * sizeof(UI4));
+		slice.m_idIDItem += nIDItems;
+		slice.m_numIDItems += nIDItems;
+	}
+
+	///<summary>Resizes the buffer of the build</summary>
+	///<remarks>In/Out : aBuffer - The buffer</remarks>
+	///<remarks>In : size - The new size of the buffer</remarks>
+	template<typename U, typename A>
+	void resizeBuffer(std::vector<U, A>& aBuffer, const UI1 size)
+	{
+		if (size > aBuffer.capacity())
+			++m_numGrowths;
+		aBuffer.resize(size);
+	}
+
+	///<returns>The number of the reallocations of the buffers after their setup, the arena is reserved by one slab</returns>
+	UI1 getNumGrowths() const
+	{
+		return m_numGrowths + m_arena.getNumSlabs() - 1;
+	}
+
+	///<summary>The arena of the nodes and of the id items</summary>
+	CMonotonicArena m_arena;
+	///<summary>The nodes of the build, the left child follows its parent in the slice of the parent, the right child is found by its id</summary>
+	SFlatKDTreeNode* m_pNodes;
+	///<summary>The id items of the leafs and of the nodes which are building</summary>
+	UI4* m_pIDItems;
+	///<summary>The number of the reallocations of the buffers of the parallel partition</summary>
+	UI1 m_numGrowths;
+};
+
+///<summary>The subtree of the KD Tree which is built by any thread in its slice of the buffers</summary>
+struct SKDTreeBuildTask
+{
+	SKDTreeBuildTask() : m_depth(0), m_numItems(0), m_numLeafs(0)
+	{
+
+	}
+
+	///<summary>The bounding box of the root of the subtree</summary>
+	SBBox m_bBox;
+	///<summary>The depth of the root of the subtree</summary>
+	UI1 m_depth;
+	///<summary>The slice of the subtree, the id items of its root are at its end</summary>
+	SKDTreeBuildSlice m_slice;
+	///<summary>The number of the id items of the root of the subtree</summary>
+	UI1 m_numItems;
+	///<summary>The number of the leafs of the subtree</summary>
+	UI1 m_numLeafs;
+};
+
+///<summary>The work-stealing queues of the build tasks, one queue for each thread</summary>
+///<remarks>The thread takes the last task from its own queue and steals the first(the biggest) task from the others</remarks>
+///<remarks>The queue is the reserved array with the index of its first task, the array is cleared when the queue becomes empty</remarks>
+///<remarks>The tasks are reserved before the build, every queue has the place for all of them, so the queues never grow</remarks>
+class CKDTreeBuildScheduler
+{
+	///<summary>The reserved tasks, they keep their addresses while the threads push and take them</summary>
+	std::vector<SKDTreeBuildTask> m_aTasks;
+	///<summary>The number of the created tasks, it's more than the number of the reserved tasks when all of them are taken</summary>
+	std::atomic<UI1> m_numTasks;
+	std::vector<std::vector<SKDTreeBuildTask*>> m_aQueues;
+	std::vector<UI1> m_aFirstTasks;
+	std::vector<std::mutex> m_aMutexes;
+	///<summary>The numbers of the reallocations of the queues, they are counted under the locks of the queues</summary>
+	std::vector<UI1> m_aNumGrowths;
+	///<summary>The number of the tasks which are pushed and not finished</summary>
+	std::atomic<I1> m_numPending;
+
+	CKDTreeBuildScheduler(const CKDTreeBuildScheduler& scheduler);
+	CKDTreeBuildScheduler& operator=(const CKDTreeBuildScheduler& scheduler);
 public:
+	///<remarks>In : nThreads - The number of the threads</remarks>
+	///<remarks>In : nTasks - The number of the reserved tasks</remarks>
+	CKDTreeBuildScheduler(const UI1 nThreads, const UI1 nTasks) : m_aTasks(nTasks), m_numTasks(0), m_aQueues(nThreads), m_aFirstTasks(nThreads, 0), m_aMutexes(nThreads), m_aNumGrowths(nThreads, 0), m_numPending(0)
+	{
+		for (UI1 i = 0; i < nThreads; ++i)
+			m_aQueues[i].reserve(nTasks);
+	}
+
+	///<summary>Takes the free reserved task</summary>
+	///<returns>The task, nullptr if all tasks are taken</returns>
+	SKDTreeBuildTask* createTask()
+	{
+		const UI1 idTask = m_numTasks++;
+		return idTask < m_aTasks.size() ? &m_aTasks[idTask] : nullptr;
+	}
+
+	///<returns>The number of the created tasks, it's called after the build</returns>
+	UI1 getNumTasks() const
+	{
+		return math::min2(static_cast<UI1>(m_numTasks), m_aTasks.size());
+	}
+
+	///<returns>The created task, it's called after the build</returns>
+	const SKDTreeBuildTask& getTask(const UI1 idTask) const
+	{
+		return m_aTasks[idTask];
+	}
+
+	///<summary>Pushes the task into the queue of the thread</summary>
+	void push(const UI1 iThread, SKDTreeBuildTask* const pTask)
+	{
+		++m_numPending;
+
+		std::lock_guard<std::mutex> lock(m_aMutexes[iThread]);
+		if (m_aQueues[iThread].size() == m_aQueues[iThread].capacity())
+			++m_aNumGrowths[iThread];
+		m_aQueues[iThread].push_back(pTask);
+	}
 
-	CHyperVector() : m_maxSize(cHyperVectorBufferSize), m_counter(0)
+	///<returns>The number of the reallocations of all queues, it's called after the build</returns>
+	UI1 getNumGrowths() const
 	{
-		m_aArr.emplace_back(std::vector<T>());
-		m_aArr.back().resize(m_maxSize);
+		UI1 nGrowths = 0;
+		for (UI1 i = 0, nQueues = m_aNumGrowths.size(); i < nQueues; ++i)
+			nGrowths += m_aNumGrowths[i];
+
+		return nGrowths;
 	}
 
-	~CHyperVector()
+	///<summary>Marks the task taken by pop as finished</summary>
+	void finish()
 	{
+		--m_numPending;
 	}
 
-	T* const getPointerToTheLastNode()
+	///<summary>Takes the task for the thread, waits while the other threads can push the new tasks</summary>
+	///<remarks>In : iThread - The thread which takes the task</remarks>
+	///<remarks>Out : pTask - The task</remarks>
+	///<returns>False if all the tasks are finished</returns>
+	bool pop(const UI1 iThread, SKDTreeBuildTask*& pTask)
 	{
-		if (m_maxSize == m_counter)
+		const UI1 nQueues = m_aQueues.size();
+		for (;;)
 		{
-			m_counter = 0;
-			m_aArr.emplace_back(std::vector<T>());
-			m_aArr.back().resize(m_maxSize);
-			return &(m_aArr.back()[m_counter++]);
+			{
+				std::lock_guard<std::mutex> lock(m_aMutexes[iThread]);
+				if (m_aFirstTasks[iThread] < m_aQueues[iThread].size())
+				{
+					pTask = m_aQueues[iThread].back();
+					m_aQueues[iThread].pop_back();
+					clearEmptyQueue(iThread);
+					return true;
+				}
+			}
+
+			for (UI1 i = 1; i < nQueues; ++i)
+			{
+				const UI1 iVictim = (iThread + i) % nQueues;
+
+				std::lock_guard<std::mutex> lock(m_aMutexes[iVictim]);
+				if (m_aFirstTasks[iVictim] < m_aQueues[iVictim].size())
+				{
+					pTask = m_aQueues[iVictim][m_aFirstTasks[iVictim]++];
+					clearEmptyQueue(iVictim);
+					return true;
+				}
+			}
+
+			if (m_numPending == 0)
+				return false;
+
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	///<summary>Clears the queue without the tasks, so its reserved memory is used again, it's called under the lock of the queue</summary>
+	void clearEmptyQueue(const UI1 iThread)
+	{
+		if (m_aFirstTasks[iThread] == m_aQueues[iThread].size())
+		{
+			m_aQueues[iThread].clear();
+			m_aFirstTasks[iThread] = 0;
 		}
-		else
-			return &(m_aArr.back()[m_counter++]);
 	}
 };
 #endif
 
+///<summary>The header of the file of the KD Tree, the arrays follow it at the aligned offsets from the start of the file</summary>
+///<remarks>The file has no pointers, so it's mapped at any address and is used without the parsing, it's read by the same build on the same architecture only</remarks>
+///<remarks>The mapping checks the header only, so the file is the trusted input, C3DKDTree::validate checks the nodes and the id items of the untrusted file</remarks>
+struct SKDTreeFileHeader
+{
+	char m_aMagic[8];
+	UI4 m_version;
+	///<summary>The sizes of the item, of the node and of the precomputed triangle, the file of the other items is rejected</summary>
+	UI4 m_sizeItem;
+	UI4 m_sizeNode;
+	UI4 m_sizeTrianglePrecomputed;
+	UI8 m_numItems;
+	UI8 m_numNodes;
+	UI8 m_numIDItems;
+	UI8 m_numTrianglesPrecomputed;
+	UI8 m_numLeafs;
+	///<summary>The SAH cost of the KD Tree after its build, the refit of the mapped KD Tree is compared with it</summary>
+	double m_costSAHBuild;
+	///<summary>Offsets of the arrays from the start of the file</summary>
+	UI8 m_offsetItems;
+	UI8 m_offsetNodes;
+	UI8 m_offsetIDItems;
+	UI8 m_offsetTrianglesPrecomputed;
+	SBBox m_bBoxTree;
+};
+
+///<summary>The builders of the KD Tree, the speed of the build or the quality of the KD Tree is chosen per use</summary>
+enum eKDTreeBuild
+{
+	///<summary>All nodes are split by the splitter</summary>
+	eKDTreeBuildSplitter,
+	///<summary>The nodes are split by the highest different bits of the sorted Morton codes of the centers of their items, it's the fastest build</summary>
+	eKDTreeBuildMorton,
+	///<summary>The top cMortonSplitterDepth levels are split by the splitter and the rest by the Morton codes</summary>
+	eKDTreeBuildMortonSplitterTop
+};
+
 template<typename T>
 class C3DKDTree
 {
@@ -54,7 +341,19 @@ public:
 	///<summary>Builds the KD Tree and copyes the aItems into the new array</summary>
 	///<remarks>In : aItems - The items for which we are building the KD Tree</remarks>
 	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
-	C3DKDTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, bool bUseMultithread = false);
+	///<remarks>In : build - The builder of the KD Tree</remarks>
+	C3DKDTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, bool bUseMultithread = false, const eKDTreeBuild build = eKDTreeBuildSplitter);
+
+	///<summary>Builds the KD Tree and moves the aItems into it, so the items aren't copied</summary>
+	///<remarks>In/Out : aItems - The items for which we are building the KD Tree, it's empty after the move</remarks>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	///<remarks>In : build - The builder of the KD Tree</remarks>
+	C3DKDTree(std::vector<T>&& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, bool bUseMultithread = false, const eKDTreeBuild build = eKDTreeBuildSplitter);
+
+	///<summary>Maps the KD Tree saved by save from the file, the arrays are used in the mapped memory without the copying</summary>
+	///<remarks>The exceptions CExceptionCanNotOpenFile and CExceptionWrongFileFormat are thrown if the file can't be mapped</remarks>
+	///<remarks>In : pNameFile - The name of the file of the KD Tree</remarks>
+	explicit C3DKDTree(const char* const pNameFile);
 
 	~C3DKDTree()
 	{
@@ -64,27 +363,201 @@ public:
 	///<summary>Finds nearest item to the point</summary>
 	///<remarks>Out : nearestItemInfo - structure of the data about nearest item</remarks>
 	///<remarks>In : point - The point for which we are find nearest item</remarks>
-	void findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, const UI1 iThread = 0);
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	void findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, SKDTreeQueryScratch& scratch) const;
 
 	///<summary>Finds nearest item to the point in the radius</summary>
-	///<remarks>Out : nearestItemInfo - structure of the data about nearest item</remarks>
+	///<remarks>In/Out : nearestItemInfo - structure of the data about nearest item, its m_minDist is the radius of the search</remarks>
+	///<remarks>In : point - The point for which we are find nearest item</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	void findNearestItemInRadius(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds nearest triangle to the point, its closest point and the feature which contains the closest point</summary>
+	///<remarks>Out : nearestFeatureINFO - structure of the data about nearest triangle and its closest feature</remarks>
 	///<remarks>In : point - The point for which we are find nearest item</remarks>
-	void findNearestItemInRadius(C3DKDTreeNearestItemINFO& itemINFO, const D3& point, const UI1 iThread = 0)
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	void findNearestItem(C3DKDTreeNearestFeatureINFO& nearestFeatureINFO, const D3& point, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds the signed distance from the point to the closed triangle mesh by one query, the sign is given by the pseudo-normal of the closest feature</summary>
+	///<remarks>Out : nearestFeatureINFO - structure of the data about nearest triangle and its closest feature, its m_minDist is not signed</remarks>
+	///<remarks>In : point - The point for which we are find the signed distance</remarks>
+	///<remarks>In : normals - The pseudo-normals of the items of the KD Tree</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	///<returns>The distance, it's negative inside of the mesh, DBL_MAX if the KD Tree is empty</returns>
+	double findSignedDist(C3DKDTreeNearestFeatureINFO& nearestFeatureINFO, const D3& point, const CMeshPseudoNormals& normals, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds all items whose distance to the point is not greater than the radius, the items are reported to the callback as they are found</summary>
+	///<remarks>The callback is called as callback(const UI1 idItem, const double dist2) once per item, the items aren't ordered by the distance</remarks>
+	///<remarks>In : point - The point for which we are finding the items</remarks>
+	///<remarks>In : radius - The radius of the search</remarks>
+	///<remarks>In : callback - The callback of the found items</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	template<typename TCallback>
+	void findItemsInRadius(const D3& point, const double radius, TCallback callback, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds all items which overlap the volume, the items are reported to the callback as they are found</summary>
+	///<remarks>The callback is called as callback(const UI1 idItem) once per item, the volume has the functions of struct_volume.h</remarks>
+	///<remarks>In : volume - The volume of the search, SVolumeBBox, SVolumeOrientedBBox or SVolumeFrustum</remarks>
+	///<remarks>In : callback - The callback of the found items</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	template<typename TVolume, typename TCallback>
+	void findItemsOverlap(const TVolume& volume, TCallback callback, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds all items which overlap the bounding box, the items are reported to the callback as they are found</summary>
+	///<remarks>The callback is called as callback(const UI1 idItem) once per item</remarks>
+	///<remarks>In : bBox - The bounding box of the search</remarks>
+	///<remarks>In : callback - The callback of the found items</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	template<typename TCallback>
+	void findItemsInBBox(const SBBox& bBox, TCallback callback, SKDTreeQueryScratch& scratch) const
 	{
-		findNearestItemInRadius(itemINFO, m_pRootNode, point, iThread);
+		findItemsOverlap(SVolumeBBox(bBox), callback, scratch);
 	}
 
-	///<summary>Finds nearest leaf of the KD Tree to the point</summary>
-	///<remarks>In : point - The point for which we are finding nearest item</remarks>
-	///<returns>The nearest leaf of the KD Tree to the point</returns>
-	const C3DKDTreeNode* const findNearestLeaf(const D3& point) const
+	///<summary>Finds k nearest items to the point which are closer than maxDist</summary>
+	///<remarks>Out : aNearestItemsINFO - structures of the data about nearest items in the ascending order of the distances, at most k</remarks>
+	///<remarks>In : point - The point for which we are finding nearest items</remarks>
+	///<remarks>In : k - The maximal number of the items</remarks>
+	///<remarks>In : maxDist - The maximal distance of the items</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	void findKNearestItems(std::vector<C3DKDTreeNearestItemINFO>& aNearestItemsINFO, const D3& point, const UI1 k, const double maxDist,
+		SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds the first item hit by the ray</summary>
+	///<remarks>Out : hitINFO - structure of the data about the first hit</remarks>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized, so the parameter of the hit is in the units of its length</remarks>
+	///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	///<returns>True if the ray hits any item at 0 <= t <= tMax, otherwise false</returns>
+	bool findFirstHit(C3DKDTreeRayHitINFO& hitINFO, const D3& origin, const D3& dir, const double tMax, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Checks that the ray hits any item, the traversal stops at the first found hit</summary>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+	///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	///<returns>True if the ray hits any item at 0 <= t <= tMax, otherwise false</returns>
+	bool findAnyHit(const D3& origin, const D3& dir, const double tMax, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds the first item hit by the segment from a to b</summary>
+	///<remarks>Out : hitINFO - structure of the data about the first hit, its m_t is the fraction of the segment from a</remarks>
+	///<remarks>In : a - The start of the segment</remarks>
+	///<remarks>In : b - The end of the segment</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	///<returns>True if the segment hits any item, otherwise false</returns>
+	bool findFirstHitSegment(C3DKDTreeRayHitINFO& hitINFO, const D3& a, const D3& b, SKDTreeQueryScratch& scratch) const
 	{
-		return findNearestLeaf(m_pRootNode, point);
+		return findFirstHit(hitINFO, a, b - a, 1., scratch);
 	}
 
-	///<summary>Gets the leafs of the KD Tree</summary>
-	///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
-	void getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes) const;
+	///<summary>Checks that the segment from a to b hits any item</summary>
+	///<remarks>In : a - The start of the segment</remarks>
+	///<remarks>In : b - The end of the segment</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+	///<returns>True if the segment hits any item, otherwise false</returns>
+	bool findAnyHitSegment(const D3& a, const D3& b, SKDTreeQueryScratch& scratch) const
+	{
+		return findAnyHit(a, b - a, 1., scratch);
+	}
+
+	///<summary>Finds nearest items to the points, the points are processed by the packets and by the threads</summary>
+	///<remarks>In : pPoints - The points for which we are finding nearest items</remarks>
+	///<remarks>In : nPoints - The number of the points</remarks>
+	///<remarks>Out : pNearestItemsINFO - structures of the data about nearest items, one per point</remarks>
+	void findNearestItems(const D3* pPoints, const UI1 nPoints, C3DKDTreeNearestItemINFO* pNearestItemsINFO) const;
+
+	///<summary>Finds nearest items to the points, the points are processed by the packets and by the threads</summary>
+	///<remarks>In : aPoints - The points for which we are finding nearest items</remarks>
+	///<remarks>Out : aNearestItemsINFO - structures of the data about nearest items, one per point</remarks>
+	void findNearestItems(const std::vector<D3>& aPoints, std::vector<C3DKDTreeNearestItemINFO>& aNearestItemsINFO) const
+	{
+		aNearestItemsINFO.resize(aPoints.size());
+		findNearestItems(aPoints.data(), aPoints.size(), aNearestItemsINFO.data());
+	}
+
+	///<summary>Inserts the item into the leafs which it overlaps, the leafs grow and the bounding box of the KD Tree grows if the item is out of it</summary>
+	///<remarks>The edits must not run concurrently with the queries, the mapped KD Tree is copied into the memory by the first edit</remarks>
+	///<remarks>In : item - The new item</remarks>
+	///<returns>Id of the new item, it's the position of the item in the items of the KD Tree</returns>
+	UI1 insertItem(const T& item);
+
+	///<summary>Removes the item from its leafs, the item is marked as removed and its id isn't reused</summary>
+	///<remarks>In : idItem - Id of the item</remarks>
+	void removeItem(const UI1 idItem);
+
+	///<summary>Replaces the item, it's removed from the leafs of the old item and is inserted into the leafs of the new one</summary>
+	///<remarks>In : idItem - Id of the item</remarks>
+	///<remarks>In : item - The new item</remarks>
+	void updateItem(const UI1 idItem, const T& item);
+
+	///<summary>Checks that the item is removed</summary>
+	///<returns>True if the item is removed by removeItem, otherwise false</returns>
+	bool isItemRemoved(const UI1 idItem) const
+	{
+		return idItem < m_aRemovedItems.size() && m_aRemovedItems[idItem];
+	}
+
+	///<summary>Rebuilds the leafs whose SAH cost grew by the new items past the threshold relative to their cost after the last rebuild, so the SAH cost of the KD Tree is restored</summary>
+	///<remarks>The leafs are rebuilt into the subtrees which are appended to the flattened KD Tree, the arrays are compacted when the half of them is unused</remarks>
+	///<remarks>The leafs below the threshold wait for the next call with their cost after the last rebuild</remarks>
+	///<remarks>The baseline of the relative cost of the refit is moved by the costs of the rebuilt leafs, it's reset by the build only</remarks>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	///<remarks>In : maxCostLeafRelative - The SAH cost of the leaf relative to its cost after the last rebuild, the leafs above it are rebuilt</remarks>
+	///<returns>The number of the rebuilt leafs</returns>
+	UI1 rebuildDegradedLeafs(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const double maxCostLeafRelative = cMaxCostLeafRebuild);
+
+	///<summary>Refits the KD Tree of the triangles to the moved vertices of the deforming mesh, the vertices are set into the triangles in place, the split planes are kept and only the moved triangles are distributed again</summary>
+	///<remarks>The leafs without the moved triangles keep their id items in place, the cost of the refit follows the number of the moved triangles</remarks>
+	///<remarks>The SAH cost of the KD Tree grows while the triangles move away from the split planes, so the KD Tree is rebuilt by the splitter when its relative cost exceeds maxCostRelative</remarks>
+	///<remarks>In : aVertices - The moved vertices of the triangles, 3 vertices per triangle in the order of the items of the KD Tree</remarks>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter of the rebuild</remarks>
+	///<remarks>Out : costRelative - The SAH cost of the refitted KD Tree relative to its cost after the last build and the rebuilds of the leafs, the KD Tree was rebuilt if it's greater than maxCostRelative</remarks>
+	///<remarks>In : maxCostRelative - The relative SAH cost of the refitted KD Tree above which it's rebuilt</remarks>
+	///<returns>False if the number of the vertices differs or the items aren't the packed triangles, then the KD Tree isn't changed</returns>
+	bool refit(const std::vector<D3>& aVertices, const C3DKDTreeNodeSplitter<T>& nodeSplitter, double& costRelative, const double maxCostRelative = cMaxCostRefitRebuild);
+
+	///<summary>Refits the KD Tree to its items, the shared vertices of the indexed triangles are moved by the caller</summary>
+	///<remarks>The moves of the items are unknown, so all items are distributed again</remarks>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter of the rebuild</remarks>
+	///<remarks>In : maxCostRelative - The relative SAH cost of the refitted KD Tree above which it's rebuilt</remarks>
+	///<returns>The SAH cost of the refitted KD Tree relative to its cost after the last build and the rebuilds of the leafs, the KD Tree was rebuilt if it's greater than maxCostRelative</returns>
+	double refit(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const double maxCostRelative = cMaxCostRefitRebuild);
+
+	///<summary>Calculates the SAH cost of the KD Tree, it's the expected cost of the query relative to the cost of the traversal of one node</summary>
+	///<returns>The SAH cost of the KD Tree, 0 for the empty KD Tree</returns>
+	double calcCostSAH() const;
+
+	///<summary>Saves the KD Tree into the binary file which is mapped by the constructor of the file</summary>
+	///<remarks>The items must have no pointers, so the triangles of the indexed mesh can't be saved</remarks>
+	///<remarks>In : pNameFile - The name of the file of the KD Tree</remarks>
+	void save(const char* const pNameFile) const;
+
+	///<summary>Checks that the nodes and the id items of the KD Tree are in their arrays, so the queries don't read out of them</summary>
+	///<remarks>The mapping of the file doesn't read the nodes, so the file which isn't trusted is checked by it before the queries</remarks>
+	///<returns>True if every reachable node and id item is in its array, every node is reached once and the depth fits the stacks of the queries</returns>
+	bool validate() const;
+
+	///<summary>Gets the items of the KD Tree, the id items of the queries are the positions in it</summary>
+	///<returns>The items of the KD Tree</returns>
+	const T* getItems() const
+	{
+		return m_pItems;
+	}
+
+	///<summary>Gets count of the items of the KD Tree</summary>
+	///<returns>Count of the items of the KD Tree</returns>
+	UI1 getNumItems() const
+	{
+		return m_nItems;
+	}
+
+	///<summary>Gets count of the nodes of the flattened KD Tree</summary>
+	///<returns>Count of the nodes of the flattened KD Tree</returns>
+	UI1 getNumNodes() const
+	{
+		return m_nFlatNodes;
+	}
 
 	///<summary>Gets count of the leafs of the KD Tree</summary>
 	///<returns>Count of the leafs of the KD Tree</returns>
@@ -93,6 +566,13 @@ public:
 		return m_numLeafs;
 	}
 
+	///<summary>Gets count of the reallocations of the buffers of the in place build after their setup</summary>
+	///<returns>Count of the reallocations, 0 if the build didn't allocate the memory or the KD Tree isn't built in place</returns>
+	UI1 getNumBuildGrowths() const
+	{
+		return m_numBuildGrowths;
+	}
+
 #ifdef DUMP_TREE
 	void dumpTree(const char* pNameDump) const;
 #endif
@@ -104,15 +584,145 @@ public:
 private:
 	C3DKDTree(const C3DKDTree& kdTree);
 
+	///<summary>Builds the KD Tree over m_aItems</summary>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	///<remarks>In : build - The builder of the KD Tree</remarks>
+	void buildTree(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const eKDTreeBuild build);
+
+	///<summary>Builds the split planes of the flattened KD Tree by the sorted Morton codes of the centers of the items and distributes the items into its leafs</summary>
+	///<remarks>In : pNodeSplitter - The splitter of the top levels, if it's nullptr, then all levels are split by the Morton codes</remarks>
+	void createTreeMorton(const C3DKDTreeNodeSplitter<T>* const pNodeSplitter);
+
+	///<summary>Builds the split planes of the subtree of the flattened KD Tree by the Morton codes, its leafs are empty</summary>
+	///<remarks>In/Out : aCodes - The sorted Morton codes of the centers of the items with the ids of the items, the range of the node is reordered by the splitter</remarks>
+	///<remarks>In/Out : aIDItems - The buffer of the id items of the node for the splitter</remarks>
+	///<remarks>In : pNodeSplitter - The splitter of the top levels, nullptr if it isn't used</remarks>
+	///<remarks>In : bBox - The bounding box of the node</remarks>
+	///<remarks>In : begin - Position of the first code of the node</remarks>
+	///<remarks>In : end - Position of the end of the codes of the node</remarks>
+	///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+	void createTreeMorton(std::vector<std::pair<UI8, UI4>>& aCodes, std::vector<UI4>& aIDItems, const C3DKDTreeNodeSplitter<T>* const pNodeSplitter, const SBBox& bBox,
+		const UI1 begin, const UI1 end, const UI1 currentDepth);
+
+	///<summary>Calculates the bounding boxes of the items into m_aBBoxItems by the threads</summary>
+	///<remarks>In : nThreads - The number of the threads</remarks>
+	///<returns>The bounding box of the not removed items</returns>
+	SBBox calcBBoxItemsParallel(const I1 nThreads);
+
+	///<summary>Distributes the not removed items into the leafs of the flattened KD Tree, the id items of the leafs are replaced</summary>
+	///<remarks>The bounding boxes of the items must be in m_aBBoxItems, they are moved into m_aBBoxItemsLeafs</remarks>
+	///<remarks>In : nThreads - The number of the threads</remarks>
+	void distributeItemsLeafs(const I1 nThreads);
+
+	///<summary>Refits the id items of the leafs of the flattened KD Tree to the moved items, the marked items are removed from their leafs and are distributed again</summary>
+	///<remarks>The leafs which got the items reuse the places of their removed items or are moved to the end of the array of the id items, only they are sorted, the other leafs are compacted in place</remarks>
+	///<remarks>In : nThreads - The number of the threads</remarks>
+	///<remarks>In : aMovedItems - The marks of the moved not removed items</remarks>
+	void refitItemsLeafs(const I1 nThreads, const std::vector<unsigned char>& aMovedItems);
+
+	///<summary>Rebuilds the refitted KD Tree by the splitter if its SAH cost relative to its cost after the last build and the rebuilds of the leafs exceeds maxCostRelative</summary>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter of the rebuild</remarks>
+	///<remarks>In : maxCostRelative - The relative SAH cost of the refitted KD Tree above which it's rebuilt</remarks>
+	///<returns>The SAH cost of the refitted KD Tree relative to its cost after the last build and the rebuilds of the leafs</returns>
+	double rebuildRefittedTree(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const double maxCostRelative);
+
+	///<summary>Rebuilds the KD Tree over its not removed items by the splitter, the garbage of the edits is dropped</summary>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	void rebuildTree(const C3DKDTreeNodeSplitter<T>& nodeSplitter);
+
+	///<summary>Writes the ids of the not removed items for the build</summary>
+	///<remarks>Out : pIDItems - The ids of the items, the array must have the place for all items</remarks>
+	///<returns>The number of the written ids</returns>
+	template<typename TID>
+	UI1 initIDItemsBuild(TID* const pIDItems) const
+	{
+		UI1 nIDItems = 0;
+		for (UI1 i = 0, nItems = m_aItems.size(); i < nItems; ++i)
+		{
+			if (!isItemRemoved(i))
+				pIDItems[nIDItems++] = static_cast<TID>(i);
+		}
+		return nIDItems;
+	}
+
+	///<summary>Points the arrays of the queries to the built arrays</summary>
+	void bindQueryArrays();
+
 	///<summary>Builds the KD Tree</summary>
 	///<remarks>In : aItems - The items for which we are building KD Tree</remarks>
 	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
 	void createTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter);
 
+#ifdef USE_INPLACE_BUILD
+	///<summary>Builds the KD Tree in place over the preallocated buffers of the id items</summary>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	void createTreeInPlace(const C3DKDTreeNodeSplitter<T>& nodeSplitter);
+
+	///<summary>Builds the subtree of the flattened KD Tree in place</summary>
+	///<remarks>In/Out : buffers - The buffers of the build</remarks>
+	///<remarks>In/Out : pScheduler - The queues of the build tasks, if it's nullptr, then the subtree is built by the current thread only</remarks>
+	///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+	///<remarks>In : bBox - The bounding box of the node</remarks>
+	///<remarks>In/Out : slice - The slice of the node, the id items of the node are at its end, the start of the slice is moved after the built subtree</remarks>
+	///<remarks>In : nItems - The number of the id items of the node</remarks>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+	///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+	void createTreeInPlace(SKDTreeBuildBuffers& buffers, CKDTreeBuildScheduler* const pScheduler, UI1& nLeafs, const SBBox& bBox, SKDTreeBuildSlice& slice, const UI1 nItems,
+		const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
+
+	///<summary>Builds the top of the flattened KD Tree in place, the big nodes are split and partitioned by all threads</summary>
+	///<remarks>In/Out : buffers - The buffers of the build</remarks>
+	///<remarks>In/Out : aScratch - The buffer for the parallel partition of the id items</remarks>
+	///<remarks>In/Out : aNumItemsThreads - The buffer for the numbers of the items of the parts of the threads in the parallel partition</remarks>
+	///<remarks>In/Out : scheduler - The queues of the build tasks, the nodes with less than cNumElementsForParallelSplit items are spawned into it</remarks>
+	///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+	///<remarks>In : bBox - The bounding box of the node</remarks>
+	///<remarks>In/Out : slice - The slice of the node, the id items of the node are at its end, the start of the slice is moved after the built subtree</remarks>
+	///<remarks>In : nItems - The number of the id items of the node</remarks>
+	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+	///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+	///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+	void createTreeTopInPlace(SKDTreeBuildBuffers& buffers, std::vector<UI4>& aScratch, std::vector<UI1>& aNumItemsThreads, CKDTreeBuildScheduler& scheduler, UI1& nLeafs, const SBBox& bBox, SKDTreeBuildSlice& slice, const UI1 nItems,
+		const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
+
+	///<summary>Partitions the id items of the node into [left | both | right] by all threads, the order of the items is kept</summary>
+	///<remarks>The partitioned id items are at the end of the id items of the node, the clipped items out of the node are dropped</remarks>
+	///<remarks>In/Out : buffers - The buffers of the build</remarks>
+	///<remarks>In/Out : aScratch - The buffer for the partition</remarks>
+	///<remarks>In/Out : aNumItems - The buffer for the numbers of the right, both and left items of the parts of the threads</remarks>
+	///<remarks>In : bBox - The bounding box of the node</remarks>
+	///<remarks>In : splitINFO - Structure of the data about node after split</remarks>
+	///<remarks>In/Out : pIDItems - The id items of the node</remarks>
+	///<remarks>In : nItems - The number of the id items of the node</remarks>
+	///<remarks>In : maxIDItems - The number of the id items of the children which fit into the slice of the node</remarks>
+	///<remarks>Out : iLeft - Position of the first id item of the left child in the id items of the node</remarks>
+	///<remarks>Out : nItemsLeft - The number of the id items of the left child</remarks>
+	///<remarks>Out : nItemsRight - The number of the id items of the right child, they are at the end of the id items of the node</remarks>
+	///<returns>False if the id items of the children don't fit into the slice of the node, then the id items of the node aren't changed</returns>
+	bool partitionParallel(SKDTreeBuildBuffers& buffers, std::vector<UI4>& aScratch, std::vector<UI1>& aNumItems, const SBBox& bBox, const SSplitINFO& splitINFO, UI4* const pIDItems, const UI1 nItems, const UI1 maxIDItems,
+		UI1& iLeft, UI1& nItemsLeft, UI1& nItemsRight) const;
+
+	///<summary>Spawns the subtree as the task, the task takes the slice of the subtree</summary>
+	///<remarks>In/Out : scheduler - The queues of the build tasks</remarks>
+	///<remarks>In/Out : pTask - The free task of the scheduler</remarks>
+	///<remarks>In : bBox - The bounding box of the root of the subtree</remarks>
+	///<remarks>In/Out : slice - The slice of the subtree, the id items of its root are at its end, its start is moved to its end</remarks>
+	///<remarks>In : nItems - The number of the id items of the root of the subtree</remarks>
+	///<remarks>In : depth - The depth of the root of the subtree</remarks>
+	void spawnSubTree(CKDTreeBuildScheduler& scheduler, SKDTreeBuildTask* const pTask, const SBBox& bBox, SKDTreeBuildSlice& slice, const UI1 nItems, const UI1 depth) const;
+
+	///<summary>Copies the subtree built in place into the flattened KD Tree, the unused parts of the slices of the spawned subtrees are dropped</summary>
+	///<remarks>In : buffers - The buffers of the build</remarks>
+	///<remarks>In : idNode - Id of the root of the subtree in the nodes of the build</remarks>
+	///<returns>Id of the root of the subtree in the array of the flattened nodes</returns>
+	UI4 copyFlatSubTree(const SKDTreeBuildBuffers& buffers, const UI4 idNode);
+#endif
+
 #ifdef USE_STACK_NODES
 
 	///<summary>Builds KD Tree</summary>
-	///<remarks>Out : hVector - The vector of the nodes of the KD Tree(for each thread)</remarks>
+	///<remarks>In/Out : arena - The arena of the nodes and of the id items of the leafs of the thread</remarks>
 	///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
 	///<remarks>In : bBox - The bounding box of the items for which we are building the KD Tree</remarks>
 	///<remarks>In : aIDItems - The items for which wea are building KD Tree</remarks>
@@ -120,16 +730,16 @@ private:
 	///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
 	///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
 	///<returns>Root node of the KD Tree</returns>
-	C3DKDTreeNode* createTree(CHyperVector<C3DKDTreeNode>& hVector, UI1& nLeafs, const SBBox& bBox, std::vector<UI1>& aIDItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
+	C3DKDTreeNode* createTree(CMonotonicArena& arena, UI1& nLeafs, const SBBox& bBox, std::vector<UI1>& aIDItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
 	
 	///<summary>Builds KD Tree</summary>
-	///<remarks>Out : hVector - The vector of the nodes KD Tree(for every thread)</remarks>
+	///<remarks>In/Out : arena - The arena of the nodes and of the id items of the leafs of the thread</remarks>
 	///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
 	///<remarks>In/Out : pTreeNode - The pointer to the leaf of the KD Tree</remarks>
 	///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
 	///<remarks>In : currentDepth - The current depth of the tree</remarks>
 	///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
-	void addSubTree(CHyperVector<C3DKDTreeNode>& hVector, UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
+	void addSubTree(CMonotonicArena& arena, UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
 #endif
 
 #ifndef USE_STACK_NODES
@@ -152,136 +762,2406 @@ private:
 	void addSubTree(UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth = cMaxDepthTree);
 #endif
 
+	///<summary>Flattens the built KD Tree into the array of the compact nodes and releases the built nodes</summary>
+	void flattenTree();
+
+	///<summary>Calculates size of the flattened KD Tree</summary>
+	///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
+	///<remarks>Out : nNodes - The number of the flattened nodes</remarks>
+	///<remarks>Out : nIDItems - The number of the id items in the leafs</remarks>
+	void getSizeFlatTree(const C3DKDTreeNode* pNode, UI1& nNodes, UI1& nIDItems) const;
+
+	///<summary>Appends the node and its subtree to the flattened KD Tree in the depth-first order</summary>
+	///<remarks>In : pNode - The pointer to the current node of the KD Tree, nullptr for the empty leaf</remarks>
+	///<returns>Id of the node in the array of the flattened nodes</returns>
+	UI4 flattenTree(const C3DKDTreeNode* pNode);
+
+	///<summary>Gets the leafs of the KD Tree</summary>
+	///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
+	void getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes) const;
+
 	///<summary>Gets the leafs of the KD Tree</summary>
 	///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
 	///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
 	///<remarks>In : idLast - The index of the last node in the array</remarks>
 	void getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes, C3DKDTreeNode* pNode, UI1& idLast) const;
 
-	///<summary>Finds nearest leaf of the KD Tree to the point</summary>
-	///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
-	///<remarks>In : point - The point for which we are finding nearest item</remarks>
-	///<returns>The nearest leaf of the KD Tree to the point</returns>
-	const C3DKDTreeNode* const findNearestLeaf(const C3DKDTreeNode* pNode, const D3& point) const;
-
-	///<summary>Finds nearest item to the point in the radius</summary>
-	///<remarks>Out : nearestItemInfo - structure of the data about nearest item</remarks>
-	///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
-	///<remarks>In : point - The point for which we are finding nearest item</remarks>
-	void findNearestItemInRadius(C3DKDTreeNearestItemINFO& nearestItemINFO, const C3DKDTreeNode* pNode, const D3& point, const UI1 iThread = 0);
+	///<summary>Gets the bounding boxes of the leafs of the flattened KD Tree</summary>
+	///<remarks>Out : aBBoxLeafs - array of the bounding boxes of the not empty leafs</remarks>
+	///<remarks>In : idNode - Id of the current node in the array of the flattened nodes</remarks>
+	///<remarks>In : bBoxNode - The bounding box of the current node</remarks>
+	void getLeafBBoxes(std::vector<SBBox>& aBBoxLeafs, UI4 idNode, const SBBox& bBoxNode) const;
 
-	///<summary>Clears the KD Tree</summary>	
-	void clear()
+	///<summary>Gets the node of the flattened KD Tree, the link to the rebuilt subtree is replaced by the root of the subtree</summary>
+	///<remarks>In/Out : idNode - Id of the node, it's changed to the id of the root of the subtree for the link</remarks>
+	///<returns>The node</returns>
+	const SFlatKDTreeNode& getFlatNode(UI4& idNode) const
 	{
-#ifdef USE_STACK_NODES
-		m_aANodesThread.clear();
-#endif
-#ifndef USE_STACK_NODES
-		if(m_pRootNode != nullptr)
-			delete m_pRootNode;
-#endif
+		const SFlatKDTreeNode* pNode = m_pFlatNodes + idNode;
+		if (pNode->isLink())
+		{
+			idNode = pNode->m_idRightNode;
+			pNode = m_pFlatNodes + idNode;
+		}
+		return *pNode;
 	}
 
-	C3DKDTree& operator=(const C3DKDTree& kdTree);
+	///<summary>The node which waits in the stack of the traversal of the edits, the leafs which got the new items are kept for the rebuild</summary>
+	struct SEditNode
+	{
+		///<summary>Id of the node in the array of the flattened nodes</summary>
+		UI4 m_idNode;
+		///<summary>Id of the parent of the node, it's patched if the node is the rebuilt right child</summary>
+		UI4 m_idParent;
+		bool m_bRight;
+		UI1 m_depth;
+		///<summary>The number of the items of the leaf before the insertion, the first kept leaf has the number of the items after the last rebuild</summary>
+		UI4 m_numItemsLeaf;
+		///<summary>The bounding box of the node, it's derived from the split planes of its parents</summary>
+		SBBox m_bBox;
+	};
 
-#ifdef USE_STACK_NODES
-	///<summary>Array of the nodes of the KD Tree</summary>	
-	std::vector<CHyperVector<C3DKDTreeNode>> m_aANodesThread;
-#endif
-	bool m_useMultithread;
-	std::vector<std::vector<UI1>> m_aITemsUsedId;
-	std::vector<std::vector<bool>> m_aItemsUsed;
+	///<summary>Copies the arrays of the mapped KD Tree into the memory, so the KD Tree can be edited</summary>
+	void detachMapping();
 
-	///<summary>Array of the items of the KD Tree</summary>	
-	std::vector<T> m_aItems;
+	///<summary>Calculates the bounding boxes of the items which aren't in m_aBBoxItemsLeafs, so the edits find the leafs of the items by them</summary>
+	void initBBoxItemsLeafs();
 
-	C3DKDTreeNode* m_pRootNode;
+	///<summary>Inserts the item into the leafs which its part clipped by the nodes overlaps</summary>
+	///<remarks>In : idItem - Id of the item</remarks>
+	void insertItemLeafs(const UI4 idItem);
 
-	UI1 m_numLeafs;
-};
+	///<summary>Finds the leafs which the part of the item clipped by the nodes overlaps, the item must be in the bounding box of the KD Tree</summary>
+	///<remarks>In : item - The item</remarks>
+	///<remarks>In : bBoxItem - The bounding box of the item</remarks>
+	///<remarks>In : visitLeaf - The functor which is called with SEditNode of every found leaf</remarks>
+	template<typename TVisitLeaf>
+	void findItemLeafs(const T& item, const SBBox& bBoxItem, TVisitLeaf visitLeaf) const;
 
-///<summary>Builds the KD Tree and copyes the aItems into new array</summary>
-///<remarks>In : aItems - The items for which we are building the KD Tree</remarks>
-///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
-template<typename T>
-C3DKDTree<T>::C3DKDTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, bool bUseMultithread) :
-	m_aItems(aItems),
-	m_pRootNode(nullptr),
-	m_numLeafs(0),
-	m_useMultithread(bUseMultithread)
-{
-	createTree(aItems, nodeSplitter);
-}
+	///<summary>Calculates the SAH cost of the subtree without the normalization by the area of the KD Tree</summary>
+	///<remarks>In : idNode - Id of the root of the subtree in the array of the flattened nodes</remarks>
+	///<remarks>In : bBoxNode - The bounding box of the root of the subtree</remarks>
+	///<returns>The sum of the costs of the nodes weighted by the areas of their bounding boxes</returns>
+	double calcCostSAH(UI4 idNode, const SBBox& bBoxNode) const;
 
-#ifdef USE_STACK_NODES
-///<summary>Builds the KD Tree</summary>
-///<remarks>In : aItems - The items for which we are building KD Tree</remarks>
-///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
-template<typename T>
-void C3DKDTree<T>::createTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter)
-{
-	const SBBox bBox = math::calcBBoxItems(m_aItems);
+	///<summary>Removes the item from all leafs which its bounding box at the insertion overlaps</summary>
+	///<remarks>In : idItem - Id of the item</remarks>
+	void removeItemLeafs(const UI4 idItem);
 
-	std::vector<UI1> aIDItems(m_aItems.size());
-	for (UI1 i = 0, nItems = aIDItems.size(); i < nItems; ++i)
-		aIDItems[i] = i;
+	///<summary>Appends the id item to the leaf, the id items of the leaf are moved to the end of the shared array if they aren't there</summary>
+	///<remarks>In : idNode - Id of the leaf</remarks>
+	///<remarks>In : idItem - Id of the item</remarks>
+	void appendIDItemLeaf(const UI4 idNode, const UI4 idItem);
 
-	const I1 nThreads = omp_get_max_threads();
+	///<summary>Copies the reachable nodes and the id items of their leafs into the new arrays if the half of the arrays is unused</summary>
+	void compactTree();
 
-	if (m_useMultithread)
-	{
-		m_aItemsUsed.resize(nThreads);
-		m_aITemsUsedId.resize(nThreads);
-		for (I1 i = 0; i < nThreads; ++i)
-			m_aItemsUsed[i].resize(m_aItems.size(), false);
-	}
-	else
-	{
-		m_aItemsUsed.resize(1);
-		m_aITemsUsedId.resize(1);
-		m_aItemsUsed[0].resize(m_aItems.size(), false);
-	}
+	///<summary>Appends the node and its subtree to the compacted arrays in the depth-first order</summary>
+	///<remarks>In/Out : aNodes - The compacted nodes</remarks>
+	///<remarks>In/Out : aIDItems - The compacted id items</remarks>
+	///<remarks>Out : pIDNodesCompact - Ids of the nodes in the compacted nodes by their ids in the array of the flattened nodes, it isn't filled if it's nullptr</remarks>
+	///<remarks>In : idNode - Id of the node in the array of the flattened nodes</remarks>
+	///<returns>Id of the node in the compacted nodes</returns>
+	UI4 compactSubTree(CFlatKDTreeNodes& aNodes, std::vector<UI4>& aIDItems, std::vector<UI4>* const pIDNodesCompact, UI4 idNode) const;
 
-	if (!m_useMultithread || nThreads == 1 || m_aItems.size() < cNumElementsForParalell)
+	///<summary>The node which waits in the stack of the closest first traversal</summary>
+	struct STraversalNode
 	{
-		m_aANodesThread.resize(1);
-		m_pRootNode = createTree(m_aANodesThread[0], m_numLeafs, bBox, aIDItems, nodeSplitter, 0);
-	}
-	else
+		///<summary>Id of the node in the array of the flattened nodes</summary>
+		UI4 m_idNode;
+		///<summary>Square of the distance from the point to the bounding box of the node</summary>
+		double m_dist2;
+		///<summary>Offsets of the point from the bounding box of the node per axis</summary>
+		double m_aOffset[3];
+	};
+
+	///<summary>The packet of the points which waits in the stack of the closest first traversal</summary>
+	struct STraversalPacket
 	{
-		m_aANodesThread.resize(1 + nThreads);
+		///<summary>Id of the node in the array of the flattened nodes</summary>
+		UI4 m_idNode;
+		///<summary>Squares of the distances from the points to the bounding box of the node</summary>
+		double m_aDist2[cPacketSize];
+		///<summary>Offsets of the points from the bounding box of the node per axis</summary>
+		double m_aOffset[cPacketSize][3];
+	};
 
-		const UI1 maxDepthParallel = math::getNumOfHighBit(nThreads, 1 << 3);
+	///<summary>Finds nearest items to the packet of the points by the closest first traversal of the KD Tree, the nodes are fetched once for the packet</summary>
+	///<remarks>In : aPoints - The points of the packet</remarks>
+	///<remarks>In : nPoints - The number of the points in the packet</remarks>
+	///<remarks>Out : aNearestItemsINFO - structures of the data about nearest items of the points</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller</remarks>
+	void findNearestItemsPacket(const D3(&aPoints)[cPacketSize], const UI1 nPoints, C3DKDTreeNearestItemINFO(&aNearestItemsINFO)[cPacketSize], SKDTreeQueryScratch& scratch) const;
 
-		m_pRootNode = createTree(m_aANodesThread[0], m_numLeafs, bBox, aIDItems, nodeSplitter, 0, maxDepthParallel);
+	///<summary>Visits the leafs of the KD Tree closer to the point than the maximal distance of the visitor by the closest first traversal</summary>
+	///<remarks>The visitor has the functions double getMaxDist2() const and void visitLeaf(const SFlatKDTreeNode& leaf), the leafs can decrease the maximal distance</remarks>
+	///<remarks>In : point - The point for which we are visiting the leafs</remarks>
+	///<remarks>In/Out : visitor - The visitor of the leafs</remarks>
+	template<typename TVisitor>
+	void traverseClosestFirst(const D3& point, TVisitor& visitor) const;
 
-		std::vector<C3DKDTreeNode*> aTreeNodes;
-		getLeafNodes(aTreeNodes);
+	///<summary>The visitor of the leafs which finds the nearest item</summary>
+	struct SNearestItemVisitor
+	{
+		const C3DKDTree& m_tree;
+		C3DKDTreeNearestItemINFO& m_nearestItemINFO;
+		const D3& m_point;
+		SKDTreeQueryScratch& m_scratch;
 
-		const I1 nTreeNodes = aTreeNodes.size();
-		std::vector<UI1> aNumLeafs(nTreeNodes, 0);
+		double getMaxDist2() const
+		{
+			return m_nearestItemINFO.m_minDist2;
+		}
 
-#pragma omp parallel for schedule(static)
-		for (I1 i = 0; i < nTreeNodes; ++i)
-			addSubTree(m_aANodesThread[i + 1], aNumLeafs[i], aTreeNodes[i], nodeSplitter, aTreeNodes[i]->getDepthNode());
+		void visitLeaf(const SFlatKDTreeNode& leaf)
+		{
+			m_tree.findNearestItemLeaf(m_nearestItemINFO, leaf, m_point, m_scratch);
+		}
+	};
 
-		m_numLeafs = 0;
-		for (I1 i = 0; i < nTreeNodes; ++i)
-			m_numLeafs += aNumLeafs[i];
-	}
-}
+	///<summary>The visitor of the leafs which finds k nearest items by the max-heap of the scratch</summary>
+	struct SKNearestItemsVisitor
+	{
+		const C3DKDTree& m_tree;
+		const D3& m_point;
+		const UI1 m_k;
+		const double m_maxDist2;
+		SKDTreeQueryScratch& m_scratch;
 
-///<summary>Builds KD Tree</summary>
-///<remarks>Out : hVector - The vector of the nodes of the KD Tree(for each thread)</remarks>
-///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
-///<remarks>In : bBox - The bounding box of the items for which we are building the KD Tree</remarks>
+		///<returns>The distance of the k-th item if k items are found, otherwise the maximal distance of the query</returns>
+		double getMaxDist2() const
+		{
+			return m_scratch.m_aHeapItems.size() < m_k ? m_maxDist2 : m_scratch.m_aHeapItems.front().m_minDist2;
+		}
+
+		void visitLeaf(const SFlatKDTreeNode& leaf);
+	};
+
+	///<summary>The visitor of the leafs which reports all items in the radius to the callback</summary>
+	template<typename TCallback>
+	struct SItemsInRadiusVisitor
+	{
+		const C3DKDTree& m_tree;
+		const D3& m_point;
+		///<summary>Square of the radius of the search</summary>
+		const double m_radius2;
+		///<summary>Square of the radius increased by cEps, so the nodes which touch the sphere are visited in spite of the rounding of their distances</summary>
+		const double m_maxDist2;
+		TCallback& m_callback;
+		SKDTreeQueryScratch& m_scratch;
+
+		double getMaxDist2() const
+		{
+			return m_maxDist2;
+		}
+
+		void visitLeaf(const SFlatKDTreeNode& leaf);
+	};
+
+	///<summary>The node which waits in the stack of the traversal of the overlap queries</summary>
+	struct STraversalBBoxNode
+	{
+		///<summary>Id of the node in the array of the flattened nodes</summary>
+		UI4 m_idNode;
+		///<summary>The bounding box of the node, it's derived from the split planes of its parents</summary>
+		SBBox m_bBox;
+	};
+
+	///<summary>The node which waits in the stack of the traversal of the ray</summary>
+	struct STraversalRayNode
+	{
+		///<summary>Id of the node in the array of the flattened nodes</summary>
+		UI4 m_idNode;
+		///<summary>The parameters of the ray where it enters and leaves the node</summary>
+		double m_tNear;
+		double m_tFar;
+	};
+
+	///<summary>Visits the leafs of the KD Tree pierced by the ray in the front to back order by the stack-based traversal of the split planes</summary>
+	///<remarks>The visitor has the functions double getMaxT() const and void visitLeaf(const SFlatKDTreeNode& leaf), the leafs can decrease the maximal parameter</remarks>
+	///<remarks>In : origin - The origin of the ray</remarks>
+	///<remarks>In : dir - The direction of the ray</remarks>
+	///<remarks>In : tMax - The maximal parameter of the ray</remarks>
+	///<remarks>In/Out : visitor - The visitor of the leafs</remarks>
+	template<typename TVisitor>
+	void traverseRay(const D3& origin, const D3& dir, const double tMax, TVisitor& visitor) const;
+
+	///<summary>The visitor of the leafs which finds the first hit of the ray</summary>
+	struct SFirstHitVisitor
+	{
+		const C3DKDTree& m_tree;
+		C3DKDTreeRayHitINFO& m_hitINFO;
+		const D3& m_origin;
+		const D3& m_dir;
+		///<summary>The parameter of the first hit if it's found, otherwise the maximal parameter of the query</summary>
+		double m_maxT;
+		bool m_bHit;
+		SKDTreeQueryScratch& m_scratch;
+
+		double getMaxT() const
+		{
+			return m_maxT;
+		}
+
+		void visitLeaf(const SFlatKDTreeNode& leaf);
+	};
+
+	///<summary>The visitor of the leafs which stops the traversal at the first found hit of the ray</summary>
+	struct SAnyHitVisitor
+	{
+		const C3DKDTree& m_tree;
+		const D3& m_origin;
+		const D3& m_dir;
+		const double m_tMax;
+		bool m_bHit;
+		SKDTreeQueryScratch& m_scratch;
+
+		///<returns>The negative parameter if the hit is found, so all nodes are pruned, otherwise the maximal parameter of the query</returns>
+		double getMaxT() const
+		{
+			return m_bHit ? -1. : m_tMax;
+		}
+
+		void visitLeaf(const SFlatKDTreeNode& leaf);
+	};
+
+	///<summary>Finds nearest item to the point by the closest first traversal of the KD Tree</summary>
+	///<remarks>In/Out : nearestItemInfo - structure of the data about nearest item, only the items closer than its m_minDist2 are searched</remarks>
+	///<remarks>In : point - The point for which we are finding nearest item</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller</remarks>
+	void findNearestItemClosestFirst(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, SKDTreeQueryScratch& scratch) const;
+
+	///<summary>Finds nearest item to the point in the leaf</summary>
+	///<remarks>In/Out : nearestItemInfo - structure of the data about nearest item, only the items closer than its m_minDist2 are searched</remarks>
+	///<remarks>In : leaf - The leaf of the flattened KD Tree</remarks>
+	///<remarks>In : point - The point for which we are finding nearest item</remarks>
+	///<remarks>In/Out : scratch - The state of the queries of the caller</remarks>
+	void findNearestItemLeaf(C3DKDTreeNearestItemINFO& nearestItemINFO, const SFlatKDTreeNode& leaf, const D3& point, SKDTreeQueryScratch& scratch) const;
+
+#ifdef USE_SIMD_DIST_TRIANGLES
+	///<summary>Finds nearest triangle to the point in the block of the id items by the vectorized kernel</summary>
+	///<remarks>In : pIDItemsBlock - The id items of the triangles of the leaf</remarks>
+	///<remarks>In : nIDItemsBlock - The number of the id items</remarks>
+	///<remarks>In : point - The point for which we are finding nearest item</remarks>
+	///<remarks>In/Out : minDist2 - Square of the distance to nearest item, only the items closer than it are searched</remarks>
+	///<remarks>In/Out : idItem - Id of nearest item</remarks>
+	void findNearestItemBlock(const UI4* pIDItemsBlock, const UI1 nIDItemsBlock, const D3& point, double& minDist2, UI1& idItem) const;
+
+	///<summary>Precomputes the triangles per item, the leafs share the precomputed triangle of the item</summary>
+	///<remarks>The triangles aren't precomputed if the items aren't the packed triangles</remarks>
+	void buildTrianglesPrecomputed();
+#endif
+
+	///<summary>Releases the nodes of the built KD Tree</summary>	
+	void clearBuildNodes()
+	{
+#ifdef USE_STACK_NODES
+		///The nodes and the id items of the leafs are released by the slabs of the arenas without the destructors
+		m_aArenasThread.clear();
+#endif
+#ifndef USE_STACK_NODES
+		if(m_pRootNode != nullptr)
+			delete m_pRootNode;
+#endif
+		m_pRootNode = nullptr;
+	}
+
+	///<summary>Clears the KD Tree</summary>	
+	void clear()
+	{
+		clearBuildNodes();
+
+		m_aFlatNodes.clear();
+		m_aFlatIDItems.clear();
+#ifdef USE_SIMD_DIST_TRIANGLES
+		m_aTrianglesPrecomputed.clear();
+#endif
+		m_fileMapping.unmap();
+		bindQueryArrays();
+	}
+
+	C3DKDTree& operator=(const C3DKDTree& kdTree);
+
+#ifdef USE_STACK_NODES
+	///<summary>The arenas of the nodes and of the id items of the leafs while the KD Tree is building, the first arena is for the top of the KD Tree and one arena is for each thread</summary>	
+	///<remarks>They are used by the build of the nodes only, so they stay empty with USE_INPLACE_BUILD</remarks>	
+	std::vector<CMonotonicArena> m_aArenasThread;
+#endif
+	bool m_useMultithread;
+
+	///<summary>Array of the items of the KD Tree</summary>	
+	std::vector<T> m_aItems;
+
+	///<summary>Root node of the KD Tree while it is building</summary>	
+	C3DKDTreeNode* m_pRootNode;
+
+	///<summary>Bounding box of the items of the KD Tree</summary>	
+	SBBox m_bBoxTree;
+	///<summary>Bounding boxes of the items while the KD Tree is building, they are released after the build</summary>	
+	std::vector<SBBox> m_aBBoxItems;
+	///<summary>Nodes of the flattened KD Tree in the depth-first order, the root node is first</summary>	
+	CFlatKDTreeNodes m_aFlatNodes;
+	///<summary>Shared array of the id items of all leafs of the flattened KD Tree</summary>	
+	std::vector<UI4> m_aFlatIDItems;
+#ifdef USE_SIMD_DIST_TRIANGLES
+	///<summary>Precomputed triangles per item for the vectorized kernels indexed by the ids of the items, it's empty if the items aren't the triangles</summary>	
+	std::vector<STrianglePrecomputed> m_aTrianglesPrecomputed;
+#endif
+
+	///<summary>The mapping of the file of the KD Tree, the arrays of the queries point into it if the KD Tree is mapped</summary>	
+	CFileMapping m_fileMapping;
+	///<summary>The arrays of the queries, they point to the built arrays or into the mapped file</summary>	
+	const T* m_pItems;
+	UI1 m_nItems;
+	const SFlatKDTreeNode* m_pFlatNodes;
+	UI1 m_nFlatNodes;
+	const UI4* m_pFlatIDItems;
+	UI1 m_nFlatIDItems;
+#ifdef USE_SIMD_DIST_TRIANGLES
+	///<summary>It's nullptr if the triangles aren't precomputed</summary>	
+	const STrianglePrecomputed* m_pTrianglesPrecomputed;
+#endif
+
+	///<summary>The marks of the removed items, it's empty until the first item is removed</summary>	
+	std::vector<bool> m_aRemovedItems;
+	///<summary>The bounding boxes of the items by which they were distributed into the leafs by the build, the refit or the edits, the moved items are removed from the old leafs by them</summary>	
+	///<remarks>It's empty for the mapped KD Tree until the first edit</remarks>	
+	std::vector<SBBox> m_aBBoxItemsLeafs;
+	///<summary>The leafs which got the new items since their last rebuild, one leaf can be kept several times in the order of the insertions</summary>	
+	std::vector<SEditNode> m_aDirtyLeafs;
+	///<summary>The numbers of the unreachable nodes and of the unused id items of the edited KD Tree</summary>	
+	UI1 m_numGarbageNodes;
+	UI1 m_numGarbageIDItems;
+	///<summary>The SAH cost of the KD Tree after the last build moved by the costs of the leafs rebuilt since then, the cost of the refitted KD Tree is compared with it</summary>	
+	double m_costSAHBuild;
+	///<summary>The number of the reallocations of the buffers of the in place build after their setup</summary>	
+	UI1 m_numBuildGrowths;
+
+	UI1 m_numLeafs;
+};
+
+///<summary>Builds the KD Tree and copyes the aItems into new array</summary>
+///<remarks>In : aItems - The items for which we are building the KD Tree</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : build - The builder of the KD Tree</remarks>
+template<typename T>
+C3DKDTree<T>::C3DKDTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, bool bUseMultithread, const eKDTreeBuild build) :
+	m_useMultithread(bUseMultithread),
+	m_aItems(aItems),
+	m_pRootNode(nullptr),
+	m_numGarbageNodes(0),
+	m_numGarbageIDItems(0),
+	m_costSAHBuild(0.),
+	m_numBuildGrowths(0),
+	m_numLeafs(0)
+{
+	buildTree(nodeSplitter, build);
+}
+
+///<summary>Builds the KD Tree and moves the aItems into it, so the items aren't copied</summary>
+///<remarks>In/Out : aItems - The items for which we are building the KD Tree, it's empty after the move</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : build - The builder of the KD Tree</remarks>
+template<typename T>
+C3DKDTree<T>::C3DKDTree(std::vector<T>&& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, bool bUseMultithread, const eKDTreeBuild build) :
+	m_useMultithread(bUseMultithread),
+	m_aItems(std::move(aItems)),
+	m_pRootNode(nullptr),
+	m_numGarbageNodes(0),
+	m_numGarbageIDItems(0),
+	m_costSAHBuild(0.),
+	m_numBuildGrowths(0),
+	m_numLeafs(0)
+{
+	buildTree(nodeSplitter, build);
+}
+
+///<summary>Builds the KD Tree over m_aItems</summary>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : build - The builder of the KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::buildTree(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const eKDTreeBuild build)
+{
+	if (build == eKDTreeBuildSplitter)
+	{
+#ifdef USE_INPLACE_BUILD
+		createTreeInPlace(nodeSplitter);
+#else
+		createTree(m_aItems, nodeSplitter);
+		flattenTree();
+#endif
+	}
+	else
+		createTreeMorton(build == eKDTreeBuildMortonSplitterTop ? &nodeSplitter : nullptr);
+
+	///The bounding boxes of the build are kept for the edits, the Morton build keeps them by distributeItemsLeafs
+	if (!m_aBBoxItems.empty())
+		m_aBBoxItemsLeafs.swap(m_aBBoxItems);
+	std::vector<SBBox>().swap(m_aBBoxItems);
+
+#ifdef USE_SIMD_DIST_TRIANGLES
+	buildTrianglesPrecomputed();
+#endif
+	bindQueryArrays();
+	m_costSAHBuild = calcCostSAH();
+}
+
+///<summary>Builds the split planes of the flattened KD Tree by the sorted Morton codes of the centers of the items and distributes the items into its leafs</summary>
+///<remarks>In : pNodeSplitter - The splitter of the top levels, if it's nullptr, then all levels are split by the Morton codes</remarks>
+template<typename T>
+void C3DKDTree<T>::createTreeMorton(const C3DKDTreeNodeSplitter<T>* const pNodeSplitter)
+{
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+	const I1 nThreads = m_useMultithread && nItems >= static_cast<I1>(cNumElementsForParalell) ? omp_get_max_threads() : 1;
+
+	m_bBoxTree = calcBBoxItemsParallel(nThreads);
+	m_aFlatNodes.clear();
+	m_aFlatIDItems.clear();
+	m_numLeafs = 0;
+
+	if (nItems == 0)
+	{
+		m_aFlatNodes.emplace_back();
+		m_aFlatNodes.back().setLeaf(0, 0);
+		m_numLeafs = 1;
+		return;
+	}
+
+	///The centers of the items are quantized in the bounding box of the KD Tree
+	std::vector<std::pair<UI8, UI4>> aCodes(nItems);
+#pragma omp parallel for num_threads(static_cast<int>(nThreads))
+	for (I1 i = 0; i < nItems; ++i)
+	{
+		const SBBox& bBoxItem = m_aBBoxItems[i];
+		aCodes[i] = std::make_pair(math::calcMortonCode((bBoxItem.m_minBB + bBoxItem.m_maxBB) * 0.5, m_bBoxTree), static_cast<UI4>(i));
+	}
+
+	math::sortMortonCodes(aCodes, nThreads > 1);
+
+	m_aFlatNodes.reserve(2 * (nItems / cMortonLeafSize) + 1);
+	std::vector<UI4> aIDItems;
+	createTreeMorton(aCodes, aIDItems, pNodeSplitter, m_bBoxTree, 0, nItems, 0);
+
+	distributeItemsLeafs(nThreads);
+	m_aFlatNodes.shrink_to_fit();
+}
+
+///<summary>Builds the split planes of the subtree of the flattened KD Tree by the Morton codes, its leafs are empty</summary>
+///<remarks>In/Out : aCodes - The sorted Morton codes of the centers of the items with the ids of the items, the range of the node is reordered by the splitter</remarks>
+///<remarks>In/Out : aIDItems - The buffer of the id items of the node for the splitter</remarks>
+///<remarks>In : pNodeSplitter - The splitter of the top levels, nullptr if it isn't used</remarks>
+///<remarks>In : bBox - The bounding box of the node</remarks>
+///<remarks>In : begin - Position of the first code of the node</remarks>
+///<remarks>In : end - Position of the end of the codes of the node</remarks>
+///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+template<typename T>
+void C3DKDTree<T>::createTreeMorton(std::vector<std::pair<UI8, UI4>>& aCodes, std::vector<UI4>& aIDItems, const C3DKDTreeNodeSplitter<T>* const pNodeSplitter, const SBBox& bBox,
+	const UI1 begin, const UI1 end, const UI1 currentDepth)
+{
+	const UI4 idNode = static_cast<UI4>(m_aFlatNodes.size());
+	m_aFlatNodes.emplace_back();
+
+	if (end - begin <= cMortonLeafSize || currentDepth >= cMaxDepthTree)
+	{
+		m_aFlatNodes[idNode].setLeaf(0, 0);
+		++m_numLeafs;
+		return;
+	}
+
+	UI1 middle = begin;
+	UI1 dim = 0;
+	double posSplit = 0.;
+
+	///The top levels are split by the splitter, the stable partition by the centers keeps the codes of the children sorted
+	if (pNodeSplitter != nullptr && currentDepth < cMortonSplitterDepth)
+	{
+		aIDItems.resize(end - begin);
+		for (UI1 i = begin; i < end; ++i)
+			aIDItems[i - begin] = aCodes[i].second;
+
+		SSplitINFO splitINFO;
+		if (pNodeSplitter->split(splitINFO, bBox, m_aItems, m_aBBoxItems, aIDItems.data(), end - begin))
+		{
+			dim = splitINFO.m_dimSplit;
+			posSplit = splitINFO.m_posSplit;
+			middle = std::stable_partition(aCodes.begin() + begin, aCodes.begin() + end, [this, dim, posSplit](const std::pair<UI8, UI4>& code)
+			{
+				const SBBox& bBoxItem = m_aBBoxItems[code.second];
+				return bBoxItem.m_minBB[dim] + bBoxItem.m_maxBB[dim] < 2. * posSplit;
+			}) - aCodes.begin();
+		}
+	}
+
+	///The node is split by the highest bit where its codes differ, the plane is the border of the cells of the codes with this bit 0 and 1
+	if (middle == begin || middle == end)
+	{
+		const UI8 codeFirst = aCodes[begin].first;
+		const UI8 codeLast = aCodes[end - 1].first;
+		if (codeFirst == codeLast)
+		{
+			m_aFlatNodes[idNode].setLeaf(0, 0);
+			++m_numLeafs;
+			return;
+		}
+
+		UI1 bit = 63;
+		while (((codeFirst ^ codeLast) >> bit) == 0)
+			--bit;
+
+		const UI8 maskBit = static_cast<UI8>(1) << bit;
+		middle = std::partition_point(aCodes.begin() + begin, aCodes.begin() + end, [maskBit](const std::pair<UI8, UI4>& code)
+		{
+			return (code.first & maskBit) == 0;
+		}) - aCodes.begin();
+
+		dim = bit % 3;
+		const UI1 level = bit / 3;
+		const UI8 coordCell = ((math::compactBitsMorton(codeLast >> dim) >> level) << level);
+		const double len = m_bBoxTree.m_maxBB[dim] - m_bBoxTree.m_minBB[dim];
+		posSplit = m_bBoxTree.m_minBB[dim] + len * static_cast<double>(coordCell) / static_cast<double>(cMortonMaxCoord);
+		posSplit = math::min2(math::max2(posSplit, bBox.m_minBB[dim]), bBox.m_maxBB[dim]);
+	}
+
+	SBBox bBoxLeft = bBox;
+	bBoxLeft.m_maxBB[dim] = posSplit;
+	createTreeMorton(aCodes, aIDItems, pNodeSplitter, bBoxLeft, begin, middle, currentDepth + 1);
+
+	const UI4 idRightNode = static_cast<UI4>(m_aFlatNodes.size());
+	SBBox bBoxRight = bBox;
+	bBoxRight.m_minBB[dim] = posSplit;
+	createTreeMorton(aCodes, aIDItems, pNodeSplitter, bBoxRight, middle, end, currentDepth + 1);
+
+	m_aFlatNodes[idNode].setInner(dim, posSplit, idRightNode);
+}
+
+///<summary>Points the arrays of the queries to the built arrays</summary>
+template<typename T>
+void C3DKDTree<T>::bindQueryArrays()
+{
+	m_pItems = m_aItems.data();
+	m_nItems = m_aItems.size();
+	m_pFlatNodes = m_aFlatNodes.data();
+	m_nFlatNodes = m_aFlatNodes.size();
+	m_pFlatIDItems = m_aFlatIDItems.data();
+	m_nFlatIDItems = m_aFlatIDItems.size();
+#ifdef USE_SIMD_DIST_TRIANGLES
+	m_pTrianglesPrecomputed = m_aTrianglesPrecomputed.empty() ? nullptr : m_aTrianglesPrecomputed.data();
+#endif
+}
+
+///<summary>Maps the KD Tree saved by save from the file, the arrays are used in the mapped memory without the copying</summary>
+///<remarks>The exceptions CExceptionCanNotOpenFile and CExceptionWrongFileFormat are thrown if the file can't be mapped</remarks>
+///<remarks>Only the header is checked, so the file must be trusted or checked by validate</remarks>
+///<remarks>In : pNameFile - The name of the file of the KD Tree</remarks>
+template<typename T>
+C3DKDTree<T>::C3DKDTree(const char* const pNameFile) :
+	m_useMultithread(false),
+	m_pRootNode(nullptr),
+	m_numGarbageNodes(0),
+	m_numGarbageIDItems(0),
+	m_costSAHBuild(0.),
+	m_numBuildGrowths(0),
+	m_numLeafs(0)
+{
+	static_assert(SItemSerializable<T>::value, "The items with the pointers can't be mapped from the file");
+
+	m_fileMapping.map(pNameFile);
+	const char* pData = m_fileMapping.getData();
+	const UI8 sizeFile = m_fileMapping.getSize();
+	if (sizeFile < sizeof(SKDTreeFileHeader))
+		throw CExceptionWrongFileFormat("The file of the KD Tree is too small ...");
+
+	const SKDTreeFileHeader& header = *reinterpret_cast<const SKDTreeFileHeader*>(pData);
+	if (memcmp(header.m_aMagic, cKDTreeFileMagic, sizeof(cKDTreeFileMagic)) != 0 || header.m_version != cKDTreeFileVersion)
+		throw CExceptionWrongFileFormat("The file isn't the KD Tree of this version ...");
+
+	if (header.m_sizeItem != sizeof(T) || header.m_sizeNode != sizeof(SFlatKDTreeNode) || header.m_sizeTrianglePrecomputed != sizeof(STrianglePrecomputed))
+		throw CExceptionWrongFileFormat("The file is the KD Tree of the other items ...");
+
+	if (header.m_offsetItems % cKDTreeFileAlignment != 0 || header.m_offsetNodes % cKDTreeFileAlignment != 0 ||
+		header.m_offsetIDItems % cKDTreeFileAlignment != 0 || header.m_offsetTrianglesPrecomputed % cKDTreeFileAlignment != 0)
+		throw CExceptionWrongFileFormat("The arrays of the file of the KD Tree aren't aligned ...");
+
+	///The arrays must be in the file, the counts of the crafted header can overflow the sizes of the arrays, so they are compared with the rest of the file
+	const auto isArrayInFile = [sizeFile](const UI8 offset, const UI8 num, const UI8 sizeElement)
+	{
+		return offset <= sizeFile && num <= (sizeFile - offset) / sizeElement;
+	};
+	if (!isArrayInFile(header.m_offsetItems, header.m_numItems, sizeof(T)) ||
+		!isArrayInFile(header.m_offsetNodes, header.m_numNodes, sizeof(SFlatKDTreeNode)) ||
+		!isArrayInFile(header.m_offsetIDItems, header.m_numIDItems, sizeof(UI4)) ||
+		!isArrayInFile(header.m_offsetTrianglesPrecomputed, header.m_numTrianglesPrecomputed, sizeof(STrianglePrecomputed)))
+		throw CExceptionWrongFileFormat("The file of the KD Tree is truncated ...");
+
+	m_bBoxTree = header.m_bBoxTree;
+	m_numLeafs = static_cast<UI1>(header.m_numLeafs);
+
+	m_pItems = reinterpret_cast<const T*>(pData + header.m_offsetItems);
+	m_nItems = static_cast<UI1>(header.m_numItems);
+	m_pFlatNodes = reinterpret_cast<const SFlatKDTreeNode*>(pData + header.m_offsetNodes);
+	m_nFlatNodes = static_cast<UI1>(header.m_numNodes);
+	m_pFlatIDItems = reinterpret_cast<const UI4*>(pData + header.m_offsetIDItems);
+	m_nFlatIDItems = static_cast<UI1>(header.m_numIDItems);
+#ifdef USE_SIMD_DIST_TRIANGLES
+	m_pTrianglesPrecomputed = header.m_numTrianglesPrecomputed == m_nItems && m_nItems != 0 ?
+		reinterpret_cast<const STrianglePrecomputed*>(pData + header.m_offsetTrianglesPrecomputed) : nullptr;
+#endif
+	///The cost is saved, so the nodes aren't read until the queries
+	m_costSAHBuild = header.m_costSAHBuild;
+}
+
+///<summary>Saves the KD Tree into the binary file which is mapped by the constructor of the file</summary>
+///<remarks>The items must have no pointers, so the triangles of the indexed mesh can't be saved</remarks>
+///<remarks>In : pNameFile - The name of the file of the KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::save(const char* const pNameFile) const
+{
+	static_assert(SItemSerializable<T>::value, "The items with the pointers can't be saved into the file");
+
+	SKDTreeFileHeader header;
+	///The padding of the header is zeroed too, so the saved files of the same KD Tree are equal
+	memset(static_cast<void*>(&header), 0, sizeof(header));
+	memcpy(header.m_aMagic, cKDTreeFileMagic, sizeof(cKDTreeFileMagic));
+	header.m_version = cKDTreeFileVersion;
+	header.m_sizeItem = sizeof(T);
+	header.m_sizeNode = sizeof(SFlatKDTreeNode);
+	header.m_sizeTrianglePrecomputed = sizeof(STrianglePrecomputed);
+	header.m_numItems = m_nItems;
+	header.m_numNodes = m_nFlatNodes;
+	header.m_numIDItems = m_nFlatIDItems;
+	header.m_numLeafs = m_numLeafs;
+	header.m_costSAHBuild = m_costSAHBuild;
+	header.m_bBoxTree = m_bBoxTree;
+
+	const void* pTrianglesPrecomputed = nullptr;
+#ifdef USE_SIMD_DIST_TRIANGLES
+	pTrianglesPrecomputed = m_pTrianglesPrecomputed;
+	header.m_numTrianglesPrecomputed = m_pTrianglesPrecomputed != nullptr ? m_nItems : 0;
+#endif
+
+	///The arrays start at the aligned offsets, so they are aligned in the mapped memory
+	const void* aPArrays[4] = { m_pItems, m_pFlatNodes, m_pFlatIDItems, pTrianglesPrecomputed };
+	const UI1 aSizeArrays[4] = { m_nItems * sizeof(T), m_nFlatNodes * sizeof(SFlatKDTreeNode), m_nFlatIDItems * sizeof(UI4),
+		static_cast<UI1>(header.m_numTrianglesPrecomputed) * sizeof(STrianglePrecomputed) };
+	UI8* aPOffsets[4] = { &header.m_offsetItems, &header.m_offsetNodes, &header.m_offsetIDItems, &header.m_offsetTrianglesPrecomputed };
+
+	UI1 offset = sizeof(SKDTreeFileHeader);
+	for (UI1 i = 0; i < 4; ++i)
+	{
+		offset = (offset + cKDTreeFileAlignment - 1) / cKDTreeFileAlignment * cKDTreeFileAlignment;
+		*aPOffsets[i] = offset;
+		offset += aSizeArrays[i];
+	}
+
+	CFileWriter file(pNameFile);
+	file.writeBytes(&header, sizeof(header));
+
+	const char aPadding[cKDTreeFileAlignment] = {};
+	UI1 sizeWritten = sizeof(SKDTreeFileHeader);
+	for (UI1 i = 0; i < 4; ++i)
+	{
+		file.writeBytes(aPadding, static_cast<UI1>(*aPOffsets[i]) - sizeWritten);
+		file.writeBytes(aPArrays[i], aSizeArrays[i]);
+		sizeWritten = static_cast<UI1>(*aPOffsets[i]) + aSizeArrays[i];
+	}
+}
+
+///<summary>Checks that the nodes and the id items of the KD Tree are in their arrays, so the queries don't read out of them</summary>
+///<remarks>The mapping of the file doesn't read the nodes, so the file which isn't trusted is checked by it before the queries</remarks>
+///<returns>True if every reachable node and id item is in its array, every node is reached once and the depth fits the stacks of the queries</returns>
+template<typename T>
+bool C3DKDTree<T>::validate() const
+{
+	if (m_nFlatNodes == 0)
+		return true;
+
+	///Every node is reached once, so the check is linear and the cycles are found.
+	///Every node has at most one waiting sibling per level, so the stack of the depth cMaxDepthTree fits
+	std::vector<bool> aReached(m_nFlatNodes, false);
+	UI4 aStack[cTraversalStackSize];
+	UI1 aDepth[cTraversalStackSize];
+	aStack[0] = 0;
+	aDepth[0] = 0;
+	UI1 nStack = 1;
+	while (nStack > 0)
+	{
+		--nStack;
+		UI4 idNode = aStack[nStack];
+		const UI1 depth = aDepth[nStack];
+		const SFlatKDTreeNode* pNode = m_pFlatNodes + idNode;
+
+		if (aReached[idNode])
+			return false;
+		aReached[idNode] = true;
+
+		///The link points to the root of the rebuilt subtree which isn't the link
+		if (pNode->isLink())
+		{
+			idNode = pNode->m_idRightNode;
+			if (idNode >= m_nFlatNodes || aReached[idNode] || m_pFlatNodes[idNode].isLink())
+				return false;
+			aReached[idNode] = true;
+			pNode = m_pFlatNodes + idNode;
+		}
+
+		if (pNode->isLeaf())
+		{
+			if (static_cast<UI1>(pNode->m_offsetItems) + pNode->m_numItems > m_nFlatIDItems)
+				return false;
+			for (UI4 i = 0; i < pNode->m_numItems; ++i)
+			{
+				if (m_pFlatIDItems[pNode->m_offsetItems + i] >= m_nItems)
+					return false;
+			}
+			continue;
+		}
+
+		if (pNode->m_dimSplit >= 3 || depth >= cMaxDepthTree || idNode + 1 >= m_nFlatNodes || pNode->m_idRightNode >= m_nFlatNodes ||
+			pNode->m_posSplit != pNode->m_posSplit)
+			return false;
+
+		aStack[nStack] = pNode->m_idRightNode;
+		aDepth[nStack++] = depth + 1;
+		aStack[nStack] = idNode + 1;
+		aDepth[nStack++] = depth + 1;
+	}
+
+	return true;
+}
+
+///<summary>Inserts the item into the leafs which it overlaps, the leafs grow and the bounding box of the KD Tree grows if the item is out of it</summary>
+///<remarks>The edits must not run concurrently with the queries, the mapped KD Tree is copied into the memory by the first edit</remarks>
+///<remarks>In : item - The new item</remarks>
+///<returns>Id of the new item, it's the position of the item in the items of the KD Tree</returns>
+template<typename T>
+UI1 C3DKDTree<T>::insertItem(const T& item)
+{
+	detachMapping();
+
+	const UI1 idItem = m_aItems.size();
+	m_aItems.push_back(item);
+	if (!m_aRemovedItems.empty())
+		m_aRemovedItems.push_back(false);
+	initBBoxItemsLeafs();
+
+#ifdef USE_SIMD_DIST_TRIANGLES
+	if (!m_aTrianglesPrecomputed.empty())
+	{
+		D3 A, B, C;
+		getTriangleVertices(item, A, B, C);
+		m_aTrianglesPrecomputed.emplace_back();
+		m_aTrianglesPrecomputed.back().setTriangle(A, B, C);
+	}
+#endif
+
+	insertItemLeafs(static_cast<UI4>(idItem));
+	bindQueryArrays();
+	return idItem;
+}
+
+///<summary>Removes the item from its leafs, the item is marked as removed and its id isn't reused</summary>
+///<remarks>In : idItem - Id of the item</remarks>
+template<typename T>
+void C3DKDTree<T>::removeItem(const UI1 idItem)
+{
+	if (isItemRemoved(idItem))
+		return;
+
+	detachMapping();
+	initBBoxItemsLeafs();
+	removeItemLeafs(static_cast<UI4>(idItem));
+
+	if (m_aRemovedItems.empty())
+		m_aRemovedItems.resize(m_aItems.size(), false);
+	m_aRemovedItems[idItem] = true;
+
+	compactTree();
+	bindQueryArrays();
+}
+
+///<summary>Replaces the item, it's removed from the leafs of the old item and is inserted into the leafs of the new one</summary>
+///<remarks>In : idItem - Id of the item</remarks>
+///<remarks>In : item - The new item</remarks>
+template<typename T>
+void C3DKDTree<T>::updateItem(const UI1 idItem, const T& item)
+{
+	detachMapping();
+	initBBoxItemsLeafs();
+
+	///The removed item is inserted again
+	if (isItemRemoved(idItem))
+		m_aRemovedItems[idItem] = false;
+	else
+		removeItemLeafs(static_cast<UI4>(idItem));
+
+	m_aItems[idItem] = item;
+
+#ifdef USE_SIMD_DIST_TRIANGLES
+	if (!m_aTrianglesPrecomputed.empty())
+	{
+		D3 A, B, C;
+		getTriangleVertices(item, A, B, C);
+		m_aTrianglesPrecomputed[idItem].setTriangle(A, B, C);
+	}
+#endif
+
+	insertItemLeafs(static_cast<UI4>(idItem));
+	bindQueryArrays();
+}
+
+///<summary>Rebuilds the leafs whose SAH cost grew by the new items past the threshold relative to their cost after the last rebuild, so the SAH cost of the KD Tree is restored</summary>
+///<remarks>The leafs are rebuilt into the subtrees which are appended to the flattened KD Tree, the arrays are compacted when the half of them is unused</remarks>
+///<remarks>The leafs below the threshold wait for the next call with their cost after the last rebuild</remarks>
+///<remarks>The baseline of the relative cost of the refit is moved by the costs of the rebuilt leafs, it's reset by the build only</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : maxCostLeafRelative - The SAH cost of the leaf relative to its cost after the last rebuild, the leafs above it are rebuilt</remarks>
+///<returns>The number of the rebuilt leafs</returns>
+template<typename T>
+UI1 C3DKDTree<T>::rebuildDegradedLeafs(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const double maxCostLeafRelative)
+{
+	///The leaf is kept once per inserted item in the order of the insertions, its bounding boxes differ if the bounding box of the KD Tree grew between the insertions
+	std::stable_sort(m_aDirtyLeafs.begin(), m_aDirtyLeafs.end(), [](const SEditNode& a, const SEditNode& b) { return a.m_idNode < b.m_idNode; });
+
+	///The splitters take the bounding boxes of the items by their ids, only the boxes of the items of the rebuilt leafs are calculated
+	m_aBBoxItems.resize(m_aItems.size());
+
+	std::vector<SEditNode> aWaitingLeafs;
+	std::vector<std::pair<UI4, SBBox>> aRebuiltSubTrees;
+	double costLeafsBuild = 0.;
+	UI1 nRebuiltLeafs = 0;
+	for (UI1 i = 0, nDirtyLeafs = m_aDirtyLeafs.size(); i < nDirtyLeafs;)
+	{
+		const SEditNode firstLeaf = m_aDirtyLeafs[i];
+		SEditNode dirtyLeaf = firstLeaf;
+		for (++i; i < nDirtyLeafs && m_aDirtyLeafs[i].m_idNode == dirtyLeaf.m_idNode; ++i)
+		{
+			for (UI1 dim = 0; dim < 3; ++dim)
+			{
+				dirtyLeaf.m_bBox.m_minBB[dim] = math::min2(dirtyLeaf.m_bBox.m_minBB[dim], m_aDirtyLeafs[i].m_bBox.m_minBB[dim]);
+				dirtyLeaf.m_bBox.m_maxBB[dim] = math::max2(dirtyLeaf.m_bBox.m_maxBB[dim], m_aDirtyLeafs[i].m_bBox.m_maxBB[dim]);
+			}
+		}
+
+		const SFlatKDTreeNode leaf = m_aFlatNodes[dirtyLeaf.m_idNode];
+		if (leaf.m_numItems == 0)
+			continue;
+
+		///The cost of the leaf after the last rebuild is taken by its first insertion, the leaf without the items costs as the leaf with one item
+		///The leafs of the zero area are compared by the numbers of the items
+		const double areaLeafBuild = math::calcHalfAreaBBox(firstLeaf.m_bBox);
+		const double areaLeaf = math::calcHalfAreaBBox(dirtyLeaf.m_bBox);
+		const double costLeafBuild = cI * static_cast<double>(math::max2(firstLeaf.m_numItemsLeaf, static_cast<UI4>(1))) * (areaLeafBuild > 0. ? areaLeafBuild : 1.);
+		const double costLeaf = cI * static_cast<double>(leaf.m_numItems) * (areaLeafBuild > 0. ? areaLeaf : 1.);
+		if (costLeaf <= maxCostLeafRelative * costLeafBuild)
+		{
+			aWaitingLeafs.push_back(firstLeaf);
+			aWaitingLeafs.push_back(dirtyLeaf);
+			continue;
+		}
+
+		UI1 nLeafs = 0;
+		const UI4 idRootNode = static_cast<UI4>(m_aFlatNodes.size());
+#ifdef USE_INPLACE_BUILD
+		SKDTreeBuildBuffers buffers;
+		SKDTreeBuildSlice slice = buffers.reserve(leaf.m_numItems);
+		UI4* const pIDItems = buffers.m_pIDItems + slice.m_endIDItems - leaf.m_numItems;
+		for (UI4 iItem = 0; iItem < leaf.m_numItems; ++iItem)
+		{
+			const UI4 idItem = m_aFlatIDItems[leaf.m_offsetItems + iItem];
+			pIDItems[iItem] = idItem;
+			m_aBBoxItems[idItem] = m_aItems[idItem].calcBBoxItem();
+		}
+		nodeSplitter.reserve(leaf.m_numItems);
+
+		createTreeInPlace(buffers, nullptr, nLeafs, dirtyLeaf.m_bBox, slice, leaf.m_numItems, nodeSplitter, dirtyLeaf.m_depth);
+		if (slice.m_idNode == 1)
+			continue;
+
+		///The subtree is appended to the arrays, its local ids are shifted to the ends of the arrays
+		const UI4 offsetIDItems = static_cast<UI4>(m_aFlatIDItems.size());
+		for (UI1 iNode = 0; iNode < slice.m_idNode; ++iNode)
+		{
+			SFlatKDTreeNode node = buffers.m_pNodes[iNode];
+			if (node.isLeaf())
+				node.m_offsetItems += offsetIDItems;
+			else
+				node.m_idRightNode += idRootNode;
+
+			m_aFlatNodes.push_back(node);
+		}
+		m_aFlatIDItems.insert(m_aFlatIDItems.end(), buffers.m_pIDItems, buffers.m_pIDItems + slice.m_idIDItem);
+#else
+		std::vector<UI1> aIDItems(leaf.m_numItems);
+		for (UI4 iItem = 0; iItem < leaf.m_numItems; ++iItem)
+		{
+			const UI4 idItem = m_aFlatIDItems[leaf.m_offsetItems + iItem];
+			aIDItems[iItem] = idItem;
+			m_aBBoxItems[idItem] = m_aItems[idItem].calcBBoxItem();
+		}
+
+#ifdef USE_STACK_NODES
+		m_aArenasThread.resize(1);
+		m_pRootNode = createTree(m_aArenasThread[0], nLeafs, dirtyLeaf.m_bBox, aIDItems, nodeSplitter, dirtyLeaf.m_depth);
+#else
+		m_pRootNode = createTree(nLeafs, dirtyLeaf.m_bBox, aIDItems, nodeSplitter, dirtyLeaf.m_depth);
+#endif
+		const bool bSplit = m_pRootNode->m_pLeftNode != nullptr || m_pRootNode->m_pRightNode != nullptr;
+
+		///The subtree is flattened to the ends of the arrays
+		if (bSplit)
+			flattenTree(m_pRootNode);
+		clearBuildNodes();
+		if (!bSplit)
+			continue;
+#endif
+
+		///The right child is found by its parent, the left child must follow its parent, so it's replaced by the link
+		if (dirtyLeaf.m_bRight)
+		{
+			m_aFlatNodes[dirtyLeaf.m_idParent].m_idRightNode = idRootNode;
+			m_aFlatNodes[dirtyLeaf.m_idNode].setLeaf(0, 0);
+		}
+		else
+			m_aFlatNodes[dirtyLeaf.m_idNode].setLinkNode(idRootNode);
+
+		++m_numGarbageNodes;
+		m_numGarbageIDItems += leaf.m_numItems;
+		m_numLeafs += nLeafs - 1;
+		++nRebuiltLeafs;
+
+		aRebuiltSubTrees.emplace_back(idRootNode, dirtyLeaf.m_bBox);
+		costLeafsBuild += cI * static_cast<double>(firstLeaf.m_numItemsLeaf) * areaLeafBuild;
+	}
+
+	m_aDirtyLeafs.swap(aWaitingLeafs);
+	std::vector<SBBox>().swap(m_aBBoxItems);
+	bindQueryArrays();
+
+	///The baseline of the refit is moved by the costs of the rebuilt leafs only, so the degradation of the other nodes by the refit or by the edits stays in the relative cost
+	const double areaTree = math::calcHalfAreaBBox(m_bBoxTree);
+	if (m_costSAHBuild > 0. && areaTree > 0.)
+	{
+		double costSubTrees = 0.;
+		for (UI1 i = 0, nSubTrees = aRebuiltSubTrees.size(); i < nSubTrees; ++i)
+			costSubTrees += calcCostSAH(aRebuiltSubTrees[i].first, aRebuiltSubTrees[i].second);
+		m_costSAHBuild = math::max2(m_costSAHBuild + (costSubTrees - costLeafsBuild) / areaTree, cEps);
+	}
+
+	compactTree();
+	bindQueryArrays();
+	return nRebuiltLeafs;
+}
+
+///<summary>Refits the KD Tree of the triangles to the moved vertices of the deforming mesh, the vertices are set into the triangles in place, the split planes are kept and only the moved triangles are distributed again</summary>
+///<remarks>The leafs without the moved triangles keep their id items in place, the cost of the refit follows the number of the moved triangles</remarks>
+///<remarks>The SAH cost of the KD Tree grows while the triangles move away from the split planes, so the KD Tree is rebuilt by the splitter when its relative cost exceeds maxCostRelative</remarks>
+///<remarks>In : aVertices - The moved vertices of the triangles, 3 vertices per triangle in the order of the items of the KD Tree</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter of the rebuild</remarks>
+///<remarks>Out : costRelative - The SAH cost of the refitted KD Tree relative to its cost after the last build and the rebuilds of the leafs, the KD Tree was rebuilt if it's greater than maxCostRelative</remarks>
+///<remarks>In : maxCostRelative - The relative SAH cost of the refitted KD Tree above which it's rebuilt</remarks>
+///<returns>False if the number of the vertices differs or the items aren't the packed triangles, then the KD Tree isn't changed</returns>
+template<typename T>
+bool C3DKDTree<T>::refit(const std::vector<D3>& aVertices, const C3DKDTreeNodeSplitter<T>& nodeSplitter, double& costRelative, const double maxCostRelative)
+{
+	///The ids of the leafs and of the removed items are the positions of the items, so the other triangles can't be refitted
+	if (aVertices.size() != 3 * m_nItems)
+		return false;
+
+	///The kind of the items is checked by the copy of the first item, so the mapped items aren't copied for nothing
+	if (m_nItems != 0)
+	{
+		T itemFirst = m_pItems[0];
+		if (!setTriangleVertices(itemFirst, aVertices[0], aVertices[1], aVertices[2]))
+			return false;
+	}
+
+	detachMapping();
+	if (m_aFlatNodes.empty())
+	{
+		const I1 nItems = static_cast<I1>(m_aItems.size());
+		for (I1 i = 0; i < nItems; ++i)
+			setTriangleVertices(m_aItems[i], aVertices[3 * i], aVertices[3 * i + 1], aVertices[3 * i + 2]);
+		costRelative = 1.;
+		return true;
+	}
+
+	///The old bounding boxes of the items bound their leafs, so they are kept for the edits till the items are distributed again
+	initBBoxItemsLeafs();
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+	const I1 nThreads = m_useMultithread && nItems >= static_cast<I1>(cNumElementsForParalell) ? omp_get_max_threads() : 1;
+
+	///The triangle which keeps its vertices stays in its leafs, the moved triangles are marked for the distribution
+	std::vector<unsigned char> aMovedItems(nItems, 0);
+	I1 nMovedItems = 0;
+#pragma omp parallel for num_threads(static_cast<int>(nThreads)) reduction(+ : nMovedItems)
+	for (I1 i = 0; i < nItems; ++i)
+	{
+		D3 aVx[3];
+		getTriangleVertices(m_aItems[i], aVx[0], aVx[1], aVx[2]);
+		const D3* const aMoved = &aVertices[3 * i];
+		bool bMoved = false;
+		for (UI1 k = 0; k < 3; ++k)
+		{
+			for (UI1 dim = 0; dim < 3; ++dim)
+				bMoved = bMoved || aMoved[k][dim] != aVx[k][dim];
+		}
+		if (!bMoved)
+			continue;
+
+		setTriangleVertices(m_aItems[i], aMoved[0], aMoved[1], aMoved[2]);
+#ifdef USE_SIMD_DIST_TRIANGLES
+		if (!m_aTrianglesPrecomputed.empty())
+			m_aTrianglesPrecomputed[i].setTriangle(aMoved[0], aMoved[1], aMoved[2]);
+#endif
+
+		if (isItemRemoved(i))
+			continue;
+
+		aMovedItems[i] = 1;
+		++nMovedItems;
+	}
+
+	if (nMovedItems != 0)
+	{
+		refitItemsLeafs(nThreads, aMovedItems);
+		compactTree();
+		bindQueryArrays();
+	}
+
+	costRelative = rebuildRefittedTree(nodeSplitter, maxCostRelative);
+	return true;
+}
+
+///<summary>Refits the KD Tree to its items, the shared vertices of the indexed triangles are moved by the caller</summary>
+///<remarks>The moves of the items are unknown, so all items are distributed again</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter of the rebuild</remarks>
+///<remarks>In : maxCostRelative - The relative SAH cost of the refitted KD Tree above which it's rebuilt</remarks>
+///<returns>The SAH cost of the refitted KD Tree relative to its cost after the last build and the rebuilds of the leafs, the KD Tree was rebuilt if it's greater than maxCostRelative</returns>
+template<typename T>
+double C3DKDTree<T>::refit(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const double maxCostRelative)
+{
+	detachMapping();
+	if (m_aFlatNodes.empty())
+		return 1.;
+
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+	const I1 nThreads = m_useMultithread && nItems >= static_cast<I1>(cNumElementsForParalell) ? omp_get_max_threads() : 1;
+
+#ifdef USE_SIMD_DIST_TRIANGLES
+	if (!m_aTrianglesPrecomputed.empty())
+	{
+#pragma omp parallel for num_threads(static_cast<int>(nThreads))
+		for (I1 i = 0; i < nItems; ++i)
+		{
+			D3 A, B, C;
+			getTriangleVertices(m_aItems[i], A, B, C);
+			m_aTrianglesPrecomputed[i].setTriangle(A, B, C);
+		}
+	}
+#endif
+
+	///The leafs which waited for the rebuild are distributed again too
+	m_bBoxTree = calcBBoxItemsParallel(nThreads);
+	distributeItemsLeafs(nThreads);
+	m_aDirtyLeafs.clear();
+	m_numGarbageIDItems = 0;
+
+	bindQueryArrays();
+	return rebuildRefittedTree(nodeSplitter, maxCostRelative);
+}
+
+///<summary>Rebuilds the refitted KD Tree by the splitter if its SAH cost relative to its cost after the last build and the rebuilds of the leafs exceeds maxCostRelative</summary>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter of the rebuild</remarks>
+///<remarks>In : maxCostRelative - The relative SAH cost of the refitted KD Tree above which it's rebuilt</remarks>
+///<returns>The SAH cost of the refitted KD Tree relative to its cost after the last build and the rebuilds of the leafs</returns>
+template<typename T>
+double C3DKDTree<T>::rebuildRefittedTree(const C3DKDTreeNodeSplitter<T>& nodeSplitter, const double maxCostRelative)
+{
+	const double costRelative = m_costSAHBuild > 0. ? calcCostSAH() / m_costSAHBuild : 1.;
+	if (costRelative > maxCostRelative)
+		rebuildTree(nodeSplitter);
+
+	return costRelative;
+}
+
+///<summary>Rebuilds the KD Tree over its not removed items by the splitter, the garbage of the edits is dropped</summary>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+template<typename T>
+void C3DKDTree<T>::rebuildTree(const C3DKDTreeNodeSplitter<T>& nodeSplitter)
+{
+	detachMapping();
+	m_aFlatNodes.clear();
+	m_aFlatIDItems.clear();
+	m_aDirtyLeafs.clear();
+	std::vector<SBBox>().swap(m_aBBoxItemsLeafs);
+	m_numGarbageNodes = 0;
+	m_numGarbageIDItems = 0;
+	m_numLeafs = 0;
+
+	buildTree(nodeSplitter, eKDTreeBuildSplitter);
+}
+
+///<summary>Calculates the bounding boxes of the items into m_aBBoxItems by the threads</summary>
+///<remarks>In : nThreads - The number of the threads</remarks>
+///<returns>The bounding box of the not removed items</returns>
+template<typename T>
+SBBox C3DKDTree<T>::calcBBoxItemsParallel(const I1 nThreads)
+{
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+
+	///The bounding box of the items is reduced from the bounding boxes of the items of the threads
+	SBBox bBoxEmpty;
+	bBoxEmpty.m_minBB = D3(DBL_MAX, DBL_MAX, DBL_MAX);
+	bBoxEmpty.m_maxBB = D3(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+	std::vector<SBBox> aBBoxThreads(nThreads, bBoxEmpty);
+
+	m_aBBoxItems.resize(nItems);
+#pragma omp parallel num_threads(static_cast<int>(nThreads))
+	{
+		SBBox& bBoxThread = aBBoxThreads[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+		for (I1 i = 0; i < nItems; ++i)
+		{
+			const SBBox& bBoxItem = m_aBBoxItems[i] = m_aItems[i].calcBBoxItem();
+			if (isItemRemoved(i))
+				continue;
+
+			for (UI1 dim = 0; dim < 3; ++dim)
+			{
+				bBoxThread.m_minBB[dim] = math::min2(bBoxThread.m_minBB[dim], bBoxItem.m_minBB[dim]);
+				bBoxThread.m_maxBB[dim] = math::max2(bBoxThread.m_maxBB[dim], bBoxItem.m_maxBB[dim]);
+			}
+		}
+	}
+
+	SBBox bBoxItems = bBoxEmpty;
+	for (I1 iThread = 0; iThread < nThreads; ++iThread)
+	{
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			bBoxItems.m_minBB[dim] = math::min2(bBoxItems.m_minBB[dim], aBBoxThreads[iThread].m_minBB[dim]);
+			bBoxItems.m_maxBB[dim] = math::max2(bBoxItems.m_maxBB[dim], aBBoxThreads[iThread].m_maxBB[dim]);
+		}
+	}
+	return bBoxItems;
+}
+
+///<summary>Distributes the not removed items into the leafs of the flattened KD Tree, the id items of the leafs are replaced</summary>
+///<remarks>The bounding boxes of the items must be in m_aBBoxItems, they are moved into m_aBBoxItemsLeafs</remarks>
+///<remarks>In : nThreads - The number of the threads</remarks>
+template<typename T>
+void C3DKDTree<T>::distributeItemsLeafs(const I1 nThreads)
+{
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+	const I1 nNodes = static_cast<I1>(m_aFlatNodes.size());
+
+	///The threads find and count the leafs of their ranges of the items
+	std::vector<std::atomic<UI4>> aNumItemsNodes(nNodes);
+	std::vector<std::vector<std::pair<UI4, UI4>>> aLeafItemsThreads(nThreads);
+#pragma omp parallel num_threads(static_cast<int>(nThreads))
+	{
+		std::vector<std::pair<UI4, UI4>>& aLeafItems = aLeafItemsThreads[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+		for (I1 i = 0; i < nItems; ++i)
+		{
+			if (isItemRemoved(i))
+				continue;
+
+			const UI4 idItem = static_cast<UI4>(i);
+			findItemLeafs(m_aItems[i], m_aBBoxItems[i], [&aLeafItems, &aNumItemsNodes, idItem](const SEditNode& leaf)
+			{
+				aLeafItems.emplace_back(leaf.m_idNode, idItem);
+				aNumItemsNodes[leaf.m_idNode].fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+	}
+
+	m_aBBoxItemsLeafs.swap(m_aBBoxItems);
+	std::vector<SBBox>().swap(m_aBBoxItems);
+
+	///The leafs are placed into the array of the id items in the order of the nodes, the counters of the leafs are reset to take the slots
+	UI4 offsetItems = 0;
+	for (I1 i = 0; i < nNodes; ++i)
+	{
+		SFlatKDTreeNode& node = m_aFlatNodes[i];
+		if (!node.isLeaf())
+			continue;
+
+		node.m_offsetItems = offsetItems;
+		node.m_numItems = aNumItemsNodes[i].load(std::memory_order_relaxed);
+		offsetItems += node.m_numItems;
+		aNumItemsNodes[i].store(0, std::memory_order_relaxed);
+	}
+
+	///The threads scatter their id items by the slots of the leafs, so the id items of the leaf are sorted to keep the order of the items
+	m_aFlatIDItems.resize(offsetItems);
+	m_aFlatIDItems.shrink_to_fit();
+#pragma omp parallel num_threads(static_cast<int>(nThreads))
+	{
+		for (I1 iThread = omp_get_thread_num(); iThread < nThreads; iThread += omp_get_num_threads())
+		{
+			const std::vector<std::pair<UI4, UI4>>& aLeafItems = aLeafItemsThreads[iThread];
+			for (UI1 i = 0, size = aLeafItems.size(); i < size; ++i)
+			{
+				const UI4 idNode = aLeafItems[i].first;
+				m_aFlatIDItems[m_aFlatNodes[idNode].m_offsetItems + aNumItemsNodes[idNode].fetch_add(1, std::memory_order_relaxed)] = aLeafItems[i].second;
+			}
+		}
+
+#pragma omp barrier
+#pragma omp for schedule(dynamic, 256)
+		for (I1 i = 0; i < nNodes; ++i)
+		{
+			const SFlatKDTreeNode& node = m_aFlatNodes[i];
+			if (node.isLeaf() && node.m_numItems > 1)
+				std::sort(m_aFlatIDItems.begin() + node.m_offsetItems, m_aFlatIDItems.begin() + node.m_offsetItems + node.m_numItems);
+		}
+	}
+}
+
+///<summary>Refits the id items of the leafs of the flattened KD Tree to the moved items, the marked items are removed from their leafs and are distributed again</summary>
+///<remarks>The leafs which got the items reuse the places of their removed items or are moved to the end of the array of the id items, only they are sorted, the other leafs are compacted in place</remarks>
+///<remarks>In : nThreads - The number of the threads</remarks>
+///<remarks>In : aMovedItems - The marks of the moved not removed items</remarks>
+template<typename T>
+void C3DKDTree<T>::refitItemsLeafs(const I1 nThreads, const std::vector<unsigned char>& aMovedItems)
+{
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+	const I1 nNodes = static_cast<I1>(m_aFlatNodes.size());
+
+	///The bounding box of the KD Tree grows by the moved items, it isn't shrunk, so the not moved items stay in it
+	SBBox bBoxEmpty;
+	bBoxEmpty.m_minBB = D3(DBL_MAX, DBL_MAX, DBL_MAX);
+	bBoxEmpty.m_maxBB = D3(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+	std::vector<SBBox> aBBoxThreads(nThreads, bBoxEmpty);
+	std::vector<std::vector<std::pair<UI4, UI4>>> aLeafItemsThreads(nThreads);
+#pragma omp parallel num_threads(static_cast<int>(nThreads))
+	{
+		SBBox& bBoxThread = aBBoxThreads[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+		for (I1 i = 0; i < nItems; ++i)
+		{
+			if (aMovedItems[i] == 0)
+				continue;
+
+			const SBBox& bBoxItem = m_aBBoxItemsLeafs[i] = m_aItems[i].calcBBoxItem();
+			for (UI1 dim = 0; dim < 3; ++dim)
+			{
+				bBoxThread.m_minBB[dim] = math::min2(bBoxThread.m_minBB[dim], bBoxItem.m_minBB[dim]);
+				bBoxThread.m_maxBB[dim] = math::max2(bBoxThread.m_maxBB[dim], bBoxItem.m_maxBB[dim]);
+			}
+		}
+
+#pragma omp single
+		{
+			for (I1 iThread = 0; iThread < nThreads; ++iThread)
+			{
+				for (UI1 dim = 0; dim < 3; ++dim)
+				{
+					m_bBoxTree.m_minBB[dim] = math::min2(m_bBoxTree.m_minBB[dim], aBBoxThreads[iThread].m_minBB[dim]);
+					m_bBoxTree.m_maxBB[dim] = math::max2(m_bBoxTree.m_maxBB[dim], aBBoxThreads[iThread].m_maxBB[dim]);
+				}
+			}
+		}
+
+		std::vector<std::pair<UI4, UI4>>& aLeafItems = aLeafItemsThreads[omp_get_thread_num()];
+#pragma omp for schedule(dynamic, 256)
+		for (I1 i = 0; i < nItems; ++i)
+		{
+			if (aMovedItems[i] == 0)
+				continue;
+
+			const UI4 idItem = static_cast<UI4>(i);
+			findItemLeafs(m_aItems[i], m_aBBoxItemsLeafs[i], [&aLeafItems, idItem](const SEditNode& leaf)
+			{
+				aLeafItems.emplace_back(leaf.m_idNode, idItem);
+			});
+		}
+	}
+
+	///The id items of the moved items are sorted by their leafs, so the leafs which got them are found by the binary search without the arrays of the nodes
+	const auto isLessLeaf = [](const std::pair<UI4, UI4>& a, const std::pair<UI4, UI4>& b) { return a.first < b.first; };
+	std::vector<std::pair<UI4, UI4>> aLeafItems;
+	{
+		UI1 nLeafItems = 0;
+		for (I1 iThread = 0; iThread < nThreads; ++iThread)
+			nLeafItems += aLeafItemsThreads[iThread].size();
+		aLeafItems.reserve(nLeafItems);
+		for (I1 iThread = 0; iThread < nThreads; ++iThread)
+		{
+			aLeafItems.insert(aLeafItems.end(), aLeafItemsThreads[iThread].begin(), aLeafItemsThreads[iThread].end());
+			std::vector<std::pair<UI4, UI4>>().swap(aLeafItemsThreads[iThread]);
+		}
+		std::sort(aLeafItems.begin(), aLeafItems.end());
+	}
+
+	///The moved items are removed from the leafs in place keeping the order of the other items, the leaf which got the items takes them after its kept items if its old place holds them
+	///The leafs whose old places are too small are moved to the end of the array of the id items after all leafs are compacted
+	std::vector<std::vector<UI4>> aMovedLeafsThreads(nThreads);
+	UI1 nGarbageIDItems = 0;
+#pragma omp parallel num_threads(static_cast<int>(nThreads)) reduction(+ : nGarbageIDItems)
+	{
+		std::vector<UI4>& aMovedLeafs = aMovedLeafsThreads[omp_get_thread_num()];
+
+#pragma omp for schedule(dynamic, 256)
+		for (I1 i = 0; i < nNodes; ++i)
+		{
+			SFlatKDTreeNode& leaf = m_aFlatNodes[i];
+			if (!leaf.isLeaf())
+				continue;
+
+			UI4* const pIDItems = m_aFlatIDItems.data() + leaf.m_offsetItems;
+			UI4 nKept = 0;
+			for (UI4 iItem = 0; iItem < leaf.m_numItems; ++iItem)
+			{
+				if (aMovedItems[pIDItems[iItem]] == 0)
+					pIDItems[nKept++] = pIDItems[iItem];
+			}
+
+			const UI4 idLeaf = static_cast<UI4>(i);
+			const auto itsGot = std::equal_range(aLeafItems.cbegin(), aLeafItems.cend(), std::make_pair(idLeaf, static_cast<UI4>(0)), isLessLeaf);
+			const UI4 nGot = static_cast<UI4>(itsGot.second - itsGot.first);
+			if (nGot != 0 && nKept + nGot > leaf.m_numItems)
+			{
+				nGarbageIDItems += leaf.m_numItems;
+				leaf.m_numItems = nKept;
+				aMovedLeafs.push_back(idLeaf);
+				continue;
+			}
+
+			nGarbageIDItems += leaf.m_numItems - nKept - nGot;
+			for (auto it = itsGot.first; it != itsGot.second; ++it)
+				pIDItems[nKept++] = it->second;
+			leaf.m_numItems = nKept;
+			if (nGot != 0)
+				std::sort(pIDItems, pIDItems + nKept);
+		}
+	}
+
+	///The moved leafs take the places after the array of the id items in the order of the nodes by the numbers of their kept and got items
+	std::vector<UI4> aMovedLeafs;
+	for (I1 iThread = 0; iThread < nThreads; ++iThread)
+		aMovedLeafs.insert(aMovedLeafs.end(), aMovedLeafsThreads[iThread].begin(), aMovedLeafsThreads[iThread].end());
+	std::sort(aMovedLeafs.begin(), aMovedLeafs.end());
+
+	const UI1 nMovedLeafs = aMovedLeafs.size();
+	std::vector<UI1> aOffsetsMovedLeafs(nMovedLeafs + 1);
+	aOffsetsMovedLeafs[0] = m_aFlatIDItems.size();
+	for (UI1 i = 0; i < nMovedLeafs; ++i)
+	{
+		const auto itsGot = std::equal_range(aLeafItems.cbegin(), aLeafItems.cend(), std::make_pair(aMovedLeafs[i], static_cast<UI4>(0)), isLessLeaf);
+		aOffsetsMovedLeafs[i + 1] = aOffsetsMovedLeafs[i] + m_aFlatNodes[aMovedLeafs[i]].m_numItems + (itsGot.second - itsGot.first);
+	}
+	m_aFlatIDItems.resize(aOffsetsMovedLeafs[nMovedLeafs]);
+
+#pragma omp parallel for num_threads(static_cast<int>(nThreads)) schedule(dynamic, 64)
+	for (I1 i = 0; i < static_cast<I1>(nMovedLeafs); ++i)
+	{
+		SFlatKDTreeNode& leaf = m_aFlatNodes[aMovedLeafs[i]];
+		UI4* const pIDItems = m_aFlatIDItems.data() + aOffsetsMovedLeafs[i];
+		std::copy(m_aFlatIDItems.data() + leaf.m_offsetItems, m_aFlatIDItems.data() + leaf.m_offsetItems + leaf.m_numItems, pIDItems);
+
+		UI4 nIDItems = leaf.m_numItems;
+		const auto itsGot = std::equal_range(aLeafItems.cbegin(), aLeafItems.cend(), std::make_pair(aMovedLeafs[i], static_cast<UI4>(0)), isLessLeaf);
+		for (auto it = itsGot.first; it != itsGot.second; ++it)
+			pIDItems[nIDItems++] = it->second;
+
+		std::sort(pIDItems, pIDItems + nIDItems);
+		leaf.m_offsetItems = static_cast<UI4>(aOffsetsMovedLeafs[i]);
+		leaf.m_numItems = nIDItems;
+	}
+	m_numGarbageIDItems += nGarbageIDItems;
+}
+
+///<summary>Calculates the SAH cost of the KD Tree, it's the expected cost of the query relative to the cost of the traversal of one node</summary>
+///<returns>The SAH cost of the KD Tree, 0 for the empty KD Tree</returns>
+template<typename T>
+double C3DKDTree<T>::calcCostSAH() const
+{
+	const double areaTree = math::calcHalfAreaBBox(m_bBoxTree);
+	if (m_nFlatNodes == 0 || !(areaTree > 0.))
+		return 0.;
+
+	return calcCostSAH(0, m_bBoxTree) / areaTree;
+}
+
+///<summary>Calculates the SAH cost of the subtree without the normalization by the area of the KD Tree</summary>
+///<remarks>In : idNode - Id of the root of the subtree in the array of the flattened nodes</remarks>
+///<remarks>In : bBoxNode - The bounding box of the root of the subtree</remarks>
+///<returns>The sum of the costs of the nodes weighted by the areas of their bounding boxes</returns>
+template<typename T>
+double C3DKDTree<T>::calcCostSAH(UI4 idNode, const SBBox& bBoxNode) const
+{
+	const SFlatKDTreeNode& node = getFlatNode(idNode);
+	const double areaNode = math::calcHalfAreaBBox(bBoxNode);
+	if (node.isLeaf())
+		return cI * static_cast<double>(node.m_numItems) * areaNode;
+
+	///The split plane of the refitted KD Tree can be out of the node, then one child is empty
+	const UI1 dim = node.m_dimSplit;
+	const double posSplit = math::min2(math::max2(node.m_posSplit, bBoxNode.m_minBB[dim]), bBoxNode.m_maxBB[dim]);
+
+	SBBox bBoxChild = bBoxNode;
+	bBoxChild.m_maxBB[dim] = posSplit;
+	const double cost = cT * areaNode + calcCostSAH(idNode + 1, bBoxChild);
+
+	bBoxChild = bBoxNode;
+	bBoxChild.m_minBB[dim] = posSplit;
+	return cost + calcCostSAH(node.m_idRightNode, bBoxChild);
+}
+
+///<summary>Copies the arrays of the mapped KD Tree into the memory, so the KD Tree can be edited</summary>
+template<typename T>
+void C3DKDTree<T>::detachMapping()
+{
+	if (m_fileMapping.getData() == nullptr)
+		return;
+
+	m_aItems.assign(m_pItems, m_pItems + m_nItems);
+	m_aFlatNodes.assign(m_pFlatNodes, m_pFlatNodes + m_nFlatNodes);
+	m_aFlatIDItems.assign(m_pFlatIDItems, m_pFlatIDItems + m_nFlatIDItems);
+#ifdef USE_SIMD_DIST_TRIANGLES
+	if (m_pTrianglesPrecomputed != nullptr)
+		m_aTrianglesPrecomputed.assign(m_pTrianglesPrecomputed, m_pTrianglesPrecomputed + m_nItems);
+#endif
+
+	m_fileMapping.unmap();
+	bindQueryArrays();
+}
+
+///<summary>Calculates the bounding boxes of the items which aren't in m_aBBoxItemsLeafs, so the edits find the leafs of the items by them</summary>
+template<typename T>
+void C3DKDTree<T>::initBBoxItemsLeafs()
+{
+	const I1 nItemsLeafs = static_cast<I1>(m_aBBoxItemsLeafs.size());
+	const I1 nItems = static_cast<I1>(m_aItems.size());
+	m_aBBoxItemsLeafs.resize(nItems);
+#pragma omp parallel for if (m_useMultithread && nItems - nItemsLeafs > static_cast<I1>(cNumElementsForParalell))
+	for (I1 i = nItemsLeafs; i < nItems; ++i)
+		m_aBBoxItemsLeafs[i] = m_aItems[i].calcBBoxItem();
+}
+
+///<summary>Inserts the item into the leafs which its part clipped by the nodes overlaps</summary>
+///<remarks>In : idItem - Id of the item</remarks>
+template<typename T>
+void C3DKDTree<T>::insertItemLeafs(const UI4 idItem)
+{
+	const T& item = m_aItems[idItem];
+	const SBBox bBoxItem = item.calcBBoxItem();
+
+	///The bounding box of the KD Tree is the bounding box of its root, so the grown box extends the leafs on the boundary
+	if (m_aFlatNodes.empty())
+	{
+		m_bBoxTree = bBoxItem;
+		m_aFlatNodes.emplace_back();
+		m_aFlatNodes.back().setLeaf(static_cast<UI4>(m_aFlatIDItems.size()), 0);
+		m_numLeafs = 1;
+	}
+
+	for (UI1 dim = 0; dim < 3; ++dim)
+	{
+		m_bBoxTree.m_minBB[dim] = math::min2(m_bBoxTree.m_minBB[dim], bBoxItem.m_minBB[dim]);
+		m_bBoxTree.m_maxBB[dim] = math::max2(m_bBoxTree.m_maxBB[dim], bBoxItem.m_maxBB[dim]);
+	}
+
+	m_aBBoxItemsLeafs[idItem] = bBoxItem;
+	findItemLeafs(item, bBoxItem, [this, idItem](const SEditNode& leaf)
+	{
+		m_aDirtyLeafs.push_back(leaf);
+		m_aDirtyLeafs.back().m_numItemsLeaf = m_aFlatNodes[leaf.m_idNode].m_numItems;
+		appendIDItemLeaf(leaf.m_idNode, idItem);
+	});
+}
+
+///<summary>Finds the leafs which the part of the item clipped by the nodes overlaps, the item must be in the bounding box of the KD Tree</summary>
+///<remarks>In : item - The item</remarks>
+///<remarks>In : bBoxItem - The bounding box of the item</remarks>
+///<remarks>In : visitLeaf - The functor which is called with SEditNode of every found leaf</remarks>
+template<typename T>
+template<typename TVisitLeaf>
+void C3DKDTree<T>::findItemLeafs(const T& item, const SBBox& bBoxItem, TVisitLeaf visitLeaf) const
+{
+	///The item is clipped by the nodes as by the perfect splits, so the leafs which only its bounding box overlaps are skipped
+	///The bounding box of the part of the item clipped by the last crossed node is kept per node, so the item is clipped again only if this part crosses the split plane
+	///The part of the triangle is kept as the polygon, so it's split by the crossed plane only instead of the clipping of the triangle by the whole node
+	SEditNode aStack[cTraversalStackSize];
+	SBBox aBBoxPartStack[cTraversalStackSize];
+	D3 aVxPartStack[cTraversalStackSize][cMaxVxClippedTriangle + 1];
+	UI1 aNumVxPartStack[cTraversalStackSize];
+	UI1 nStack = 1;
+	aStack[0].m_idNode = 0;
+	aStack[0].m_idParent = 0;
+	aStack[0].m_bRight = false;
+	aStack[0].m_depth = 0;
+	aStack[0].m_numItemsLeaf = 0;
+	aStack[0].m_bBox = m_bBoxTree;
+	aBBoxPartStack[0] = bBoxItem;
+	const bool bTriangle = getTriangleVertices(item, aVxPartStack[0][0], aVxPartStack[0][1], aVxPartStack[0][2]);
+	aNumVxPartStack[0] = 3;
+
+	D3 aVxPart[cMaxVxClippedTriangle + 1];
+	while (nStack != 0)
+	{
+		--nStack;
+		SEditNode editNode = aStack[nStack];
+		SBBox bBoxPart = aBBoxPartStack[nStack];
+		UI1 nVxPart = aNumVxPartStack[nStack];
+		if (bTriangle)
+			std::copy(aVxPartStack[nStack], aVxPartStack[nStack] + nVxPart, aVxPart);
+
+		for (;;)
+		{
+			if (m_aFlatNodes[editNode.m_idNode].isLink())
+				editNode.m_idNode = m_aFlatNodes[editNode.m_idNode].m_idRightNode;
+
+			const SFlatKDTreeNode& node = m_aFlatNodes[editNode.m_idNode];
+			if (node.isLeaf())
+			{
+				visitLeaf(editNode);
+				break;
+			}
+
+			const UI1 dim = node.m_dimSplit;
+			const double posSplit = node.m_posSplit;
+			eSplitSide side = eSplitSideBoth;
+			SBBox bBoxPartRight = bBoxPart;
+			if (bBoxPart.m_minBB[dim] >= posSplit)
+				side = eSplitSideRight;
+			else if (bBoxPart.m_maxBB[dim] < posSplit)
+				side = eSplitSideLeft;
+			else if (bTriangle)
+			{
+				///The degenerate part can get more vertices than the clipped triangle, so the part which can't get one more vertex isn't split
+				if (nVxPart <= cMaxVxClippedTriangle)
+				{
+					UI1 nVxLeft = 0;
+					UI1 nVxRight = 0;
+					D3 aVxLeft[cMaxVxClippedTriangle + 1];
+					math::splitClippedTriangle(aVxPart, nVxPart, dim, posSplit, aVxLeft, nVxLeft, aVxPartStack[nStack], nVxRight);
+					if (nVxLeft == 0 && nVxRight == 0)
+						break;
+
+					if (nVxLeft == 0)
+						side = eSplitSideRight;
+					else if (nVxRight == 0)
+						side = eSplitSideLeft;
+
+					if (nVxRight != 0)
+						bBoxPartRight = math::calcBBoxPoints(aVxPartStack[nStack], nVxRight);
+					if (nVxLeft != 0)
+						bBoxPart = math::calcBBoxPoints(aVxLeft, nVxLeft);
+
+					if (side == eSplitSideRight)
+					{
+						std::copy(aVxPartStack[nStack], aVxPartStack[nStack] + nVxRight, aVxPart);
+						nVxPart = nVxRight;
+						bBoxPart = bBoxPartRight;
+					}
+					else
+					{
+						aNumVxPartStack[nStack] = nVxRight;
+						std::copy(aVxLeft, aVxLeft + nVxLeft, aVxPart);
+						nVxPart = nVxLeft;
+					}
+				}
+				else
+				{
+					std::copy(aVxPart, aVxPart + nVxPart, aVxPartStack[nStack]);
+					aNumVxPartStack[nStack] = nVxPart;
+				}
+			}
+			else
+			{
+				if (!item.calcBBoxClipped(editNode.m_bBox, bBoxPart))
+					break;
+
+				if (bBoxPart.m_minBB[dim] >= posSplit)
+					side = eSplitSideRight;
+				else if (bBoxPart.m_maxBB[dim] < posSplit)
+					side = eSplitSideLeft;
+				bBoxPartRight = bBoxPart;
+			}
+
+			if (side != eSplitSideLeft)
+			{
+				SEditNode& rightNode = side == eSplitSideRight ? editNode : aStack[nStack];
+				if (side == eSplitSideBoth)
+				{
+					rightNode = editNode;
+					aBBoxPartStack[nStack++] = bBoxPartRight;
+				}
+
+				rightNode.m_idParent = rightNode.m_idNode;
+				rightNode.m_idNode = node.m_idRightNode;
+				rightNode.m_bRight = true;
+				++rightNode.m_depth;
+				rightNode.m_bBox.m_minBB[dim] = posSplit;
+				if (side == eSplitSideRight)
+					continue;
+			}
+
+			editNode.m_bBox.m_maxBB[dim] = posSplit;
+			editNode.m_idParent = editNode.m_idNode;
+			editNode.m_idNode = editNode.m_idNode + 1;
+			editNode.m_bRight = false;
+			++editNode.m_depth;
+		}
+	}
+}
+
+///<summary>Removes the item from all leafs which its bounding box at the insertion overlaps</summary>
+///<remarks>In : idItem - Id of the item</remarks>
+template<typename T>
+void C3DKDTree<T>::removeItemLeafs(const UI4 idItem)
+{
+	if (m_aFlatNodes.empty())
+		return;
+
+	///The item can be moved since the insertion(the shared vertices of the indexed triangles), so the leafs are found by its old bounding box
+	const SBBox& bBoxItem = m_aBBoxItemsLeafs[idItem];
+
+	UI4 aStack[cTraversalStackSize];
+	UI1 nStack = 1;
+	aStack[0] = 0;
+
+	while (nStack != 0)
+	{
+		UI4 idNode = aStack[--nStack];
+		for (;;)
+		{
+			if (m_aFlatNodes[idNode].isLink())
+				idNode = m_aFlatNodes[idNode].m_idRightNode;
+
+			SFlatKDTreeNode& node = m_aFlatNodes[idNode];
+			if (node.isLeaf())
+			{
+				///The id item is replaced by the last id item of the leaf, the freed place is unused if it isn't at the end of the array
+				for (UI4 i = node.m_offsetItems, iEnd = node.m_offsetItems + node.m_numItems; i < iEnd; ++i)
+				{
+					if (m_aFlatIDItems[i] != idItem)
+						continue;
+
+					m_aFlatIDItems[i] = m_aFlatIDItems[iEnd - 1];
+					--node.m_numItems;
+					if (iEnd == m_aFlatIDItems.size())
+						m_aFlatIDItems.pop_back();
+					else
+						++m_numGarbageIDItems;
+					break;
+				}
+				break;
+			}
+
+			const bool bLeft = bBoxItem.m_minBB[node.m_dimSplit] < node.m_posSplit;
+			const bool bRight = bBoxItem.m_maxBB[node.m_dimSplit] >= node.m_posSplit;
+			if (bLeft && bRight)
+				aStack[nStack++] = node.m_idRightNode;
+
+			idNode = bLeft ? idNode + 1 : node.m_idRightNode;
+		}
+	}
+}
+
+///<summary>Appends the id item to the leaf, the id items of the leaf are moved to the end of the shared array if they aren't there</summary>
+///<remarks>In : idNode - Id of the leaf</remarks>
+///<remarks>In : idItem - Id of the item</remarks>
+template<typename T>
+void C3DKDTree<T>::appendIDItemLeaf(const UI4 idNode, const UI4 idItem)
+{
+	SFlatKDTreeNode& leaf = m_aFlatNodes[idNode];
+	const UI1 nIDItems = m_aFlatIDItems.size();
+	if (leaf.m_offsetItems + leaf.m_numItems != nIDItems)
+	{
+		///The old place of the id items is unused until the KD Tree is compacted
+		const UI1 offsetItems = leaf.m_offsetItems;
+		const UI1 numItems = leaf.m_numItems;
+		m_aFlatIDItems.resize(nIDItems + numItems);
+		std::copy(m_aFlatIDItems.begin() + offsetItems, m_aFlatIDItems.begin() + offsetItems + numItems, m_aFlatIDItems.begin() + nIDItems);
+
+		leaf.m_offsetItems = static_cast<UI4>(nIDItems);
+		m_numGarbageIDItems += numItems;
+	}
+
+	m_aFlatIDItems.push_back(idItem);
+	++leaf.m_numItems;
+}
+
+///<summary>Copies the reachable nodes and the id items of their leafs into the new arrays if the half of the arrays is unused</summary>
+///<remarks>The KD Tree is compacted only if the half of its nodes or its id items is unused</remarks>
+template<typename T>
+void C3DKDTree<T>::compactTree()
+{
+	if (2 * m_numGarbageNodes <= m_aFlatNodes.size() && 2 * m_numGarbageIDItems <= m_aFlatIDItems.size())
+		return;
+
+	CFlatKDTreeNodes aNodes;
+	std::vector<UI4> aIDItems;
+	aNodes.reserve(m_aFlatNodes.size() - m_numGarbageNodes);
+	aIDItems.reserve(m_aFlatIDItems.size() - m_numGarbageIDItems);
+
+	std::vector<UI4> aIDNodesLayout(m_aDirtyLeafs.empty() ? 0 : m_aFlatNodes.size(), 0);
+	compactSubTree(aNodes, aIDItems, m_aDirtyLeafs.empty() ? nullptr : &aIDNodesLayout, 0);
+
+	///The leafs which wait for the rebuild keep the ids of the nodes, so they are moved to the compacted nodes
+	for (UI1 i = 0, nDirtyLeafs = m_aDirtyLeafs.size(); i < nDirtyLeafs; ++i)
+	{
+		m_aDirtyLeafs[i].m_idNode = aIDNodesLayout[m_aDirtyLeafs[i].m_idNode];
+		m_aDirtyLeafs[i].m_idParent = aIDNodesLayout[m_aDirtyLeafs[i].m_idParent];
+	}
+
+	m_aFlatNodes.swap(aNodes);
+	m_aFlatIDItems.swap(aIDItems);
+	m_numGarbageNodes = 0;
+	m_numGarbageIDItems = 0;
+}
+
+///<summary>Appends the node and its subtree to the compacted arrays in the depth-first order</summary>
+///<remarks>In/Out : aNodes - The compacted nodes</remarks>
+///<remarks>In/Out : aIDItems - The compacted id items</remarks>
+///<remarks>Out : pIDNodesCompact - Ids of the nodes in the compacted nodes by their ids in the array of the flattened nodes, it isn't filled if it's nullptr</remarks>
+///<remarks>In : idNode - Id of the node in the array of the flattened nodes</remarks>
+///<returns>Id of the node in the compacted nodes</returns>
+template<typename T>
+UI4 C3DKDTree<T>::compactSubTree(CFlatKDTreeNodes& aNodes, std::vector<UI4>& aIDItems, std::vector<UI4>* const pIDNodesCompact, UI4 idNode) const
+{
+	if (m_aFlatNodes[idNode].isLink())
+		idNode = m_aFlatNodes[idNode].m_idRightNode;
+
+	const SFlatKDTreeNode& node = m_aFlatNodes[idNode];
+	const UI4 idCompactNode = static_cast<UI4>(aNodes.size());
+	aNodes.push_back(node);
+	if (pIDNodesCompact != nullptr)
+		(*pIDNodesCompact)[idNode] = idCompactNode;
+
+	if (node.isLeaf())
+	{
+		aNodes.back().m_offsetItems = static_cast<UI4>(aIDItems.size());
+		if (node.m_numItems != 0)
+			aIDItems.insert(aIDItems.end(), m_aFlatIDItems.begin() + node.m_offsetItems, m_aFlatIDItems.begin() + node.m_offsetItems + node.m_numItems);
+		return idCompactNode;
+	}
+
+	compactSubTree(aNodes, aIDItems, pIDNodesCompact, idNode + 1);
+	aNodes[idCompactNode].m_idRightNode = compactSubTree(aNodes, aIDItems, pIDNodesCompact, node.m_idRightNode);
+	return idCompactNode;
+}
+
+#ifdef USE_SIMD_DIST_TRIANGLES
+///<summary>Precomputes the triangles per item, the leafs share the precomputed triangle of the item</summary>
+///<remarks>The triangles aren't precomputed if the items aren't the packed triangles</remarks>
+template<typename T>
+void C3DKDTree<T>::buildTrianglesPrecomputed()
+{
+	///The kind of the items is checked by the first item before the precomputed triangles are allocated
+	D3 A, B, C;
+	const UI1 nItems = m_aItems.size();
+	if (nItems == 0 || !getTriangleVertices(m_aItems[0], A, B, C))
+		return;
+
+	m_aTrianglesPrecomputed.resize(nItems);
+	for (UI1 i = 0; i < nItems; ++i)
+	{
+		getTriangleVertices(m_aItems[i], A, B, C);
+		m_aTrianglesPrecomputed[i].setTriangle(A, B, C);
+	}
+}
+#endif
+
+#ifdef USE_INPLACE_BUILD
+///<summary>Builds the KD Tree in place over the preallocated buffers of the id items</summary>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+template<typename T>
+void C3DKDTree<T>::createTreeInPlace(const C3DKDTreeNodeSplitter<T>& nodeSplitter)
+{
+	const SBBox bBox = math::calcBBoxItems(m_aItems, m_aBBoxItems);
+	m_bBoxTree = bBox;
+
+	const UI1 nItems = m_aItems.size();
+	const I1 nThreads = omp_get_max_threads();
+
+	///The ids of the items are at the end of the slice of the root, the ids of the removed items are skipped
+	SKDTreeBuildBuffers buffers;
+	SKDTreeBuildSlice slice = buffers.reserve(nItems);
+	const UI1 nIDItems = initIDItemsBuild(buffers.m_pIDItems + slice.m_endIDItems - nItems);
+	slice.m_endIDItems -= nItems - nIDItems;
+
+	///The node has every item once at most, so the buffers of the splitter are reserved for all items
+	nodeSplitter.reserve(nItems);
+
+	if (!m_useMultithread || nThreads == 1 || nItems < cNumElementsForParalell)
+	{
+		createTreeInPlace(buffers, nullptr, m_numLeafs, bBox, slice, nIDItems, nodeSplitter, 0);
+		m_numBuildGrowths = buffers.getNumGrowths();
+
+		///The subtrees follow each other without the gaps
+		m_aFlatNodes.assign(buffers.m_pNodes, buffers.m_pNodes + slice.m_idNode);
+		m_aFlatIDItems.assign(buffers.m_pIDItems, buffers.m_pIDItems + slice.m_idIDItem);
+		return;
+	}
+
+	///The top of the KD Tree is built by all threads, the smaller nodes and the big right children are spawned as the tasks with their slices
+	///The nested task has cNumElementsForParalell items at least, so every queue is reserved for all tasks which fit into the id items
+	///The node of the top is built by the current thread when all reserved tasks are taken, so the queues never grow
+	CKDTreeBuildScheduler scheduler(nThreads, cInPlaceIDItemsFactor * nItems / cNumElementsForParalell + 1);
+	{
+		std::vector<UI4> aScratch(nItems);
+		std::vector<UI1> aNumItemsThreads(3 * nThreads + 3);
+		createTreeTopInPlace(buffers, aScratch, aNumItemsThreads, scheduler, m_numLeafs, bBox, slice, nIDItems, nodeSplitter, 0);
+	}
+
+#pragma omp parallel num_threads(static_cast<int>(nThreads))
+	{
+		const UI1 iThread = omp_get_thread_num();
+		nodeSplitter.reserve(nItems);
+
+		SKDTreeBuildTask* pTask = nullptr;
+		while (scheduler.pop(iThread, pTask))
+		{
+			createTreeInPlace(buffers, &scheduler, pTask->m_numLeafs, pTask->m_bBox, pTask->m_slice, pTask->m_numItems, nodeSplitter, pTask->m_depth);
+
+			scheduler.finish();
+		}
+	}
+
+	UI1 nNodes = slice.m_numNodes;
+	UI1 nIDItemsLeafs = slice.m_numIDItems;
+	for (UI1 iTask = 0, nTasks = scheduler.getNumTasks(); iTask < nTasks; ++iTask)
+	{
+		const SKDTreeBuildTask& task = scheduler.getTask(iTask);
+		nNodes += task.m_slice.m_numNodes;
+		nIDItemsLeafs += task.m_slice.m_numIDItems;
+		m_numLeafs += task.m_numLeafs;
+	}
+	m_numBuildGrowths = buffers.getNumGrowths() + scheduler.getNumGrowths();
+
+	m_aFlatNodes.reserve(nNodes);
+	m_aFlatIDItems.reserve(nIDItemsLeafs);
+	copyFlatSubTree(buffers, 0);
+}
+
+///<summary>Builds the subtree of the flattened KD Tree in place</summary>
+///<remarks>In/Out : buffers - The buffers of the build</remarks>
+///<remarks>In/Out : pScheduler - The queues of the build tasks, if it's nullptr, then the subtree is built by the current thread only</remarks>
+///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+///<remarks>In : bBox - The bounding box of the node</remarks>
+///<remarks>In/Out : slice - The slice of the node, the id items of the node are at its end, the start of the slice is moved after the built subtree</remarks>
+///<remarks>In : nItems - The number of the id items of the node</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::createTreeInPlace(SKDTreeBuildBuffers& buffers, CKDTreeBuildScheduler* const pScheduler, UI1& nLeafs, const SBBox& bBox, SKDTreeBuildSlice& slice, const UI1 nItems,
+	const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+{
+	UI4* const pIDItems = buffers.m_pIDItems + slice.m_endIDItems - nItems;
+	SFlatKDTreeNode& node = buffers.takeNode(slice);
+
+	///The node is split only if its slice has the nodes for the children
+	SSplitINFO splitINFO;
+	if (currentDepth >= maxDepth || slice.m_endNodes - slice.m_idNode < 2 || !nodeSplitter.split(splitINFO, bBox, m_aItems, m_aBBoxItems, pIDItems, nItems))
+	{
+		buffers.setLeaf(slice, node, pIDItems, nItems);
+
+		++nLeafs;
+		return;
+	}
+
+	const UI1 dim = splitINFO.m_dimSplit;
+	const double posSplit = splitINFO.m_posSplit;
+
+	///Partitions the id items into [none | left | both | right], the clipped items out of the node(none) are dropped
+	UI1 iNone = 0;
+	UI1 iLeft = 0;
+	UI1 iBoth = nItems;
+	UI1 iRight = nItems;
+	while (iLeft < iBoth)
+	{
+		switch (classifyItem(m_aItems[pIDItems[iBoth - 1]], m_aBBoxItems[pIDItems[iBoth - 1]], bBox, splitINFO))
+		{
+		case eSplitSideRight:
+			std::swap(pIDItems[--iRight], pIDItems[--iBoth]);
+			break;
+		case eSplitSideLeft:
+			std::swap(pIDItems[iBoth - 1], pIDItems[iLeft++]);
+			break;
+		case eSplitSideNone:
+			std::swap(pIDItems[iBoth - 1], pIDItems[iLeft++]);
+			std::swap(pIDItems[iLeft - 1], pIDItems[iNone++]);
+			break;
+		default:
+			--iBoth;
+		}
+	}
+
+	///The items on the both sides are shared by the children : the left child is [left | both] and the right child is [both | right] at the end of the slice
+	///The node is split only if the id items of its children fit into its slice
+	const UI1 nItemsLeft = iRight - iNone;
+	const UI1 nItemsRight = nItems - iLeft;
+	if (nItemsLeft + nItemsRight > slice.m_endIDItems - slice.m_idIDItem)
+	{
+		buffers.setLeaf(slice, node, pIDItems, nItems);
+
+		++nLeafs;
+		return;
+	}
+
+	///The big right child is spawned with its share of the slice before the left child is built, so the other threads can steal it
+	///The subtrees of the left child are spawned only if it has cNumElementsForParalell items at least
+	SKDTreeBuildTask* const pTaskRight = pScheduler != nullptr && nItemsRight >= cNumElementsForParalell ? pScheduler->createTask() : nullptr;
+	const bool bShareByItems = pTaskRight != nullptr || (pScheduler != nullptr && nItemsLeft >= cNumElementsForParalell);
+
+	SKDTreeBuildSlice sliceLeft;
+	SKDTreeBuildSlice sliceRight;
+	slice.share(sliceLeft, sliceRight, nItemsLeft, nItemsRight, bShareByItems);
+	::memmove(buffers.m_pIDItems + sliceLeft.m_endIDItems - nItemsLeft, pIDItems + iNone, nItemsLeft * sizeof(UI4));
+
+	SBBox bBoxLeft = bBox;
+	bBoxLeft.m_maxBB[dim] = posSplit;
+
+	SBBox bBoxRight = bBox;
+	bBoxRight.m_minBB[dim] = posSplit;
+
+	const UI4 idRightNode = static_cast<UI4>(sliceRight.m_idNode);
+	if (pTaskRight != nullptr)
+		spawnSubTree(*pScheduler, pTaskRight, bBoxRight, sliceRight, nItemsRight, currentDepth + 1);
+
+	if (nItemsLeft != 0)
+		createTreeInPlace(buffers, pScheduler, nLeafs, bBoxLeft, sliceLeft, nItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
+	else
+		buffers.takeNode(sliceLeft).setLeaf(static_cast<UI4>(sliceLeft.m_idIDItem), 0);
+
+	if (pTaskRight != nullptr)
+	{
+		///The task takes the end of the slice, so the subtree takes the whole slice
+		slice.moveAfter(sliceLeft);
+		slice.m_idNode = slice.m_endNodes;
+		slice.m_idIDItem = slice.m_endIDItems;
+
+		node.setInner(dim, posSplit, idRightNode);
+		return;
+	}
+
+	///The right child takes the rest of the slice after the left child
+	slice.moveAfter(sliceLeft);
+	sliceRight = SKDTreeBuildSlice(slice.m_idNode, slice.m_endNodes, slice.m_idIDItem, slice.m_endIDItems);
+
+	if (nItemsRight != 0)
+		createTreeInPlace(buffers, pScheduler, nLeafs, bBoxRight, sliceRight, nItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
+	else
+		buffers.takeNode(sliceRight).setLeaf(static_cast<UI4>(sliceRight.m_idIDItem), 0);
+
+	slice.moveAfter(sliceRight);
+	node.setInner(dim, posSplit, static_cast<UI4>(sliceLeft.m_idNode));
+}
+
+///<summary>Builds the top of the flattened KD Tree in place, the big nodes are split and partitioned by all threads</summary>
+///<remarks>In/Out : buffers - The buffers of the build</remarks>
+///<remarks>In/Out : aScratch - The buffer for the parallel partition of the id items</remarks>
+///<remarks>In/Out : aNumItemsThreads - The buffer for the numbers of the items of the parts of the threads in the parallel partition</remarks>
+///<remarks>In/Out : scheduler - The queues of the build tasks, the nodes with less than cNumElementsForParallelSplit items are spawned into it</remarks>
+///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+///<remarks>In : bBox - The bounding box of the node</remarks>
+///<remarks>In/Out : slice - The slice of the node, the id items of the node are at its end, the start of the slice is moved after the built subtree</remarks>
+///<remarks>In : nItems - The number of the id items of the node</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::createTreeTopInPlace(SKDTreeBuildBuffers& buffers, std::vector<UI4>& aScratch, std::vector<UI1>& aNumItemsThreads, CKDTreeBuildScheduler& scheduler, UI1& nLeafs, const SBBox& bBox, SKDTreeBuildSlice& slice, const UI1 nItems,
+	const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+{
+	if (nItems < cNumElementsForParallelSplit)
+	{
+		///The node is built by the current thread if all tasks are taken
+		SKDTreeBuildTask* const pTask = scheduler.createTask();
+		if (pTask != nullptr)
+			spawnSubTree(scheduler, pTask, bBox, slice, nItems, currentDepth);
+		else
+			createTreeInPlace(buffers, &scheduler, nLeafs, bBox, slice, nItems, nodeSplitter, currentDepth, maxDepth);
+		return;
+	}
+
+	UI4* const pIDItems = buffers.m_pIDItems + slice.m_endIDItems - nItems;
+	SFlatKDTreeNode& node = buffers.takeNode(slice);
+
+	///The node is split only if its slice has the nodes and the id items for the children
+	SSplitINFO splitINFO;
+	UI1 iLeft = 0;
+	UI1 nItemsLeft = 0;
+	UI1 nItemsRight = 0;
+	if (currentDepth >= maxDepth || slice.m_endNodes - slice.m_idNode < 2 || !nodeSplitter.split(splitINFO, bBox, m_aItems, m_aBBoxItems, pIDItems, nItems) ||
+		!partitionParallel(buffers, aScratch, aNumItemsThreads, bBox, splitINFO, pIDItems, nItems, slice.m_endIDItems - slice.m_idIDItem, iLeft, nItemsLeft, nItemsRight))
+	{
+		buffers.setLeaf(slice, node, pIDItems, nItems);
+
+		++nLeafs;
+		return;
+	}
+
+	const UI1 dim = splitINFO.m_dimSplit;
+	const double posSplit = splitINFO.m_posSplit;
+
+	SKDTreeBuildSlice sliceLeft;
+	SKDTreeBuildSlice sliceRight;
+	slice.share(sliceLeft, sliceRight, nItemsLeft, nItemsRight, true);
+	::memmove(buffers.m_pIDItems + sliceLeft.m_endIDItems - nItemsLeft, pIDItems + iLeft, nItemsLeft * sizeof(UI4));
+
+	SBBox bBoxChild = bBox;
+	bBoxChild.m_maxBB[dim] = posSplit;
+	if (nItemsLeft != 0)
+		createTreeTopInPlace(buffers, aScratch, aNumItemsThreads, scheduler, nLeafs, bBoxChild, sliceLeft, nItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
+	else
+		buffers.takeNode(sliceLeft).setLeaf(static_cast<UI4>(sliceLeft.m_idIDItem), 0);
+
+	///The right child takes the rest of the slice after the left child
+	slice.moveAfter(sliceLeft);
+	sliceRight = SKDTreeBuildSlice(slice.m_idNode, slice.m_endNodes, slice.m_idIDItem, slice.m_endIDItems);
+
+	bBoxChild = bBox;
+	bBoxChild.m_minBB[dim] = posSplit;
+	if (nItemsRight != 0)
+		createTreeTopInPlace(buffers, aScratch, aNumItemsThreads, scheduler, nLeafs, bBoxChild, sliceRight, nItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
+	else
+		buffers.takeNode(sliceRight).setLeaf(static_cast<UI4>(sliceRight.m_idIDItem), 0);
+
+	slice.moveAfter(sliceRight);
+	node.setInner(dim, posSplit, static_cast<UI4>(sliceLeft.m_idNode));
+}
+
+///<summary>Partitions the id items of the node into [left | both | right] by all threads, the order of the items is kept</summary>
+///<remarks>The partitioned id items are at the end of the id items of the node, the clipped items out of the node are dropped</remarks>
+///<remarks>In/Out : buffers - The buffers of the build</remarks>
+///<remarks>In/Out : aScratch - The buffer for the partition</remarks>
+///<remarks>In/Out : aNumItems - The buffer for the numbers of the right, both and left items of the parts of the threads</remarks>
+///<remarks>In : bBox - The bounding box of the node</remarks>
+///<remarks>In : splitINFO - Structure of the data about node after split</remarks>
+///<remarks>In/Out : pIDItems - The id items of the node</remarks>
+///<remarks>In : nItems - The number of the id items of the node</remarks>
+///<remarks>In : maxIDItems - The number of the id items of the children which fit into the slice of the node</remarks>
+///<remarks>Out : iLeft - Position of the first id item of the left child in the id items of the node</remarks>
+///<remarks>Out : nItemsLeft - The number of the id items of the left child</remarks>
+///<remarks>Out : nItemsRight - The number of the id items of the right child, they are at the end of the id items of the node</remarks>
+///<returns>False if the id items of the children don't fit into the slice of the node, then the id items of the node aren't changed</returns>
+template<typename T>
+bool C3DKDTree<T>::partitionParallel(SKDTreeBuildBuffers& buffers, std::vector<UI4>& aScratch, std::vector<UI1>& aNumItems, const SBBox& bBox, const SSplitINFO& splitINFO, UI4* const pIDItems, const UI1 nItems, const UI1 maxIDItems,
+	UI1& iLeft, UI1& nItemsLeft, UI1& nItemsRight) const
+{
+	///The child has every item of the node once at most
+	if (aScratch.size() < nItems)
+		buffers.resizeBuffer(aScratch, nItems);
+
+	///The numbers of the right, both and left items of the part of every thread
+	const UI1 nNumItems = 3 * static_cast<UI1>(omp_get_max_threads()) + 3;
+	if (aNumItems.size() < nNumItems)
+		buffers.resizeBuffer(aNumItems, nNumItems);
+	std::fill(aNumItems.begin(), aNumItems.end(), 0);
+
+#pragma omp parallel
+	{
+		const UI1 nThreads = omp_get_num_threads();
+		const UI1 iThread = omp_get_thread_num();
+		const UI1 beginThread = nItems * iThread / nThreads;
+		const UI1 endThread = nItems * (iThread + 1) / nThreads;
+
+		UI1 aNumThread[4] = { 0, 0, 0, 0 };
+		for (UI1 i = beginThread; i < endThread; ++i)
+			++aNumThread[classifyItem(m_aItems[pIDItems[i]], m_aBBoxItems[pIDItems[i]], bBox, splitINFO)];
+
+		aNumItems[3 * iThread] = aNumThread[eSplitSideRight];
+		aNumItems[3 * iThread + 1] = aNumThread[eSplitSideBoth];
+		aNumItems[3 * iThread + 2] = aNumThread[eSplitSideLeft];
+
+#pragma omp barrier
+
+		UI1 aNum[3] = { 0, 0, 0 };
+		UI1 aOffset[3] = { 0, 0, 0 };
+		for (UI1 i = 0; i < nThreads; ++i)
+		{
+			for (UI1 side = 0; side < 3; ++side)
+			{
+				if (i < iThread)
+					aOffset[side] += aNumItems[3 * i + side];
+				aNum[side] += aNumItems[3 * i + side];
+			}
+		}
+
+		///All threads see the same numbers, so they skip the partition together
+		if (aNum[2] + 2 * aNum[1] + aNum[0] <= maxIDItems)
+		{
+			UI1 iLeftThread = aOffset[2];
+			UI1 iBoth = aNum[2] + aOffset[1];
+			UI1 iRight = aNum[2] + aNum[1] + aOffset[0];
+			for (UI1 i = beginThread; i < endThread; ++i)
+			{
+				const UI4 idItem = pIDItems[i];
+				switch (classifyItem(m_aItems[idItem], m_aBBoxItems[idItem], bBox, splitINFO))
+				{
+				case eSplitSideRight:
+					aScratch[iRight++] = idItem;
+					break;
+				case eSplitSideLeft:
+					aScratch[iLeftThread++] = idItem;
+					break;
+				case eSplitSideBoth:
+					aScratch[iBoth++] = idItem;
+					break;
+				default:
+					break;
+				}
+			}
+
+#pragma omp barrier
+
+			///The clipped items out of the node are dropped
+			const UI1 nCopy = aNum[0] + aNum[1] + aNum[2];
+			UI4* const pCopy = pIDItems + nItems - nCopy;
+			::memcpy(pCopy + nCopy * iThread / nThreads, aScratch.data() + nCopy * iThread / nThreads, (nCopy * (iThread + 1) / nThreads - nCopy * iThread / nThreads) * sizeof(UI4));
+		}
+	}
+
+	UI1 aNum[3] = { 0, 0, 0 };
+	for (UI1 i = 0; i + 2 < aNumItems.size(); i += 3)
+	{
+		for (UI1 side = 0; side < 3; ++side)
+			aNum[side] += aNumItems[i + side];
+	}
+
+	nItemsLeft = aNum[2] + aNum[1];
+	nItemsRight = aNum[1] + aNum[0];
+	iLeft = nItems - aNum[0] - aNum[1] - aNum[2];
+	return nItemsLeft + nItemsRight <= maxIDItems;
+}
+
+///<summary>Spawns the subtree as the task, the task takes the slice of the subtree</summary>
+///<remarks>In/Out : scheduler - The queues of the build tasks</remarks>
+///<remarks>In/Out : pTask - The free task of the scheduler</remarks>
+///<remarks>In : bBox - The bounding box of the root of the subtree</remarks>
+///<remarks>In/Out : slice - The slice of the subtree, the id items of its root are at its end, its start is moved to its end</remarks>
+///<remarks>In : nItems - The number of the id items of the root of the subtree</remarks>
+///<remarks>In : depth - The depth of the root of the subtree</remarks>
+template<typename T>
+void C3DKDTree<T>::spawnSubTree(CKDTreeBuildScheduler& scheduler, SKDTreeBuildTask* const pTask, const SBBox& bBox, SKDTreeBuildSlice& slice, const UI1 nItems, const UI1 depth) const
+{
+	pTask->m_bBox = bBox;
+	pTask->m_depth = depth;
+	pTask->m_slice = SKDTreeBuildSlice(slice.m_idNode, slice.m_endNodes, slice.m_idIDItem, slice.m_endIDItems);
+	pTask->m_numItems = nItems;
+	slice.m_idNode = slice.m_endNodes;
+	slice.m_idIDItem = slice.m_endIDItems;
+
+	scheduler.push(static_cast<UI1>(omp_get_thread_num()), pTask);
+}
+
+///<summary>Copies the subtree built in place into the flattened KD Tree, the unused parts of the slices of the spawned subtrees are dropped</summary>
+///<remarks>In : buffers - The buffers of the build</remarks>
+///<remarks>In : idNode - Id of the root of the subtree in the nodes of the build</remarks>
+///<returns>Id of the root of the subtree in the array of the flattened nodes</returns>
+template<typename T>
+UI4 C3DKDTree<T>::copyFlatSubTree(const SKDTreeBuildBuffers& buffers, const UI4 idNode)
+{
+	const SFlatKDTreeNode& node = buffers.m_pNodes[idNode];
+	const UI4 idNewNode = static_cast<UI4>(m_aFlatNodes.size());
+	m_aFlatNodes.push_back(node);
+
+	if (node.isLeaf())
+	{
+		m_aFlatNodes[idNewNode].m_offsetItems = static_cast<UI4>(m_aFlatIDItems.size());
+		m_aFlatIDItems.insert(m_aFlatIDItems.end(), buffers.m_pIDItems + node.m_offsetItems, buffers.m_pIDItems + node.m_offsetItems + node.m_numItems);
+		return idNewNode;
+	}
+
+	copyFlatSubTree(buffers, idNode + 1);
+	const UI4 idRightNode = copyFlatSubTree(buffers, node.m_idRightNode);
+	m_aFlatNodes[idNewNode].m_idRightNode = idRightNode;
+
+	return idNewNode;
+}
+#endif
+
+
+#ifdef USE_STACK_NODES
+///<summary>Builds the KD Tree</summary>
+///<remarks>In : aItems - The items for which we are building KD Tree</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+template<typename T>
+void C3DKDTree<T>::createTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter)
+{
+	const SBBox bBox = math::calcBBoxItems(m_aItems, m_aBBoxItems);
+	m_bBoxTree = bBox;
+
+	std::vector<UI1> aIDItems(m_aItems.size());
+	aIDItems.resize(initIDItemsBuild(aIDItems.data()));
+
+	const I1 nThreads = omp_get_max_threads();
+
+	if (!m_useMultithread || nThreads == 1 || m_aItems.size() < cNumElementsForParalell)
+	{
+		m_aArenasThread.resize(1);
+		m_pRootNode = createTree(m_aArenasThread[0], m_numLeafs, bBox, aIDItems, nodeSplitter, 0);
+	}
+	else
+	{
+		m_aArenasThread.resize(1 + nThreads);
+
+		const UI1 maxDepthParallel = math::getNumOfHighBit(nThreads, 1 << 3);
+
+		m_pRootNode = createTree(m_aArenasThread[0], m_numLeafs, bBox, aIDItems, nodeSplitter, 0, maxDepthParallel);
+
+		std::vector<C3DKDTreeNode*> aTreeNodes;
+		getLeafNodes(aTreeNodes);
+
+		const I1 nTreeNodes = aTreeNodes.size();
+		std::vector<UI1> aNumLeafs(nTreeNodes, 0);
+
+#pragma omp parallel for schedule(static)
+		for (I1 i = 0; i < nTreeNodes; ++i)
+			addSubTree(m_aArenasThread[i + 1], aNumLeafs[i], aTreeNodes[i], nodeSplitter, aTreeNodes[i]->getDepthNode());
+
+		m_numLeafs = 0;
+		for (I1 i = 0; i < nTreeNodes; ++i)
+			m_numLeafs += aNumLeafs[i];
+	}
+}
+
+///<summary>Builds KD Tree</summary>
+///<remarks>In/Out : arena - The arena of the nodes and of the id items of the leafs of the thread</remarks>
+///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+///<remarks>In : bBox - The bounding box of the items for which we are building the KD Tree</remarks>
+///<remarks>In : aIDItems - The items for which wea are building KD Tree</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
+///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+///<returns>Root node of the KD Tree</returns>
+template<typename T>
+C3DKDTreeNode* C3DKDTree<T>::createTree(CMonotonicArena& arena, UI1& nLeafs, const SBBox& bBox, std::vector<UI1>& aIDItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+{
+	SBBox bBoxItemsLeft;
+	SBBox bBoxItemsRight;
+
+	std::vector<UI1> aIDItemsLeft;
+	std::vector<UI1> aIDItemsRight;
+
+	C3DKDTreeNode* pTreeNode = arena.create<C3DKDTreeNode>();
+	pTreeNode->setBBox(bBox);
+	pTreeNode->setDepth(currentDepth);
+
+	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, m_aBBoxItems, aIDItems))
+	{
+		if (aIDItemsLeft.size() != 0)
+			pTreeNode->m_pLeftNode = createTree(arena, nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
+		else
+			pTreeNode->m_pLeftNode = nullptr;
+
+		if (aIDItemsRight.size() != 0)
+			pTreeNode->m_pRightNode = createTree(arena, nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
+		else
+			pTreeNode->m_pRightNode = nullptr;
+	}
+	else
+	{
+		pTreeNode->setData(arena, aIDItems);
+		pTreeNode->m_pLeftNode = nullptr;
+		pTreeNode->m_pRightNode = nullptr;
+
+		++nLeafs;
+	}
+
+	return pTreeNode;
+}
+
+///<summary>Builds KD Tree</summary>
+///<remarks>In/Out : arena - The arena of the nodes and of the id items of the leafs of the thread</remarks>
+///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+///<remarks>In/Out : pTreeNode - The pointer to the leaf of the KD Tree</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<remarks>In : currentDepth - The current depth of the tree</remarks>
+///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::addSubTree(CMonotonicArena& arena, UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+{
+	if (!pTreeNode)
+		return;
+
+	SBBox bBoxItemsLeft;
+	SBBox bBoxItemsRight;
+
+	std::vector<UI1> aIDItemsLeft;
+	std::vector<UI1> aIDItemsRight;
+
+	///The splitter takes the id items by the vector, the leaf of the top of the KD Tree keeps them in the arena
+	const std::vector<UI1> aIDItems(pTreeNode->getIDItems(), pTreeNode->getIDItems() + pTreeNode->size());
+
+	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, m_aBBoxItems, aIDItems))
+	{
+		if (aIDItemsLeft.size() != 0)
+			pTreeNode->m_pLeftNode = createTree(arena, nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
+		else
+			pTreeNode->m_pLeftNode = nullptr;
+
+		if (aIDItemsRight.size() != 0)
+			pTreeNode->m_pRightNode = createTree(arena, nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
+		else
+			pTreeNode->m_pRightNode = nullptr;
+
+		pTreeNode->clearData();
+	}
+	else
+		++nLeafs;
+}
+#endif
+
+#ifndef USE_STACK_NODES
+///<summary>Builds the KD Tree</summary>
+///<remarks>In : aItems - The items for which we are building KD Tree</remarks>
+///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+template<typename T>
+void C3DKDTree<T>::createTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter)
+{
+	const SBBox bBox = math::calcBBoxItems(m_aItems, m_aBBoxItems);
+	m_bBoxTree = bBox;
+
+	std::vector<UI1> aIDItems(m_aItems.size());
+	aIDItems.resize(initIDItemsBuild(aIDItems.data()));
+
+	const I1 nThreads = omp_get_max_threads();
+
+	if (nThreads == 1 || m_aItems.size() < cNumElementsForParalell)
+		m_pRootNode = createTree(m_numLeafs, bBox, aIDItems, nodeSplitter, 0);
+	else
+	{
+		const UI1 maxDepthParallel = math::getNumOfHighBit(nThreads, 1 << 3);
+
+		m_pRootNode = createTree(m_numLeafs, bBox, aIDItems, nodeSplitter, 0, maxDepthParallel);
+
+		std::vector<C3DKDTreeNode*> aTreeNodes;
+		getLeafNodes(aTreeNodes);
+
+		const I1 nTreeNodes = aTreeNodes.size();
+		std::vector<UI1> aNumLeafs(nTreeNodes, 0);
+
+#pragma omp parallel for schedule(static)
+		for (I1 i = 0; i < nTreeNodes; ++i)
+			addSubTree(aNumLeafs[i], aTreeNodes[i], nodeSplitter, aTreeNodes[i]->getDepthNode());
+
+		m_numLeafs = 0;
+		for (I1 i = 0; i < nTreeNodes; ++i)
+			m_numLeafs += aNumLeafs[i];
+	}
+}
+
+///<summary>Builds KD Tree</summary>
+///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
+///<remarks>In : bBox - The bounding box of the items for which we are building the KD Tree</remarks>
 ///<remarks>In : aIDItems - The items for which wea are building KD Tree</remarks>
 ///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
 ///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
 ///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
 ///<returns>Root node of the KD Tree</returns>
 template<typename T>
-C3DKDTreeNode* C3DKDTree<T>::createTree(CHyperVector<C3DKDTreeNode>& hVector, UI1& nLeafs, const SBBox& bBox, std::vector<UI1>& aIDItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+C3DKDTreeNode* C3DKDTree<T>::createTree(UI1& nLeafs, const SBBox& bBox, std::vector<UI1>& aIDItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
 {
 	SBBox bBoxItemsLeft;
 	SBBox bBoxItemsRight;
@@ -289,19 +3169,17 @@ C3DKDTreeNode* C3DKDTree<T>::createTree(CHyperVector<C3DKDTreeNode>& hVector, UI
 	std::vector<UI1> aIDItemsLeft;
 	std::vector<UI1> aIDItemsRight;
 
-	C3DKDTreeNode* pTreeNode = hVector.getPointerToTheLastNode();
-	pTreeNode->setBBox(bBox);
-	pTreeNode->setDepth(currentDepth);
+	C3DKDTreeNode* pTreeNode = new C3DKDTreeNode(bBox, currentDepth);
 
-	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, aIDItems))
+	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, m_aBBoxItems, aIDItems))
 	{
 		if (aIDItemsLeft.size() != 0)
-			pTreeNode->m_pLeftNode = createTree(hVector, nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
+			pTreeNode->m_pLeftNode = createTree(nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
 		else
 			pTreeNode->m_pLeftNode = nullptr;
 
 		if (aIDItemsRight.size() != 0)
-			pTreeNode->m_pRightNode = createTree(hVector, nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
+			pTreeNode->m_pRightNode = createTree(nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
 		else
 			pTreeNode->m_pRightNode = nullptr;
 	}
@@ -318,380 +3196,883 @@ C3DKDTreeNode* C3DKDTree<T>::createTree(CHyperVector<C3DKDTreeNode>& hVector, UI
 }
 
 ///<summary>Builds KD Tree</summary>
-///<remarks>Out : hVector - The vector of the nodes KD Tree(for every thread)</remarks>
 ///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
 ///<remarks>In/Out : pTreeNode - The pointer to the leaf of the KD Tree</remarks>
 ///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
 ///<remarks>In : currentDepth - The current depth of the tree</remarks>
-///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
+///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks
+template<typename T>
+void C3DKDTree<T>::addSubTree(UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+{
+	if (!pTreeNode)
+		return;
+
+	SBBox bBoxItemsLeft;
+	SBBox bBoxItemsRight;
+
+	std::vector<UI1> aIDItemsLeft;
+	std::vector<UI1> aIDItemsRight;
+
+	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, m_aBBoxItems, pTreeNode->getData()))
+	{
+		if (aIDItemsLeft.size() != 0)
+			pTreeNode->m_pLeftNode = createTree(nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
+		else
+			pTreeNode->m_pLeftNode = nullptr;
+
+		if (aIDItemsRight.size() != 0)
+			pTreeNode->m_pRightNode = createTree(nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
+		else
+			pTreeNode->m_pRightNode = nullptr;
+
+		pTreeNode->clearData();
+	}
+	else
+		++nLeafs;
+}
+#endif
+
+///<summary>Gets the leafs of the KD Tree</summary>
+///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes) const
+{
+	UI1 idLast = 0;
+
+	aLeafNodes.resize(m_numLeafs);
+	getLeafNodes(aLeafNodes, m_pRootNode, idLast);
+}
+
+///<summary>Gets the leafs of the KD Tree</summary>
+///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
+///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
+///<remarks>In : idLast - The index of the last node in the array</remarks>
+template<typename T>
+void C3DKDTree<T>::getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes, C3DKDTreeNode* pNode, UI1& idLast) const
+{
+	if (pNode->m_pLeftNode == nullptr && pNode->m_pRightNode == nullptr)
+		aLeafNodes[idLast++] = pNode;
+	else
+	{
+		if (pNode->m_pLeftNode != nullptr)
+			getLeafNodes(aLeafNodes, pNode->m_pLeftNode, idLast);
+
+		if (pNode->m_pRightNode != nullptr)
+			getLeafNodes(aLeafNodes, pNode->m_pRightNode, idLast);
+	}
+}
+
+///<summary>Flattens the built KD Tree into the array of the compact nodes and releases the built nodes</summary>
+template<typename T>
+void C3DKDTree<T>::flattenTree()
+{
+	UI1 nNodes = 0;
+	UI1 nIDItems = 0;
+	getSizeFlatTree(m_pRootNode, nNodes, nIDItems);
+
+	m_aFlatNodes.clear();
+	m_aFlatIDItems.clear();
+	m_aFlatNodes.reserve(nNodes);
+	m_aFlatIDItems.reserve(nIDItems);
+
+	flattenTree(m_pRootNode);
+
+	clearBuildNodes();
+}
+
+///<summary>Calculates size of the flattened KD Tree</summary>
+///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
+///<remarks>Out : nNodes - The number of the flattened nodes</remarks>
+///<remarks>Out : nIDItems - The number of the id items in the leafs</remarks>
+template<typename T>
+void C3DKDTree<T>::getSizeFlatTree(const C3DKDTreeNode* pNode, UI1& nNodes, UI1& nIDItems) const
+{
+	++nNodes;
+	if (pNode == nullptr)
+		return;
+
+	if (pNode->m_pLeftNode == nullptr && pNode->m_pRightNode == nullptr)
+	{
+		nIDItems += pNode->size();
+		return;
+	}
+
+	getSizeFlatTree(pNode->m_pLeftNode, nNodes, nIDItems);
+	getSizeFlatTree(pNode->m_pRightNode, nNodes, nIDItems);
+}
+
+///<summary>Appends the node and its subtree to the flattened KD Tree in the depth-first order</summary>
+///<remarks>In : pNode - The pointer to the current node of the KD Tree, nullptr for the empty leaf</remarks>
+///<returns>Id of the node in the array of the flattened nodes</returns>
+template<typename T>
+UI4 C3DKDTree<T>::flattenTree(const C3DKDTreeNode* pNode)
+{
+	const UI4 idNode = static_cast<UI4>(m_aFlatNodes.size());
+	m_aFlatNodes.emplace_back();
+
+	if (pNode == nullptr)
+	{
+		m_aFlatNodes[idNode].setLeaf(static_cast<UI4>(m_aFlatIDItems.size()), 0);
+		return idNode;
+	}
+
+	if (pNode->m_pLeftNode == nullptr && pNode->m_pRightNode == nullptr)
+	{
+		const UI1* pIDItems = pNode->getIDItems();
+		m_aFlatNodes[idNode].setLeaf(static_cast<UI4>(m_aFlatIDItems.size()), static_cast<UI4>(pNode->size()));
+
+		for (UI1 i = 0, nItems = pNode->size(); i < nItems; ++i)
+			m_aFlatIDItems.push_back(static_cast<UI4>(pIDItems[i]));
+
+		return idNode;
+	}
+
+	flattenTree(pNode->m_pLeftNode);
+	const UI4 idRightNode = flattenTree(pNode->m_pRightNode);
+
+	m_aFlatNodes[idNode].setInner(pNode->getDimSplit(), pNode->getPosSplit(), idRightNode);
+
+	return idNode;
+}
+
+///<summary>Gets the bounding boxes of the leafs of the flattened KD Tree</summary>
+///<remarks>Out : aBBoxLeafs - array of the bounding boxes of the not empty leafs</remarks>
+///<remarks>In : idNode - Id of the current node in the array of the flattened nodes</remarks>
+///<remarks>In : bBoxNode - The bounding box of the current node</remarks>
+template<typename T>
+void C3DKDTree<T>::getLeafBBoxes(std::vector<SBBox>& aBBoxLeafs, UI4 idNode, const SBBox& bBoxNode) const
+{
+	const SFlatKDTreeNode& node = getFlatNode(idNode);
+	if (node.isLeaf())
+	{
+		if (node.m_numItems != 0)
+			aBBoxLeafs.push_back(bBoxNode);
+		return;
+	}
+
+	SBBox bBoxChild = bBoxNode;
+	bBoxChild.m_maxBB[node.m_dimSplit] = node.m_posSplit;
+	getLeafBBoxes(aBBoxLeafs, idNode + 1, bBoxChild);
+
+	bBoxChild = bBoxNode;
+	bBoxChild.m_minBB[node.m_dimSplit] = node.m_posSplit;
+	getLeafBBoxes(aBBoxLeafs, node.m_idRightNode, bBoxChild);
+}
+
+///<summary>Finds nearest item to the point</summary>
+///<remarks>Out : nearestItemInfo - structure of the data about nearest item</remarks>
+///<remarks>In : point - The point for which we are find nearest item</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+template<typename T>
+void C3DKDTree<T>::findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, SKDTreeQueryScratch& scratch) const
+{
+	nearestItemINFO = C3DKDTreeNearestItemINFO();
+	scratch.begin(m_nItems);
+	findNearestItemClosestFirst(nearestItemINFO, point, scratch);
+
+	if (nearestItemINFO.m_minDist2 < DBL_MAX)
+		nearestItemINFO.m_minDist = sqrt(nearestItemINFO.m_minDist2);
+}
+
+///<summary>Finds nearest item to the point in the radius</summary>
+///<remarks>In/Out : nearestItemInfo - structure of the data about nearest item, its m_minDist is the radius of the search</remarks>
+///<remarks>In : point - The point for which we are find nearest item</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+template<typename T>
+void C3DKDTree<T>::findNearestItemInRadius(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, SKDTreeQueryScratch& scratch) const
+{
+	if (nearestItemINFO.m_minDist < DBL_MAX)
+		nearestItemINFO.m_minDist2 = nearestItemINFO.m_minDist * nearestItemINFO.m_minDist;
+
+	scratch.begin(m_nItems);
+	findNearestItemClosestFirst(nearestItemINFO, point, scratch);
+
+	if (nearestItemINFO.m_minDist2 < DBL_MAX)
+		nearestItemINFO.m_minDist = sqrt(nearestItemINFO.m_minDist2);
+}
+
+///<summary>Finds nearest triangle to the point, its closest point and the feature which contains the closest point</summary>
+///<remarks>Out : nearestFeatureINFO - structure of the data about nearest triangle and its closest feature</remarks>
+///<remarks>In : point - The point for which we are find nearest item</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+template<typename T>
+void C3DKDTree<T>::findNearestItem(C3DKDTreeNearestFeatureINFO& nearestFeatureINFO, const D3& point, SKDTreeQueryScratch& scratch) const
+{
+	nearestFeatureINFO = C3DKDTreeNearestFeatureINFO();
+	findNearestItem(static_cast<C3DKDTreeNearestItemINFO&>(nearestFeatureINFO), point, scratch);
+
+	///The feature is calculated for nearest triangle only, so the search keeps the vectorized kernels
+	if (nearestFeatureINFO.m_minDist2 < DBL_MAX)
+		m_pItems[nearestFeatureINFO.m_idItem].calcDist2Feature(point, nearestFeatureINFO.m_closestPoint, nearestFeatureINFO.m_feature);
+}
+
+///<summary>Finds the signed distance from the point to the closed triangle mesh by one query, the sign is given by the pseudo-normal of the closest feature</summary>
+///<remarks>Out : nearestFeatureINFO - structure of the data about nearest triangle and its closest feature, its m_minDist is not signed</remarks>
+///<remarks>In : point - The point for which we are find the signed distance</remarks>
+///<remarks>In : normals - The pseudo-normals of the items of the KD Tree</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+///<returns>The distance, it's negative inside of the mesh, DBL_MAX if the KD Tree is empty</returns>
+template<typename T>
+double C3DKDTree<T>::findSignedDist(C3DKDTreeNearestFeatureINFO& nearestFeatureINFO, const D3& point, const CMeshPseudoNormals& normals, SKDTreeQueryScratch& scratch) const
+{
+	findNearestItem(nearestFeatureINFO, point, scratch);
+	if (nearestFeatureINFO.m_minDist2 == DBL_MAX)
+		return DBL_MAX;
+
+	const D3& normal = normals.getNormal(nearestFeatureINFO.m_idItem, nearestFeatureINFO.m_feature);
+	return (point - nearestFeatureINFO.m_closestPoint) * normal < 0. ? -nearestFeatureINFO.m_minDist : nearestFeatureINFO.m_minDist;
+}
+
+///<summary>Finds all items whose distance to the point is not greater than the radius, the items are reported to the callback as they are found</summary>
+///<remarks>The callback is called as callback(const UI1 idItem, const double dist2) once per item, the items aren't ordered by the distance</remarks>
+///<remarks>In : point - The point for which we are finding the items</remarks>
+///<remarks>In : radius - The radius of the search</remarks>
+///<remarks>In : callback - The callback of the found items</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+template<typename T>
+template<typename TCallback>
+void C3DKDTree<T>::findItemsInRadius(const D3& point, const double radius, TCallback callback, SKDTreeQueryScratch& scratch) const
+{
+	if (radius < 0. || m_nFlatNodes == 0)
+		return;
+
+	scratch.begin(m_nItems);
+
+	///The distance to the node is the distance from the point to its bounding box, so the traversal prunes the nodes out of the sphere
+	const double radius2 = radius * radius;
+	SItemsInRadiusVisitor<TCallback> visitor = { *this, point, radius2, (radius + cEps) * (radius + cEps), callback, scratch };
+	traverseClosestFirst(point, visitor);
+}
+
+///<summary>Finds all items which overlap the volume, the items are reported to the callback as they are found</summary>
+///<remarks>The callback is called as callback(const UI1 idItem) once per item, the volume has the functions of struct_volume.h</remarks>
+///<remarks>In : volume - The volume of the search, SVolumeBBox, SVolumeOrientedBBox or SVolumeFrustum</remarks>
+///<remarks>In : callback - The callback of the found items</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+template<typename T>
+template<typename TVolume, typename TCallback>
+void C3DKDTree<T>::findItemsOverlap(const TVolume& volume, TCallback callback, SKDTreeQueryScratch& scratch) const
+{
+	if (m_nFlatNodes == 0 || !volume.isOverlapBBox(m_bBoxTree))
+		return;
+
+	scratch.begin(m_nItems);
+
+	///The right children wait in the stack with their bounding boxes, the nodes out of the volume are pruned by their bounding boxes
+	STraversalBBoxNode aStack[cTraversalStackSize];
+	UI1 nStack = 1;
+	aStack[0].m_idNode = 0;
+	aStack[0].m_bBox = m_bBoxTree;
+
+	while (nStack != 0)
+	{
+		const STraversalBBoxNode& traversalNode = aStack[--nStack];
+		UI4 idNode = traversalNode.m_idNode;
+		SBBox bBox = traversalNode.m_bBox;
+
+		for (;;)
+		{
+			const SFlatKDTreeNode& node = getFlatNode(idNode);
+			if (node.isLeaf())
+			{
+				for (UI4 i = node.m_offsetItems, iEnd = node.m_offsetItems + node.m_numItems; i < iEnd; ++i)
+				{
+					const UI4 idItem = m_pFlatIDItems[i];
+					if (scratch.isUsed(idItem))
+						continue;
+
+					scratch.setUsed(idItem);
+
+					if (m_pItems[idItem].isOverlap(volume))
+						callback(idItem);
+				}
+				break;
+			}
+
+			const UI4 dim = node.m_dimSplit;
+			SBBox bBoxLeft = bBox;
+			bBoxLeft.m_maxBB[dim] = node.m_posSplit;
+			SBBox bBoxRight = bBox;
+			bBoxRight.m_minBB[dim] = node.m_posSplit;
+
+			const bool bLeft = volume.isOverlapBBox(bBoxLeft);
+			const bool bRight = volume.isOverlapBBox(bBoxRight);
+			if (bLeft && bRight)
+			{
+				STraversalBBoxNode& rightNode = aStack[nStack++];
+				rightNode.m_idNode = node.m_idRightNode;
+				rightNode.m_bBox = bBoxRight;
+			}
+
+			if (bLeft)
+			{
+				idNode = idNode + 1;
+				bBox = bBoxLeft;
+			}
+			else if (bRight)
+			{
+				idNode = node.m_idRightNode;
+				bBox = bBoxRight;
+			}
+			else
+				break;
+		}
+	}
+}
+
+///<summary>Finds k nearest items to the point which are closer than maxDist</summary>
+///<remarks>Out : aNearestItemsINFO - structures of the data about nearest items in the ascending order of the distances, at most k</remarks>
+///<remarks>In : point - The point for which we are finding nearest items</remarks>
+///<remarks>In : k - The maximal number of the items</remarks>
+///<remarks>In : maxDist - The maximal distance of the items</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+template<typename T>
+void C3DKDTree<T>::findKNearestItems(std::vector<C3DKDTreeNearestItemINFO>& aNearestItemsINFO, const D3& point, const UI1 k, const double maxDist,
+	SKDTreeQueryScratch& scratch) const
+{
+	aNearestItemsINFO.clear();
+	if (k == 0 || m_nFlatNodes == 0)
+		return;
+
+	scratch.begin(m_nItems);
+	scratch.m_aHeapItems.clear();
+	scratch.m_aHeapItems.reserve(k);
+
+	SKNearestItemsVisitor visitor = { *this, point, k, maxDist < DBL_MAX ? maxDist * maxDist : DBL_MAX, scratch };
+	traverseClosestFirst(point, visitor);
+
+	std::sort_heap(scratch.m_aHeapItems.begin(), scratch.m_aHeapItems.end(), isCloserItem);
+	aNearestItemsINFO.assign(scratch.m_aHeapItems.begin(), scratch.m_aHeapItems.end());
+	for (UI1 i = 0, nItems = aNearestItemsINFO.size(); i < nItems; ++i)
+	{
+		C3DKDTreeNearestItemINFO& nearestItemINFO = aNearestItemsINFO[i];
+		if (nearestItemINFO.m_minDist2 < cEps2)
+			nearestItemINFO.m_minDist2 = 0.;
+		nearestItemINFO.m_minDist = sqrt(nearestItemINFO.m_minDist2);
+	}
+}
+
+///<summary>Finds the first item hit by the ray</summary>
+///<remarks>Out : hitINFO - structure of the data about the first hit</remarks>
+///<remarks>In : origin - The origin of the ray</remarks>
+///<remarks>In : dir - The direction of the ray, it's not normalized, so the parameter of the hit is in the units of its length</remarks>
+///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+///<returns>True if the ray hits any item at 0 <= t <= tMax, otherwise false</returns>
+template<typename T>
+bool C3DKDTree<T>::findFirstHit(C3DKDTreeRayHitINFO& hitINFO, const D3& origin, const D3& dir, const double tMax, SKDTreeQueryScratch& scratch) const
+{
+	hitINFO = C3DKDTreeRayHitINFO();
+	if (tMax < 0.)
+		return false;
+
+	scratch.begin(m_nItems);
+
+	SFirstHitVisitor visitor = { *this, hitINFO, origin, dir, tMax, false, scratch };
+	traverseRay(origin, dir, tMax, visitor);
+	return visitor.m_bHit;
+}
+
+///<summary>Checks that the ray hits any item, the traversal stops at the first found hit</summary>
+///<remarks>In : origin - The origin of the ray</remarks>
+///<remarks>In : dir - The direction of the ray, it's not normalized</remarks>
+///<remarks>In : tMax - The maximal parameter of the hit point origin + dir * t</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller, the queries with the different scratches can run concurrently</remarks>
+///<returns>True if the ray hits any item at 0 <= t <= tMax, otherwise false</returns>
+template<typename T>
+bool C3DKDTree<T>::findAnyHit(const D3& origin, const D3& dir, const double tMax, SKDTreeQueryScratch& scratch) const
+{
+	if (tMax < 0.)
+		return false;
+
+	scratch.begin(m_nItems);
+
+	SAnyHitVisitor visitor = { *this, origin, dir, tMax, false, scratch };
+	traverseRay(origin, dir, tMax, visitor);
+	return visitor.m_bHit;
+}
+
+///<summary>Finds nearest items to the points, the points are processed by the packets and by the threads</summary>
+///<remarks>In : pPoints - The points for which we are finding nearest items</remarks>
+///<remarks>In : nPoints - The number of the points</remarks>
+///<remarks>Out : pNearestItemsINFO - structures of the data about nearest items, one per point</remarks>
 template<typename T>
-void C3DKDTree<T>::addSubTree(CHyperVector<C3DKDTreeNode>& hVector, UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+void C3DKDTree<T>::findNearestItems(const D3* pPoints, const UI1 nPoints, C3DKDTreeNearestItemINFO* pNearestItemsINFO) const
 {
-	if (!pTreeNode)
+	if (nPoints == 0)
 		return;
 
-	SBBox bBoxItemsLeft;
-	SBBox bBoxItemsRight;
+	///The points are sorted by the Morton codes, so the points of one packet are close to each other and visit the same nodes
+	const SBBox bBoxPoints = math::calcBBoxPoints(pPoints, nPoints);
+	std::vector<std::pair<UI8, UI4>> aOrder(nPoints);
+	for (UI1 i = 0; i < nPoints; ++i)
+		aOrder[i] = std::make_pair(math::calcMortonCode(pPoints[i], bBoxPoints), static_cast<UI4>(i));
 
-	std::vector<UI1> aIDItemsLeft;
-	std::vector<UI1> aIDItemsRight;
+	math::sortMortonCodes(aOrder, m_useMultithread);
+
+	const I1 nPackets = static_cast<I1>((nPoints + cPacketSize - 1) / cPacketSize);
 
-	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, pTreeNode->getData()))
+#pragma omp parallel if(m_useMultithread && nPackets > cPacketsPerChunk)
 	{
-		if (aIDItemsLeft.size() != 0)
-			pTreeNode->m_pLeftNode = createTree(hVector, nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
-		else
-			pTreeNode->m_pLeftNode = nullptr;
+		SKDTreeQueryScratch scratch;
 
-		if (aIDItemsRight.size() != 0)
-			pTreeNode->m_pRightNode = createTree(hVector, nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
-		else
-			pTreeNode->m_pRightNode = nullptr;
+#pragma omp for schedule(dynamic, cPacketsPerChunk)
+		for (I1 iPacket = 0; iPacket < nPackets; ++iPacket)
+		{
+			const UI1 begin = iPacket * cPacketSize;
+			const UI1 nPacketPoints = math::min2(cPacketSize, nPoints - begin);
 
-		pTreeNode->clearData();
+			///The free places of the last packet are filled by its first point
+			D3 aPoints[cPacketSize];
+			for (UI1 i = 0; i < cPacketSize; ++i)
+				aPoints[i] = pPoints[aOrder[begin + (i < nPacketPoints ? i : 0)].second];
+
+			C3DKDTreeNearestItemINFO aNearestItemsINFO[cPacketSize];
+			findNearestItemsPacket(aPoints, nPacketPoints, aNearestItemsINFO, scratch);
+
+			for (UI1 i = 0; i < nPacketPoints; ++i)
+				pNearestItemsINFO[aOrder[begin + i].second] = aNearestItemsINFO[i];
+		}
 	}
-	else
-		++nLeafs;
 }
-#endif
 
-#ifndef USE_STACK_NODES
-///<summary>Builds the KD Tree</summary>
-///<remarks>In : aItems - The items for which we are building KD Tree</remarks>
-///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
+///<summary>Finds nearest items to the packet of the points by the closest first traversal of the KD Tree, the nodes are fetched once for the packet</summary>
+///<remarks>In : aPoints - The points of the packet</remarks>
+///<remarks>In : nPoints - The number of the points in the packet</remarks>
+///<remarks>Out : aNearestItemsINFO - structures of the data about nearest items of the points</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller</remarks>
 template<typename T>
-void C3DKDTree<T>::createTree(const std::vector<T>& aItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter)
+void C3DKDTree<T>::findNearestItemsPacket(const D3(&aPoints)[cPacketSize], const UI1 nPoints, C3DKDTreeNearestItemINFO(&aNearestItemsINFO)[cPacketSize], SKDTreeQueryScratch& scratch) const
 {
-	const SBBox bBox = math::calcBBoxItems(m_aItems);
-
-	std::vector<UI1> aIDItems(m_aItems.size());
-	for (UI1 i = 0, nItems = aIDItems.size(); i < nItems; ++i)
-		aIDItems[i] = i;
-
-	const I1 nThreads = omp_get_max_threads();
+	scratch.begin(m_nItems);
 
-	if (m_useMultithread)
-	{
-		m_aItemsUsed.resize(nThreads);
-		m_aITemsUsedId.resize(nThreads);
-		for (I1 i = 0; i < nThreads; ++i)
-			m_aItemsUsed[i].resize(m_aItems.size(), false);
-	}
-	else
+	///The free places of the packet have the zero radius, so they are never active
+	double aMinDist2[cPacketSize];
+	STraversalPacket aStack[cTraversalStackSize];
+	UI1 nStack = 1;
+	aStack[0].m_idNode = 0;
+	for (UI1 i = 0; i < cPacketSize; ++i)
 	{
-		m_aItemsUsed.resize(1);
-		m_aITemsUsedId.resize(1);
-		m_aItemsUsed[0].resize(m_aItems.size(), false);
+		aMinDist2[i] = i < nPoints ? DBL_MAX : 0.;
+		aStack[0].m_aDist2[i] = 0.;
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			double& offset = aStack[0].m_aOffset[i][dim];
+			if (aPoints[i][dim] < m_bBoxTree.m_minBB[dim])
+				offset = aPoints[i][dim] - m_bBoxTree.m_minBB[dim];
+			else if (aPoints[i][dim] > m_bBoxTree.m_maxBB[dim])
+				offset = aPoints[i][dim] - m_bBoxTree.m_maxBB[dim];
+			else
+				offset = 0.;
+
+			aStack[0].m_aDist2[i] += offset * offset;
+		}
 	}
 
-	if (nThreads == 1 || m_aItems.size() < cNumElementsForParalell)
-		m_pRootNode = createTree(m_numLeafs, bBox, aIDItems, nodeSplitter, 0);
-	else
+	while (nStack != 0)
 	{
-		const UI1 maxDepthParallel = math::getNumOfHighBit(nThreads, 1 << 3);
+		STraversalPacket packet = aStack[--nStack];
 
-		m_pRootNode = createTree(m_numLeafs, bBox, aIDItems, nodeSplitter, 0, maxDepthParallel);
+		///The point is active in the node if its bounding box is closer than the nearest item of the point
+		UI1 nActive = 0;
+		for (UI1 i = 0; i < cPacketSize; ++i)
+			nActive += packet.m_aDist2[i] < aMinDist2[i];
 
-		std::vector<C3DKDTreeNode*> aTreeNodes;
-		getLeafNodes(aTreeNodes);
+		while (nActive != 0)
+		{
+			const SFlatKDTreeNode& node = getFlatNode(packet.m_idNode);
+			if (node.isLeaf())
+			{
+				///The item is marked as used only if it's checked by all points of the packet, so the points are checked even if they become inactive by the items of the leaf
+				const bool bAllActive = nActive == nPoints;
+				for (UI4 i = node.m_offsetItems, iEnd = node.m_offsetItems + node.m_numItems; i < iEnd; ++i)
+				{
+					const UI4 idItem = m_pFlatIDItems[i];
+					if (scratch.isUsed(idItem))
+						continue;
 
-		const I1 nTreeNodes = aTreeNodes.size();
-		std::vector<UI1> aNumLeafs(nTreeNodes, 0);
+					if (bAllActive)
+						scratch.setUsed(idItem);
 
-#pragma omp parallel for schedule(static)
-		for (I1 i = 0; i < nTreeNodes; ++i)
-			addSubTree(aNumLeafs[i], aTreeNodes[i], nodeSplitter, aTreeNodes[i]->getDepthNode());
+					const T& item = m_pItems[idItem];
+					for (UI1 iPoint = 0; iPoint < cPacketSize; ++iPoint)
+					{
+						if (iPoint >= nPoints || (!bAllActive && packet.m_aDist2[iPoint] >= aMinDist2[iPoint]))
+							continue;
 
-		m_numLeafs = 0;
-		for (I1 i = 0; i < nTreeNodes; ++i)
-			m_numLeafs += aNumLeafs[i];
-	}
-}
+						const double dist2 = item.calcDist2(aPoints[iPoint]);
+						if (dist2 < aMinDist2[iPoint])
+						{
+							aMinDist2[iPoint] = dist2;
+							aNearestItemsINFO[iPoint].m_idItem = idItem;
+						}
+					}
+				}
+				break;
+			}
 
-///<summary>Builds KD Tree</summary>
-///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
-///<remarks>In : bBox - The bounding box of the items for which we are building the KD Tree</remarks>
-///<remarks>In : aIDItems - The items for which wea are building KD Tree</remarks>
-///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
-///<remarks>In : currentDepth - The current depth of the KD tree</remarks>
-///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks>
-///<returns>Root node of the KD Tree</returns>
-template<typename T>
-C3DKDTreeNode* C3DKDTree<T>::createTree(UI1& nLeafs, const SBBox& bBox, std::vector<UI1>& aIDItems, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
-{
-	SBBox bBoxItemsLeft;
-	SBBox bBoxItemsRight;
+			const UI4 dim = node.m_dimSplit;
 
-	std::vector<UI1> aIDItemsLeft;
-	std::vector<UI1> aIDItemsRight;
+			///The packet goes to the child where are the most of the active points
+			double aDiff[cPacketSize];
+			I1 nLeftMajority = 0;
+			for (UI1 i = 0; i < cPacketSize; ++i)
+			{
+				aDiff[i] = aPoints[i][dim] - node.m_posSplit;
+				if (packet.m_aDist2[i] < aMinDist2[i])
+					nLeftMajority += aDiff[i] < 0. ? 1 : -1;
+			}
 
-	C3DKDTreeNode* pTreeNode = new C3DKDTreeNode(bBox, currentDepth);
+			const bool bNearLeft = nLeftMajority >= 0;
 
-	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, aIDItems))
-	{
-		if (aIDItemsLeft.size() != 0)
-			pTreeNode->m_pLeftNode = createTree(nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
-		else
-			pTreeNode->m_pLeftNode = nullptr;
+			STraversalPacket farPacket = packet;
+			farPacket.m_idNode = bNearLeft ? node.m_idRightNode : packet.m_idNode + 1;
+			packet.m_idNode = bNearLeft ? packet.m_idNode + 1 : node.m_idRightNode;
 
-		if (aIDItemsRight.size() != 0)
-			pTreeNode->m_pRightNode = createTree(nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
-		else
-			pTreeNode->m_pRightNode = nullptr;
+			///The distance is changed for the points on the other side of the split plane only
+			UI1 nActiveFar = 0;
+			nActive = 0;
+			for (UI1 i = 0; i < cPacketSize; ++i)
+			{
+				STraversalPacket& otherSidePacket = ((aDiff[i] < 0.) == bNearLeft) ? farPacket : packet;
+				otherSidePacket.m_aDist2[i] += aDiff[i] * aDiff[i] - otherSidePacket.m_aOffset[i][dim] * otherSidePacket.m_aOffset[i][dim];
+				otherSidePacket.m_aOffset[i][dim] = aDiff[i];
+
+				nActiveFar += farPacket.m_aDist2[i] < aMinDist2[i];
+				nActive += packet.m_aDist2[i] < aMinDist2[i];
+			}
+
+			if (nActiveFar != 0)
+				aStack[nStack++] = farPacket;
+		}
 	}
-	else
+
+	for (UI1 i = 0; i < nPoints; ++i)
 	{
-		pTreeNode->setData(aIDItems);
-		pTreeNode->m_pLeftNode = nullptr;
-		pTreeNode->m_pRightNode = nullptr;
+		C3DKDTreeNearestItemINFO& nearestItemINFO = aNearestItemsINFO[i];
+		nearestItemINFO.m_minDist2 = aMinDist2[i] < cEps2 ? 0. : aMinDist2[i];
 
-		++nLeafs;
+		///The point without the nearest item keeps DBL_MAX as findNearestItem does
+		nearestItemINFO.m_minDist = nearestItemINFO.m_minDist2 == DBL_MAX ? DBL_MAX : sqrt(nearestItemINFO.m_minDist2);
 	}
-
-	return pTreeNode;
 }
 
-///<summary>Builds KD Tree</summary>
-///<remarks>Out : nLeafs - The number of the leafs of the KD Tree</remarks>
-///<remarks>In/Out : pTreeNode - The pointer to the leaf of the KD Tree</remarks>
-///<remarks>In : nodeSplitter - The abstract class of the Splitter</remarks>
-///<remarks>In : currentDepth - The current depth of the tree</remarks>
-///<remarks>In : maxDepth - The maximal depth of the KD Tree</remarks
+///<summary>Finds nearest item to the point by the closest first traversal of the KD Tree</summary>
+///<remarks>In/Out : nearestItemInfo - structure of the data about nearest item, only the items closer than its m_minDist2 are searched</remarks>
+///<remarks>In : point - The point for which we are finding nearest item</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller</remarks>
 template<typename T>
-void C3DKDTree<T>::addSubTree(UI1& nLeafs, C3DKDTreeNode* const pTreeNode, const C3DKDTreeNodeSplitter<T>& nodeSplitter, const UI1 currentDepth, const UI1 maxDepth)
+void C3DKDTree<T>::findNearestItemClosestFirst(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, SKDTreeQueryScratch& scratch) const
 {
-	if (!pTreeNode)
-		return;
+	SNearestItemVisitor visitor = { *this, nearestItemINFO, point, scratch };
+	traverseClosestFirst(point, visitor);
+}
 
-	SBBox bBoxItemsLeft;
-	SBBox bBoxItemsRight;
+///<summary>Visits the leafs of the KD Tree closer to the point than the maximal distance of the visitor by the closest first traversal</summary>
+///<remarks>The visitor has the functions double getMaxDist2() const and void visitLeaf(const SFlatKDTreeNode& leaf), the leafs can decrease the maximal distance</remarks>
+///<remarks>In : point - The point for which we are visiting the leafs</remarks>
+///<remarks>In/Out : visitor - The visitor of the leafs</remarks>
+template<typename T>
+template<typename TVisitor>
+void C3DKDTree<T>::traverseClosestFirst(const D3& point, TVisitor& visitor) const
+{
+	///The far children wait in the stack, the distances to them are updated incrementally by the offset on the split axis only
+	STraversalNode aStack[cTraversalStackSize];
+	UI1 nStack = 1;
+	aStack[0].m_idNode = 0;
+	aStack[0].m_dist2 = 0.;
+	for (UI1 dim = 0; dim < 3; ++dim)
+	{
+		double& offset = aStack[0].m_aOffset[dim];
+		if (point[dim] < m_bBoxTree.m_minBB[dim])
+			offset = point[dim] - m_bBoxTree.m_minBB[dim];
+		else if (point[dim] > m_bBoxTree.m_maxBB[dim])
+			offset = point[dim] - m_bBoxTree.m_maxBB[dim];
+		else
+			offset = 0.;
 
-	std::vector<UI1> aIDItemsLeft;
-	std::vector<UI1> aIDItemsRight;
+		aStack[0].m_dist2 += offset * offset;
+	}
 
-	if (currentDepth < maxDepth && pTreeNode->splitNode(aIDItemsLeft, aIDItemsRight, bBoxItemsLeft, bBoxItemsRight, nodeSplitter, m_aItems, pTreeNode->getData()))
+	while (nStack != 0)
 	{
-		if (aIDItemsLeft.size() != 0)
-			pTreeNode->m_pLeftNode = createTree(nLeafs, bBoxItemsLeft, aIDItemsLeft, nodeSplitter, currentDepth + 1, maxDepth);
-		else
-			pTreeNode->m_pLeftNode = nullptr;
+		const STraversalNode& traversalNode = aStack[--nStack];
+		if (traversalNode.m_dist2 >= visitor.getMaxDist2())
+			continue;
 
-		if (aIDItemsRight.size() != 0)
-			pTreeNode->m_pRightNode = createTree(nLeafs, bBoxItemsRight, aIDItemsRight, nodeSplitter, currentDepth + 1, maxDepth);
-		else
-			pTreeNode->m_pRightNode = nullptr;
+		UI4 idNode = traversalNode.m_idNode;
+		const double dist2 = traversalNode.m_dist2;
+		double aOffset[3] = { traversalNode.m_aOffset[0], traversalNode.m_aOffset[1], traversalNode.m_aOffset[2] };
 
-		pTreeNode->clearData();
-	}
-	else
-		++nLeafs;
-}
-#endif
+		///Goes down to the leaf through the near children, the distance to them is not changed
+		for (;;)
+		{
+			const SFlatKDTreeNode& node = getFlatNode(idNode);
+			if (node.isLeaf())
+			{
+				visitor.visitLeaf(node);
+				break;
+			}
 
-///<summary>Gets the leafs of the KD Tree</summary>
-///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
-template<typename T>
-void C3DKDTree<T>::getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes) const
-{
-	UI1 idLast = 0;
+			const UI4 dim = node.m_dimSplit;
+			const double diff = point[dim] - node.m_posSplit;
+			const UI4 idNearNode = diff < 0. ? idNode + 1 : node.m_idRightNode;
+			const UI4 idFarNode = diff < 0. ? node.m_idRightNode : idNode + 1;
 
-	aLeafNodes.resize(m_numLeafs);
-	getLeafNodes(aLeafNodes, m_pRootNode, idLast);
+			const double dist2Far = dist2 - aOffset[dim] * aOffset[dim] + diff * diff;
+			if (dist2Far < visitor.getMaxDist2())
+			{
+				STraversalNode& farNode = aStack[nStack++];
+				farNode.m_idNode = idFarNode;
+				farNode.m_dist2 = dist2Far;
+				farNode.m_aOffset[0] = aOffset[0];
+				farNode.m_aOffset[1] = aOffset[1];
+				farNode.m_aOffset[2] = aOffset[2];
+				farNode.m_aOffset[dim] = diff;
+			}
+
+			idNode = idNearNode;
+		}
+	}
 }
 
-///<summary>Gets the leafs of the KD Tree</summary>
-///<remarks>Out : aLeafsNodes - array of the pointers to the leafs of the KD Tree</remarks>
-///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
-///<remarks>In : idLast - The index of the last node in the array</remarks>
+///<summary>Reports the unused items of the leaf in the radius to the callback</summary>
+///<remarks>In : leaf - The leaf of the flattened KD Tree</remarks>
 template<typename T>
-void C3DKDTree<T>::getLeafNodes(std::vector<C3DKDTreeNode*>& aLeafNodes, C3DKDTreeNode* pNode, UI1& idLast) const
+template<typename TCallback>
+void C3DKDTree<T>::SItemsInRadiusVisitor<TCallback>::visitLeaf(const SFlatKDTreeNode& leaf)
 {
-	if (pNode->m_pLeftNode == nullptr && pNode->m_pRightNode == nullptr)
-		aLeafNodes[idLast++] = pNode;
-	else
+	for (UI4 i = leaf.m_offsetItems, iEnd = leaf.m_offsetItems + leaf.m_numItems; i < iEnd; ++i)
 	{
-		if (pNode->m_pLeftNode != nullptr)
-			getLeafNodes(aLeafNodes, pNode->m_pLeftNode, idLast);
+		const UI4 idItem = m_tree.m_pFlatIDItems[i];
+		if (m_scratch.isUsed(idItem))
+			continue;
 
-		if (pNode->m_pRightNode != nullptr)
-			getLeafNodes(aLeafNodes, pNode->m_pRightNode, idLast);
+		m_scratch.setUsed(idItem);
+
+		const double dist2 = m_tree.m_pItems[idItem].calcDist2(m_point);
+		if (dist2 <= m_radius2)
+			m_callback(idItem, dist2 < cEps2 ? 0. : dist2);
 	}
 }
 
-///<summary>Finds nearest leaf of the KD Tree to the point</summary>
-///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
-///<remarks>In : point - The point for which we are finding nearest item</remarks>
-///<returns>The nearest leaf of the KD Tree to the point</returns>
+///<summary>Adds the unused items of the leaf which are closer than the k-th item into the max-heap of the scratch</summary>
+///<remarks>In : leaf - The leaf of the flattened KD Tree</remarks>
 template<typename T>
-const C3DKDTreeNode* const C3DKDTree<T>::findNearestLeaf(const C3DKDTreeNode* pNode, const D3& point) const
+void C3DKDTree<T>::SKNearestItemsVisitor::visitLeaf(const SFlatKDTreeNode& leaf)
 {
-#ifdef USE_STACK_TRAVERSAL_TREE
-	std::vector<const C3DKDTreeNode*> aVec;
-	aVec.push_back(pNode);
-
-	for (;;)
+	std::vector<C3DKDTreeNearestItemINFO>& aHeapItems = m_scratch.m_aHeapItems;
+	for (UI4 i = leaf.m_offsetItems, iEnd = leaf.m_offsetItems + leaf.m_numItems; i < iEnd; ++i)
 	{
-		const C3DKDTreeNode* const pLastNode = aVec.back();
+		const UI4 idItem = m_tree.m_pFlatIDItems[i];
+		if (m_scratch.isUsed(idItem))
+			continue;
 
-		if (pLastNode->m_pLeftNode == nullptr && pLastNode->m_pRightNode == nullptr)
-			return pLastNode;
+		m_scratch.setUsed(idItem);
 
-		if (pLastNode->m_pRightNode == nullptr)
-		{
-			aVec.push_back(pLastNode->m_pLeftNode);
+		const double dist2 = m_tree.m_pItems[idItem].calcDist2(m_point);
+		if (dist2 >= getMaxDist2())
 			continue;
-		}
 
-		if (pLastNode->m_pLeftNode == nullptr)
+		///The farthest item is replaced if the heap is full
+		if (aHeapItems.size() == m_k)
 		{
-			aVec.push_back(pLastNode->m_pRightNode);
-			continue;
+			std::pop_heap(aHeapItems.begin(), aHeapItems.end(), isCloserItem);
+			aHeapItems.pop_back();
 		}
 
-		const D3 midPointBBoxLeft = (pLastNode->m_pLeftNode->getBBoxNode()).calcMid();
-		const D3 midPointBBoxRight = (pLastNode->m_pRightNode->getBBoxNode()).calcMid();
-
-		if ((point - midPointBBoxLeft).norm2() < (point - midPointBBoxRight).norm2())
-			aVec.push_back(pLastNode->m_pLeftNode);
-		else
-			aVec.push_back(pLastNode->m_pRightNode);
+		C3DKDTreeNearestItemINFO itemINFO;
+		itemINFO.m_idItem = idItem;
+		itemINFO.m_minDist2 = dist2;
+		aHeapItems.push_back(itemINFO);
+		std::push_heap(aHeapItems.begin(), aHeapItems.end(), isCloserItem);
 	}
-#endif
+}
 
-#ifndef USE_STACK_TRAVERSAL_TREE
-	if (pNode->m_pLeftNode == nullptr && pNode->m_pRightNode == nullptr)
-		return pNode;
+///<summary>Visits the leafs of the KD Tree pierced by the ray in the front to back order by the stack-based traversal of the split planes</summary>
+///<remarks>The visitor has the functions double getMaxT() const and void visitLeaf(const SFlatKDTreeNode& leaf), the leafs can decrease the maximal parameter</remarks>
+///<remarks>In : origin - The origin of the ray</remarks>
+///<remarks>In : dir - The direction of the ray</remarks>
+///<remarks>In : tMax - The maximal parameter of the ray</remarks>
+///<remarks>In/Out : visitor - The visitor of the leafs</remarks>
+template<typename T>
+template<typename TVisitor>
+void C3DKDTree<T>::traverseRay(const D3& origin, const D3& dir, const double tMax, TVisitor& visitor) const
+{
+	double tNearTree = 0.;
+	double tFarTree = tMax;
+	if (m_nFlatNodes == 0 || !math::clipRayBBox(m_bBoxTree, origin, dir, tNearTree, tFarTree))
+		return;
 
-	if (pNode->m_pRightNode == nullptr)
-		return findNearestLeaf(pNode->m_pLeftNode, point);
+	double aInvDir[3];
+	for (UI1 dim = 0; dim < 3; ++dim)
+		aInvDir[dim] = dir[dim] != 0. ? 1. / dir[dim] : 0.;
 
-	if (pNode->m_pLeftNode == nullptr)
-		return findNearestLeaf(pNode->m_pRightNode, point);
+	///The far children wait in the stack with the segments of the ray in them, the hits closer than their entry prune them
+	STraversalRayNode aStack[cTraversalStackSize];
+	UI1 nStack = 1;
+	aStack[0].m_idNode = 0;
+	aStack[0].m_tNear = tNearTree;
+	aStack[0].m_tFar = tFarTree;
 
-	const D3 midPointBBoxLeft = (pNode->m_pLeftNode->getBBoxNode()).calcMid();
-	const D3 midPointBBoxRight = (pNode->m_pRightNode->getBBoxNode()).calcMid();
+	while (nStack != 0)
+	{
+		const STraversalRayNode& traversalNode = aStack[--nStack];
+		if (traversalNode.m_tNear > visitor.getMaxT())
+			continue;
 
-	if ((point - midPointBBoxLeft).norm2() < (point - midPointBBoxRight).norm2())
-		return findNearestLeaf(pNode->m_pLeftNode, point);
-	else
-		return findNearestLeaf(pNode->m_pRightNode, point);
-#endif
-}
+		UI4 idNode = traversalNode.m_idNode;
+		const double tNear = traversalNode.m_tNear;
+		double tFar = traversalNode.m_tFar;
 
-///<summary>Finds nearest item to the point</summary>
-///<remarks>Out : nearestItemInfo - structure of the data about nearest item</remarks>
-///<remarks>In : point - The point for which we are find nearest item</remarks>
-template<typename T>
-void C3DKDTree<T>::findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, const D3& point, const UI1 iThread)
-{
-	const C3DKDTreeNode* const pNearestLeaf = findNearestLeaf(point);
+		///Goes down to the leaf through the near children, the segment of the ray is cut by the split planes
+		for (;;)
+		{
+			const SFlatKDTreeNode& node = getFlatNode(idNode);
+			if (node.isLeaf())
+			{
+				visitor.visitLeaf(node);
+				break;
+			}
 
-	pNearestLeaf->findNearestItem(nearestItemINFO, m_aItemsUsed[iThread], m_aITemsUsedId[iThread], m_aItems, point, true);
+			///The points on the split plane are in the right child
+			const UI4 dim = node.m_dimSplit;
+			const double diff = node.m_posSplit - origin[dim];
+			const bool bLeftNear = diff > 0. || (diff == 0. && dir[dim] < 0.);
+			const UI4 idNearNode = bLeftNear ? idNode + 1 : node.m_idRightNode;
+			const UI4 idFarNode = bLeftNear ? node.m_idRightNode : idNode + 1;
 
-	if (nearestItemINFO.m_minDist2 <= cEps2 || math::isSphereInBBox(pNearestLeaf->getBBoxNode(), point, nearestItemINFO.m_minDist))
-	{
-		for (UI1 i = 0, size = m_aITemsUsedId[iThread].size(); i < size; ++i)
-			m_aItemsUsed[iThread][m_aITemsUsedId[iThread][i]] = false;
+			///The ray which is parallel to the split plane never crosses it
+			const double tSplit = dir[dim] != 0. ? diff * aInvDir[dim] : DBL_MAX;
+			if (tSplit > tFar || tSplit <= 0.)
+				idNode = idNearNode;
+			else if (tSplit < tNear)
+				idNode = idFarNode;
+			else
+			{
+				STraversalRayNode& farNode = aStack[nStack++];
+				farNode.m_idNode = idFarNode;
+				farNode.m_tNear = tSplit;
+				farNode.m_tFar = tFar;
 
-		m_aITemsUsedId[iThread].clear();
+				idNode = idNearNode;
+				tFar = tSplit;
+			}
+		}
 	}
-	else
+}
+
+///<summary>Intersects the ray with the unused items of the leaf, the first hit is kept</summary>
+///<remarks>In : leaf - The leaf of the flattened KD Tree</remarks>
+template<typename T>
+void C3DKDTree<T>::SFirstHitVisitor::visitLeaf(const SFlatKDTreeNode& leaf)
+{
+	for (UI4 i = leaf.m_offsetItems, iEnd = leaf.m_offsetItems + leaf.m_numItems; i < iEnd; ++i)
 	{
-		findNearestItemInRadius(nearestItemINFO, point, iThread);
+		const UI4 idItem = m_tree.m_pFlatIDItems[i];
+		if (m_scratch.isUsed(idItem))
+			continue;
 
-		for (UI1 i = 0, size = m_aITemsUsedId[iThread].size(); i < size; ++i)
-			m_aItemsUsed[iThread][m_aITemsUsedId[iThread][i]] = false;
+		m_scratch.setUsed(idItem);
 
-		m_aITemsUsedId[iThread].clear();
+		///The hit can be out of the leaf if the item is in the several leafs, it prunes the nodes behind it only
+		double t = 0.;
+		if (m_tree.m_pItems[idItem].calcIntersectRay(m_origin, m_dir, m_maxT, t) && (!m_bHit || t < m_maxT))
+		{
+			m_maxT = t;
+			m_bHit = true;
+			m_hitINFO.m_idItem = idItem;
+			m_hitINFO.m_t = t;
+		}
 	}
 }
 
-///<summary>Finds nearest item to the point in the radius</summary>
-///<remarks>Out : nearestItemInfo - structure of the data about nearest item</remarks>
-///<remarks>In : pNode - The pointer to the current node of the KD Tree</remarks>
-///<remarks>In : point - The point for which we are finding nearest item</remarks>
+///<summary>Intersects the ray with the unused items of the leaf until the first hit</summary>
+///<remarks>In : leaf - The leaf of the flattened KD Tree</remarks>
 template<typename T>
-void C3DKDTree<T>::findNearestItemInRadius(C3DKDTreeNearestItemINFO& nearestItemINFO, const C3DKDTreeNode* pNode, const D3& point, const UI1 iThread)
+void C3DKDTree<T>::SAnyHitVisitor::visitLeaf(const SFlatKDTreeNode& leaf)
 {
-#ifdef USE_STACK_TRAVERSAL_TREE
-#if 0
-	std::stack<const C3DKDTreeNode*> aPNodes;
-	const C3DKDTreeNode* pCurrentNode = pNode;
-
-	bool bDone = false;
-	while (!bDone)
+	for (UI4 i = leaf.m_offsetItems, iEnd = leaf.m_offsetItems + leaf.m_numItems; i < iEnd; ++i)
 	{
-		if (pCurrentNode != nullptr && math::isIntersectSphereBBox(pCurrentNode->getBBoxNode(), point, nearestItemINFO.m_minDist))
-		{
-			if (pCurrentNode->m_pLeftNode == nullptr && pCurrentNode->m_pRightNode == nullptr)
-			{
-				C3DKDTreeNearestItemINFO tempNearestItemINFO;
-				pCurrentNode->findNearestItem(tempNearestItemINFO, m_aItemsUsed[iThread], m_aITemsUsedId[iThread], m_aItems, point, true);
-				if (tempNearestItemINFO.m_minDist < nearestItemINFO.m_minDist)
-					nearestItemINFO = tempNearestItemINFO;
-			}
-			aPNodes.push(pCurrentNode);
-			pCurrentNode = pCurrentNode->m_pLeftNode;
-		}
-		else
+		const UI4 idItem = m_tree.m_pFlatIDItems[i];
+		if (m_scratch.isUsed(idItem))
+			continue;
+
+		m_scratch.setUsed(idItem);
+
+		double t = 0.;
+		if (m_tree.m_pItems[idItem].calcIntersectRay(m_origin, m_dir, m_tMax, t))
 		{
-			if (!aPNodes.empty())
-			{
-				pCurrentNode = aPNodes.top();
-				aPNodes.pop();
-				pCurrentNode = pCurrentNode->m_pRightNode;
-			}
-			else
-				bDone = true;
+			m_bHit = true;
+			return;
 		}
 	}
-#else
-	std::vector<const C3DKDTreeNode*> aVec;
-	aVec.push_back(pNode);
+}
 
-	for (UI1 i = 0; i < aVec.size(); ++i)
+///<summary>Finds nearest item to the point in the leaf</summary>
+///<remarks>In/Out : nearestItemInfo - structure of the data about nearest item, only the items closer than its m_minDist2 are searched</remarks>
+///<remarks>In : leaf - The leaf of the flattened KD Tree</remarks>
+///<remarks>In : point - The point for which we are finding nearest item</remarks>
+///<remarks>In/Out : scratch - The state of the queries of the caller</remarks>
+template<typename T>
+void C3DKDTree<T>::findNearestItemLeaf(C3DKDTreeNearestItemINFO& nearestItemINFO, const SFlatKDTreeNode& leaf, const D3& point, SKDTreeQueryScratch& scratch) const
+{
+#ifdef USE_SIMD_DIST_TRIANGLES
+	///The unused triangles of the leaf are gathered into the blocks of the vectorized kernel
+	if (m_pTrianglesPrecomputed != nullptr)
 	{
-		if (math::isIntersectSphereBBox(aVec[i]->getBBoxNode(), point, nearestItemINFO.m_minDist))
+		UI4 aIDItemsBlock[cTrianglesBlockSize];
+		UI1 nIDItemsBlock = 0;
+		for (UI4 i = leaf.m_offsetItems, iEnd = leaf.m_offsetItems + leaf.m_numItems; i < iEnd; ++i)
 		{
-			if (aVec[i]->m_pLeftNode == nullptr && aVec[i]->m_pRightNode == nullptr)
-			{
-				C3DKDTreeNearestItemINFO tempNearestItemINFO;
-				aVec[i]->findNearestItem(tempNearestItemINFO, m_aItemsUsed[iThread], m_aITemsUsedId[iThread], m_aItems, point, true);
-				if (tempNearestItemINFO.m_minDist < nearestItemINFO.m_minDist)
-					nearestItemINFO = tempNearestItemINFO;
+			const UI4 idItem = m_pFlatIDItems[i];
+			if (scratch.isUsed(idItem))
 				continue;
-			}
 
-			if (aVec[i]->m_pLeftNode != nullptr)
-				aVec.push_back(aVec[i]->m_pLeftNode); 
+			scratch.setUsed(idItem);
 
-			if (aVec[i]->m_pRightNode != nullptr)
-				aVec.push_back(aVec[i]->m_pRightNode);
+			aIDItemsBlock[nIDItemsBlock++] = idItem;
+			if (nIDItemsBlock == cTrianglesBlockSize)
+			{
+				findNearestItemBlock(aIDItemsBlock, nIDItemsBlock, point, nearestItemINFO.m_minDist2, nearestItemINFO.m_idItem);
+				nIDItemsBlock = 0;
+			}
 		}
+
+		findNearestItemBlock(aIDItemsBlock, nIDItemsBlock, point, nearestItemINFO.m_minDist2, nearestItemINFO.m_idItem);
+
+		if (nearestItemINFO.m_minDist2 < cEps2)
+			nearestItemINFO.m_minDist2 = 0.;
+
+		return;
 	}
 #endif
-#endif
 
-#ifndef USE_STACK_TRAVERSAL_TREE
-	if (math::isIntersectSphereBBox(pNode->getBBoxNode(), point, nearestItemINFO.m_minDist))
-	{
-		if (pNode->m_pLeftNode == nullptr && pNode->m_pRightNode == nullptr)
-		{
-			C3DKDTreeNearestItemINFO tempNearestItemINFO;
-			pNode->findNearestItem(tempNearestItemINFO, m_aItemsUsed[iThread], m_aITemsUsedId[iThread], m_aItems, point, true);
-			if (tempNearestItemINFO.m_minDist < nearestItemINFO.m_minDist)
-				nearestItemINFO = tempNearestItemINFO;
-			return;
-		}
+	leaf.findNearestItem(nearestItemINFO, scratch, m_pItems, m_pFlatIDItems, point);
+}
 
-		if (pNode->m_pLeftNode != nullptr)
-			findNearestItemInRadius(nearestItemINFO, pNode->m_pLeftNode, point, iThread);
+#ifdef USE_SIMD_DIST_TRIANGLES
+///<summary>Finds nearest triangle to the point in the block of the id items by the vectorized kernel</summary>
+///<remarks>In : pIDItemsBlock - The id items of the triangles of the leaf</remarks>
+///<remarks>In : nIDItemsBlock - The number of the id items</remarks>
+///<remarks>In : point - The point for which we are finding nearest item</remarks>
+///<remarks>In/Out : minDist2 - Square of the distance to nearest item, only the items closer than it are searched</remarks>
+///<remarks>In/Out : idItem - Id of nearest item</remarks>
+template<typename T>
+void C3DKDTree<T>::findNearestItemBlock(const UI4* pIDItemsBlock, const UI1 nIDItemsBlock, const D3& point, double& minDist2, UI1& idItem) const
+{
+	if (nIDItemsBlock == 0)
+		return;
 
-		if (pNode->m_pRightNode != nullptr)
-			findNearestItemInRadius(nearestItemINFO, pNode->m_pRightNode, point, iThread);
+	UI1 iMin = 0;
+	const double dist2 = math::calcMinDist2Triangles(m_pTrianglesPrecomputed, pIDItemsBlock, nIDItemsBlock, point, iMin);
+	if (dist2 < minDist2)
+	{
+		minDist2 = dist2;
+		idItem = pIDItemsBlock[iMin];
 	}
-#endif
 }
+#endif
 
 #ifdef DUMP_TREE
 template<typename T>
@@ -700,13 +4081,10 @@ void C3DKDTree<T>::dumpTree(const char* pNameDump) const
 	try
 	{
 		CFileWriterDXF dumpTree(pNameDump);
-		std::vector<C3DKDTreeNode*> aLeafs;
-		getLeafNodes(aLeafs);
-		for (UI1 i = 0, nLeafs = aLeafs.size(); i < nLeafs; ++i)
-		{
-			const SBBox& bBoxLeaf = aLeafs[i]->getBBoxNode();
-			dumpTree.writeBBox(bBoxLeaf);
-		}
+		std::vector<SBBox> aBBoxLeafs;
+		getLeafBBoxes(aBBoxLeafs, 0, m_bBoxTree);
+		for (UI1 i = 0, nLeafs = aBBoxLeafs.size(); i < nLeafs; ++i)
+			dumpTree.writeBBox(aBBoxLeafs[i]);
 	}
 	catch (CExceptionCanNotOpenFile& err)
 	{
@@ -720,25 +4098,26 @@ void C3DKDTree<T>::dumpTree(const char* pNameDump) const
 template<typename T>
 void C3DKDTree<T>::dumpLogTree(const char* pNameLog, const char* pNameModel, const UI1 time)
 {
-	std::vector<C3DKDTreeNode*> aLeafs;
-	getLeafNodes(aLeafs);
-
-	const UI1 nLeafs = aLeafs.size();
-
+	UI1 nLeafs = 0;
 	UI1 maxItems = 0;
 	UI1 sumItems = 0;
-	for (UI1 i = 0; i < nLeafs; ++i)
+	for (UI1 i = 0, nNodes = m_nFlatNodes; i < nNodes; ++i)
 	{
-		if (maxItems < aLeafs[i]->size())
-			maxItems = aLeafs[i]->size();
+		if (!m_pFlatNodes[i].isLeaf() || m_pFlatNodes[i].m_numItems == 0)
+			continue;
+
+		++nLeafs;
+		if (maxItems < m_pFlatNodes[i].m_numItems)
+			maxItems = m_pFlatNodes[i].m_numItems;
 
-		sumItems += aLeafs[i]->size();
+		sumItems += m_pFlatNodes[i].m_numItems;
 	}
 
 	try
 	{
 		CFileWriterLOG logFile(pNameLog, pNameModel);
 		logFile.writeAttrUI1("NUM LEAFS       ", nLeafs);
+		logFile.writeAttrUI1("NUM NODES       ", m_nFlatNodes);
 		logFile.writeAttrUI1("MAX NUM ELEMENTS", maxItems);
 		logFile.writeAttrDbl("AVG NUM ELEMENTS", static_cast<double>(sumItems) / static_cast<double>(nLeafs));
 		if (time != -1)
@@ -0,0 +1,152 @@
+#pragma once
+#include "math_util.h"
+#include "struct_basic_types.h"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+///<summary>The angle-weighted pseudo-normals of the faces, the edges and the vertices of the closed triangle mesh</summary>
+///<remarks>The point is outside of the mesh if the vector from its closest point to it has the positive dot product with the pseudo-normal of the closest feature</remarks>
+///<remarks>The vertices of the triangles are welded by the exact coordinates, so the triangles of the soup must share the bitwise equal vertices</remarks>
+class CMeshPseudoNormals
+{
+	CMeshPseudoNormals(const CMeshPseudoNormals& normals);
+	CMeshPseudoNormals& operator=(const CMeshPseudoNormals& normals);
+public:
+	///<summary>Precomputes the pseudo-normals of the triangles</summary>
+	///<remarks>In : aItems - The triangles of the mesh in the order of the id items of the KD Tree, their vertices are item[0], item[1], item[2]</remarks>
+	///<remarks>In : nItems - Count of the triangles</remarks>
+	template<typename T>
+	CMeshPseudoNormals(const T* aItems, const UI1 nItems);
+
+	///<summary>Gets the pseudo-normal of the feature of the triangle</summary>
+	///<remarks>In : idItem - Id of the triangle</remarks>
+	///<remarks>In : feature - The feature of the triangle</remarks>
+	///<returns>The pseudo-normal, it's not normalized for the edges and the vertices</returns>
+	const D3& getNormal(const UI1 idItem, const eTriangleFeature feature) const
+	{
+		switch (feature)
+		{
+		case eTriangleFeatureVertexA:
+			return m_aNormalsVertex[m_aIDVx[3 * idItem]];
+		case eTriangleFeatureVertexB:
+			return m_aNormalsVertex[m_aIDVx[3 * idItem + 1]];
+		case eTriangleFeatureVertexC:
+			return m_aNormalsVertex[m_aIDVx[3 * idItem + 2]];
+		case eTriangleFeatureEdgeAB:
+			return m_aNormalsEdge[3 * idItem];
+		case eTriangleFeatureEdgeBC:
+			return m_aNormalsEdge[3 * idItem + 1];
+		case eTriangleFeatureEdgeCA:
+			return m_aNormalsEdge[3 * idItem + 2];
+		default:
+			return m_aNormalsFace[idItem];
+		}
+	}
+
+	///<summary>Gets count of the triangles</summary>
+	///<returns>Count of the triangles</returns>
+	UI1 getNumItems() const
+	{
+		return m_aNormalsFace.size();
+	}
+
+private:
+	///<summary>The unit normals of the triangles, they are 0 for the degenerate triangles</summary>
+	std::vector<D3> m_aNormalsFace;
+	///<summary>The sums of the normals of the triangles of the edges AB, BC and CA, 3 per triangle</summary>
+	std::vector<D3> m_aNormalsEdge;
+	///<summary>The sums of the normals of the triangles of the welded vertices weighted by the angles of the triangles at them</summary>
+	std::vector<D3> m_aNormalsVertex;
+	///<summary>Ids of the welded vertices A, B and C, 3 per triangle</summary>
+	std::vector<UI4> m_aIDVx;
+};
+
+///<summary>Precomputes the pseudo-normals of the triangles</summary>
+///<remarks>In : aItems - The triangles of the mesh in the order of the id items of the KD Tree, their vertices are item[0], item[1], item[2]</remarks>
+///<remarks>In : nItems - Count of the triangles</remarks>
+template<typename T>
+CMeshPseudoNormals::CMeshPseudoNormals(const T* aItems, const UI1 nItems)
+{
+	std::vector<D3> aCorners(3 * nItems);
+	for (UI1 idItem = 0; idItem < nItems; ++idItem)
+	{
+		for (UI1 iCorner = 0; iCorner < 3; ++iCorner)
+			aCorners[3 * idItem + iCorner] = D3(aItems[idItem][iCorner]);
+	}
+
+	///The corners are welded by sorting them by the coordinates
+	std::vector<UI4> aOrder(aCorners.size());
+	for (UI1 i = 0; i < aOrder.size(); ++i)
+		aOrder[i] = static_cast<UI4>(i);
+
+	std::sort(aOrder.begin(), aOrder.end(), [&aCorners](const UI4 a, const UI4 b)
+	{
+		const D3& A = aCorners[a];
+		const D3& B = aCorners[b];
+		if (A[0] != B[0])
+			return A[0] < B[0];
+		if (A[1] != B[1])
+			return A[1] < B[1];
+		return A[2] < B[2];
+	});
+
+	m_aIDVx.resize(aCorners.size());
+	UI4 nVx = 0;
+	for (UI1 i = 0; i < aOrder.size(); ++i)
+	{
+		const D3& corner = aCorners[aOrder[i]];
+		if (i != 0)
+		{
+			const D3& prevCorner = aCorners[aOrder[i - 1]];
+			if (corner[0] != prevCorner[0] || corner[1] != prevCorner[1] || corner[2] != prevCorner[2])
+				++nVx;
+		}
+
+		m_aIDVx[aOrder[i]] = nVx;
+	}
+
+	m_aNormalsFace.resize(nItems);
+	m_aNormalsVertex.assign(aCorners.empty() ? 0 : nVx + 1, D3(0., 0., 0.));
+	for (UI1 idItem = 0; idItem < nItems; ++idItem)
+	{
+		const D3* aVx = &aCorners[3 * idItem];
+		const D3 normal = math::normalizeVector((aVx[1] - aVx[0]) % (aVx[2] - aVx[0]));
+		m_aNormalsFace[idItem] = normal;
+
+		for (UI1 iCorner = 0; iCorner < 3; ++iCorner)
+		{
+			const D3 e0 = math::normalizeVector(aVx[(iCorner + 1) % 3] - aVx[iCorner]);
+			const D3 e1 = math::normalizeVector(aVx[(iCorner + 2) % 3] - aVx[iCorner]);
+			const double angle = acos(math::max2(-1., math::min2(1., e0 * e1)));
+
+			D3& normalVertex = m_aNormalsVertex[m_aIDVx[3 * idItem + iCorner]];
+			normalVertex = normalVertex + normal * angle;
+		}
+	}
+
+	///The edges AB, BC and CA of the triangles are grouped by the ids of their welded vertices
+	std::vector<std::pair<UI8, UI4>> aEdges(aCorners.size());
+	for (UI1 i = 0; i < aEdges.size(); ++i)
+	{
+		const UI1 idItem = i / 3;
+		const UI8 idA = m_aIDVx[i];
+		const UI8 idB = m_aIDVx[3 * idItem + (i + 1) % 3];
+		aEdges[i].first = idA < idB ? (idA << 32) | idB : (idB << 32) | idA;
+		aEdges[i].second = static_cast<UI4>(i);
+	}
+
+	std::sort(aEdges.begin(), aEdges.end());
+
+	m_aNormalsEdge.resize(aEdges.size());
+	for (UI1 begin = 0, end = 0; begin < aEdges.size(); begin = end)
+	{
+		D3 normal(0., 0., 0.);
+		for (end = begin; end < aEdges.size() && aEdges[end].first == aEdges[begin].first; ++end)
+			normal = normal + m_aNormalsFace[aEdges[end].second / 3];
+
+		for (UI1 i = begin; i < end; ++i)
+			m_aNormalsEdge[aEdges[i].second] = normal;
+	}
+}
@@ -3,10 +3,12 @@
 #include "struct_basic_types.h"
 
 #include <vector>
+#include <algorithm>
+#include <omp.h>
 
 struct SSplitINFO
 {
-	explicit SSplitINFO(UI1 numItemsLeft = 0, UI1 numItemsRight = 0) : m_numItemsLeft(numItemsLeft), m_numItemsRight(numItemsRight)
+	explicit SSplitINFO(UI1 numItemsLeft = 0, UI1 numItemsRight = 0) : m_numItemsLeft(numItemsLeft), m_numItemsRight(numItemsRight), m_clipItems(false)
 	{
 
 	}
@@ -21,8 +23,50 @@ public:
 	UI1 m_numItemsLeft;
 	///<summary>Numbers of the elements on the right side of split plane</summary>
 	UI1 m_numItemsRight;
+	///<summary>The items which are crossed by the split plane are clipped by the bounding box of the node(perfect splits)</summary>
+	bool m_clipItems;
 };
 
+enum eSplitSide
+{
+	eSplitSideLeft,
+	eSplitSideRight,
+	eSplitSideBoth,
+	///<summary>The clipped item is out of the bounding box of the node</summary>
+	eSplitSideNone
+};
+
+///<summary>Classifies the item by the split plane</summary>
+///<remarks>In : item - The item</remarks>
+///<remarks>In : bBoxItem - Bounding box of the item</remarks>
+///<remarks>In : bBoxNode - Bounding box of the node which is split</remarks>
+///<remarks>In : splitINFO - Structure of the data about node after split</remarks>
+///<returns>The side of the split plane where is the item</returns>
+template<typename T>
+inline eSplitSide classifyItem(const T& item, const SBBox& bBoxItem, const SBBox& bBoxNode, const SSplitINFO& splitINFO)
+{
+	if (bBoxItem.m_minBB[splitINFO.m_dimSplit] >= splitINFO.m_posSplit)
+		return eSplitSideRight;
+
+	if (bBoxItem.m_maxBB[splitINFO.m_dimSplit] < splitINFO.m_posSplit)
+		return eSplitSideLeft;
+
+	if (!splitINFO.m_clipItems)
+		return eSplitSideBoth;
+
+	SBBox bBoxClipped;
+	if (!item.calcBBoxClipped(bBoxNode, bBoxClipped))
+		return eSplitSideNone;
+
+	if (bBoxClipped.m_minBB[splitINFO.m_dimSplit] >= splitINFO.m_posSplit)
+		return eSplitSideRight;
+
+	if (bBoxClipped.m_maxBB[splitINFO.m_dimSplit] < splitINFO.m_posSplit)
+		return eSplitSideLeft;
+
+	return eSplitSideBoth;
+}
+
 template<typename T>
 class C3DKDTreeNodeSplitter
 {
@@ -31,9 +75,27 @@ public:
 	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
 	///<remarks>In : bBox - Bounding box which we want to split</remarks>
 	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
 	///<remarks>In : aIDtems - The array of id items from aItems which we want to split</remarks>
 	///<returns>True if we are split the node, otherwise false</returns>
-	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<UI1>& aIDItems) const = 0;
+	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const std::vector<UI1>& aIDItems) const = 0;
+
+	///<summary>Splits the bounding box on two AABB bounding boxes</summary>
+	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : pIDItems - The range of id items from aItems which we want to split</remarks>
+	///<remarks>In : nItems - The number of id items in the range</remarks>
+	///<returns>True if we are split the node, otherwise false</returns>
+	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const UI4* pIDItems, const UI1 nItems) const = 0;
+
+	///<summary>Allocates the buffers of the current thread for the splits of the nodes, so the splits don't allocate the memory in the build</summary>
+	///<remarks>In : nItems - The maximal number of the items of the node</remarks>
+	virtual void reserve(const UI1) const
+	{
+
+	}
 
 	virtual ~C3DKDTreeNodeSplitter()
 	{
@@ -63,14 +125,82 @@ class C3DKDTreeNodeSplitterSAH : public C3DKDTreeNodeSplitter<T>
 	///<summary>Splits the bounding box on two AABB bounding boxes</summary>
 	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
 	///<remarks>In : bBox - Bounding box which we want to split</remarks>
-	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aItems - The array of all items, the binned SAH uses only their bounding boxes</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
 	///<remarks>In : aIDtems - The array of id items from aItems which we want to split</remarks>
 	///<returns>True if we are split the node, otherwise false</returns>
-	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<UI1>& aIDItems) const;
+	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& /*aItems*/, const std::vector<SBBox>& aBBoxItems, const std::vector<UI1>& aIDItems) const
+	{
+		return splitIDItems(splitINFO, bBox, aBBoxItems, aIDItems.data(), aIDItems.size());
+	}
+
+	///<summary>Splits the bounding box on two AABB bounding boxes</summary>
+	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aItems - The array of all items, the binned SAH uses only their bounding boxes</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : pIDItems - The range of id items from aItems which we want to split</remarks>
+	///<remarks>In : nItems - The number of id items in the range</remarks>
+	///<returns>True if we are split the node, otherwise false</returns>
+	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& /*aItems*/, const std::vector<SBBox>& aBBoxItems, const UI4* pIDItems, const UI1 nItems) const
+	{
+		return splitIDItems(splitINFO, bBox, aBBoxItems, pIDItems, nItems);
+	}
+
+protected:
+	///<summary>Splits the bounding box on two AABB bounding boxes</summary>
+	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : pIDItems - The range of id items which we want to split</remarks>
+	///<remarks>In : nItems - The number of id items in the range</remarks>
+	///<returns>True if we are split the node, otherwise false</returns>
+	template<typename TID>
+	bool splitIDItems(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<SBBox>& aBBoxItems, const TID* pIDItems, const UI1 nItems) const;
+
+	///<summary>ON/OFF binning of the big nodes by the threads</summary>
+	const bool m_useMultithread;
+
+	///<summary>Calculates in which position of the "discretizated plane" are the minBBItem and the maxBBItem of the items</summary>
+	///<remarks>In/Out : aBinL - array of the low events</remarks>
+	///<remarks>In/Out : aBinH - array of the high events</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aTemp - The number of the bins per unit of the length for every axis</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : pIDItems - The range of id items from aItems</remarks>
+	///<remarks>In : nItems - The number of id items in the range</remarks>
+	template<typename TID>
+	static void binIDItems(UI1(&aBinL)[3][cNumBins + 1], UI1(&aBinH)[3][cNumBins + 1], const SBBox& bBox, const double(&aTemp)[3],
+		const std::vector<SBBox>& aBBoxItems, const TID* pIDItems, const UI1 nItems)
+	{
+		for (UI1 i = 0; i < nItems; ++i)
+		{
+			const SBBox& bBoxItem = aBBoxItems[pIDItems[i]];
+
+			if (bBoxItem.m_minBB[0] >= bBox.m_minBB[0])
+				++aBinL[0][static_cast<UI1>((bBoxItem.m_minBB[0] - bBox.m_minBB[0]) * aTemp[0])];
+
+			if (bBoxItem.m_minBB[1] >= bBox.m_minBB[1])
+				++aBinL[1][static_cast<UI1>((bBoxItem.m_minBB[1] - bBox.m_minBB[1]) * aTemp[1])];
+
+			if (bBoxItem.m_minBB[2] >= bBox.m_minBB[2])
+				++aBinL[2][static_cast<UI1>((bBoxItem.m_minBB[2] - bBox.m_minBB[2]) * aTemp[2])];
+
+			if (bBoxItem.m_maxBB[0] <= bBox.m_maxBB[0])
+				++aBinH[0][static_cast<UI1>((bBoxItem.m_maxBB[0] - bBox.m_minBB[0]) * aTemp[0])];
+
+			if (bBoxItem.m_maxBB[1] <= bBox.m_maxBB[1])
+				++aBinH[1][static_cast<UI1>((bBoxItem.m_maxBB[1] - bBox.m_minBB[1]) * aTemp[1])];
+
+			if (bBoxItem.m_maxBB[2] <= bBox.m_maxBB[2])
+				++aBinH[2][static_cast<UI1>((bBoxItem.m_maxBB[2] - bBox.m_minBB[2]) * aTemp[2])];
+		}
+	}
 
 public:
 
-	C3DKDTreeNodeSplitterSAH()
+	///<remarks>In : bUseMultithread - ON/OFF binning of the big nodes by the threads(outside of the parallel regions only)</remarks>
+	explicit C3DKDTreeNodeSplitterSAH(bool bUseMultithread = false) : m_useMultithread(bUseMultithread)
 	{
 		for (UI1 i = 1; i < cNumBins; ++i)
 			m_aCoef[i] = static_cast<double>(i) / cNumBinsDouble;
@@ -80,13 +210,15 @@ public:
 ///<summary>Splits the bounding box on two AABB bounding boxes</summary>
 ///<remarks>Out : splitINFO - Structure of the data about node after split</remarks>
 ///<remarks>In : bBox - Bounding box which we want to split</remarks>
-///<remarks>In : aItems - The array of all items</remarks>
-///<remarks>In : aIDtems - The array of id items from aItems which we want to split</remarks>
+///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+///<remarks>In : pIDItems - The range of id items which we want to split</remarks>
+///<remarks>In : nItems - The number of id items in the range</remarks>
 ///<returns>True if we are split the node, otherwise false</returns>	
 template<typename T>
-bool C3DKDTreeNodeSplitterSAH<T>::split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<UI1>& aIDItems) const
+template<typename TID>
+bool C3DKDTreeNodeSplitterSAH<T>::splitIDItems(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<SBBox>& aBBoxItems, const TID* pIDItems, const UI1 nItems) const
 {
-	//if (aIDItems.size() < cMaxElementsInNode)
+	//if (nItems < cMaxElementsInNode)
 	//	return false;
 
 	/// aBinL - array of the low events
@@ -114,29 +246,39 @@ bool C3DKDTreeNodeSplitterSAH<T>::split(SSplitINFO& splitINFO, const SBBox& bBox
 		cNumBinsDouble / aLen[2]
 	};
 
-	///Calculates in which position of the "discretizated plane" is the current point(minBBItem or maxBBItem)
-	for (UI1 i = 0, nItems = aIDItems.size(); i < nItems; ++i)
+	///The big nodes are binned by the threads into the private bins, which are summed up
+	if (m_useMultithread && nItems >= cNumElementsForParallelSplit && !omp_in_parallel())
 	{
-		const SBBox& bBoxItem = aItems[aIDItems[i]].getBBoxItem();
-
-		if (bBoxItem.m_minBB[0] >= bBox.m_minBB[0])
-			++aBinL[0][static_cast<UI1>((bBoxItem.m_minBB[0] - bBox.m_minBB[0]) * aTemp[0])];
-
-		if (bBoxItem.m_minBB[1] >= bBox.m_minBB[1])
-			++aBinL[1][static_cast<UI1>((bBoxItem.m_minBB[1] - bBox.m_minBB[1]) * aTemp[1])];
+#pragma omp parallel
+		{
+			UI1 aBinLThread[3][cNumBins + 1];
+			UI1 aBinHThread[3][cNumBins + 1];
 
-		if (bBoxItem.m_minBB[2] >= bBox.m_minBB[2])
-			++aBinL[2][static_cast<UI1>((bBoxItem.m_minBB[2] - bBox.m_minBB[2]) * aTemp[2])];
+			::memset(aBinLThread, 0, sizeof(aBinLThread));
+			::memset(aBinHThread, 0, sizeof(aBinHThread));
 
-		if (bBoxItem.m_maxBB[0] <= bBox.m_maxBB[0])
-			++aBinH[0][static_cast<UI1>((bBoxItem.m_maxBB[0] - bBox.m_minBB[0]) * aTemp[0])];
+			const UI1 nThreads = omp_get_num_threads();
+			const UI1 iThread = omp_get_thread_num();
+			const UI1 begin = nItems * iThread / nThreads;
+			const UI1 end = nItems * (iThread + 1) / nThreads;
 
-		if (bBoxItem.m_maxBB[1] <= bBox.m_maxBB[1])
-			++aBinH[1][static_cast<UI1>((bBoxItem.m_maxBB[1] - bBox.m_minBB[1]) * aTemp[1])];
+			binIDItems(aBinLThread, aBinHThread, bBox, aTemp, aBBoxItems, pIDItems + begin, end - begin);
 
-		if (bBoxItem.m_maxBB[2] <= bBox.m_maxBB[2])
-			++aBinH[2][static_cast<UI1>((bBoxItem.m_maxBB[2] - bBox.m_minBB[2]) * aTemp[2])];
+#pragma omp critical
+			{
+				for (UI1 dim = 0; dim < 3; ++dim)
+				{
+					for (UI1 i = 0; i <= cNumBins; ++i)
+					{
+						aBinL[dim][i] += aBinLThread[dim][i];
+						aBinH[dim][i] += aBinHThread[dim][i];
+					}
+				}
+			}
+		}
 	}
+	else
+		binIDItems(aBinL, aBinH, bBox, aTemp, aBBoxItems, pIDItems, nItems);
 
 	aBinL[0][cNumBins - 1] += aBinL[0][cNumBins];
 	aBinH[0][cNumBins - 1] += aBinH[0][cNumBins];
@@ -187,7 +329,7 @@ bool C3DKDTreeNodeSplitterSAH<T>::split(SSplitINFO& splitINFO, const SBBox& bBox
 			/// SA - surface area of the bounding box
 			const double aSAL = m_aCoef[i] * aLen[dim] * aLenSum[dim] + aLenMul[dim];
 			const double aSAR = SA + aLenMul[dim] - aSAL;
-			const double aSAH = aSAL * static_cast<double>(aIDItems.size() - aBinL[dim][i]) + aSAR * static_cast<double>(aIDItems.size() - aBinH[dim][i - 1]);
+			const double aSAH = aSAL * static_cast<double>(nItems - aBinL[dim][i]) + aSAR * static_cast<double>(nItems - aBinH[dim][i - 1]);
 
 			if (aSAH < minSAH.m_SAH)
 			{
@@ -198,7 +340,7 @@ bool C3DKDTreeNodeSplitterSAH<T>::split(SSplitINFO& splitINFO, const SBBox& bBox
 		}
 	}
 
-	if ((static_cast<double>(aIDItems.size()) * cI) < (cI * minSAH.m_SAH / SA + cT))
+	if ((static_cast<double>(nItems) * cI) < (cI * minSAH.m_SAH / SA + cT))
 		return false;
 
 	splitINFO.m_dimSplit = minSAH.m_dimSplit;
@@ -209,11 +351,222 @@ bool C3DKDTreeNodeSplitterSAH<T>::split(SSplitINFO& splitINFO, const SBBox& bBox
 		const UI1 nItemsR = aBinL[splitINFO.m_dimSplit][minSAH.m_nPlane];
 		const UI1 nItemsL = aBinH[splitINFO.m_dimSplit][minSAH.m_nPlane - 1];
 
-		const UI1 nItemsB = aIDItems.size() - nItemsL - nItemsR;
+		const UI1 nItemsB = nItems - nItemsL - nItemsR;
 
 		splitINFO.m_numItemsLeft = nItemsL + nItemsB;
 		splitINFO.m_numItemsRight = nItemsR + nItemsB;
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+template<typename T>
+class C3DKDTreeNodeSplitterSAHSweep : public C3DKDTreeNodeSplitterSAH<T>
+{
+	///<summary>The sorted positions of the events of the items per axis</summary>
+	struct SSweepEvents
+	{
+		///<summary>Positions of the low events(the minimums of the bounding boxes of the items)</summary>
+		std::vector<double> m_aMin[3];
+		///<summary>Positions of the high events(the maximums of the bounding boxes of the items)</summary>
+		std::vector<double> m_aMax[3];
+	};
+
+	///<summary>Splits the bounding box on two AABB bounding boxes</summary>
+	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : aIDtems - The array of id items from aItems which we want to split</remarks>
+	///<returns>True if we are split the node, otherwise false</returns>
+	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const std::vector<UI1>& aIDItems) const
+	{
+		return sweepIDItems(splitINFO, bBox, aItems, aBBoxItems, aIDItems.data(), aIDItems.size());
+	}
+
+	///<summary>Splits the bounding box on two AABB bounding boxes</summary>
+	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : pIDItems - The range of id items from aItems which we want to split</remarks>
+	///<remarks>In : nItems - The number of id items in the range</remarks>
+	///<returns>True if we are split the node, otherwise false</returns>
+	virtual bool split(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const UI4* pIDItems, const UI1 nItems) const
+	{
+		return sweepIDItems(splitINFO, bBox, aItems, aBBoxItems, pIDItems, nItems);
+	}
+
+	///<summary>Splits the bounding box on two AABB bounding boxes by the minimum of the SAH over all events of the items</summary>
+	///<remarks>Out : splitINFO -Structure of the data about node after split</remarks>
+	///<remarks>In : bBox - Bounding box which we want to split</remarks>
+	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+	///<remarks>In : pIDItems - The range of id items from aItems which we want to split</remarks>
+	///<remarks>In : nItems - The number of id items in the range</remarks>
+	///<returns>True if we are split the node, otherwise false</returns>
+	template<typename TID>
+	bool sweepIDItems(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const TID* pIDItems, const UI1 nItems) const;
+
+	///<returns>The buffers of the events of the current thread, they are reused by the nodes of the thread</returns>
+	static SSweepEvents& getEvents()
+	{
+		static thread_local SSweepEvents events;
+		return events;
+	}
+
+	///<summary>Resizes the buffers of the events of the current thread</summary>
+	///<remarks>In/Out : events - The buffers of the events</remarks>
+	///<remarks>In : nItems - The number of the items of the node</remarks>
+	static void resizeEvents(SSweepEvents& events, const UI1 nItems)
+	{
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			if (events.m_aMin[dim].size() < nItems)
+			{
+				events.m_aMin[dim].resize(nItems);
+				events.m_aMax[dim].resize(nItems);
+			}
+		}
+	}
+
+	///<summary>ON/OFF clipping of the items by the bounding box of the node(perfect splits)</summary>
+	const bool m_perfectSplits;
+	///<summary>The nodes with more items are split by the binned SAH(hybrid mode)</summary>
+	const UI1 m_maxItemsSweep;
+
+public:
+
+	///<remarks>In : bPerfectSplits - ON/OFF clipping of the items by the bounding box of the node</remarks>
+	///<remarks>In : maxItemsSweep - The nodes with more items are split by the binned SAH, SIZE_MAX - all nodes are split by the sweep</remarks>
+	///<remarks>In : bUseMultithread - ON/OFF binning of the big nodes by the threads(outside of the parallel regions only)</remarks>
+	explicit C3DKDTreeNodeSplitterSAHSweep(bool bPerfectSplits = true, UI1 maxItemsSweep = cMaxElementsForSweepSplit, bool bUseMultithread = false) :
+		C3DKDTreeNodeSplitterSAH<T>(bUseMultithread), m_perfectSplits(bPerfectSplits), m_maxItemsSweep(maxItemsSweep)
+	{
+
+	}
+
+	///<summary>Allocates the events of the current thread for the nodes split by the sweep, the bigger nodes are binned</summary>
+	///<remarks>In : nItems - The maximal number of the items of the node</remarks>
+	virtual void reserve(const UI1 nItems) const
+	{
+		resizeEvents(getEvents(), std::min(nItems, m_maxItemsSweep));
+	}
+};
+
+///<summary>Splits the bounding box on two AABB bounding boxes by the minimum of the SAH over all events of the items</summary>
+///<remarks>Out : splitINFO - Structure of the data about node after split</remarks>
+///<remarks>In : bBox - Bounding box which we want to split</remarks>
+///<remarks>In : aItems - The array of all items</remarks>
+///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
+///<remarks>In : pIDItems - The range of id items from aItems which we want to split</remarks>
+///<remarks>In : nItems - The number of id items in the range</remarks>
+///<returns>True if we are split the node, otherwise false</returns>
+template<typename T>
+template<typename TID>
+bool C3DKDTreeNodeSplitterSAHSweep<T>::sweepIDItems(SSplitINFO& splitINFO, const SBBox& bBox, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const TID* pIDItems, const UI1 nItems) const
+{
+	splitINFO.m_clipItems = m_perfectSplits;
+
+	///Hybrid mode : the big nodes are split by the binned SAH
+	if (nItems > m_maxItemsSweep)
+		return this->splitIDItems(splitINFO, bBox, aBBoxItems, pIDItems, nItems);
+
+	const double aLen[3]
+	{
+		bBox.m_maxBB[0] - bBox.m_minBB[0],
+		bBox.m_maxBB[1] - bBox.m_minBB[1],
+		bBox.m_maxBB[2] - bBox.m_minBB[2]
+	};
+
+	if (aLen[0] < cEps || aLen[1] < cEps || aLen[2] < cEps)
+		return false;
+
+	///The events are allocated by reserve before the build, they grow here only for the splits out of the build
+	SSweepEvents& events = getEvents();
+	resizeEvents(events, nItems);
+
+	///The items out of the node after clipping are not counted
+	UI1 nEvents = 0;
+	for (UI1 i = 0; i < nItems; ++i)
+	{
+		const T& item = aItems[pIDItems[i]];
+
+		SBBox bBoxClipped;
+		if (m_perfectSplits && !item.calcBBoxClipped(bBox, bBoxClipped))
+			continue;
+
+		const SBBox& bBoxItem = m_perfectSplits ? bBoxClipped : aBBoxItems[pIDItems[i]];
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			events.m_aMin[dim][nEvents] = bBoxItem.m_minBB[dim];
+			events.m_aMax[dim][nEvents] = bBoxItem.m_maxBB[dim];
+		}
+		++nEvents;
+	}
+
+	if (nEvents == 0)
+		return false;
+
+	const double aLenMul[3]
+	{
+		aLen[1] * aLen[2],
+		aLen[0] * aLen[2],
+		aLen[0] * aLen[1]
+	};
+
+	const double aLenSum[3]
+	{
+		aLen[1] + aLen[2],
+		aLen[0] + aLen[2],
+		aLen[0] + aLen[1]
+	};
+
+	const double SA = aLenMul[0] + aLenMul[1] + aLenMul[2];
+
+	double minSAH = DBL_MAX;
+	for (UI1 dim = 0; dim < 3; ++dim)
+	{
+		double* aMin = events.m_aMin[dim].data();
+		double* aMax = events.m_aMax[dim].data();
+
+		std::sort(aMin, aMin + nEvents);
+		std::sort(aMax, aMax + nEvents);
+
+		///Sweep over the events in ascending order, the item is on the left side if max < pos, on the right side if min >= pos
+		UI1 iMin = 0;
+		UI1 iMax = 0;
+		while (iMin < nEvents || iMax < nEvents)
+		{
+			const double pos = (iMax == nEvents || (iMin < nEvents && aMin[iMin] < aMax[iMax])) ? aMin[iMin] : aMax[iMax];
+
+			if (pos > bBox.m_minBB[dim] && pos < bBox.m_maxBB[dim])
+			{
+				/// SAH = cT + cI * (SAL * numL + SAR * numR) / SA, but here is optimized : SAH = (SAL * numL + SAR * numR)
+				const double aSAL = (pos - bBox.m_minBB[dim]) * aLenSum[dim] + aLenMul[dim];
+				const double aSAR = SA + aLenMul[dim] - aSAL;
+				const double aSAH = aSAL * static_cast<double>(iMin) + aSAR * static_cast<double>(nEvents - iMax);
+
+				if (aSAH < minSAH)
+				{
+					minSAH = aSAH;
+					splitINFO.m_dimSplit = dim;
+					splitINFO.m_posSplit = pos;
+					splitINFO.m_numItemsLeft = iMin;
+					splitINFO.m_numItemsRight = nEvents - iMax;
+				}
+			}
+
+			while (iMin < nEvents && aMin[iMin] == pos)
+				++iMin;
+
+			while (iMax < nEvents && aMax[iMax] == pos)
+				++iMax;
+		}
+	}
+
+	if ((static_cast<double>(nEvents) * cI) < (cI * minSAH / SA + cT))
+		return false;
+
+	return true;
+}
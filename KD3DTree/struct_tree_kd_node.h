@@ -1,6 +1,10 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include "math_util.h"
+#include "struct_arena.h"
 #include "struct_basic_types.h"
 #include "struct_node_splitter.h"
 
@@ -17,31 +21,199 @@ struct C3DKDTreeNearestItemINFO
 	}
 };
 
+///<summary>The class of information about nearest Item with its closest point and its feature which contains the closest point</summary>
+struct C3DKDTreeNearestFeatureINFO : public C3DKDTreeNearestItemINFO
+{
+	///<summary>The closest point of the nearest item</summary>
+	D3 m_closestPoint;
+	///<summary>The face, the edge or the vertex of the nearest triangle which contains the closest point</summary>
+	eTriangleFeature m_feature;
+	C3DKDTreeNearestFeatureINFO() : m_feature(eTriangleFeatureFace)
+	{
+
+	}
+};
+
+///<summary>The class of information about the hit of the ray</summary>
+struct C3DKDTreeRayHitINFO
+{
+	///<summary>Id of the hit item in the array of all items</summary>
+	UI1 m_idItem;
+	///<summary>The parameter of the hit point origin + dir * t, it's DBL_MAX if the ray hits nothing</summary>
+	double m_t;
+	C3DKDTreeRayHitINFO() : m_idItem(0), m_t(DBL_MAX)
+	{
+
+	}
+};
+
+///<summary>The state of the queries of one caller, it's reused by all queries of the caller</summary>
+///<remarks>The KD Tree is not changed by the queries, so the queries with the different scratches can run concurrently on one KD Tree</remarks>
+///<remarks>The used items are stamped by the epoch of the query, so the new query doesn't clear the marks of the previous one</remarks>
+struct SKDTreeQueryScratch
+{
+	SKDTreeQueryScratch() : m_epoch(0)
+	{
+
+	}
+
+	///<summary>Starts the new epoch for the query</summary>
+	///<remarks>In : nItems - The number of the items of the KD Tree</remarks>
+	void begin(const UI1 nItems)
+	{
+		if (m_aEpochItems.size() < nItems)
+			m_aEpochItems.resize(nItems, 0);
+
+		///The stamps are cleared once per 2^32 queries only
+		if (++m_epoch == 0)
+		{
+			std::fill(m_aEpochItems.begin(), m_aEpochItems.end(), 0);
+			m_epoch = 1;
+		}
+	}
+
+	///<summary>Checks that the item is already used by the query</summary>
+	///<returns>True if the item is already used by the query, otherwise false</returns>
+	bool isUsed(const UI4 idItem) const
+	{
+		return m_aEpochItems[idItem] == m_epoch;
+	}
+
+	///<summary>Marks the item as used by the query</summary>
+	void setUsed(const UI4 idItem)
+	{
+		m_aEpochItems[idItem] = m_epoch;
+	}
+
+	///<summary>Array of the epochs of the queries which used the items last</summary>
+	std::vector<UI4> m_aEpochItems;
+	///<summary>The epoch of the current query</summary>
+	UI4 m_epoch;
+	///<summary>The max-heap of the nearest items by the distance of the k nearest items query, its capacity is k</summary>
+	std::vector<C3DKDTreeNearestItemINFO> m_aHeapItems;
+};
+
+///<summary>Compares the items by the distance to the point</summary>
+///<returns>True if the item a is closer than the item b</returns>
+inline bool isCloserItem(const C3DKDTreeNearestItemINFO& a, const C3DKDTreeNearestItemINFO& b)
+{
+	return a.m_minDist2 < b.m_minDist2;
+}
+
+///<summary>The compact node of the flattened KD Tree(16 bytes)</summary>
+///<remarks>Inner node : axis and position of the split plane and id of the right child, the left child is the next node in the array</remarks>
+///<remarks>Leaf : offset and number of the items in the shared array of the id items</remarks>
+struct SFlatKDTreeNode
+{
+	SFlatKDTreeNode() : m_posSplit(0.), m_idRightNode(0), m_dimSplit(cFlatNodeLeaf)
+	{
+
+	}
+
+	bool isLeaf() const
+	{
+		return m_dimSplit == cFlatNodeLeaf;
+	}
+
+	bool isLink() const
+	{
+		return m_dimSplit == cFlatNodeLink;
+	}
+
+	///<summary>Makes the inner node</summary>
+	void setInner(const UI1 dimSplit, const double& posSplit, const UI4 idRightNode)
+	{
+		m_posSplit = posSplit;
+		m_idRightNode = idRightNode;
+		m_dimSplit = static_cast<UI4>(dimSplit);
+	}
+
+	///<summary>Makes the leaf</summary>
+	void setLeaf(const UI4 offsetItems, const UI4 numItems)
+	{
+		m_offsetItems = offsetItems;
+		m_numItems = numItems;
+		m_dimSplit = cFlatNodeLeaf;
+	}
+
+	///<summary>Makes the link to the subtree which is building by the other task</summary>
+	///<remarks>In : idTask - Id of the task in the tasks of the thread</remarks>
+	///<remarks>In : iThread - The thread which spawned the task</remarks>
+	void setLink(const UI4 idTask, const UI4 iThread)
+	{
+		m_offsetItems = idTask;
+		m_numItems = iThread;
+		m_dimSplit = cFlatNodeLink;
+	}
+
+	///<summary>Makes the link to the rebuilt subtree, the node is replaced by the root of the subtree by the queries</summary>
+	///<remarks>In : idNode - Id of the root of the rebuilt subtree, it's the inner node</remarks>
+	void setLinkNode(const UI4 idNode)
+	{
+		m_idRightNode = idNode;
+		m_dimSplit = cFlatNodeLink;
+	}
+
+	///<summary>Finds the nearest item to the point in the current leaf</summary>
+	///<remarks>In/Out : nearestItemINFO - Information about the nearest item, it is updated by the items of the current leaf which are closer</remarks>
+	///<remarks>In/Out : scratch - The state of the query, the used items are skipped</remarks>
+	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aIDItems - The shared array of the id items of all leafs</remarks>
+	///<remarks>In : point - The point for which we are searching the nearest item</remarks>
+	///<remarks>In : calcSqrtDist - optimaized flag, if it's false, then we do not compute sqrt(dist^2)</remarks>	
+	template<typename T>
+	void findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, SKDTreeQueryScratch& scratch, const T* aItems,
+		const UI4* aIDItems, const D3& point, bool calcSqrtDist = false) const;
+
+	union
+	{
+		///<summary>Position of the split plane(inner node)</summary>
+		double m_posSplit;
+		///<summary>Offset of the first id item in the shared array(leaf)</summary>
+		UI4 m_offsetItems;
+	};
+
+	union
+	{
+		///<summary>Id of the right child(inner node)</summary>
+		UI4 m_idRightNode;
+		///<summary>Number of the items(leaf)</summary>
+		UI4 m_numItems;
+	};
+
+	///<summary>Axis of the split plane or cFlatNodeLeaf(or cFlatNodeLink while the KD Tree is building and for the rebuilt subtrees of the edited KD Tree)</summary>
+	UI4 m_dimSplit;
+};
+
+static_assert(sizeof(SFlatKDTreeNode) == 16, "SFlatKDTreeNode must be 16 bytes");
+
+///<summary>The array of the flattened nodes, it starts at the cache line, so the nodes are laid out by the cache lines</summary>
+typedef std::vector<SFlatKDTreeNode, CCacheLineAllocator<SFlatKDTreeNode>> CFlatKDTreeNodes;
+
 class C3DKDTreeNode
 {
 public:
 
 #ifdef USE_STACK_NODES
-	C3DKDTreeNode() : m_depth(0), m_pLeftNode(nullptr), m_pRightNode(nullptr)
+	///<summary>The node is created in the arena of the thread, it isn't destroyed, so it's trivially destructible</summary>
+	C3DKDTreeNode() : m_pLeftNode(nullptr), m_pRightNode(nullptr), m_depth(0), m_dimSplit(0), m_posSplit(0.), m_pIDItems(nullptr), m_numItems(0)
 	{
 
 	}
-#endif
-
-	explicit C3DKDTreeNode(const SBBox& bBox, UI1 depthNode) : m_bBox(bBox), m_depth(depthNode), m_pLeftNode(nullptr), m_pRightNode(nullptr)
+#else
+	explicit C3DKDTreeNode(const SBBox& bBox, UI1 depthNode) : m_pLeftNode(nullptr), m_pRightNode(nullptr), m_depth(depthNode), m_dimSplit(0), m_posSplit(0.), m_bBox(bBox)
 	{
 
 	}
 
 	~C3DKDTreeNode()
 	{
-#ifndef USE_STACK_NODES
 		if (m_pLeftNode != nullptr)
 			delete m_pLeftNode;
 		if (m_pRightNode != nullptr)
 			delete m_pRightNode;
-#endif
 	}
+#endif
 
 	void setBBox(const SBBox& bBox)
 	{
@@ -53,6 +225,23 @@ public:
 		m_depth = depthNode;
 	}
 
+#ifdef USE_STACK_NODES
+	///<summary>Sets the data of the id items in the current node, they are copied into the arena</summary>
+	///<remarks>In/Out : arena - The arena of the thread which builds the node</remarks>
+	///<remarks>In : aItemID - The id items of the node</remarks>
+	void setData(CMonotonicArena& arena, const std::vector<UI1>& aItemID);
+
+	///<returns>The id items of the node, they are in the arena</returns>
+	const UI1* getIDItems() const
+	{
+		return m_pIDItems;
+	}
+
+	UI1 size() const
+	{
+		return m_numItems;
+	}
+#else
 	///<summary>Sets the data of the id items in the current node</summary>
 	void setData(std::vector<UI1>& aItemID);
 
@@ -61,10 +250,17 @@ public:
 		return m_aIDItems;
 	}
 
+	///<returns>The id items of the node</returns>
+	const UI1* getIDItems() const
+	{
+		return m_aIDItems.data();
+	}
+
 	UI1 size() const
 	{
 		return m_aIDItems.size();
 	}
+#endif
 
 	const SBBox& getBBoxNode() const
 	{
@@ -76,6 +272,18 @@ public:
 		return m_depth;
 	}
 
+	///<returns>Axis of the split plane of the inner node</returns>
+	UI1 getDimSplit() const
+	{
+		return m_dimSplit;
+	}
+
+	///<returns>Position of the split plane of the inner node</returns>
+	double getPosSplit() const
+	{
+		return m_posSplit;
+	}
+
 	///<summary>Splits the node into the two nodes</summary>
 	///<remarks>Out : aIDItemsLeft - Resulting array of the items on the left side of the split plane</remarks>
 	///<remarks>Out : aIDItemsRight - Resulting array of the items on the right side of the split plane</remarks>
@@ -83,27 +291,23 @@ public:
 	///<remarks>Out : bBoxItemsRight - Resulting bounding box of the items on the right side of the split plane</remarks>
 	///<remarks>In : nodeSplitter - splitter which we want to use for split</remarks>
 	///<remarks>In : aItems - The array of all items</remarks>
+	///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
 	///<remarks>In : aIDtems - The array of id items from aItems which we want to split</remarks>
 	///<returns>True if we are split the node, otherwise false</returns>	
 	template<typename T>
-	bool C3DKDTreeNode::splitNode(std::vector<UI1>& aIDItemsLeft, std::vector<UI1>& aIDItemsRight, SBBox& bBoxItemsLeft, SBBox& bBoxItemsRight,
-		const C3DKDTreeNodeSplitter<T>& nodeSplitter, const std::vector<T>& aItems, const std::vector<UI1>& aIDItems) const;
-
-	///<summary>Finds the nearest item to the point in the current node</summary>
-	///<remarks>Out : nearestItemINFO - Information about the nearest item in the current node</remarks>
-	///<remarks>In/Out : aItemsUsed - Array of the used items, where aItemsUsed[idItem] = false or true</remarks>
-	///<remarks>In/Out : aItemsUsedId - Array of the id used items</remarks>
-	///<remarks>In : aItems - The array of all items</remarks>
-	///<remarks>In : point - The point for which we are searching the nearest item</remarks>
-	///<remarks>In : calcSqrtDist - optimaized flag, if it's false, then we do not compute sqrt(dist^2)</remarks>	
-	template<typename T>
-	void findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, std::vector<bool>& aItemsUsed, std::vector<UI1>& aItemsUsedId, const std::vector<T>& aItems,
-		const D3& point, bool calcSqrtDist = false) const;
+	bool splitNode(std::vector<UI1>& aIDItemsLeft, std::vector<UI1>& aIDItemsRight, SBBox& bBoxItemsLeft, SBBox& bBoxItemsRight,
+		const C3DKDTreeNodeSplitter<T>& nodeSplitter, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const std::vector<UI1>& aIDItems);
 
 	void clearData()
 	{
+#ifdef USE_STACK_NODES
+		///The memory of the id items is released with the arena
+		m_pIDItems = nullptr;
+		m_numItems = 0;
+#else
 		if (m_aIDItems.size() > 0)
 			m_aIDItems.clear();
+#endif
 	}
 
 	C3DKDTreeNode* m_pLeftNode;
@@ -111,10 +315,36 @@ public:
 
 private:
 	UI1 m_depth;
+	UI1 m_dimSplit;
+	double m_posSplit;
 	SBBox m_bBox;
+#ifdef USE_STACK_NODES
+	///<summary>The id items of the leaf in the arena of the thread which built it</summary>
+	const UI1* m_pIDItems;
+	UI1 m_numItems;
+#else
 	std::vector<UI1> m_aIDItems;
+#endif
 };
 
+#ifdef USE_STACK_NODES
+///<summary>Sets the data of the id items in the current node, they are copied into the arena</summary>
+///<remarks>In/Out : arena - The arena of the thread which builds the node</remarks>
+///<remarks>In : aItemID - The id items of the node</remarks>
+void C3DKDTreeNode::setData(CMonotonicArena& arena, const std::vector<UI1>& aItemID)
+{
+	m_numItems = aItemID.size();
+	if (m_numItems == 0)
+	{
+		m_pIDItems = nullptr;
+		return;
+	}
+
+	UI1* pIDItems = arena.allocateArray<UI1>(m_numItems);
+	::memcpy(pIDItems, aItemID.data(), m_numItems * sizeof(UI1));
+	m_pIDItems = pIDItems;
+}
+#else
 ///<summary>Sets the data of the id items in the current node</summary>
 void C3DKDTreeNode::setData(std::vector<UI1>& aItemID)
 {
@@ -123,6 +353,7 @@ void C3DKDTreeNode::setData(std::vector<UI1>& aItemID)
 
 	m_aIDItems = std::move(aItemID);
 }
+#endif
 
 ///<summary>Splits the node into the two nodes</summary>
 ///<remarks>Out : aIDItemsLeft - Resulting array of the items on the left side of the split plane</remarks>
@@ -131,33 +362,33 @@ void C3DKDTreeNode::setData(std::vector<UI1>& aItemID)
 ///<remarks>Out : bBoxItemsRight - Resulting bounding box of the items on the right side of the split plane</remarks>
 ///<remarks>In : nodeSplitter - splitter which we want to use for split</remarks>
 ///<remarks>In : aItems - The array of all items</remarks>
+///<remarks>In : aBBoxItems - Bounding boxes of all items</remarks>
 ///<remarks>In : aIDtems - The array of id items from aItems which we want to split</remarks>
 ///<returns>True if we are split the node, otherwise false</returns>	
 template<typename T>
 bool C3DKDTreeNode::splitNode(std::vector<UI1>& aIDItemsLeft, std::vector<UI1>& aIDItemsRight, SBBox& bBoxItemsLeft, SBBox& bBoxItemsRight,
-	const C3DKDTreeNodeSplitter<T>& nodeSplitter, const std::vector<T>& aItems, const std::vector<UI1>& aIDItems) const
+	const C3DKDTreeNodeSplitter<T>& nodeSplitter, const std::vector<T>& aItems, const std::vector<SBBox>& aBBoxItems, const std::vector<UI1>& aIDItems)
 {
 	SSplitINFO splitINFO;
-	if (!nodeSplitter.split(splitINFO, m_bBox, aItems, aIDItems))
+	if (!nodeSplitter.split(splitINFO, m_bBox, aItems, aBBoxItems, aIDItems))
 		return false;
 
-	if (splitINFO.m_numItemsLeft == 0 && splitINFO.m_numItemsRight == 0)
+	m_dimSplit = splitINFO.m_dimSplit;
+	m_posSplit = splitINFO.m_posSplit;
+
+	///The numbers of the clipped items are recounted, because the splitter counts them by the bounding boxes
+	if ((splitINFO.m_numItemsLeft == 0 && splitINFO.m_numItemsRight == 0) || splitINFO.m_clipItems)
 	{
+		splitINFO.m_numItemsLeft = 0;
+		splitINFO.m_numItemsRight = 0;
+
 		for (UI1 i = 0, nItems = aIDItems.size(); i < nItems; ++i)
 		{
-			const SBBox& bBox = aItems[aIDItems[i]].getBBoxItem();
-			if (bBox.m_minBB[splitINFO.m_dimSplit] < splitINFO.m_posSplit && bBox.m_maxBB[splitINFO.m_dimSplit] < splitINFO.m_posSplit)
+			const eSplitSide side = classifyItem(aItems[aIDItems[i]], aBBoxItems[aIDItems[i]], m_bBox, splitINFO);
+			if (side == eSplitSideLeft || side == eSplitSideBoth)
 				++splitINFO.m_numItemsLeft;
-			else
-			{
-				if (bBox.m_minBB[splitINFO.m_dimSplit] >= splitINFO.m_posSplit && bBox.m_maxBB[splitINFO.m_dimSplit] >= splitINFO.m_posSplit)
-					++splitINFO.m_numItemsRight;
-				else
-				{
-					++splitINFO.m_numItemsLeft;
-					++splitINFO.m_numItemsRight;
-				}
-			}
+			if (side == eSplitSideRight || side == eSplitSideBoth)
+				++splitINFO.m_numItemsRight;
 		}
 	}
 
@@ -166,19 +397,11 @@ bool C3DKDTreeNode::splitNode(std::vector<UI1>& aIDItemsLeft, std::vector<UI1>&
 
 	for (UI1 i = 0, iLeft = 0, iRight = 0, nItems = aIDItems.size(); i < nItems; ++i)
 	{
-		const SBBox& bBox = aItems[aIDItems[i]].getBBoxItem();
-		if (bBox.m_minBB[splitINFO.m_dimSplit] < splitINFO.m_posSplit && bBox.m_maxBB[splitINFO.m_dimSplit] < splitINFO.m_posSplit)
+		const eSplitSide side = classifyItem(aItems[aIDItems[i]], aBBoxItems[aIDItems[i]], m_bBox, splitINFO);
+		if (side == eSplitSideLeft || side == eSplitSideBoth)
 			aIDItemsLeft[iLeft++] = aIDItems[i];
-		else
-		{
-			if (bBox.m_minBB[splitINFO.m_dimSplit] >= splitINFO.m_posSplit && bBox.m_maxBB[splitINFO.m_dimSplit] >= splitINFO.m_posSplit)
-				aIDItemsRight[iRight++] = aIDItems[i];
-			else
-			{
-				aIDItemsLeft[iLeft++] = aIDItems[i];
-				aIDItemsRight[iRight++] = aIDItems[i];
-			}
-		}
+		if (side == eSplitSideRight || side == eSplitSideBoth)
+			aIDItemsRight[iRight++] = aIDItems[i];
 	}
 
 	bBoxItemsLeft = m_bBox;
@@ -190,34 +413,34 @@ bool C3DKDTreeNode::splitNode(std::vector<UI1>& aIDItemsLeft, std::vector<UI1>&
 	return true;
 }
 
-///<summary>Finds the nearest item to the point in the current node</summary>
-///<remarks>Out : nearestItemINFO - Information about the nearest item in the current node</remarks>
-///<remarks>In/Out : aItemsUsed - Array of the used items, where aItemsUsed[idItem] = false or true</remarks>
-///<remarks>In/Out : aItemsUsedId - Array of the id used items</remarks>
+///<summary>Finds the nearest item to the point in the current leaf</summary>
+///<remarks>In/Out : nearestItemINFO - Information about the nearest item, it is updated by the items of the current leaf which are closer</remarks>
+///<remarks>In/Out : scratch - The state of the query, the used items are skipped</remarks>
 ///<remarks>In : aItems - The array of all items</remarks>
+///<remarks>In : aIDItems - The shared array of the id items of all leafs</remarks>
 ///<remarks>In : point - The point for which we are searching the nearest item</remarks>
 ///<remarks>In : calcSqrtDist - optimaized flag, if it's false, then we do not compute sqrt(dist^2)</remarks>	
 template<typename T>
-void C3DKDTreeNode::findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, std::vector<bool>& aItemsUsed, std::vector<UI1>& aItemsUsedId, const std::vector<T>& aItems,
-	const D3& point, bool calcSqrtDist) const
+void SFlatKDTreeNode::findNearestItem(C3DKDTreeNearestItemINFO& nearestItemINFO, SKDTreeQueryScratch& scratch, const T* aItems,
+	const UI4* aIDItems, const D3& point, bool calcSqrtDist) const
 {
-	double minDist2 = DBL_MAX;
-	for (UI1 i = 0, nItems = m_aIDItems.size(); i < nItems; ++i)
+	double minDist2 = nearestItemINFO.m_minDist2;
+	for (UI4 i = m_offsetItems, iEnd = m_offsetItems + m_numItems; i < iEnd; ++i)
 	{
-		if (aItemsUsed[m_aIDItems[i]])
+		const UI4 idItem = aIDItems[i];
+		if (scratch.isUsed(idItem))
 			continue;
 
-		const double dist2 = aItems[m_aIDItems[i]].calcDist2(point);
+		scratch.setUsed(idItem);
+
+		const double dist2 = aItems[idItem].calcDist2(point);
 
 		if (dist2 < minDist2)
 		{
 			minDist2 = dist2;
-			nearestItemINFO.m_idItem = m_aIDItems[i];
+			nearestItemINFO.m_idItem = idItem;
 			nearestItemINFO.m_minDist2 = minDist2;
 		}
-
-		aItemsUsed[m_aIDItems[i]] = true;
-		aItemsUsedId.push_back(m_aIDItems[i]);
 	}
 
 	if (nearestItemINFO.m_minDist2 < cEps2)
@@ -0,0 +1,111 @@
+#pragma once
+#include "math_util.h"
+#include "struct_basic_types.h"
+
+///The volume of the overlap queries of the KD Tree is resolved statically by the template of the query, it must have the functions:
+///	bool isOverlapBBox(const SBBox& bBox) const - False if the bounding box is out of the volume, it can be true for some bounding boxes out of the volume
+///	bool isOverlapTriangle(const D3& A, const D3& B, const D3& C) const - The exact test of the triangle
+
+///<summary>The axis aligned bounding box as the volume of the overlap queries</summary>
+struct SVolumeBBox
+{
+	explicit SVolumeBBox(const SBBox& bBox) : m_bBox(bBox)
+	{
+
+	}
+
+	bool isOverlapBBox(const SBBox& bBox) const
+	{
+		return math::isOverlapBBoxes(m_bBox, bBox);
+	}
+
+	bool isOverlapTriangle(const D3& A, const D3& B, const D3& C) const
+	{
+		return math::isOverlapTriangleBBox(A, B, C, m_bBox);
+	}
+
+	SBBox m_bBox;
+};
+
+///<summary>The oriented bounding box as the volume of the overlap queries</summary>
+///<remarks>The nodes are pruned by its axis aligned bounding box, the triangles are tested in its local coordinates</remarks>
+struct SVolumeOrientedBBox
+{
+	///<remarks>In : center - The center of the box</remarks>
+	///<remarks>In : aAxis - The orthonormal axes of the box</remarks>
+	///<remarks>In : halfSize - The half sizes of the box along its axes</remarks>
+	SVolumeOrientedBBox(const D3& center, const D3(&aAxis)[3], const D3& halfSize) : m_center(center), m_aAxis{ aAxis[0], aAxis[1], aAxis[2] }
+	{
+		m_bBoxLocal.m_minBB = D3(-halfSize[0], -halfSize[1], -halfSize[2]);
+		m_bBoxLocal.m_maxBB = halfSize;
+
+		for (UI1 dim = 0; dim < 3; ++dim)
+		{
+			const double extent = halfSize[0] * fabs(aAxis[0][dim]) + halfSize[1] * fabs(aAxis[1][dim]) + halfSize[2] * fabs(aAxis[2][dim]);
+			m_bBoxBounding.m_minBB[dim] = center[dim] - extent;
+			m_bBoxBounding.m_maxBB[dim] = center[dim] + extent;
+		}
+	}
+
+	bool isOverlapBBox(const SBBox& bBox) const
+	{
+		return math::isOverlapBBoxes(m_bBoxBounding, bBox);
+	}
+
+	bool isOverlapTriangle(const D3& A, const D3& B, const D3& C) const
+	{
+		return math::isOverlapTriangleBBox(toLocal(A), toLocal(B), toLocal(C), m_bBoxLocal);
+	}
+
+	///<returns>The coordinates of the point along the axes of the box from its center</returns>
+	D3 toLocal(const D3& point) const
+	{
+		const D3 offset = point - m_center;
+		return D3(offset * m_aAxis[0], offset * m_aAxis[1], offset * m_aAxis[2]);
+	}
+
+	D3 m_center;
+	D3 m_aAxis[3];
+	///<summary>The box in its local coordinates</summary>
+	SBBox m_bBoxLocal;
+	///<summary>The axis aligned bounding box of the box</summary>
+	SBBox m_bBoxBounding;
+};
+
+///<summary>The frustum of 6 planes as the volume of the overlap queries</summary>
+struct SVolumeFrustum
+{
+	///<remarks>In : aNormal - The outer normals of the planes, the frustum is n * x <= offset for all planes</remarks>
+	///<remarks>In : aOffset - The offsets of the planes</remarks>
+	SVolumeFrustum(const D3(&aNormal)[6], const double(&aOffset)[6])
+	{
+		for (UI1 iPlane = 0; iPlane < 6; ++iPlane)
+		{
+			m_aNormal[iPlane] = aNormal[iPlane];
+			m_aOffset[iPlane] = aOffset[iPlane];
+		}
+	}
+
+	///<summary>The bounding box is out of the frustum if its corner which is the deepest by the normal of any plane is out of this plane</summary>
+	bool isOverlapBBox(const SBBox& bBox) const
+	{
+		for (UI1 iPlane = 0; iPlane < 6; ++iPlane)
+		{
+			const D3& normal = m_aNormal[iPlane];
+			const D3 corner(normal[0] < 0. ? bBox.m_maxBB[0] : bBox.m_minBB[0],
+				normal[1] < 0. ? bBox.m_maxBB[1] : bBox.m_minBB[1],
+				normal[2] < 0. ? bBox.m_maxBB[2] : bBox.m_minBB[2]);
+			if (normal * corner > m_aOffset[iPlane])
+				return false;
+		}
+		return true;
+	}
+
+	bool isOverlapTriangle(const D3& A, const D3& B, const D3& C) const
+	{
+		return math::isOverlapTrianglePlanes(A, B, C, m_aNormal, m_aOffset, 6);
+	}
+
+	D3 m_aNormal[6];
+	double m_aOffset[6];
+};